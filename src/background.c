@@ -33,6 +33,8 @@
 
 static GThreadPool *thread_pool_remote = NULL;
 static GThreadPool *thread_pool_local = NULL;
+// Shared by all the jobs splitting their work into parts, see a_background_parts_new()
+static GThreadPool *thread_pool_parts = NULL;
 #ifdef HAVE_LIBMAPNIK
 static GThreadPool *thread_pool_local_mapnik = NULL;
 #endif
@@ -226,6 +228,92 @@ void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gch
     g_thread_pool_push( thread_pool_local, args, NULL );
 }
 
+struct _BackgroundParts {
+  GFunc func;
+  GMutex mutex;
+  GCond cond;
+  guint pending;
+};
+
+typedef struct {
+  BackgroundParts *bp;
+  gpointer data;
+} BackgroundPart;
+
+static void parts_helper ( BackgroundPart *part, gpointer user_data )
+{
+  BackgroundParts *bp = part->bp;
+  bp->func ( part->data, NULL );
+  g_free ( part );
+
+  g_mutex_lock ( &bp->mutex );
+  bp->pending--;
+  g_cond_signal ( &bp->cond );
+  g_mutex_unlock ( &bp->mutex );
+}
+
+/**
+ * a_background_parts_new:
+ * @func: Function to be run for each part
+ *
+ * For a job in BACKGROUND_POOL_LOCAL that splits its own work into parts to be done at the same time.
+ * The parts of every job are run by one shared pool, the same size as the local pool,
+ *  so the number of threads stays bounded however many jobs do this.
+ * Parts must not wait for other parts.
+ */
+BackgroundParts *a_background_parts_new ( GFunc func )
+{
+  BackgroundParts *bp = g_malloc0 ( sizeof(BackgroundParts) );
+  bp->func = func;
+  g_mutex_init ( &bp->mutex );
+  g_cond_init ( &bp->cond );
+  return bp;
+}
+
+/**
+ * a_background_parts_push:
+ *
+ * Queue a part, to be run as soon as a thread of the shared pool is free
+ */
+void a_background_parts_push ( BackgroundParts *bp, gpointer data )
+{
+  BackgroundPart *part = g_malloc ( sizeof(BackgroundPart) );
+  part->bp = bp;
+  part->data = data;
+  g_mutex_lock ( &bp->mutex );
+  bp->pending++;
+  g_mutex_unlock ( &bp->mutex );
+  g_thread_pool_push ( thread_pool_parts, part, NULL );
+}
+
+/**
+ * a_background_parts_wait:
+ *
+ * Wait for all the parts pushed to complete, and then free @bp
+ */
+void a_background_parts_wait ( BackgroundParts *bp )
+{
+  g_mutex_lock ( &bp->mutex );
+  while ( bp->pending )
+    g_cond_wait ( &bp->cond, &bp->mutex );
+  g_mutex_unlock ( &bp->mutex );
+  g_mutex_clear ( &bp->mutex );
+  g_cond_clear ( &bp->cond );
+  g_free ( bp );
+}
+
+/**
+ * a_background_parts_get_max_threads:
+ *
+ * Returns: How many parts may be run at the same time
+ */
+guint a_background_parts_get_max_threads ()
+{
+  if ( !thread_pool_parts )
+    return 1;
+  return MAX ( 1, g_thread_pool_get_max_threads ( thread_pool_parts ) );
+}
+
 // In main thread
 static void cancel_job_with_iter ( GtkTreeIter *piter )
 {
@@ -330,6 +418,7 @@ void a_background_post_init()
   }
 
   thread_pool_local = g_thread_pool_new ( (GFunc) thread_helper, NULL, max_threads, FALSE, NULL );
+  thread_pool_parts = g_thread_pool_new ( (GFunc) parts_helper, NULL, max_threads, FALSE, NULL );
 
 #ifdef HAVE_LIBMAPNIK
   // implicit use of 'MAPNIK_PREFS_NAMESPACE' to avoid dependency issues
@@ -398,6 +487,7 @@ void a_background_uninit()
   // Don't wait for these threads to complete - i.e. end now.
   g_thread_pool_free ( thread_pool_remote, TRUE, FALSE );
   g_thread_pool_free ( thread_pool_local, TRUE, FALSE );
+  g_thread_pool_free ( thread_pool_parts, TRUE, FALSE );
 #ifdef HAVE_LIBMAPNIK
   g_thread_pool_free ( thread_pool_local_mapnik, TRUE, FALSE );
 #endif
@@ -44,6 +44,13 @@ typedef enum {
 void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gchar *message, vik_thr_func func, gpointer userdata, vik_thr_free_func userdata_free_func, vik_thr_free_func userdata_cancel_cleanup_func, gint number_items );
 int a_background_thread_progress ( gpointer callbackdata, gdouble fraction );
 int a_background_testcancel ( gpointer callbackdata );
+
+typedef struct _BackgroundParts BackgroundParts;
+BackgroundParts *a_background_parts_new ( GFunc func );
+void a_background_parts_push ( BackgroundParts *bp, gpointer data );
+void a_background_parts_wait ( BackgroundParts *bp );
+guint a_background_parts_get_max_threads ();
+
 void a_background_show_window ();
 void a_background_init ();
 void a_background_post_init ();
@@ -281,6 +281,59 @@ end:
 	return(unzip_data);
 }
 
+/**
+ * uncompress_gzip_data:
+ * @data:              pointer to start of the gzip (or zlib) compressed data
+ * @size:              the size of the compressed data block
+ * @uncompressed_size: returns the size of the uncompressed data
+ *
+ * Returns a pointer to uncompressed data (maybe NULL), free after use
+ */
+void *uncompress_gzip_data(const void *data, gsize size, gsize *uncompressed_size)
+{
+#ifndef HAVE_LIBZ
+	return NULL;
+#else
+	z_stream stream;
+	int err;
+	// Initial guess of the output size, grown as necessary
+	gsize out_size = MAX(size * 4, 4096);
+	guchar *out = g_malloc(out_size);
+
+	memset(&stream, 0, sizeof(stream));
+	stream.next_in = (Bytef*)data;
+	stream.avail_in = size;
+
+	/* adding 32 to windowBits means automatically detect a gzip or zlib header */
+	if ((err = inflateInit2(&stream, 32 + MAX_WBITS)) != Z_OK) {
+		g_warning("%s(): inflateInit2 failed", __PRETTY_FUNCTION__);
+		g_free(out);
+		return NULL;
+	}
+
+	do {
+		if (stream.total_out == out_size) {
+			out_size *= 2;
+			out = g_realloc(out, out_size);
+		}
+		stream.next_out = out + stream.total_out;
+		stream.avail_out = out_size - stream.total_out;
+		err = inflate(&stream, Z_NO_FLUSH);
+	} while (err == Z_OK);
+
+	if (err != Z_STREAM_END) {
+		g_warning("%s() inflate failed err=%d \"%s\"", __PRETTY_FUNCTION__, err, stream.msg == NULL ? "unknown" : stream.msg);
+		inflateEnd(&stream);
+		g_free(out);
+		return NULL;
+	}
+
+	*uncompressed_size = stream.total_out;
+	inflateEnd(&stream);
+	return out;
+#endif
+}
+
 /**
  * uncompress_bzip2:
  * @name: The name of the file to attempt to decompress
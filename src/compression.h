@@ -33,6 +33,8 @@ G_BEGIN_DECLS
 
 void *unzip_file(gchar *zip_file, gulong *unzip_size);
 
+void *uncompress_gzip_data(const void *data, gsize size, gsize *uncompressed_size);
+
 gchar* uncompress_bzip2 ( const gchar *name );
 
 VikLoadType_t uncompress_load_zip_file ( const gchar *filename,
@@ -102,6 +102,11 @@ static char *get_cookie_file ( gboolean init )
 static gint curl_ssl_verifypeer = 1; // https://curl.haxx.se/libcurl/c/CURLOPT_SSL_VERIFYPEER.html
 static gchar* curl_cainfo = NULL;    // https://curl.haxx.se/libcurl/c/CURLOPT_CAINFO.html
 
+// Limits for concurrent downloads via the multi interface
+static gint curl_max_host_connections = 2; // https://curl.se/libcurl/c/CURLMOPT_MAX_HOST_CONNECTIONS.html
+static gint curl_max_transfers = 8;        // Number of simultaneous transfers for each multi handle
+static gboolean curl_http2 = TRUE;         // Multiplex transfers over HTTP/2 connections where the server supports it
+
 /* This should to be called from main() to make sure thread safe */
 void curl_download_init()
 {
@@ -127,6 +132,14 @@ void curl_download_init()
     curl_cainfo = g_strdup ( str );
     g_free ( str );
   }
+
+  gint tmp_int;
+  if ( a_settings_get_integer ( "curl_max_host_connections", &tmp_int ) )
+    curl_max_host_connections = tmp_int;
+  if ( a_settings_get_integer ( "curl_max_transfers", &tmp_int ) )
+    curl_max_transfers = tmp_int;
+  if ( a_settings_get_boolean ( "curl_http2", &tmp ) )
+    curl_http2 = tmp;
 }
 
 /* This should to be called from main() to make sure thread safe */
@@ -174,18 +187,14 @@ static void common_opts ( CURL *curl, const char *uri, DownloadFileOptions *opti
 }
 
 /**
+ * Setup the curl handle for downloading into the file
  *
+ * Returns the list of headers to be sent, which should be freed after the transfer
  */
-CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOptions *options, CurlDownloadOptions *cdo, void *handle )
+static struct curl_slist *file_opts ( CURL *curl, const char *uri, FILE *f, DownloadFileOptions *options, CurlDownloadOptions *cdo )
 {
-  CURL *curl;
   struct curl_slist *curl_send_headers = NULL;
-  CURLcode res = CURLE_FAILED_INIT;
 
-  curl = handle ? handle : curl_easy_init ();
-  if ( !curl ) {
-    return CURL_DOWNLOAD_ERROR;
-  }
   common_opts ( curl, uri, options );
   curl_easy_setopt ( curl, CURLOPT_WRITEDATA, f );
   curl_easy_setopt ( curl, CURLOPT_WRITEFUNCTION, curl_write_func);
@@ -230,8 +239,14 @@ CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOption
   if ( curl_send_headers )
     curl_easy_setopt ( curl, CURLOPT_HTTPHEADER , curl_send_headers );
 
-  res = curl_easy_perform ( curl );
+  return curl_send_headers;
+}
 
+/**
+ * Convert the result of the transfer into our error values
+ */
+static CURL_download_t file_result ( CURL *curl, CURLcode res, const char *uri )
+{
   if (res == CURLE_OK) {
     glong response;
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response);
@@ -255,6 +270,26 @@ CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOption
     g_warning ( "%s: curl error: %d for uri %s", __FUNCTION__, res, uri );
     res = CURL_DOWNLOAD_ERROR;
   }
+  return (CURL_download_t)res;
+}
+
+/**
+ *
+ */
+CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOptions *options, CurlDownloadOptions *cdo, void *handle )
+{
+  CURL *curl;
+  struct curl_slist *curl_send_headers = NULL;
+  CURL_download_t res;
+
+  curl = handle ? handle : curl_easy_init ();
+  if ( !curl ) {
+    return CURL_DOWNLOAD_ERROR;
+  }
+  curl_send_headers = file_opts ( curl, uri, f, options, cdo );
+
+  res = file_result ( curl, curl_easy_perform ( curl ), uri );
+
   if (curl_send_headers) {
     curl_slist_free_all(curl_send_headers);
     curl_send_headers = NULL;
@@ -266,11 +301,12 @@ CURL_download_t curl_download_uri ( const char *uri, FILE *f, DownloadFileOption
 }
 
 /**
- * curl_download_get_url:
- *  Either hostname and/or uri should be defined
+ * Either hostname and/or uri should be defined
  *
+ * Returns the full url, which is only newly allocated when neither hostname nor uri is returned
+ *  or NULL if it can't be determined
  */
-CURL_download_t curl_download_get_url ( const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp, CurlDownloadOptions *cdo, void *handle )
+static gchar *get_full_url ( const char *hostname, const char *uri, gboolean ftp )
 {
   gchar *full = NULL;
 
@@ -288,9 +324,20 @@ CURL_download_t curl_download_get_url ( const char *hostname, const char *uri, F
   else if ( hostname && uri )
     /* Compose the full url */
     full = g_strdup_printf ( "%s://%s%s", (ftp?"ftp":"http"), hostname, uri );
-  else {
+
+  return full;
+}
+
+/**
+ * curl_download_get_url:
+ *  Either hostname and/or uri should be defined
+ *
+ */
+CURL_download_t curl_download_get_url ( const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp, CurlDownloadOptions *cdo, void *handle )
+{
+  gchar *full = get_full_url ( hostname, uri, ftp );
+  if ( !full )
     return CURL_DOWNLOAD_ERROR;
-  }
 
   CURL_download_t ret = curl_download_uri ( full, f, options, cdo, handle );
   // Only free newly allocated memory
@@ -369,3 +416,228 @@ void curl_download_handle_cleanup ( void *handle )
 {
   curl_easy_cleanup(handle);
 }
+
+/*
+ * Concurrent downloads via the curl multi interface
+ *
+ * The multi handle is driven from the thread that created it (i.e. a background download job),
+ *  by repeatedly calling curl_download_multi_perform() until all the requests have completed.
+ * Completion callbacks are thus also called in that thread.
+ */
+
+typedef struct {
+  CURL *curl;
+  gchar *uri;
+  FILE *f;
+  DownloadFileOptions *options;
+  CurlDownloadOptions *cdo;
+  struct curl_slist *headers;
+  CurlDownloadDoneFunc done;
+  gpointer user_data;
+} CurlMultiRequest;
+
+typedef struct {
+  CURLM *multi;
+  GQueue *pending;     // Requests waiting to be started
+  GList *active;       // Requests in progress
+  GQueue *idle;        // Reusable easy handles
+  guint max_transfers;
+  gint64 interval;     // Minimum time between starting requests (microseconds)
+  gint64 last_start;
+} CurlMulti;
+
+static void multi_request_free ( CurlMultiRequest *cmr )
+{
+  if ( cmr->headers )
+    curl_slist_free_all ( cmr->headers );
+  g_free ( cmr->uri );
+  g_free ( cmr );
+}
+
+/**
+ * curl_download_multi_init:
+ * @max_transfers: Maximum number of simultaneous transfers. 0 means use the default.
+ * @interval_ms:   Minimum time between starting each request (milliseconds), to be polite to the server
+ *
+ * Returns: A handle for concurrent downloads, free with curl_download_multi_cleanup()
+ */
+void *curl_download_multi_init ( guint max_transfers, guint interval_ms )
+{
+  CURLM *multi = curl_multi_init ();
+  if ( !multi )
+    return NULL;
+
+  CurlMulti *cm = g_malloc0 ( sizeof(CurlMulti) );
+  cm->multi = multi;
+  cm->pending = g_queue_new ();
+  cm->idle = g_queue_new ();
+  cm->max_transfers = curl_max_transfers > 0 ? curl_max_transfers : 1;
+  if ( max_transfers && max_transfers < cm->max_transfers )
+    cm->max_transfers = max_transfers;
+  cm->interval = (gint64)interval_ms * 1000;
+
+#if LIBCURL_VERSION_NUM >= 0x071e00
+  if ( curl_max_host_connections > 0 )
+    curl_multi_setopt ( multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)curl_max_host_connections );
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072b00
+  curl_multi_setopt ( multi, CURLMOPT_PIPELINING, curl_http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING );
+#endif
+  return cm;
+}
+
+/**
+ * curl_download_multi_add:
+ * @f:         The file to write to, which must remain open until @done is called
+ * @options:   Download options, which must remain valid until @done is called
+ * @cdo:       Curl options, which must remain valid until @done is called
+ * @done:      Function called when the download has finished (or failed or been cancelled)
+ *
+ * Queue a download; it is started by curl_download_multi_perform() as the limits allow.
+ * Either hostname and/or uri should be defined.
+ */
+void curl_download_multi_add ( void *handle, const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp, CurlDownloadOptions *cdo, CurlDownloadDoneFunc done, gpointer user_data )
+{
+  CurlMulti *cm = (CurlMulti*)handle;
+
+  gchar *full = get_full_url ( hostname, uri, ftp );
+  if ( !full ) {
+    done ( CURL_DOWNLOAD_ERROR, user_data );
+    return;
+  }
+
+  CurlMultiRequest *cmr = g_malloc0 ( sizeof(CurlMultiRequest) );
+  // Always keep our own copy
+  cmr->uri = ( hostname != full && uri != full ) ? full : g_strdup ( full );
+  cmr->f = f;
+  cmr->options = options;
+  cmr->cdo = cdo;
+  cmr->done = done;
+  cmr->user_data = user_data;
+  g_queue_push_tail ( cm->pending, cmr );
+}
+
+/**
+ * Start as many pending requests as allowed
+ *
+ * Returns the time (microseconds) until the next request can be started, 0 if not waiting
+ */
+static gint64 multi_start_pending ( CurlMulti *cm )
+{
+  while ( !g_queue_is_empty(cm->pending) && g_list_length(cm->active) < cm->max_transfers ) {
+    gint64 now = g_get_monotonic_time ();
+    if ( cm->interval && (now - cm->last_start) < cm->interval )
+      return cm->interval - (now - cm->last_start);
+
+    CurlMultiRequest *cmr = g_queue_pop_head ( cm->pending );
+    CURL *curl = g_queue_pop_head ( cm->idle );
+    if ( curl )
+      curl_easy_reset ( curl );
+    else
+      curl = curl_easy_init ();
+    if ( !curl ) {
+      cmr->done ( CURL_DOWNLOAD_ERROR, cmr->user_data );
+      multi_request_free ( cmr );
+      continue;
+    }
+    cmr->curl = curl;
+    cmr->headers = file_opts ( curl, cmr->uri, cmr->f, cmr->options, cmr->cdo );
+    curl_easy_setopt ( curl, CURLOPT_PRIVATE, cmr );
+#if LIBCURL_VERSION_NUM >= 0x072f00
+    if ( curl_http2 )
+      curl_easy_setopt ( curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS );
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072b00
+    // Prefer waiting for an existing connection that can be multiplexed over opening a new one
+    if ( curl_http2 )
+      curl_easy_setopt ( curl, CURLOPT_PIPEWAIT, 1L );
+#endif
+    curl_multi_add_handle ( cm->multi, curl );
+    cm->active = g_list_prepend ( cm->active, cmr );
+    cm->last_start = now;
+  }
+  return 0;
+}
+
+static void multi_request_finish ( CurlMulti *cm, CurlMultiRequest *cmr, CURL_download_t result )
+{
+  curl_multi_remove_handle ( cm->multi, cmr->curl );
+  cm->active = g_list_remove ( cm->active, cmr );
+  g_queue_push_tail ( cm->idle, cmr->curl );
+  cmr->done ( result, cmr->user_data );
+  multi_request_free ( cmr );
+}
+
+/**
+ * curl_download_multi_perform:
+ * @timeout_ms: Maximum time to wait for any activity
+ *
+ * Progress the transfers, calling the completion functions of any finished downloads.
+ *
+ * Returns: The number of downloads that have not yet completed
+ */
+guint curl_download_multi_perform ( void *handle, gint timeout_ms )
+{
+  CurlMulti *cm = (CurlMulti*)handle;
+
+  gint64 wait = multi_start_pending ( cm );
+
+  int running = 0;
+  curl_multi_perform ( cm->multi, &running );
+  if ( running ) {
+    gint timeout = timeout_ms;
+    if ( wait && (wait / 1000) < timeout )
+      timeout = (wait / 1000) + 1;
+    curl_multi_wait ( cm->multi, NULL, 0, timeout, NULL );
+    curl_multi_perform ( cm->multi, &running );
+  }
+  else if ( wait )
+    g_usleep ( MIN(wait, (gint64)timeout_ms * 1000) );
+
+  CURLMsg *msg;
+  int msgs_left;
+  while ( (msg = curl_multi_info_read ( cm->multi, &msgs_left )) ) {
+    if ( msg->msg != CURLMSG_DONE )
+      continue;
+    CurlMultiRequest *cmr = NULL;
+    curl_easy_getinfo ( msg->easy_handle, CURLINFO_PRIVATE, (char**)&cmr );
+    if ( cmr ) {
+      // NB msg is invalid after removing the handle
+      CURLcode res = msg->data.result;
+      multi_request_finish ( cm, cmr, file_result ( cmr->curl, res, cmr->uri ) );
+    }
+  }
+
+  return g_list_length(cm->active) + g_queue_get_length(cm->pending);
+}
+
+/**
+ * curl_download_multi_cleanup:
+ *
+ * Any downloads not yet completed are aborted,
+ *  with their completion functions being called with CURL_DOWNLOAD_ERROR
+ */
+void curl_download_multi_cleanup ( void *handle )
+{
+  CurlMulti *cm = (CurlMulti*)handle;
+  if ( !cm )
+    return;
+
+  while ( cm->active )
+    multi_request_finish ( cm, cm->active->data, CURL_DOWNLOAD_ERROR );
+
+  CurlMultiRequest *cmr;
+  while ( (cmr = g_queue_pop_head ( cm->pending )) ) {
+    cmr->done ( CURL_DOWNLOAD_ERROR, cmr->user_data );
+    multi_request_free ( cmr );
+  }
+  g_queue_free ( cm->pending );
+
+  CURL *curl;
+  while ( (curl = g_queue_pop_head ( cm->idle )) )
+    curl_easy_cleanup ( curl );
+  g_queue_free ( cm->idle );
+
+  curl_multi_cleanup ( cm->multi );
+  g_free ( cm );
+}
@@ -60,6 +60,13 @@ void curl_download_handle_cleanup ( void * handle );
 
 char* curl_download_get_ptr ( const char *uri, DownloadFileOptions *options );
 
+typedef void (*CurlDownloadDoneFunc) ( CURL_download_t result, gpointer user_data );
+
+void *curl_download_multi_init ( guint max_transfers, guint interval_ms );
+void curl_download_multi_add ( void *handle, const char *hostname, const char *uri, FILE *f, DownloadFileOptions *options, gboolean ftp, CurlDownloadOptions *curl_options, CurlDownloadDoneFunc done, gpointer user_data );
+guint curl_download_multi_perform ( void *handle, gint timeout_ms );
+void curl_download_multi_cleanup ( void *handle );
+
 G_END_DECLS
 
 #endif
@@ -45,7 +45,20 @@
 #include "file_magic.h"
 
 #define DEM_BLOCK_SIZE 1024
-#define GET_COLUMN(dem,n) ((VikDEMColumn *)g_ptr_array_index( (dem)->columns, (n) ))
+#define GET_COLUMN(columns,n) ((DEMColumn *)g_ptr_array_index( (columns), (n) ))
+
+/* A column of a DEM file whilst it is being read */
+typedef struct {
+  /* east-west coordinate for ALL items in the column */
+  gdouble east_west;
+
+  /* coordinate of northern and southern boundaries */
+  gdouble south;
+//  gdouble north;
+
+  guint n_points;
+  gint16 *points;
+} DEMColumn;
 
 static gboolean get_double_and_continue ( gchar **buffer, gdouble *tmp, gboolean warn )
 {
@@ -152,15 +165,15 @@ static gboolean dem_parse_header ( gchar *buffer, VikDEM *dem )
   return TRUE;
 }
 
-static void dem_parse_block_as_cont ( gchar *buffer, VikDEM *dem, gint *cur_column, gint *cur_row )
+static void dem_parse_block_as_cont ( gchar *buffer, VikDEM *dem, GPtrArray *columns, gint *cur_column, gint *cur_row )
 {
   gint tmp;
-  while ( *cur_row < GET_COLUMN(dem, *cur_column)->n_points ) {
+  while ( *cur_row < GET_COLUMN(columns, *cur_column)->n_points ) {
     if ( get_int_and_continue(&buffer, &tmp,FALSE) ) {
       if ( dem->orig_vert_units == VIK_DEM_VERT_DECIMETERS )
-        GET_COLUMN(dem, *cur_column)->points[*cur_row] = (gint16) (tmp / 10);
+        GET_COLUMN(columns, *cur_column)->points[*cur_row] = (gint16) (tmp / 10);
       else
-        GET_COLUMN(dem, *cur_column)->points[*cur_row] = (gint16) tmp;
+        GET_COLUMN(columns, *cur_column)->points[*cur_row] = (gint16) tmp;
     } else
       return;
     (*cur_row)++;
@@ -168,7 +181,7 @@ static void dem_parse_block_as_cont ( gchar *buffer, VikDEM *dem, gint *cur_colu
   *cur_row = -1; /* expecting new column */
 }
 
-static void dem_parse_block_as_header ( gchar *buffer, VikDEM *dem, gint *cur_column, gint *cur_row )
+static void dem_parse_block_as_header ( gchar *buffer, VikDEM *dem, GPtrArray *columns, gint *cur_column, gint *cur_row )
 {
   guint n_rows;
   gint i;
@@ -206,7 +219,6 @@ static void dem_parse_block_as_header ( gchar *buffer, VikDEM *dem, gint *cur_co
   if ( !get_double_and_continue(&buffer, &tmp, TRUE)) return;
 
 
-  dem->n_columns ++;
   (*cur_column) ++;
 
   /* empty spaces for things before that were skipped */
@@ -216,35 +228,69 @@ static void dem_parse_block_as_header ( gchar *buffer, VikDEM *dem, gint *cur_co
 
   n_rows += *cur_row;
 
-  g_ptr_array_add ( dem->columns, g_malloc(sizeof(VikDEMColumn)) );
-  GET_COLUMN(dem,*cur_column)->east_west = east_west;
-  GET_COLUMN(dem,*cur_column)->south = south;
-  GET_COLUMN(dem,*cur_column)->n_points = n_rows;
-  GET_COLUMN(dem,*cur_column)->points = g_malloc(sizeof(gint16)*n_rows);
+  g_ptr_array_add ( columns, g_malloc(sizeof(DEMColumn)) );
+  GET_COLUMN(columns,*cur_column)->east_west = east_west;
+  GET_COLUMN(columns,*cur_column)->south = south;
+  GET_COLUMN(columns,*cur_column)->n_points = n_rows;
+  GET_COLUMN(columns,*cur_column)->points = g_malloc(sizeof(gint16)*n_rows);
 
   /* no information for things before that */
   for ( i = 0; i < (*cur_row); i++ )
-    GET_COLUMN(dem,*cur_column)->points[i] = VIK_DEM_INVALID_ELEVATION;
+    GET_COLUMN(columns,*cur_column)->points[i] = VIK_DEM_INVALID_ELEVATION;
 
   /* now just continue */
-  dem_parse_block_as_cont ( buffer, dem, cur_column, cur_row );
+  dem_parse_block_as_cont ( buffer, dem, columns, cur_column, cur_row );
 
 
 }
 
-static void dem_parse_block ( gchar *buffer, VikDEM *dem, gint *cur_column, gint *cur_row )
+static void dem_parse_block ( gchar *buffer, VikDEM *dem, GPtrArray *columns, gint *cur_column, gint *cur_row )
 {
   /* if haven't read anything or have read all items in a columns and are expecting a new column */
   if ( *cur_column == -1 || *cur_row == -1 ) {
-    dem_parse_block_as_header(buffer, dem, cur_column, cur_row);
+    dem_parse_block_as_header(buffer, dem, columns, cur_column, cur_row);
   } else {
-    dem_parse_block_as_cont(buffer, dem, cur_column, cur_row);
+    dem_parse_block_as_cont(buffer, dem, columns, cur_column, cur_row);
+  }
+}
+
+/**
+ * Put the columns as read into the single block of points
+ */
+static void dem_set_points_from_columns ( VikDEM *dem, GPtrArray *columns )
+{
+  guint col, row;
+  dem->n_columns = columns->len;
+  dem->n_rows = 0;
+  for ( col = 0; col < dem->n_columns; col++ )
+    dem->n_rows = MAX ( dem->n_rows, GET_COLUMN(columns, col)->n_points );
+
+  gint16 *points = g_malloc ( sizeof(gint16) * dem->n_columns * dem->n_rows );
+  for ( col = 0; col < dem->n_columns; col++ ) {
+    DEMColumn *column = GET_COLUMN(columns, col);
+    for ( row = 0; row < dem->n_rows; row++ )
+      points[(gsize)(dem->n_rows - 1 - row) * dem->n_columns + col] =
+        row < column->n_points ? column->points[row] : VIK_DEM_INVALID_ELEVATION;
   }
+  dem->points = points;
+  dem->big_endian = FALSE;
+  dem->mf = NULL;
 }
 
+static void dem_column_free ( DEMColumn *column )
+{
+  g_free ( column->points );
+  g_free ( column );
+}
+
+/**
+ * The grid in the file is used as is (big endian, rows from the north) -
+ *  so for the usual uncompressed file it stays memory mapped
+ *  and is shared with any other users via the page cache,
+ *  rather than being copied out when loaded.
+ */
 static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basename, gboolean zip)
 {
-  gint i, j;
   VikDEM *dem;
   off_t file_size;
   gint16 *dem_mem = NULL;
@@ -256,7 +302,7 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
   gint arcsec;
   GError *error = NULL;
 
-  dem = g_malloc(sizeof(VikDEM));
+  dem = g_malloc0(sizeof(VikDEM));
 
   dem->horiz_units = VIK_DEM_HORIZ_LL_ARCSECONDS;
   dem->orig_vert_units = VIK_DEM_VERT_DECIMETERS;
@@ -272,9 +318,6 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
   dem->max_north = 3600 + dem->min_north;
   dem->max_east = 3600 + dem->min_east;
 
-  dem->columns = g_ptr_array_new();
-  dem->n_columns = 0;
-
   if ((mf = g_mapped_file_new(file_name, FALSE, &error)) == NULL) {
     g_critical(_("Couldn't map file %s: %s"), file_name, error->message);
     g_error_free(error);
@@ -290,14 +333,15 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
 
     if ((unzip_mem = unzip_file(dem_file, &ucsize)) == NULL) {
       g_mapped_file_unref(mf);
-      g_ptr_array_foreach ( dem->columns, (GFunc)g_free, NULL );
-      g_ptr_array_free(dem->columns, TRUE);
       g_free(dem);
       return NULL;
     }
 
     dem_mem = unzip_mem;
     file_size = ucsize;
+    // Finished with the file itself
+    g_mapped_file_unref(mf);
+    mf = NULL;
   }
   else
     dem_mem = (gint16 *)dem_file;
@@ -308,7 +352,10 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
     arcsec = 1;
   else {
     g_warning("%s(): file %s does not have right size", __PRETTY_FUNCTION__, basename);
-    g_mapped_file_unref(mf);
+    if (mf)
+      g_mapped_file_unref(mf);
+    else
+      g_free(dem_mem);
     g_free(dem);
     return NULL;
   }
@@ -316,27 +363,12 @@ static VikDEM *vik_dem_read_srtm_hgt(const gchar *file_name, const gchar *basena
   num_rows = (arcsec == 3) ? num_rows_3sec : num_rows_1sec;
   dem->east_scale = dem->north_scale = arcsec;
 
-  for ( i = 0; i < num_rows; i++ ) {
-    dem->n_columns++;
-    g_ptr_array_add ( dem->columns, g_malloc(sizeof(VikDEMColumn)) );
-    GET_COLUMN(dem,i)->east_west = dem->min_east + arcsec*i;
-    GET_COLUMN(dem,i)->south = dem->min_north;
-    GET_COLUMN(dem,i)->n_points = num_rows;
-    GET_COLUMN(dem,i)->points = g_malloc(sizeof(gint16)*num_rows);
-  }
-
-  int ent = 0;
-  for ( i = (num_rows - 1); i >= 0; i-- ) {
-    for ( j = 0; j < num_rows; j++ ) {
-      GET_COLUMN(dem,j)->points[i] = GINT16_FROM_BE(dem_mem[ent]);
-      ent++;
-    }
+  dem->n_columns = num_rows;
+  dem->n_rows = num_rows;
+  dem->points = dem_mem;
+  dem->big_endian = TRUE;
+  dem->mf = mf;
 
-  }
-
-  if (zip)
-    g_free(dem_mem);
-  g_mapped_file_unref(mf);
   return dem;
 }
 
@@ -349,6 +381,7 @@ VikDEM *vik_dem_new_from_file(const gchar *file)
   /* use to record state for dem_parse_block */
   gint cur_column = -1;
   gint cur_row = -1;
+  GPtrArray *columns;
   const gchar *basename = a_file_basename(file);
 
   if ( g_access ( file, R_OK ) != 0 )
@@ -364,7 +397,7 @@ VikDEM *vik_dem_new_from_file(const gchar *file)
   }
 
       /* Create Structure */
-  rv = g_malloc(sizeof(VikDEM));
+  rv = g_malloc0(sizeof(VikDEM));
 
       /* Header */
   f = g_fopen(file, "r");
@@ -380,8 +413,7 @@ VikDEM *vik_dem_new_from_file(const gchar *file)
   }
   /* TODO: actually use header -- i.e. GET # OF COLUMNS EXPECTED */
 
-  rv->columns = g_ptr_array_new();
-  rv->n_columns = 0;
+  columns = g_ptr_array_new_with_free_func ( (GDestroyNotify)dem_column_free );
 
       /* Column -- Data */
   while (! feof(f) ) {
@@ -398,7 +430,7 @@ VikDEM *vik_dem_new_from_file(const gchar *file)
        tmp++;
      }
 
-     dem_parse_block(buffer, rv, &cur_column, &cur_row);
+     dem_parse_block(buffer, rv, columns, &cur_column, &cur_row);
   }
 
      /* TODO - class C records (right now says 'Invalid' and dies) */
@@ -407,8 +439,11 @@ VikDEM *vik_dem_new_from_file(const gchar *file)
   f = NULL;
 
   /* 24k scale */
-  if ( rv->horiz_units == VIK_DEM_HORIZ_UTM_METERS && rv->n_columns >= 2 )
-    rv->north_scale = rv->east_scale = GET_COLUMN(rv, 1)->east_west - GET_COLUMN(rv,0)->east_west;
+  if ( rv->horiz_units == VIK_DEM_HORIZ_UTM_METERS && columns->len >= 2 )
+    rv->north_scale = rv->east_scale = GET_COLUMN(columns, 1)->east_west - GET_COLUMN(columns,0)->east_west;
+
+  dem_set_points_from_columns ( rv, columns );
+  g_ptr_array_free ( columns, TRUE );
 
   /* FIXME bug in 10m DEM's */
   if ( rv->horiz_units == VIK_DEM_HORIZ_UTM_METERS && rv->north_scale == 10 ) {
@@ -420,21 +455,145 @@ VikDEM *vik_dem_new_from_file(const gchar *file)
   return rv;
 }
 
+static void dem_overview_free ( VikDEMOverview *ov )
+{
+  g_free ( ov->mean );
+  g_free ( ov );
+}
+
 void vik_dem_free ( VikDEM *dem )
 {
-  guint i;
-  for ( i = 0; i < dem->n_columns; i++)
-    g_free ( GET_COLUMN(dem, i)->points );
-  g_ptr_array_foreach ( dem->columns, (GFunc)g_free, NULL );
-  g_ptr_array_free ( dem->columns, TRUE );
+  for ( guint ii = 0; ii < VIK_DEM_MAX_OVERVIEWS; ii++ )
+    if ( dem->overviews[ii] )
+      dem_overview_free ( dem->overviews[ii] );
+  if ( dem->mf )
+    g_mapped_file_unref ( dem->mf );
+  else
+    g_free ( (gpointer)dem->points );
   g_free ( dem );
 }
 
+/**
+ * vik_dem_get_xy:
+ * @col: Column from the west
+ * @row: Row from the south
+ */
 gint16 vik_dem_get_xy ( VikDEM *dem, guint col, guint row )
 {
-  if ( col < dem->n_columns )
-    if ( row < GET_COLUMN(dem, col)->n_points )
-      return GET_COLUMN(dem, col)->points[row];
+  if ( col < dem->n_columns && row < dem->n_rows ) {
+    gint16 elev = dem->points[(gsize)(dem->n_rows - 1 - row) * dem->n_columns + col];
+    return dem->big_endian ? GINT16_FROM_BE(elev) : elev;
+  }
+  return VIK_DEM_INVALID_ELEVATION;
+}
+
+// Overviews may be wanted by several threads at once
+G_LOCK_DEFINE_STATIC(overviews);
+
+/**
+ * Make the overview from the level below, (the DEM itself when below is NULL)
+ */
+static VikDEMOverview *dem_overview_new ( VikDEM *dem, const VikDEMOverview *below )
+{
+  guint below_columns = below ? below->n_columns : dem->n_columns;
+  guint below_rows = below ? below->n_rows : dem->n_rows;
+  VikDEMOverview *ov = g_malloc ( sizeof(VikDEMOverview) );
+  ov->n_columns = (below_columns + 1) / 2;
+  ov->n_rows = (below_rows + 1) / 2;
+  gsize size = (gsize)ov->n_columns * ov->n_rows;
+  ov->mean = g_malloc ( sizeof(gint16) * size );
+
+  for ( guint row = 0; row < ov->n_rows; row++ ) {
+    for ( guint col = 0; col < ov->n_columns; col++ ) {
+      gint sum = 0, count = 0;
+      for ( guint yy = row * 2; yy < MIN(row * 2 + 2, below_rows); yy++ ) {
+        for ( guint xx = col * 2; xx < MIN(col * 2 + 2, below_columns); xx++ ) {
+          gint16 elev;
+          if ( below )
+            elev = below->mean[(gsize)(below_rows - 1 - yy) * below_columns + xx];
+          else
+            elev = vik_dem_get_xy ( dem, xx, yy );
+          if ( elev == VIK_DEM_INVALID_ELEVATION )
+            continue;
+          sum += elev;
+          count++;
+        }
+      }
+      gsize ii = (gsize)(ov->n_rows - 1 - row) * ov->n_columns + col;
+      ov->mean[ii] = count ? sum / count : VIK_DEM_INVALID_ELEVATION;
+    }
+  }
+  return ov;
+}
+
+/**
+ * vik_dem_get_overview:
+ * @level: 1 for 2x reduced, 2 for 4x reduced and so on
+ *
+ * The overview (and any levels below it) is made when first requested.
+ *
+ * Returns: The overview or NULL if the level is not available
+ */
+const VikDEMOverview *vik_dem_get_overview ( VikDEM *dem, guint level )
+{
+  if ( level < 1 || level > VIK_DEM_MAX_OVERVIEWS )
+    return NULL;
+  VikDEMOverview *ov = g_atomic_pointer_get ( &dem->overviews[level-1] );
+  if ( ov )
+    return ov;
+
+  G_LOCK ( overviews );
+  for ( guint ii = 0; ii < level; ii++ ) {
+    if ( !dem->overviews[ii] ) {
+      VikDEMOverview *below = ii ? dem->overviews[ii-1] : NULL;
+      // No point going beyond a single sample
+      if ( below && below->n_columns == 1 && below->n_rows == 1 )
+        break;
+      g_atomic_pointer_set ( &dem->overviews[ii], dem_overview_new ( dem, below ) );
+    }
+  }
+  ov = dem->overviews[level-1];
+  G_UNLOCK ( overviews );
+  return ov;
+}
+
+/**
+ * vik_dem_get_overview_level:
+ * @samples_per_pixel: How many DEM samples are covered by each pixel being drawn
+ *
+ * Returns: The level suitable for drawing, 0 being the DEM itself
+ */
+guint vik_dem_get_overview_level ( VikDEM *dem, gdouble samples_per_pixel )
+{
+  if ( samples_per_pixel < 2.0 )
+    return 0;
+  guint level = MIN ( (guint)floor(log2(samples_per_pixel)), VIK_DEM_MAX_OVERVIEWS );
+  // Limited by the size of the DEM
+  guint size = MAX ( dem->n_columns, dem->n_rows );
+  while ( level > 0 && (size >> level) == 0 )
+    level--;
+  return level;
+}
+
+/**
+ * vik_dem_get_xy_level:
+ * @level: The overview level, 0 for the DEM itself
+ * @col:   Column from the west (of the DEM itself)
+ * @row:   Row from the south (of the DEM itself)
+ *
+ * Returns: The mean elevation of the overview sample covering the position
+ */
+gint16 vik_dem_get_xy_level ( VikDEM *dem, guint level, guint col, guint row )
+{
+  if ( level == 0 )
+    return vik_dem_get_xy ( dem, col, row );
+  const VikDEMOverview *ov = vik_dem_get_overview ( dem, level );
+  if ( !ov )
+    return vik_dem_get_xy ( dem, col, row );
+  col >>= level;
+  row >>= level;
+  if ( col < ov->n_columns && row < ov->n_rows )
+    return ov->mean[(gsize)(ov->n_rows - 1 - row) * ov->n_columns + col];
   return VIK_DEM_INVALID_ELEVATION;
 }
 
@@ -566,6 +725,179 @@ gint16 vik_dem_get_shepard_interpol ( VikDEM *dem, gdouble east, gdouble north )
 
 }
 
+/**
+ * Get the sample from the block of points, where (ii) has already been checked to be within it
+ */
+static inline gint16 dem_get_index ( const VikDEM *dem, gsize ii )
+{
+  return dem->big_endian ? GINT16_FROM_BE(dem->points[ii]) : dem->points[ii];
+}
+
+/**
+ * Position relative to the DEM grid (in samples from the south west corner)
+ *
+ * Returns: The index of the sample to the south west of the position,
+ *  or -1 when the position is outside of the DEM
+ */
+static inline gssize dem_grid_position ( const VikDEM *dem, gdouble east, gdouble north, gdouble *fx, gdouble *fy )
+{
+  gdouble gx = (east - dem->min_east) / dem->east_scale;
+  gdouble gy = (north - dem->min_north) / dem->north_scale;
+  // NB also false for NAN
+  if ( !(gx >= 0.0 && gy >= 0.0 && gx <= dem->n_columns - 1 && gy <= dem->n_rows - 1) )
+    return -1;
+  // The last column/row uses the column/row before it
+  guint col = MIN ( (guint)gx, dem->n_columns - 2 );
+  guint row = MIN ( (guint)gy, dem->n_rows - 2 );
+  *fx = gx - col;
+  *fy = gy - row;
+  // Rows are from the north
+  return (gssize)(dem->n_rows - 1 - row) * dem->n_columns + col;
+}
+
+/**
+ * vik_dem_get_bilinear_interpol:
+ *
+ * Bilinear interpolation of the four samples around the position
+ */
+gint16 vik_dem_get_bilinear_interpol ( VikDEM *dem, gdouble east, gdouble north )
+{
+  gdouble fx, fy;
+  if ( dem->n_columns < 2 || dem->n_rows < 2 )
+    return VIK_DEM_INVALID_ELEVATION;
+  gssize ii = dem_grid_position ( dem, east, north, &fx, &fy );
+  if ( ii < 0 )
+    return VIK_DEM_INVALID_ELEVATION;
+
+  gint16 sw = dem_get_index ( dem, ii );
+  gint16 se = dem_get_index ( dem, ii + 1 );
+  gint16 nw = dem_get_index ( dem, ii - dem->n_columns );
+  gint16 ne = dem_get_index ( dem, ii - dem->n_columns + 1 );
+  if ( sw == VIK_DEM_INVALID_ELEVATION || se == VIK_DEM_INVALID_ELEVATION ||
+       nw == VIK_DEM_INVALID_ELEVATION || ne == VIK_DEM_INVALID_ELEVATION )
+    return VIK_DEM_INVALID_ELEVATION;
+
+  gdouble bottom = sw + (se - sw) * fx;
+  gdouble top = nw + (ne - nw) * fx;
+  return (gint16)floor ( bottom + (top - bottom) * fy + 0.5 );
+}
+
+#define DEM_SAMPLE_BLOCK 256
+
+/**
+ * vik_dem_sample_batch:
+ * @lats:  Latitudes of the positions (degrees)
+ * @lons:  Longitudes of the positions (degrees)
+ * @count: Number of positions
+ * @elevs: Returns the elevation of each position, as vik_dem_get_bilinear_interpol(),
+ *         or VIK_DEM_INVALID_ELEVATION when outside of the DEM or any of the samples around it are missing
+ *
+ * Get the elevations of many positions at once.
+ *
+ * Positions are processed in blocks: firstly working out where each is in the grid,
+ *  then fetching the samples around it and lastly interpolating between them.
+ * The first and last steps are simple loops over arrays which the compiler can vectorize.
+ *
+ * Returns: The number of valid elevations
+ */
+guint vik_dem_sample_batch ( VikDEM *dem, const gdouble *lats, const gdouble *lons, guint count, gint16 *elevs )
+{
+  gdouble gx[DEM_SAMPLE_BLOCK], gy[DEM_SAMPLE_BLOCK];
+  gdouble sw[DEM_SAMPLE_BLOCK], se[DEM_SAMPLE_BLOCK], nw[DEM_SAMPLE_BLOCK], ne[DEM_SAMPLE_BLOCK];
+  gssize index[DEM_SAMPLE_BLOCK];
+  guint found = 0;
+
+  if ( dem->n_columns < 2 || dem->n_rows < 2 ) {
+    for ( guint ii = 0; ii < count; ii++ )
+      elevs[ii] = VIK_DEM_INVALID_ELEVATION;
+    return found;
+  }
+
+  const gdouble east_scale = 1.0 / dem->east_scale;
+  const gdouble north_scale = 1.0 / dem->north_scale;
+  const gdouble max_x = dem->n_columns - 1;
+  const gdouble max_y = dem->n_rows - 1;
+  const gssize n_columns = dem->n_columns;
+  const gssize last_row = dem->n_rows - 1;
+
+  for ( guint start = 0; start < count; start += DEM_SAMPLE_BLOCK ) {
+    const guint nn = MIN ( DEM_SAMPLE_BLOCK, count - start );
+    const gdouble *lat = lats + start;
+    const gdouble *lon = lons + start;
+
+    // Position in the units of the DEM
+    if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
+      for ( guint ii = 0; ii < nn; ii++ ) {
+        gx[ii] = (lon[ii] * 3600 - dem->min_east) * east_scale;
+        gy[ii] = (lat[ii] * 3600 - dem->min_north) * north_scale;
+      }
+    }
+    else {
+      for ( guint ii = 0; ii < nn; ii++ ) {
+        struct LatLon ll = { lat[ii], lon[ii] };
+        struct UTM utm;
+        a_coords_latlon_to_utm ( &ll, &utm );
+        if ( utm.zone == dem->utm_zone ) {
+          gx[ii] = (utm.easting - dem->min_east) * east_scale;
+          gy[ii] = (utm.northing - dem->min_north) * north_scale;
+        }
+        else
+          gx[ii] = gy[ii] = -1.0;
+      }
+    }
+
+    // Grid cell and the position within it
+    for ( guint ii = 0; ii < nn; ii++ ) {
+      gboolean inside = gx[ii] >= 0.0 && gy[ii] >= 0.0 && gx[ii] <= max_x && gy[ii] <= max_y;
+      gdouble x = inside ? gx[ii] : 0.0;
+      gdouble y = inside ? gy[ii] : 0.0;
+      // The last column/row uses the column/row before it
+      gssize col = MIN ( (gssize)x, n_columns - 2 );
+      gssize row = MIN ( (gssize)y, last_row - 1 );
+      gx[ii] = x - col;
+      gy[ii] = y - row;
+      // Rows are from the north
+      index[ii] = inside ? (last_row - row) * n_columns + col : -1;
+    }
+
+    // Samples around each position
+    for ( guint ii = 0; ii < nn; ii++ ) {
+      if ( index[ii] < 0 ) {
+        sw[ii] = se[ii] = nw[ii] = ne[ii] = 0.0;
+        continue;
+      }
+      gint16 v1 = dem_get_index ( dem, index[ii] );
+      gint16 v2 = dem_get_index ( dem, index[ii] + 1 );
+      gint16 v3 = dem_get_index ( dem, index[ii] - n_columns );
+      gint16 v4 = dem_get_index ( dem, index[ii] - n_columns + 1 );
+      if ( v1 == VIK_DEM_INVALID_ELEVATION || v2 == VIK_DEM_INVALID_ELEVATION ||
+           v3 == VIK_DEM_INVALID_ELEVATION || v4 == VIK_DEM_INVALID_ELEVATION )
+        index[ii] = -1;
+      sw[ii] = v1;
+      se[ii] = v2;
+      nw[ii] = v3;
+      ne[ii] = v4;
+    }
+
+    // Interpolate
+    for ( guint ii = 0; ii < nn; ii++ ) {
+      gdouble bottom = sw[ii] + (se[ii] - sw[ii]) * gx[ii];
+      gdouble top = nw[ii] + (ne[ii] - nw[ii]) * gx[ii];
+      sw[ii] = bottom + (top - bottom) * gy[ii];
+    }
+
+    for ( guint ii = 0; ii < nn; ii++ ) {
+      if ( index[ii] < 0 )
+        elevs[start+ii] = VIK_DEM_INVALID_ELEVATION;
+      else {
+        elevs[start+ii] = (gint16)floor ( sw[ii] + 0.5 );
+        found++;
+      }
+    }
+  }
+  return found;
+}
+
 void vik_dem_east_north_to_xy ( VikDEM *dem, gdouble east, gdouble north, guint *col, guint *row )
 {
   *col = (guint) floor((east - dem->min_east) / dem->east_scale);
@@ -38,9 +38,25 @@ G_BEGIN_DECLS
 #define VIK_DEM_VERT_METERS 1 /* wrong in 250k?	 */
 
 
+/* Sufficient to reduce even a 1 arcsecond DEM to a single sample */
+#define VIK_DEM_MAX_OVERVIEWS 12
+
+/* A reduced resolution version of a DEM, each sample covering a 2x2 block of the level below */
 typedef struct {
   guint n_columns;
-  GPtrArray *columns;
+  guint n_rows;
+  /* rows from the north, as for the DEM points */
+  gint16 *mean;
+} VikDEMOverview;
+
+typedef struct {
+  guint n_columns;
+  guint n_rows;
+  /* All the samples in one block, a row at a time starting from the north,
+   * i.e. the layout of SRTM .hgt files so these can be used as is */
+  const gint16 *points;
+  gboolean big_endian; /* samples are stored big endian (as in .hgt files) */
+  GMappedFile *mf; /* the file the points are mapped from, otherwise points are allocated */
 
   guint8 horiz_units;
   guint8 orig_vert_units; /* original, always converted to meters when loading. */
@@ -51,29 +67,26 @@ typedef struct {
 
   guint8 utm_zone;
   gchar utm_letter;
-} VikDEM;
 
-typedef struct {
-  /* east-west coordinate for ALL items in the column */
-  gdouble east_west;
-
-  /* coordinate of northern and southern boundaries */
-  gdouble south;
-//  gdouble north;
-
-  guint n_points;
-  gint16 *points;
-} VikDEMColumn;
+  /* built when first needed, [0] is the 2x reduced level */
+  VikDEMOverview *overviews[VIK_DEM_MAX_OVERVIEWS];
+} VikDEM;
 
 
 VikDEM *vik_dem_new_from_file(const gchar *file);
 void vik_dem_free ( VikDEM *dem );
 gint16 vik_dem_get_xy ( VikDEM *dem, guint x, guint y );
+const VikDEMOverview *vik_dem_get_overview ( VikDEM *dem, guint level );
+guint vik_dem_get_overview_level ( VikDEM *dem, gdouble samples_per_pixel );
+gint16 vik_dem_get_xy_level ( VikDEM *dem, guint level, guint x, guint y );
 
 gint16 vik_dem_get_east_north ( VikDEM *dem, gdouble east, gdouble north );
 gint16 vik_dem_get_simple_interpol ( VikDEM *dem, gdouble east, gdouble north );
 gint16 vik_dem_get_shepard_interpol ( VikDEM *dem, gdouble east, gdouble north );
 gint16 vik_dem_get_best_interpol ( VikDEM *dem, gdouble east, gdouble north );
+gint16 vik_dem_get_bilinear_interpol ( VikDEM *dem, gdouble east, gdouble north );
+
+guint vik_dem_sample_batch ( VikDEM *dem, const gdouble *lats, const gdouble *lons, guint count, gint16 *elevs );
 
 void vik_dem_east_north_to_xy ( VikDEM *dem, gdouble east, gdouble north, guint *col, guint *row );
 
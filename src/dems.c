@@ -21,18 +21,33 @@
  */
 #include <glib.h>
 #include <glib/gi18n.h>
+#include <math.h>
 
 #include "dems.h"
 #include "background.h"
+#include "globals.h"
 
 typedef struct {
   VikDEM *dem;
   guint ref_count;
+  gdouble resolution; // Approximate distance between samples in metres - smaller is better
+  LatLonBBox bbox;
 } LoadedDEM;
 
 GHashTable *loaded_dems = NULL;
 /* filename -> DEM */
 
+// Spatial index of the loaded DEMs,
+//  each whole degree cell of latitude/longitude has the DEMs covering it, best resolution first
+static GHashTable *dem_grid = NULL;
+// The cell of the last lookup, since consecutive lookups (e.g. along a track) are very likely to be in the same one
+static gint last_cell = -1;
+static GPtrArray *last_cell_dems = NULL;
+// Loading DEMs may happen in a background thread whilst lookups occur
+G_LOCK_DEFINE_STATIC(dems);
+
+#define DEM_GRID_CELL(lat,lon) ((gint)(floor(lat)+90) * 360 + (gint)(floor(lon)+180))
+
 static void loaded_dem_free ( LoadedDEM *ldem )
 {
   vik_dem_free ( ldem->dem );
@@ -41,10 +56,97 @@ static void loaded_dem_free ( LoadedDEM *ldem )
 
 void a_dems_uninit ()
 {
+  if ( dem_grid )
+    g_hash_table_destroy ( dem_grid );
+  dem_grid = NULL;
+  last_cell = -1;
+  last_cell_dems = NULL;
   if ( loaded_dems )
     g_hash_table_destroy ( loaded_dems );
 }
 
+static gint ldem_compare_resolution ( gconstpointer a, gconstpointer b )
+{
+  const LoadedDEM *ldem1 = *(const LoadedDEM **)a;
+  const LoadedDEM *ldem2 = *(const LoadedDEM **)b;
+  if ( ldem1->resolution < ldem2->resolution )
+    return -1;
+  if ( ldem1->resolution > ldem2->resolution )
+    return 1;
+  return 0;
+}
+
+/**
+ * Call the function for each grid cell covered by the DEM
+ */
+static void grid_foreach_cell ( LoadedDEM *ldem, void (*func)(gint, LoadedDEM*) )
+{
+  // The bounds of UTM DEMs are only approximate in lat/lon terms, so allow some extra
+  gint margin = ldem->dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ? 1 : 0;
+  gint south = MAX ( -90, (gint)floor(ldem->bbox.south) - margin );
+  gint north = MIN ( 89, (gint)floor(ldem->bbox.north) + margin );
+  gint west = MAX ( -180, (gint)floor(ldem->bbox.west) - margin );
+  gint east = MIN ( 179, (gint)floor(ldem->bbox.east) + margin );
+  for ( gint lat = south; lat <= north; lat++ )
+    for ( gint lon = west; lon <= east; lon++ )
+      func ( DEM_GRID_CELL(lat, lon), ldem );
+}
+
+static void grid_add_cell ( gint cell, LoadedDEM *ldem )
+{
+  GPtrArray *dems = g_hash_table_lookup ( dem_grid, GINT_TO_POINTER(cell) );
+  if ( !dems ) {
+    dems = g_ptr_array_new ();
+    g_hash_table_insert ( dem_grid, GINT_TO_POINTER(cell), dems );
+  }
+  g_ptr_array_add ( dems, ldem );
+  g_ptr_array_sort ( dems, ldem_compare_resolution );
+}
+
+static void grid_remove_cell ( gint cell, LoadedDEM *ldem )
+{
+  GPtrArray *dems = g_hash_table_lookup ( dem_grid, GINT_TO_POINTER(cell) );
+  if ( dems ) {
+    g_ptr_array_remove ( dems, ldem );
+    if ( dems->len == 0 )
+      g_hash_table_remove ( dem_grid, GINT_TO_POINTER(cell) );
+  }
+}
+
+static void grid_add ( LoadedDEM *ldem )
+{
+  if ( !dem_grid )
+    dem_grid = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_ptr_array_unref );
+  grid_foreach_cell ( ldem, grid_add_cell );
+  last_cell = -1;
+  last_cell_dems = NULL;
+}
+
+static void grid_remove ( LoadedDEM *ldem )
+{
+  if ( dem_grid )
+    grid_foreach_cell ( ldem, grid_remove_cell );
+  last_cell = -1;
+  last_cell_dems = NULL;
+}
+
+/**
+ * Get the DEMs covering the position, best resolution first
+ *
+ * Must be called with the dems lock held
+ */
+static GPtrArray *grid_lookup ( const struct LatLon *ll )
+{
+  if ( !dem_grid || ll->lat < -90.0 || ll->lat >= 90.0 || ll->lon < -180.0 || ll->lon >= 180.0 )
+    return NULL;
+  gint cell = DEM_GRID_CELL(ll->lat, ll->lon);
+  if ( cell != last_cell ) {
+    last_cell = cell;
+    last_cell_dems = g_hash_table_lookup ( dem_grid, GINT_TO_POINTER(cell) );
+  }
+  return last_cell_dems;
+}
+
 /* To load a dem. if it was already loaded, will simply
  * reference the one already loaded and return it.
  */
@@ -52,6 +154,7 @@ VikDEM *a_dems_load(const gchar *filename)
 {
   LoadedDEM *ldem;
 
+  G_LOCK ( dems );
   /* dems init hash table */
   if ( ! loaded_dems )
     loaded_dems = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify) loaded_dem_free );
@@ -59,29 +162,72 @@ VikDEM *a_dems_load(const gchar *filename)
   ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
   if ( ldem ) {
     ldem->ref_count++;
+    G_UNLOCK ( dems );
+    return ldem->dem;
+  }
+  G_UNLOCK ( dems );
+
+  VikDEM *dem = vik_dem_new_from_file ( filename );
+  if ( ! dem )
+    return NULL;
+
+  G_LOCK ( dems );
+  // Possibly loaded by another thread in the meantime
+  ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
+  if ( ldem ) {
+    ldem->ref_count++;
+    G_UNLOCK ( dems );
+    vik_dem_free ( dem );
     return ldem->dem;
-  } else {
-    VikDEM *dem = vik_dem_new_from_file ( filename );
-    if ( ! dem )
-      return NULL;
-    ldem = g_malloc ( sizeof(LoadedDEM) );
-    ldem->ref_count = 1;
-    ldem->dem = dem;
-    g_hash_table_insert ( loaded_dems, g_strdup(filename), ldem );
-    return dem;
   }
+  ldem = g_malloc ( sizeof(LoadedDEM) );
+  ldem->ref_count = 1;
+  ldem->dem = dem;
+  ldem->bbox = vik_dem_get_bbox ( dem );
+  // One arcsecond of latitude is about 30.87m
+  ldem->resolution = dem->north_scale * (dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ? 30.87 : 1.0);
+  g_hash_table_insert ( loaded_dems, g_strdup(filename), ldem );
+  grid_add ( ldem );
+  G_UNLOCK ( dems );
+  return dem;
+}
+
+/**
+ * a_dems_ref:
+ *
+ * Take another reference to a DEM, only if it is already loaded
+ *  (so never reads the file)
+ *
+ * Returns: The DEM or NULL if it is not loaded
+ */
+VikDEM *a_dems_ref ( const gchar *filename )
+{
+  VikDEM *dem = NULL;
+  G_LOCK ( dems );
+  LoadedDEM *ldem = loaded_dems ? g_hash_table_lookup ( loaded_dems, filename ) : NULL;
+  if ( ldem ) {
+    ldem->ref_count++;
+    dem = ldem->dem;
+  }
+  G_UNLOCK ( dems );
+  return dem;
 }
 
 void a_dems_unref(const gchar *filename)
 {
-  LoadedDEM *ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
+  G_LOCK ( dems );
+  LoadedDEM *ldem = loaded_dems ? (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename ) : NULL;
   if ( !ldem ) {
     /* This is fine - probably means the loaded list was aborted / not completed for some reason */
+    G_UNLOCK ( dems );
     return;
   }
   ldem->ref_count--;
-  if ( ldem->ref_count == 0 )
+  if ( ldem->ref_count == 0 ) {
+    grid_remove ( ldem );
     g_hash_table_remove ( loaded_dems, filename );
+  }
+  G_UNLOCK ( dems );
 }
 
 /* to get a DEM that was already loaded.
@@ -90,10 +236,13 @@ void a_dems_unref(const gchar *filename)
  */
 VikDEM *a_dems_get(const gchar *filename)
 {
-  LoadedDEM *ldem = g_hash_table_lookup ( loaded_dems, filename );
+  VikDEM *dem = NULL;
+  G_LOCK ( dems );
+  LoadedDEM *ldem = loaded_dems ? g_hash_table_lookup ( loaded_dems, filename ) : NULL;
   if ( ldem )
-    return ldem->dem;
-  return NULL;
+    dem = ldem->dem;
+  G_UNLOCK ( dems );
+  return dem;
 }
 
 
@@ -167,92 +316,242 @@ GList *a_dems_list_copy ( GList *dems )
   return rv;
 }
 
+/**
+ * a_dems_list_get_elev_by_coord:
+ *
+ * Get the elevation at the position from the first DEM in the list covering it
+ *
+ * Only the DEMs in the position's grid cell are considered,
+ *  so DEMs elsewhere need not be looked at.
+ */
 gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord )
 {
-  static struct UTM utm_tmp;
-  static struct LatLon ll_tmp;
-  GList *iter = dems;
-  VikDEM *dem;
-  gint elev;
+  if ( !loaded_dems )
+    return VIK_DEM_INVALID_ELEVATION;
 
-  while ( iter ) {
-    dem = a_dems_get ( (gchar *) iter->data );
-    if ( dem ) {
-      if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
-        vik_coord_to_latlon ( coord, &ll_tmp );
-        ll_tmp.lat *= 3600;
-        ll_tmp.lon *= 3600;
-        elev = vik_dem_get_east_north(dem, ll_tmp.lon, ll_tmp.lat);
-        if ( elev != VIK_DEM_INVALID_ELEVATION )
-          return elev;
-      } else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
-        vik_coord_to_utm ( coord, &utm_tmp );
-        if ( utm_tmp.zone == dem->utm_zone &&
-             (elev = vik_dem_get_east_north(dem, utm_tmp.easting, utm_tmp.northing)) != VIK_DEM_INVALID_ELEVATION )
-            return elev;
+  struct LatLon ll;
+  vik_coord_to_latlon ( coord, &ll );
+
+  gint16 elev = VIK_DEM_INVALID_ELEVATION;
+  G_LOCK ( dems );
+  GPtrArray *cell_dems = grid_lookup ( &ll );
+  if ( cell_dems ) {
+    struct UTM utm;
+    gboolean have_utm = FALSE;
+    for ( GList *iter = dems; iter && elev == VIK_DEM_INVALID_ELEVATION; iter = iter->next ) {
+      LoadedDEM *ldem = g_hash_table_lookup ( loaded_dems, iter->data );
+      guint ii;
+      for ( ii = 0; ii < cell_dems->len; ii++ )
+        if ( g_ptr_array_index ( cell_dems, ii ) == ldem )
+          break;
+      if ( ii == cell_dems->len )
+        continue;
+      VikDEM *dem = ldem->dem;
+      if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS )
+        elev = vik_dem_get_east_north ( dem, ll.lon * 3600, ll.lat * 3600 );
+      else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
+        if ( !have_utm ) {
+          vik_coord_to_utm ( coord, &utm );
+          have_utm = TRUE;
+        }
+        if ( utm.zone == dem->utm_zone )
+          elev = vik_dem_get_east_north ( dem, utm.easting, utm.northing );
       }
     }
-    iter = iter->next;
   }
-  return VIK_DEM_INVALID_ELEVATION;
+  G_UNLOCK ( dems );
+  return elev;
 }
 
-typedef struct {
-  const VikCoord *coord;
-  VikDemInterpol method;
-  gint elev;
-} CoordElev;
+static gint16 dem_get_elev ( VikDEM *dem, gdouble east, gdouble north, VikDemInterpol method )
+{
+  switch ( method ) {
+    case VIK_DEM_INTERPOL_NONE:   return vik_dem_get_east_north ( dem, east, north );
+    case VIK_DEM_INTERPOL_SIMPLE: return vik_dem_get_simple_interpol ( dem, east, north );
+    case VIK_DEM_INTERPOL_BEST:   return vik_dem_get_shepard_interpol ( dem, east, north );
+    case VIK_DEM_INTERPOL_BILINEAR: return vik_dem_get_bilinear_interpol ( dem, east, north );
+    default: break;
+  }
+  return VIK_DEM_INVALID_ELEVATION;
+}
 
-static gboolean get_elev_by_coord(gpointer key, LoadedDEM *ldem, CoordElev *ce)
+/**
+ * Get the elevation from the best resolution DEM at the position
+ *
+ * Must be called with the dems lock held
+ */
+static gint16 get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method )
 {
-  VikDEM *dem = ldem->dem;
-  gdouble lat, lon;
-
-  if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
-    struct LatLon ll_tmp;
-    vik_coord_to_latlon (ce->coord, &ll_tmp );
-    lat = ll_tmp.lat * 3600;
-    lon = ll_tmp.lon * 3600;
-  } else if (dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS) {
-    static struct UTM utm_tmp;
-    if (utm_tmp.zone != dem->utm_zone)
-      return FALSE;
-    vik_coord_to_utm (ce->coord, &utm_tmp);
-    lat = utm_tmp.northing;
-    lon = utm_tmp.easting;
-  } else
-    return FALSE;
+  struct LatLon ll;
+  vik_coord_to_latlon ( coord, &ll );
+  GPtrArray *dems = grid_lookup ( &ll );
+  if ( !dems )
+    return VIK_DEM_INVALID_ELEVATION;
 
-  switch (ce->method) {
-    case VIK_DEM_INTERPOL_NONE:
-      ce->elev = vik_dem_get_east_north(dem, lon, lat);
-      break;
-    case VIK_DEM_INTERPOL_SIMPLE:
-      ce->elev = vik_dem_get_simple_interpol(dem, lon, lat);
-      break;
-    case VIK_DEM_INTERPOL_BEST:
-      ce->elev = vik_dem_get_shepard_interpol(dem, lon, lat);
-      break;
-    default: break;
+  struct UTM utm;
+  gboolean have_utm = FALSE;
+  for ( guint ii = 0; ii < dems->len; ii++ ) {
+    LoadedDEM *ldem = g_ptr_array_index ( dems, ii );
+    VikDEM *dem = ldem->dem;
+    gint16 elev = VIK_DEM_INVALID_ELEVATION;
+    if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
+      if ( ll.lat < ldem->bbox.south || ll.lat > ldem->bbox.north || ll.lon < ldem->bbox.west || ll.lon > ldem->bbox.east )
+        continue;
+      elev = dem_get_elev ( dem, ll.lon * 3600, ll.lat * 3600, method );
+    }
+    else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
+      if ( !have_utm ) {
+        vik_coord_to_utm ( coord, &utm );
+        have_utm = TRUE;
+      }
+      if ( utm.zone != dem->utm_zone )
+        continue;
+      elev = dem_get_elev ( dem, utm.easting, utm.northing, method );
+    }
+    if ( elev != VIK_DEM_INVALID_ELEVATION )
+      return elev;
   }
-  return (ce->elev != VIK_DEM_INVALID_ELEVATION);
+  return VIK_DEM_INVALID_ELEVATION;
 }
 
-/* TODO: keep a (sorted) linked list of DEMs and select the best resolution one */
+/**
+ * a_dems_get_elev_by_coord:
+ *
+ * Get the elevation at the position from the loaded DEMs,
+ *  using the best resolution DEM where several overlap
+ */
 gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method )
 {
-  CoordElev ce;
-
   if (!loaded_dems)
     return VIK_DEM_INVALID_ELEVATION;
 
-  ce.coord = coord;
-  ce.method = method;
-  ce.elev = VIK_DEM_INVALID_ELEVATION;
+  G_LOCK ( dems );
+  gint16 elev = get_elev_by_coord ( coord, method );
+  G_UNLOCK ( dems );
+  return elev;
+}
 
-  if(!g_hash_table_find(loaded_dems, (GHRFunc)get_elev_by_coord, &ce))
-    return VIK_DEM_INVALID_ELEVATION;
-  return ce.elev;
+/**
+ * Get the elevations a DEM at a time, using vik_dem_sample_batch()
+ *
+ * Must be called with the dems lock held
+ */
+static guint get_elevs_by_coords_bilinear ( const VikCoord *coords, guint count, gint16 *elevs )
+{
+  guint found = 0;
+  gdouble *lats = g_new ( gdouble, count );
+  gdouble *lons = g_new ( gdouble, count );
+  GPtrArray *ldems = g_ptr_array_new ();
+  GPtrArray *last_dems = NULL;
+
+  // Positions and all the DEMs that could cover them
+  for ( guint ii = 0; ii < count; ii++ ) {
+    struct LatLon ll;
+    vik_coord_to_latlon ( &coords[ii], &ll );
+    lats[ii] = ll.lat;
+    lons[ii] = ll.lon;
+    elevs[ii] = VIK_DEM_INVALID_ELEVATION;
+    GPtrArray *dems = grid_lookup ( &ll );
+    if ( dems && dems != last_dems ) {
+      for ( guint jj = 0; jj < dems->len; jj++ ) {
+        gpointer ldem = g_ptr_array_index ( dems, jj );
+        guint kk;
+        for ( kk = 0; kk < ldems->len; kk++ )
+          if ( g_ptr_array_index ( ldems, kk ) == ldem )
+            break;
+        if ( kk == ldems->len )
+          g_ptr_array_add ( ldems, ldem );
+      }
+      last_dems = dems;
+    }
+  }
+  g_ptr_array_sort ( ldems, ldem_compare_resolution );
+
+  // Then from the best DEM first, the positions still without an elevation
+  gdouble *sub_lats = g_new ( gdouble, count );
+  gdouble *sub_lons = g_new ( gdouble, count );
+  guint *sub_index = g_new ( guint, count );
+  gint16 *sub_elevs = g_new ( gint16, count );
+  for ( guint jj = 0; jj < ldems->len && found < count; jj++ ) {
+    LoadedDEM *ldem = g_ptr_array_index ( ldems, jj );
+    gboolean is_ll = ldem->dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS;
+    guint nn = 0;
+    for ( guint ii = 0; ii < count; ii++ ) {
+      if ( elevs[ii] != VIK_DEM_INVALID_ELEVATION )
+        continue;
+      if ( is_ll && (lats[ii] < ldem->bbox.south || lats[ii] > ldem->bbox.north ||
+                     lons[ii] < ldem->bbox.west || lons[ii] > ldem->bbox.east) )
+        continue;
+      sub_lats[nn] = lats[ii];
+      sub_lons[nn] = lons[ii];
+      sub_index[nn] = ii;
+      nn++;
+    }
+    if ( nn && vik_dem_sample_batch ( ldem->dem, sub_lats, sub_lons, nn, sub_elevs ) ) {
+      for ( guint ii = 0; ii < nn; ii++ ) {
+        if ( sub_elevs[ii] != VIK_DEM_INVALID_ELEVATION ) {
+          elevs[sub_index[ii]] = sub_elevs[ii];
+          found++;
+        }
+      }
+    }
+  }
+
+  g_free ( sub_elevs );
+  g_free ( sub_index );
+  g_free ( sub_lons );
+  g_free ( sub_lats );
+  g_ptr_array_free ( ldems, TRUE );
+  g_free ( lons );
+  g_free ( lats );
+  return found;
+}
+
+/**
+ * a_dems_get_elev_by_coords:
+ * @coords: The positions
+ * @count:  The number of positions
+ * @elevs:  Returns the elevation of each position, (VIK_DEM_INVALID_ELEVATION when unknown)
+ *
+ * Get the elevations of many positions at once, as a_dems_get_elev_by_coord()
+ *
+ * Returns: The number of positions with a known elevation
+ */
+guint a_dems_get_elev_by_coords ( const VikCoord *coords, guint count, VikDemInterpol method, gint16 *elevs )
+{
+  guint found = 0;
+  if ( !loaded_dems ) {
+    for ( guint ii = 0; ii < count; ii++ )
+      elevs[ii] = VIK_DEM_INVALID_ELEVATION;
+    return found;
+  }
+
+  G_LOCK ( dems );
+  if ( method == VIK_DEM_INTERPOL_BILINEAR )
+    found = get_elevs_by_coords_bilinear ( coords, count, elevs );
+  else {
+    for ( guint ii = 0; ii < count; ii++ ) {
+      elevs[ii] = get_elev_by_coord ( &coords[ii], method );
+      if ( elevs[ii] != VIK_DEM_INVALID_ELEVATION )
+        found++;
+    }
+  }
+  G_UNLOCK ( dems );
+  return found;
+}
+
+/**
+ * a_dems_get_track_interpol:
+ * @method: The interpolation method otherwise used
+ *
+ * Returns: The interpolation method for elevations along tracks,
+ *  which is bilinear when that is the user's preference
+ */
+VikDemInterpol a_dems_get_track_interpol ( VikDemInterpol method )
+{
+  if ( a_vik_get_dem_track_interpol() == VIK_DEM_TRACK_INTERPOL_BILINEAR )
+    return VIK_DEM_INTERPOL_BILINEAR;
+  return method;
 }
 
 /**
@@ -267,17 +566,36 @@ gboolean a_dems_overlaps_bbox ( LatLonBBox bbox )
     return FALSE;
 
   gboolean ans = FALSE;
-  LatLonBBox dem_bbox;
+
+  gint south = MAX ( -90, (gint)floor(bbox.south) );
+  gint north = MIN ( 89, (gint)floor(bbox.north) );
+  gint west = MAX ( -180, (gint)floor(bbox.west) );
+  gint east = MIN ( 179, (gint)floor(bbox.east) );
+
+  G_LOCK ( dems );
+  // For areas smaller than the number of DEMs loaded, just check the grid cells of the area
+  if ( south <= north && west <= east
+       && (guint)((north - south + 1) * (east - west + 1)) <= g_hash_table_size(loaded_dems) ) {
+    for ( gint lat = south; lat <= north && !ans; lat++ ) {
+      for ( gint lon = west; lon <= east && !ans; lon++ ) {
+        GPtrArray *ldems = g_hash_table_lookup ( dem_grid, GINT_TO_POINTER(DEM_GRID_CELL(lat, lon)) );
+        for ( guint ii = 0; ldems && ii < ldems->len && !ans; ii++ )
+          ans = BBOX_INTERSECT(((LoadedDEM*)g_ptr_array_index(ldems, ii))->bbox, bbox);
+      }
+    }
+    G_UNLOCK ( dems );
+    return ans;
+  }
 
   gpointer key, value;
   GHashTableIter ght_iter;
   g_hash_table_iter_init ( &ght_iter, loaded_dems );
   while ( g_hash_table_iter_next (&ght_iter, &key, &value) ) {
-    dem_bbox = vik_dem_get_bbox ( ((LoadedDEM*)value)->dem );
-    if ( BBOX_INTERSECT(dem_bbox, bbox) ) {
+    if ( BBOX_INTERSECT(((LoadedDEM*)value)->bbox, bbox) ) {
       ans = TRUE;
       break;
     }
   }
+  G_UNLOCK ( dems );
   return ans;
 }
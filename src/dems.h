@@ -31,10 +31,12 @@ typedef enum {
   VIK_DEM_INTERPOL_NONE = 0,
   VIK_DEM_INTERPOL_SIMPLE,
   VIK_DEM_INTERPOL_BEST,
+  VIK_DEM_INTERPOL_BILINEAR,
 } VikDemInterpol;
 
 void a_dems_uninit ();
 VikDEM *a_dems_load(const gchar *filename);
+VikDEM *a_dems_ref ( const gchar *filename );
 void a_dems_unref(const gchar *filename);
 VikDEM *a_dems_get(const gchar *filename);
 int a_dems_load_list ( GList **dems, gpointer threaddata );
@@ -42,6 +44,8 @@ void a_dems_list_free ( GList *dems );
 GList *a_dems_list_copy ( GList *dems );
 gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord );
 gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method);
+guint a_dems_get_elev_by_coords ( const VikCoord *coords, guint count, VikDemInterpol method, gint16 *elevs );
+VikDemInterpol a_dems_get_track_interpol ( VikDemInterpol method );
 
 gboolean a_dems_overlaps_bbox ( LatLonBBox bbox );
 
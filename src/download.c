@@ -333,16 +333,40 @@ static void set_etag(const char *fn, const char *fntmp, CurlDownloadOptions *cdo
   }
 }
 
-static DownloadResult_t download( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *options, gboolean ftp, void *handle)
-{
-  FILE *f;
+/**
+ * The state of a single download between preparing for it and finishing it
+ */
+typedef struct {
+  gchar *fn;
   gchar *tmpfilename;
-  gboolean failure = FALSE;
-  CurlDownloadOptions cdo = {0, NULL, NULL};
+  FILE *f;
+  gboolean file_exists;
+  DownloadFileOptions *options;
+  CurlDownloadOptions cdo;
+} DownloadState;
+
+static void download_state_free ( DownloadState *ds )
+{
+  if ( ds->options != NULL && ds->options->use_etag ) {
+    g_free ( ds->cdo.etag );
+    g_free ( ds->cdo.new_etag );
+  }
+  g_free ( ds->tmpfilename );
+  g_free ( ds->fn );
+}
+
+/**
+ * Check whether the download is needed and if so open the temporary file to download into
+ *
+ * Returns DOWNLOAD_SUCCESS if the download should proceed, otherwise the result to return
+ */
+static DownloadResult_t download_prepare ( const char *hostname, const char *uri, DownloadState *ds )
+{
+  DownloadFileOptions *options = ds->options;
 
   /* Check file */
-  gboolean file_exists = g_file_test ( fn, G_FILE_TEST_EXISTS );
-  if ( file_exists )
+  ds->file_exists = g_file_test ( ds->fn, G_FILE_TEST_EXISTS );
+  if ( ds->file_exists )
   {
     // Options should always be specified when request downloading
     //  a file that already exists (i.e. map tiles)
@@ -352,7 +376,7 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
     time_t file_age = options->expiry_age;
     /* Get the modified time of this file */
     GStatBuf buf;
-    (void)g_stat ( fn, &buf );
+    (void)g_stat ( ds->fn, &buf );
     time_t file_time = buf.st_mtime;
     if ( (time(NULL) - file_time) < file_age ) {
       /* File cache is too recent, so return */
@@ -360,15 +384,15 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
     }
 
     if ( options->check_file_server_time ) {
-      cdo.time_condition = file_time;
+      ds->cdo.time_condition = file_time;
     }
 
     if ( options->use_etag ) {
-      get_etag(fn, &cdo);
+      get_etag(ds->fn, &ds->cdo);
     }
 
   } else {
-    gchar *dir = g_path_get_dirname ( fn );
+    gchar *dir = g_path_get_dirname ( ds->fn );
     if ( g_mkdir_with_parents ( dir , 0777 ) != 0)
       g_warning ("%s: Failed to mkdir %s", __FUNCTION__, dir );
     g_free ( dir );
@@ -380,27 +404,32 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
     return DOWNLOAD_PARAMETERS_ERROR;
   }
 
-  tmpfilename = g_strdup_printf("%s.tmp", fn);
+  gchar *tmpfilename = g_strdup_printf("%s.tmp", ds->fn);
   if (!lock_file ( tmpfilename ) )
   {
     g_debug("%s: Couldn't take lock on temporary file \"%s\"", __FUNCTION__, tmpfilename);
     g_free ( tmpfilename );
-    if (options->use_etag)
-      g_free ( cdo.etag );
     return DOWNLOAD_FILE_WRITE_ERROR;
   }
-  f = g_fopen ( tmpfilename, "w+b" );  /* truncate file and open it */
-  if ( ! f ) {
+  ds->f = g_fopen ( tmpfilename, "w+b" );  /* truncate file and open it */
+  if ( ! ds->f ) {
     g_warning("Couldn't open temporary file \"%s\": %s", tmpfilename, g_strerror(errno));
+    unlock_file ( tmpfilename );
     g_free ( tmpfilename );
-    if (options->use_etag)
-      g_free ( cdo.etag );
     return DOWNLOAD_FILE_WRITE_ERROR;
   }
+  // NB The locked filename must be the same pointer when unlocking
+  ds->tmpfilename = tmpfilename;
+  return DOWNLOAD_SUCCESS;
+}
 
-  /* Call the backend function */
-  CURL_download_t ret = curl_download_get_url ( hostname, uri, f, options, ftp, &cdo, handle );
-
+/**
+ * Process the downloaded temporary file according to the result of the transfer
+ */
+static DownloadResult_t download_finish ( DownloadState *ds, CURL_download_t ret )
+{
+  DownloadFileOptions *options = ds->options;
+  gboolean failure = FALSE;
   DownloadResult_t result = DOWNLOAD_SUCCESS;
 
   if (ret != CURL_DOWNLOAD_NO_ERROR && ret != CURL_DOWNLOAD_NO_NEWER_FILE) {
@@ -409,67 +438,72 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
     result = DOWNLOAD_HTTP_ERROR;
   }
 
-  if (!failure && options != NULL && options->check_file != NULL && ! options->check_file(f)) {
+  if (!failure && options != NULL && options->check_file != NULL && ! options->check_file(ds->f)) {
     g_debug("%s: file content checking failed", __FUNCTION__);
     failure = TRUE;
     result = DOWNLOAD_CONTENT_ERROR;
   }
 
-  fclose ( f );
-  f = NULL;
+  fclose ( ds->f );
+  ds->f = NULL;
 
   if (failure)
   {
-    g_warning(_("Download error: %s"), fn);
-    if ( g_remove ( tmpfilename ) != 0 )
-      g_warning( ("Failed to remove: %s"), tmpfilename);
-    unlock_file ( tmpfilename );
-    g_free ( tmpfilename );
-    if ( options != NULL && options->use_etag ) {
-      g_free ( cdo.etag );
-      g_free ( cdo.new_etag );
-    }
+    g_warning(_("Download error: %s"), ds->fn);
+    if ( g_remove ( ds->tmpfilename ) != 0 )
+      g_warning( ("Failed to remove: %s"), ds->tmpfilename);
+    unlock_file ( ds->tmpfilename );
     return result;
   }
 
   if (ret == CURL_DOWNLOAD_NO_NEWER_FILE)  {
-    (void)g_remove ( tmpfilename );
+    (void)g_remove ( ds->tmpfilename );
      // update mtime of local copy
      // Not security critical, thus potential Time of Check Time of Use race condition is not bad
      // coverity[toctou]
-     if ( g_utime ( fn, NULL ) != 0 )
-       g_warning ( "%s couldn't set time on: %s", __FUNCTION__, fn );
+     if ( g_utime ( ds->fn, NULL ) != 0 )
+       g_warning ( "%s couldn't set time on: %s", __FUNCTION__, ds->fn );
   } else {
     if ( options != NULL && options->convert_file )
-      options->convert_file ( tmpfilename );
+      options->convert_file ( ds->tmpfilename );
 
     if ( options != NULL && options->use_etag ) {
-      if ( cdo.new_etag ) {
+      if ( ds->cdo.new_etag ) {
         /* server returned an etag value */
-        set_etag(fn, tmpfilename, &cdo);
+        set_etag(ds->fn, ds->tmpfilename, &ds->cdo);
       }
     }
 
     // Remove existing file if it exists and then replace with the newly downloaded file
     // Potential TOCTOU, but we shouldn't be requesting downloads of the same file multiple times anyway.
-    if ( file_exists )
-      if ( g_remove ( fn ) )
-        g_warning ( "%s: failed to remove: %s", __FUNCTION__, fn );
+    if ( ds->file_exists )
+      if ( g_remove ( ds->fn ) )
+        g_warning ( "%s: failed to remove: %s", __FUNCTION__, ds->fn );
 
      /* move completely-downloaded file to permanent location */
-     if ( g_rename ( tmpfilename, fn ) )
-        g_warning ("%s: file rename failed [%s] to [%s]", __FUNCTION__, tmpfilename, fn );
+     if ( g_rename ( ds->tmpfilename, ds->fn ) )
+        g_warning ("%s: file rename failed [%s] to [%s]", __FUNCTION__, ds->tmpfilename, ds->fn );
   }
-  unlock_file ( tmpfilename );
-  g_free ( tmpfilename );
+  unlock_file ( ds->tmpfilename );
 
-  if ( options != NULL && options->use_etag ) {
-    g_free ( cdo.etag );
-    g_free ( cdo.new_etag );
-  }
   return DOWNLOAD_SUCCESS;
 }
 
+static DownloadResult_t download( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *options, gboolean ftp, void *handle)
+{
+  DownloadState ds = { g_strdup(fn), NULL, NULL, FALSE, options, {0, NULL, NULL} };
+
+  DownloadResult_t result = download_prepare ( hostname, uri, &ds );
+  if ( result == DOWNLOAD_SUCCESS ) {
+    /* Call the backend function */
+    CURL_download_t ret = curl_download_get_url ( hostname, uri, ds.f, options, ftp, &ds.cdo, handle );
+    result = download_finish ( &ds, ret );
+  }
+
+  download_state_free ( &ds );
+  return result;
+}
+
 /**
  * uri: like "/uri.html?whatever"
  * only reason for the "wrapper" is so we can do redirects.
@@ -494,6 +528,87 @@ void a_download_handle_cleanup ( void *handle )
   curl_download_handle_cleanup ( handle );
 }
 
+typedef struct {
+  DownloadState ds;
+  DownloadDoneFunc done;
+  gpointer user_data;
+} DownloadMultiRequest;
+
+static void download_multi_done ( CURL_download_t ret, gpointer user_data )
+{
+  DownloadMultiRequest *dmr = (DownloadMultiRequest*)user_data;
+  DownloadResult_t result = download_finish ( &dmr->ds, ret );
+  dmr->done ( result, dmr->user_data );
+  download_state_free ( &dmr->ds );
+  if ( dmr->ds.options )
+    a_download_file_options_free ( dmr->ds.options );
+  g_free ( dmr );
+}
+
+/**
+ * a_download_multi_init:
+ * @max_transfers: Maximum number of simultaneous downloads (0 for the default)
+ * @interval_ms:   Minimum time between starting each download (milliseconds)
+ *
+ * Create a handle for performing multiple downloads concurrently.
+ * The handle must only be used in the thread that created it.
+ */
+void *a_download_multi_init ( guint max_transfers, guint interval_ms )
+{
+  return curl_download_multi_init ( max_transfers, interval_ms );
+}
+
+/**
+ * a_http_download_get_url_multi:
+ * @opt:  Download options - this takes ownership and they will be freed via a_download_file_options_free()
+ * @done: Function called with the result, which may be called before this function returns
+ *         (e.g. when the download is not required)
+ *
+ * Queue a download as per a_http_download_get_url(),
+ *  which is progressed by calling a_download_multi_perform()
+ */
+void a_http_download_get_url_multi ( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *opt, void *multi, DownloadDoneFunc done, gpointer user_data )
+{
+  DownloadMultiRequest *dmr = g_malloc0 ( sizeof(DownloadMultiRequest) );
+  dmr->ds.fn = g_strdup ( fn );
+  dmr->ds.options = opt;
+  dmr->done = done;
+  dmr->user_data = user_data;
+
+  DownloadResult_t result = download_prepare ( hostname, uri, &dmr->ds );
+  if ( result != DOWNLOAD_SUCCESS ) {
+    done ( result, user_data );
+    download_state_free ( &dmr->ds );
+    if ( opt )
+      a_download_file_options_free ( opt );
+    g_free ( dmr );
+    return;
+  }
+
+  curl_download_multi_add ( multi, hostname, uri, dmr->ds.f, opt, FALSE, &dmr->ds.cdo, download_multi_done, dmr );
+}
+
+/**
+ * a_download_multi_perform:
+ * @timeout_ms: Maximum time to wait for activity
+ *
+ * Returns: The number of downloads still outstanding
+ */
+guint a_download_multi_perform ( void *multi, gint timeout_ms )
+{
+  return curl_download_multi_perform ( multi, timeout_ms );
+}
+
+/**
+ * a_download_multi_cleanup:
+ *
+ * Any outstanding downloads are aborted (with their done functions called with an error result)
+ */
+void a_download_multi_cleanup ( void *multi )
+{
+  curl_download_multi_cleanup ( multi );
+}
+
 /**
  * a_download_url_to_tmp_file:
  * @uri:         The URI (Uniform Resource Identifier)
@@ -134,6 +134,13 @@ DownloadResult_t a_ftp_download_get_url ( const char *hostname, const char *uri,
 void *a_download_handle_init ();
 void a_download_handle_cleanup ( void *handle );
 
+// Concurrent downloads
+typedef void (*DownloadDoneFunc) ( DownloadResult_t result, gpointer user_data );
+void *a_download_multi_init ( guint max_transfers, guint interval_ms );
+void a_http_download_get_url_multi ( const char *hostname, const char *uri, const char *fn, DownloadFileOptions *opt, void *multi, DownloadDoneFunc done, gpointer user_data );
+guint a_download_multi_perform ( void *multi, gint timeout_ms );
+void a_download_multi_cleanup ( void *multi );
+
 gchar *a_download_uri_to_tmp_file ( const gchar *uri, DownloadFileOptions *options );
 
 G_END_DECLS
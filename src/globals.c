@@ -152,6 +152,7 @@ static VikLayerParam io_prefs[] = {
 static gchar * params_vik_fileref[] = {N_("Absolute"), N_("Relative"), NULL};
 static VikLayerParamScale params_recent_files[] = { {-1, 25, 1, 0} };
 static gchar * params_pos_type[] = {N_("None"), N_("Bottom"), N_("Middle"), N_("Top"), NULL};
+static gchar * params_dem_track_interpol[] = {N_("Best"), N_("Bilinear"), NULL};
 
 // Seemingly GTK's default for the number of recent files
 static VikLayerParamData rcnt_files_default ( void ) { return VIK_LPD_INT(10); }
@@ -178,6 +179,8 @@ static VikLayerParam prefs_advanced[] = {
     N_("Select trackpoint from mouse over graph on main display"), vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "warn_unsaved_changes_on_exit", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Warn Unsaved Changes on Exit:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "select_newly_created_layer", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Select Newly Created Layer:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, N_("Automatically select the newly created layer"), vik_lpd_true_default, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "dem_track_interpolation", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("DEM Interpolation for Tracks:"), VIK_LAYER_WIDGET_COMBOBOX, params_dem_track_interpol, NULL,
+    N_("How elevations between DEM samples are worked out when applying DEM data to tracks and drawing their DEM profiles. Bilinear is faster for long tracks."), NULL, NULL, NULL },
 };
 
 static gchar * params_startup_methods[] = {N_("Home Location"), N_("Last Location"), N_("Specified File"), N_("Auto Location"), NULL};
@@ -459,6 +462,11 @@ gboolean a_vik_get_auto_trackpoint_select ( )
   return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "auto_trackpoint_select")->b;
 }
 
+vik_dem_track_interpol_t a_vik_get_dem_track_interpol ( )
+{
+  return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "dem_track_interpolation")->u;
+}
+
 // Startup Options
 gboolean a_vik_get_restore_window_state ( )
 {
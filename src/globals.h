@@ -283,6 +283,13 @@ gboolean a_vik_get_select_double_click_to_zoom ( );
 
 gboolean a_vik_get_auto_trackpoint_select ( );
 
+typedef enum {
+  VIK_DEM_TRACK_INTERPOL_BEST,
+  VIK_DEM_TRACK_INTERPOL_BILINEAR,
+} vik_dem_track_interpol_t;
+
+vik_dem_track_interpol_t a_vik_get_dem_track_interpol ( );
+
 gboolean a_vik_get_restore_window_state ( );
 
 gboolean a_vik_get_add_default_map_layer ( );
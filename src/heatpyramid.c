@@ -0,0 +1,361 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "heatpyramid.h"
+
+#define TILE_SIZE 256
+#define SHIFT 4
+#define SIZE (1 << SHIFT)
+
+typedef struct {
+  gint64 key;   // Of the position, as chunk_key()
+  guint zoom;
+  gint cx, cy;  // Position in chunks, i.e. of its north west pixel divided by the chunk size
+  guint32 values[SIZE*SIZE]; // Of each pixel as [y*SIZE+x]
+} hp_chunk_t;
+
+struct _HeatPyramid {
+  gint ref_count;
+  GRWLock lock;
+  guint max_zoom;
+  GHashTable *chunks;   // Of hp_chunk_t keyed by their key
+  hp_chunk_t **recent;  // The chunk last added to on each zoom level, as points usually follow on from each other
+  guint32 *max;         // Highest heat on each zoom level
+  gboolean *max_valid;  // Whether the highest heat is still known, as it isn't once heat has been taken away
+};
+
+// NB Positions are never negative, and even at zoom level 20 the chunks are within 24 bits
+static inline gint64 chunk_key ( guint zoom, gint cx, gint cy )
+{
+  return ((gint64)zoom << 48) | ((gint64)cy << 24) | cx;
+}
+
+static inline hp_chunk_t *get_chunk ( HeatPyramid *hp, guint zoom, gint cx, gint cy )
+{
+  gint64 key = chunk_key ( zoom, cx, cy );
+  return g_hash_table_lookup ( hp->chunks, &key );
+}
+
+static hp_chunk_t *get_chunk_new ( HeatPyramid *hp, guint zoom, gint cx, gint cy )
+{
+  hp_chunk_t *chunk = get_chunk ( hp, zoom, cx, cy );
+  if ( !chunk ) {
+    chunk = g_malloc0 ( sizeof(hp_chunk_t) );
+    chunk->zoom = zoom;
+    chunk->cx = cx;
+    chunk->cy = cy;
+    chunk->key = chunk_key ( zoom, cx, cy );
+    g_hash_table_insert ( hp->chunks, &chunk->key, chunk );
+  }
+  return chunk;
+}
+
+/**
+ * heat_pyramid_new:
+ * @max_zoom: The most detailed zoom level (in the manner of OSM tiles, thus 0 is the whole world in one tile)
+ */
+HeatPyramid *heat_pyramid_new ( guint max_zoom )
+{
+  HeatPyramid *hp = g_malloc0 ( sizeof(HeatPyramid) );
+  hp->ref_count = 1;
+  g_rw_lock_init ( &hp->lock );
+  hp->max_zoom = max_zoom;
+  hp->chunks = g_hash_table_new_full ( g_int64_hash, g_int64_equal, NULL, g_free );
+  hp->recent = g_malloc0_n ( max_zoom + 1, sizeof(hp_chunk_t*) );
+  hp->max = g_malloc0_n ( max_zoom + 1, sizeof(guint32) );
+  hp->max_valid = g_malloc0_n ( max_zoom + 1, sizeof(gboolean) );
+  for ( guint zz = 0; zz <= max_zoom; zz++ )
+    hp->max_valid[zz] = TRUE;
+  return hp;
+}
+
+HeatPyramid *heat_pyramid_ref ( HeatPyramid *hp )
+{
+  g_atomic_int_inc ( &hp->ref_count );
+  return hp;
+}
+
+void heat_pyramid_unref ( HeatPyramid *hp )
+{
+  if ( !hp )
+    return;
+  if ( !g_atomic_int_dec_and_test ( &hp->ref_count ) )
+    return;
+  g_hash_table_destroy ( hp->chunks );
+  g_rw_lock_clear ( &hp->lock );
+  g_free ( hp->recent );
+  g_free ( hp->max );
+  g_free ( hp->max_valid );
+  g_free ( hp );
+}
+
+void heat_pyramid_clear ( HeatPyramid *hp )
+{
+  g_rw_lock_writer_lock ( &hp->lock );
+  g_hash_table_remove_all ( hp->chunks );
+  for ( guint zz = 0; zz <= hp->max_zoom; zz++ ) {
+    hp->recent[zz] = NULL;
+    hp->max[zz] = 0;
+    hp->max_valid[zz] = TRUE;
+  }
+  g_rw_lock_writer_unlock ( &hp->lock );
+}
+
+guint heat_pyramid_get_max_zoom ( HeatPyramid *hp )
+{
+  return hp->max_zoom;
+}
+
+/**
+ * heat_pyramid_size:
+ *
+ * Returns: The number of chunks (over all zoom levels), as an indication of the memory used
+ */
+guint heat_pyramid_size ( HeatPyramid *hp )
+{
+  g_rw_lock_reader_lock ( &hp->lock );
+  guint size = g_hash_table_size ( hp->chunks );
+  g_rw_lock_reader_unlock ( &hp->lock );
+  return size;
+}
+
+/**
+ * Add the heat to the pixel
+ */
+static inline void add_value ( HeatPyramid *hp, guint32 *value, guint zoom, guint32 count )
+{
+  *value += count;
+  if ( *value > hp->max[zoom] )
+    hp->max[zoom] = *value;
+}
+
+/**
+ * heat_pyramid_add:
+ * @x: Pixel position at the maximum zoom level
+ * @y: Pixel position at the maximum zoom level
+ * @count: The heat to add, e.g. the number of points in the pixel
+ *
+ * NB Not for use on a pyramid shared with other threads, instead add to another one and then merge it in.
+ */
+void heat_pyramid_add ( HeatPyramid *hp, gint x, gint y, guint32 count )
+{
+  gint limit = TILE_SIZE << hp->max_zoom;
+  if ( x < 0 || y < 0 || x >= limit || y >= limit )
+    return;
+  for ( guint zz = 0; zz <= hp->max_zoom; zz++ ) {
+    guint shift = hp->max_zoom - zz;
+    gint px = x >> shift;
+    gint py = y >> shift;
+    hp_chunk_t *chunk = hp->recent[zz];
+    if ( !chunk || chunk->cx != (px >> SHIFT) || chunk->cy != (py >> SHIFT) ) {
+      chunk = get_chunk_new ( hp, zz, px >> SHIFT, py >> SHIFT );
+      hp->recent[zz] = chunk;
+    }
+    add_value ( hp, &chunk->values[(py & (SIZE-1)) * SIZE + (px & (SIZE-1))], zz, count );
+  }
+}
+
+/**
+ * Work out again the highest heat on those zoom levels where it is no longer known
+ * NB The writer lock must be held, unless the pyramid is not shared
+ */
+static void update_max ( HeatPyramid *hp )
+{
+  gboolean any = FALSE;
+  for ( guint zz = 0; zz <= hp->max_zoom; zz++ ) {
+    if ( !hp->max_valid[zz] ) {
+      hp->max[zz] = 0;
+      any = TRUE;
+    }
+  }
+  if ( !any )
+    return;
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, hp->chunks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    hp_chunk_t *chunk = value;
+    if ( hp->max_valid[chunk->zoom] )
+      continue;
+    guint32 max = hp->max[chunk->zoom];
+    for ( guint ii = 0; ii < SIZE*SIZE; ii++ )
+      if ( chunk->values[ii] > max )
+        max = chunk->values[ii];
+    hp->max[chunk->zoom] = max;
+  }
+  for ( guint zz = 0; zz <= hp->max_zoom; zz++ )
+    hp->max_valid[zz] = TRUE;
+}
+
+/**
+ * heat_pyramid_merge:
+ * @dest: Which must have the same maximum zoom level as @hp
+ * @hp: The heat to add into @dest, which must not be shared with other threads
+ */
+void heat_pyramid_merge ( HeatPyramid *dest, HeatPyramid *hp )
+{
+  g_return_if_fail ( dest->max_zoom == hp->max_zoom );
+  g_rw_lock_writer_lock ( &dest->lock );
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, hp->chunks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    hp_chunk_t *chunk = value;
+    hp_chunk_t *dchunk = get_chunk_new ( dest, chunk->zoom, chunk->cx, chunk->cy );
+    for ( guint ii = 0; ii < SIZE*SIZE; ii++ )
+      if ( chunk->values[ii] )
+        add_value ( dest, &dchunk->values[ii], chunk->zoom, chunk->values[ii] );
+  }
+  g_rw_lock_writer_unlock ( &dest->lock );
+}
+
+/**
+ * heat_pyramid_subtract:
+ * @dest: Which must have the same maximum zoom level as @hp
+ * @hp: The heat to take away from @dest, which must have been added to it before
+ *
+ * Chunks left without any heat are freed.
+ */
+void heat_pyramid_subtract ( HeatPyramid *dest, HeatPyramid *hp )
+{
+  g_return_if_fail ( dest->max_zoom == hp->max_zoom );
+  g_rw_lock_writer_lock ( &dest->lock );
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, hp->chunks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    hp_chunk_t *chunk = value;
+    hp_chunk_t *dchunk = get_chunk ( dest, chunk->zoom, chunk->cx, chunk->cy );
+    if ( !dchunk ) {
+      g_critical ( "%s: taking away heat that was never added", __FUNCTION__ );
+      continue;
+    }
+    guint32 left = 0;
+    for ( guint ii = 0; ii < SIZE*SIZE; ii++ ) {
+      if ( chunk->values[ii] > dchunk->values[ii] ) {
+        g_critical ( "%s: taking away heat that was never added", __FUNCTION__ );
+        dchunk->values[ii] = 0;
+      }
+      else
+        dchunk->values[ii] -= chunk->values[ii];
+      left |= dchunk->values[ii];
+    }
+    dest->max_valid[chunk->zoom] = FALSE;
+    if ( !left ) {
+      if ( dest->recent[chunk->zoom] == dchunk )
+        dest->recent[chunk->zoom] = NULL;
+      g_hash_table_remove ( dest->chunks, &dchunk->key );
+    }
+  }
+  update_max ( dest );
+  g_rw_lock_writer_unlock ( &dest->lock );
+}
+
+/**
+ * heat_pyramid_get_max:
+ *
+ * Returns: The highest heat of any pixel at the zoom level,
+ *  which for those beyond the maximum zoom level is that of the maximum
+ */
+guint32 heat_pyramid_get_max ( HeatPyramid *hp, guint zoom )
+{
+  zoom = MIN ( zoom, hp->max_zoom );
+  g_rw_lock_reader_lock ( &hp->lock );
+  guint32 max = hp->max[zoom];
+  g_rw_lock_reader_unlock ( &hp->lock );
+  return max;
+}
+
+static inline guint32 get_value ( HeatPyramid *hp, guint zoom, gint px, gint py )
+{
+  if ( px < 0 || py < 0 )
+    return 0;
+  hp_chunk_t *chunk = get_chunk ( hp, zoom, px >> SHIFT, py >> SHIFT );
+  if ( !chunk )
+    return 0;
+  return chunk->values[(py & (SIZE-1)) * SIZE + (px & (SIZE-1))];
+}
+
+/**
+ * heat_pyramid_read:
+ * @x: Pixel position at the zoom level of the north west corner of the area
+ * @y: Pixel position at the zoom level of the north west corner of the area
+ * @values: Set to the heat of each pixel of the area, as [y*width+x]
+ *
+ * Beyond the maximum zoom level, the heat of each pixel of the maximum zoom level
+ *  is put in the middle of the pixels it covers (with the others having none).
+ *
+ * Returns: FALSE if there is no heat anywhere in the area
+ */
+gboolean heat_pyramid_read ( HeatPyramid *hp, guint zoom, gint x, gint y, guint width, guint height, guint32 *values )
+{
+  gboolean found = FALSE;
+  memset ( values, 0, width * height * sizeof(guint32) );
+  g_rw_lock_reader_lock ( &hp->lock );
+  if ( zoom <= hp->max_zoom ) {
+    for ( guint yy = 0; yy < height; yy++ ) {
+      guint32 *row = values + yy * width;
+      gint py = y + yy;
+      if ( py < 0 )
+        continue;
+      // A run of the row at a time, for each chunk it passes through
+      for ( guint xx = 0; xx < width; ) {
+        gint px = x + xx;
+        if ( px < 0 ) {
+          xx++;
+          continue;
+        }
+        guint run = MIN ( width - xx, SIZE - (px & (SIZE-1)) );
+        hp_chunk_t *chunk = get_chunk ( hp, zoom, px >> SHIFT, py >> SHIFT );
+        if ( chunk ) {
+          const guint32 *src = &chunk->values[(py & (SIZE-1)) * SIZE + (px & (SIZE-1))];
+          memcpy ( &row[xx], src, run * sizeof(guint32) );
+          for ( guint ii = 0; ii < run && !found; ii++ )
+            found = src[ii] != 0;
+        }
+        xx += run;
+      }
+    }
+  }
+  else {
+    guint dz = zoom - hp->max_zoom;
+    gint step = 1 << dz;
+    gint half = step / 2;
+    // The first pixels which are in the middle of a pixel of the maximum zoom level
+    guint x0 = (half - x) & (step - 1);
+    guint y0 = (half - y) & (step - 1);
+    for ( guint yy = y0; yy < height; yy += step ) {
+      for ( guint xx = x0; xx < width; xx += step ) {
+        gint px = x + (gint)xx;
+        gint py = y + (gint)yy;
+        guint32 value = (px < 0 || py < 0) ? 0 : get_value ( hp, hp->max_zoom, px >> dz, py >> dz );
+        values[yy * width + xx] = value;
+        if ( value )
+          found = TRUE;
+      }
+    }
+  }
+  g_rw_lock_reader_unlock ( &hp->lock );
+  return found;
+}
@@ -0,0 +1,59 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_HEATPYRAMID_H
+#define __VIKING_HEATPYRAMID_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * Heat (the number of track points) of each pixel of the web mercator tiles,
+ *  for every zoom level from 0 up to a maximum.
+ *
+ * Positions are the pixels of the maximum zoom level (with 256 pixels per tile),
+ *  each of which adds to the pixel containing it on all the other zoom levels.
+ * Held sparsely as 16x16 pixel chunks in a hash table,
+ *  as tracks only pass through a small part of each chunk at the detailed zoom levels.
+ * Heat is kept as exact counts, so it can be taken away again to leave just what remains.
+ *
+ * Reading from a pyramid (and merging into it) may be done by several threads at the same time,
+ *  but heat_pyramid_add() is only for a pyramid that is not shared.
+ */
+typedef struct _HeatPyramid HeatPyramid;
+
+HeatPyramid *heat_pyramid_new ( guint max_zoom );
+HeatPyramid *heat_pyramid_ref ( HeatPyramid *hp );
+void heat_pyramid_unref ( HeatPyramid *hp );
+void heat_pyramid_clear ( HeatPyramid *hp );
+
+guint heat_pyramid_get_max_zoom ( HeatPyramid *hp );
+guint heat_pyramid_size ( HeatPyramid *hp );
+
+void heat_pyramid_add ( HeatPyramid *hp, gint x, gint y, guint32 count );
+void heat_pyramid_merge ( HeatPyramid *dest, HeatPyramid *hp );
+void heat_pyramid_subtract ( HeatPyramid *dest, HeatPyramid *hp );
+
+guint32 heat_pyramid_get_max ( HeatPyramid *hp, guint zoom );
+gboolean heat_pyramid_read ( HeatPyramid *hp, guint zoom, gint x, gint y, guint width, guint height, guint32 *values );
+
+G_END_DECLS
+
+#endif
@@ -27,6 +27,7 @@
 #include "viking.h"
 #include "icons/icons.h"
 #include "mapcache.h"
+#include "tileindex.h"
 #include "background.h"
 #include "dems.h"
 #include "babel.h"
@@ -201,6 +202,7 @@ int main( int argc, char *argv[] )
   maps_layer_init ();
   vik_dem_layer_init ();
   a_mapcache_init ();
+  a_tileindex_init ();
   a_background_init ();
 
   a_toolbar_init();
@@ -286,6 +288,7 @@ int main( int argc, char *argv[] )
   a_toolbar_uninit ();
   a_background_uninit ();
   maps_layer_uninit ();
+  a_tileindex_uninit ();
   a_mapcache_uninit ();
   a_dems_uninit ();
   a_layer_defaults_uninit ();
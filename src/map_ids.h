@@ -30,6 +30,8 @@
 #define MAP_ID_EXPEDIA 5
 
 #define MAP_ID_MAPNIK_RENDER 7
+#define MAP_ID_DEM_RENDER 8
+#define MAP_ID_HEATMAP_RENDER 9
 
 // Mostly OSM related - except the Blue Marble value
 #define MAP_ID_OSM_MAPNIK 13
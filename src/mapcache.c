@@ -24,124 +24,289 @@
 
 #include <glib/gi18n.h>
 #include <string.h>
+#include <math.h>
 #include "globals.h"
 #include "mapcache.h"
 #include "preferences.h"
 #include "vik_compat.h"
 
-#define MC_KEY_SIZE 64
+// The cache is split into a number of independent shards, each with its own lock,
+//  so lookups from the drawing and the various background threads don't all contend on a single lock
+#define MC_NUM_SHARDS 16
 
-typedef struct _List {
-  struct _List *next;
-  gchar *key;
-} List;
-
-/* a circular linked list, a pointer to the tail, and the tail points to the head */
-/* this is so we can free the last */
-static List *queue_tail = NULL;
-static int queue_count = 0;
-
-static guint32 cache_size = 0;
-static guint32 max_cache_size = VIK_CONFIG_MAPCACHE_SIZE * 1024 * 1024;
-
-static GHashTable *cache = NULL;
+// Default size (MB) of the second tier holding the original encoded (PNG/JPEG/etc...) tile data
+#define MC_ENCODED_SIZE_DEFAULT 64
 
 typedef struct {
-  GdkPixbuf *pixbuf;
+  gint x;
+  gint y;
+  gint z;
+  gint zoom;
+  guint name_hash;
+  guint16 type;
+  guint8 alpha;
+  gint xshrink; // Shrinkfactors quantized to 1/1000th
+  gint yshrink;
+} mc_key_t;
+
+typedef struct _cache_item_t {
+  mc_key_t key;
+  GdkPixbuf *pixbuf; // Only used in the pixbuf tier
+  GBytes *bytes;     // Only used in the encoded tier
   mapcache_extra_t extra;
+  guint size;
+  gint generation; // Generation of the map type when added
+  // Intrusive doubly linked list, head is the least recently used item in the tier
+  struct _cache_item_t *prev;
+  struct _cache_item_t *next;
 } cache_item_t;
 
-static GMutex *mc_mutex = NULL;
+typedef struct {
+  GHashTable *items; // Keys are owned by the items
+  cache_item_t *head;
+  cache_item_t *tail;
+  guint32 size;
+  gboolean encoded;
+} mc_tier_t;
+
+typedef struct {
+  GMutex *mutex;
+  mc_tier_t pixbufs;
+  // Encoded tiles are keyed by the tile identity only (i.e. alpha 0 and shrinkfactors of 1.0)
+  mc_tier_t encoded;
+  GHashTable *stats; // Per map type mapcache_stats_t
+} mc_shard_t;
+
+static mc_shard_t shards[MC_NUM_SHARDS];
+
+static guint32 max_cache_size = VIK_CONFIG_MAPCACHE_SIZE * 1024 * 1024;
+static guint32 max_encoded_size = MC_ENCODED_SIZE_DEFAULT * 1024 * 1024;
 
-#define HASHKEY_FORMAT_STRING "%d-%d-%d-%d-%d-%d-%d-%.3f-%.3f"
-#define HASHKEY_FORMAT_STRING_NOSHRINK_NOR_ALPHA "%d-%d-%d-%d-%d-%d-"
-#define HASHKEY_FORMAT_STRING_TYPE "%d-"
+// Flushing a map type simply increments its generation,
+//  any items from previous generations are then treated as not being in the cache
+//  and get removed when next encountered (or evicted in the normal way)
+static gint type_generation[G_MAXUINT16+1];
 
 static VikLayerParamScale params_scales[] = {
   /* min, max, step, digits (decimal places) */
  { 1, 4096, 4, 0 },
+ { 0, 1024, 4, 0 },
 };
 
 static VikLayerParamData mcs_default ( void ) { return VIK_LPD_UINT(VIK_CONFIG_MAPCACHE_SIZE); }
+static VikLayerParamData mces_default ( void ) { return VIK_LPD_UINT(MC_ENCODED_SIZE_DEFAULT); }
 
 static VikLayerParam prefs[] = {
-  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "mapcache_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Map cache memory size (MB):"), VIK_LAYER_WIDGET_HSCALE, params_scales, NULL, NULL, mcs_default, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "mapcache_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Map cache memory size (MB):"), VIK_LAYER_WIDGET_HSCALE, &params_scales[0], NULL, NULL, mcs_default, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_NAMESPACE "mapcache_encoded_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Map cache compressed memory size (MB):"), VIK_LAYER_WIDGET_HSCALE, &params_scales[1], NULL,
+    N_("Additional memory for keeping tiles in their original file format, which is much smaller than the displayable image. Set to 0 to disable."), mces_default, NULL, NULL },
 };
 
+static void key_init ( mc_key_t *key, gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name )
+{
+  key->x = x;
+  key->y = y;
+  key->z = z;
+  key->zoom = zoom;
+  key->name_hash = name ? g_str_hash ( name ) : 0;
+  key->type = type;
+  key->alpha = alpha;
+  key->xshrink = (gint)round ( xshrinkfactor * 1000 );
+  key->yshrink = (gint)round ( yshrinkfactor * 1000 );
+}
+
+/**
+ * The tile identity - i.e. ignoring alpha and shrinkfactors
+ * This determines the shard, so all variants of a tile are in the same shard
+ */
+static guint key_tile_hash ( const mc_key_t *key )
+{
+  guint hh = key->type;
+  hh = hh * 31 + key->x;
+  hh = hh * 31 + key->y;
+  hh = hh * 31 + key->z;
+  hh = hh * 31 + key->zoom;
+  hh = hh * 31 + key->name_hash;
+  return hh;
+}
+
+static gboolean key_tile_equal ( const mc_key_t *k1, const mc_key_t *k2 )
+{
+  return k1->x == k2->x && k1->y == k2->y && k1->z == k2->z && k1->zoom == k2->zoom &&
+         k1->type == k2->type && k1->name_hash == k2->name_hash;
+}
+
+static guint key_hash ( gconstpointer ptr )
+{
+  const mc_key_t *key = ptr;
+  guint hh = key_tile_hash ( key );
+  hh = hh * 31 + key->alpha;
+  hh = hh * 31 + key->xshrink;
+  hh = hh * 31 + key->yshrink;
+  return hh;
+}
+
+static gboolean key_equal ( gconstpointer ptr1, gconstpointer ptr2 )
+{
+  const mc_key_t *k1 = ptr1;
+  const mc_key_t *k2 = ptr2;
+  return key_tile_equal ( k1, k2 ) &&
+         k1->alpha == k2->alpha && k1->xshrink == k2->xshrink && k1->yshrink == k2->yshrink;
+}
+
+static mc_shard_t *get_shard ( const mc_key_t *key )
+{
+  return &shards[key_tile_hash(key) % MC_NUM_SHARDS];
+}
+
+/**
+ * Must be called with the shard lock held
+ */
+static mapcache_stats_t *get_stats ( mc_shard_t *shard, guint16 type )
+{
+  mapcache_stats_t *stats = g_hash_table_lookup ( shard->stats, GUINT_TO_POINTER(type) );
+  if ( !stats ) {
+    stats = g_malloc0 ( sizeof(mapcache_stats_t) );
+    g_hash_table_insert ( shard->stats, GUINT_TO_POINTER(type), stats );
+  }
+  return stats;
+}
+
 static void cache_item_free (cache_item_t *ci)
 {
   if ( ci->pixbuf )
     g_object_unref ( ci->pixbuf );
+  if ( ci->bytes )
+    g_bytes_unref ( ci->bytes );
   g_free ( ci );
 }
 
+static void tier_init ( mc_tier_t *tier, gboolean encoded )
+{
+  tier->items = g_hash_table_new ( key_hash, key_equal );
+  tier->head = NULL;
+  tier->tail = NULL;
+  tier->size = 0;
+  tier->encoded = encoded;
+}
+
 void a_mapcache_init ()
 {
   a_preferences_register ( prefs, (VikLayerParamData){0}, VIKING_PREFERENCES_GROUP_KEY );
 
-  mc_mutex = vik_mutex_new ();
-  cache = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify) cache_item_free );
+  for ( guint ii = 0; ii < MC_NUM_SHARDS; ii++ ) {
+    shards[ii].mutex = vik_mutex_new ();
+    tier_init ( &shards[ii].pixbufs, FALSE );
+    tier_init ( &shards[ii].encoded, TRUE );
+    shards[ii].stats = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
+  }
 }
 
-static void cache_add(gchar *key, GdkPixbuf *pixbuf, mapcache_extra_t extra)
+/* adds item to tail */
+static void list_add_tail ( mc_tier_t *tier, cache_item_t *ci )
 {
-  cache_item_t *ci = g_malloc ( sizeof(cache_item_t) );
-  ci->pixbuf = pixbuf;
-  ci->extra = extra;
-  if ( g_hash_table_insert ( cache, key, ci ) )
-  {
-    // ATM size of 'extra' data hardly worth trying to count (compared to pixbuf sizes)
-    if ( pixbuf ) {
-      cache_size += gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
-      // Not sure what this 100 represents anyway - probably a guess at an average pixbuf metadata size
-      cache_size += 100;
-    }
-  }
+  ci->next = NULL;
+  ci->prev = tier->tail;
+  if ( tier->tail )
+    tier->tail->next = ci;
+  else
+    tier->head = ci;
+  tier->tail = ci;
 }
 
-static void cache_remove(const gchar *key)
+static void list_unlink ( mc_tier_t *tier, cache_item_t *ci )
+{
+  if ( ci->prev )
+    ci->prev->next = ci->next;
+  else
+    tier->head = ci->next;
+  if ( ci->next )
+    ci->next->prev = ci->prev;
+  else
+    tier->tail = ci->prev;
+  ci->prev = ci->next = NULL;
+}
+
+/**
+ * Must be called with the shard lock held
+ */
+static void cache_remove ( mc_shard_t *shard, mc_tier_t *tier, cache_item_t *ci )
 {
-  cache_item_t *ci = g_hash_table_lookup ( cache, key );
-  if (ci && ci->pixbuf) {
-    cache_size -= gdk_pixbuf_get_rowstride(ci->pixbuf) * gdk_pixbuf_get_height(ci->pixbuf);
-    cache_size -= 100;
-    g_hash_table_remove ( cache, key );
+  mapcache_stats_t *stats = get_stats ( shard, ci->key.type );
+  if ( tier->encoded ) {
+    stats->encoded_bytes -= ci->size;
+    stats->encoded_count--;
   }
+  else {
+    stats->bytes -= ci->size;
+    stats->count--;
+  }
+  list_unlink ( tier, ci );
+  g_hash_table_remove ( tier->items, &ci->key );
+  tier->size -= ci->size;
+  cache_item_free ( ci );
 }
 
-/* returns key from head, adds on newtailkey to tail. */
-static gchar *list_shift_add_entry ( gchar *newtailkey )
+/**
+ * Must be called with the shard lock held
+ * Returns the item if it's valid (i.e. not from a flushed generation)
+ */
+static cache_item_t *cache_lookup ( mc_shard_t *shard, mc_tier_t *tier, const mc_key_t *key )
 {
-  gchar *oldheadkey = queue_tail->next->key;
-  queue_tail->next->key = newtailkey;
-  queue_tail = queue_tail->next;
-  return oldheadkey;
+  cache_item_t *ci = g_hash_table_lookup ( tier->items, key );
+  if ( ci && ci->generation != g_atomic_int_get(&type_generation[ci->key.type]) ) {
+    cache_remove ( shard, tier, ci );
+    ci = NULL;
+  }
+  return ci;
 }
 
-static gchar *list_shift ()
+/**
+ * Must be called with the shard lock held
+ * Inserts the item as the most recently used, replacing any existing entry,
+ *  and then removes the least recently used items to keep within the size
+ */
+static void cache_insert ( mc_shard_t *shard, mc_tier_t *tier, cache_item_t *ci, guint32 max_size )
 {
-  gchar *oldheadkey = queue_tail->next->key;
-  List *oldhead = queue_tail->next;
-  queue_tail->next = queue_tail->next->next;
-  g_free ( oldhead );
-  queue_count--;
-  return oldheadkey;
+  cache_item_t *old = g_hash_table_lookup ( tier->items, &ci->key );
+  if ( old )
+    cache_remove ( shard, tier, old );
+
+  g_hash_table_insert ( tier->items, &ci->key, ci );
+  list_add_tail ( tier, ci );
+  tier->size += ci->size;
+
+  mapcache_stats_t *stats = get_stats ( shard, ci->key.type );
+  if ( tier->encoded ) {
+    stats->encoded_bytes += ci->size;
+    stats->encoded_count++;
+  }
+  else {
+    stats->bytes += ci->size;
+    stats->count++;
+  }
+
+  // Remove the least recently used items - whilst ensuring there's more than one thing to delete
+  while ( tier->size > max_size && tier->head != tier->tail ) {
+    mapcache_stats_t *hstats = get_stats ( shard, tier->head->key.type );
+    if ( tier->encoded )
+      hstats->encoded_evictions++;
+    else
+      hstats->evictions++;
+    cache_remove ( shard, tier, tier->head );
+  }
 }
 
-/* adds key to tail */
-static void list_add_entry ( gchar *key )
+/**
+ * Must be called with the shard lock held
+ * Now the most recently used
+ */
+static void cache_promote ( mc_tier_t *tier, cache_item_t *ci )
 {
-  List *newlist = g_malloc ( sizeof ( List ) );
-  newlist->key = key;
-  if ( queue_tail ) {
-    newlist->next = queue_tail->next;
-    queue_tail->next = newlist;
-    queue_tail = newlist;
-  } else {
-    newlist->next = newlist;
-    queue_tail = newlist;
+  if ( ci != tier->tail ) {
+    list_unlink ( tier, ci );
+    list_add_tail ( tier, ci );
   }
-  queue_count++;
 }
 
 /**
@@ -160,38 +325,40 @@ void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y,
     }
   }
 
-  guint nn = name ? g_str_hash ( name ) : 0;
-  gchar *key = g_strdup_printf ( HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
-
-  g_mutex_lock(mc_mutex);
-
-  if ( pixbuf )
-    g_object_ref(pixbuf);
-  cache_add(key, pixbuf, extra);
+  cache_item_t *ci = g_malloc ( sizeof(cache_item_t) );
+  key_init ( &ci->key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name );
+  ci->pixbuf = pixbuf;
+  ci->bytes = NULL;
+  ci->extra = extra;
+  ci->generation = g_atomic_int_get ( &type_generation[type] );
+  ci->size = 0;
+  // ATM size of 'extra' data hardly worth trying to count (compared to pixbuf sizes)
+  if ( pixbuf ) {
+    g_object_ref ( pixbuf );
+    ci->size = gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+    // Not sure what this 100 represents anyway - probably a guess at an average pixbuf metadata size
+    ci->size += 100;
+  }
 
   // TODO: that should be done on preference change only...
   max_cache_size = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_size")->u * 1024 * 1024;
+  const guint32 max_shard_size = max_cache_size / MC_NUM_SHARDS;
 
-  if ( cache_size > max_cache_size ) {
-    if ( queue_tail ) {
-      gchar *oldkey = list_shift_add_entry ( key );
-      cache_remove(oldkey);
+  mc_shard_t *shard = get_shard ( &ci->key );
+  g_mutex_lock ( shard->mutex );
 
-      while ( cache_size > max_cache_size &&
-             (queue_tail->next != queue_tail) ) { /* make sure there's more than one thing to delete */
-        oldkey = list_shift ();
-        cache_remove(oldkey);
-      }
-    }
-    /* chop off 'start' etc */
-  } else {
-    list_add_entry ( key );
-    /* business as usual */
+  cache_insert ( shard, &shard->pixbufs, ci, max_shard_size );
+
+  if ( pixbuf && extra.duration > 0.0 ) {
+    mapcache_stats_t *stats = get_stats ( shard, type );
+    stats->decodes++;
+    stats->decode_time += extra.duration;
   }
-  g_mutex_unlock(mc_mutex);
+
+  g_mutex_unlock ( shard->mutex );
 
   static int tmp = 0;
-  if ( (++tmp == 100 )) { g_debug("DEBUG: cache count=%d size=%u list count=%d", g_hash_table_size(cache), cache_size, queue_count ); tmp=0; }
+  if ( (++tmp == 100 )) { g_debug("DEBUG: cache count=%d size=%u", a_mapcache_get_count(), a_mapcache_get_size() ); tmp=0; }
 }
 
 /**
@@ -199,113 +366,177 @@ void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y,
  * Caller have to decrease references counter, when buffer is no longer needed.
  * Returns a #GdkPixbuf which may be NULL.
  */
-GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
+static GdkPixbuf *cache_get ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name, gboolean fallback )
 {
-  static char key[MC_KEY_SIZE];
-  guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
-  g_mutex_lock(mc_mutex); /* prevent returning pixbuf when cache is being cleared */
-  cache_item_t *ci = g_hash_table_lookup ( cache, key );
-  if ( ci ) {
-    if ( ci->pixbuf )
-      g_object_ref(ci->pixbuf);
-    g_mutex_unlock(mc_mutex);
-    return ci->pixbuf;
-  } else {
-    g_mutex_unlock(mc_mutex);
-    return NULL;
+  mc_key_t key;
+  key_init ( &key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name );
+  GdkPixbuf *pixbuf = NULL;
+  mc_shard_t *shard = get_shard ( &key );
+  g_mutex_lock ( shard->mutex ); /* prevent returning pixbuf when cache is being cleared */
+  cache_item_t *ci = cache_lookup ( shard, &shard->pixbufs, &key );
+  if ( ci && ci->pixbuf ) {
+    pixbuf = g_object_ref ( ci->pixbuf );
+    cache_promote ( &shard->pixbufs, ci );
+  }
+  mapcache_stats_t *stats = get_stats ( shard, type );
+  if ( fallback ) {
+    if ( pixbuf )
+      stats->fallback_hits++;
+    else
+      stats->fallback_misses++;
+  }
+  else {
+    if ( pixbuf )
+      stats->hits++;
+    else
+      stats->misses++;
   }
+  g_mutex_unlock ( shard->mutex );
+  return pixbuf;
+}
+
+GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
+{
+  return cache_get ( x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name, FALSE );
+}
+
+/**
+ * As a_mapcache_get(), but for speculative lookups of a substitute for a tile not yet available
+ *  (e.g. from another zoom level), so these do not distort the hit rate of the wanted tiles
+ */
+GdkPixbuf *a_mapcache_get_fallback ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
+{
+  return cache_get ( x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name, TRUE );
 }
 
 mapcache_extra_t a_mapcache_get_extra ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
 {
-  static char key[MC_KEY_SIZE];
-  guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
-  cache_item_t *ci = g_hash_table_lookup ( cache, key );
+  mc_key_t key;
+  key_init ( &key, x, y, z, type, zoom, alpha, xshrinkfactor, yshrinkfactor, name );
+  mapcache_extra_t extra = { 0.0, MAPCACHE_STATUS_NOT_IN_CACHE };
+  mc_shard_t *shard = get_shard ( &key );
+  g_mutex_lock ( shard->mutex );
+  cache_item_t *ci = cache_lookup ( shard, &shard->pixbufs, &key );
   if ( ci )
-    return ci->extra;
-  else
-    return (mapcache_extra_t) { 0.0, MAPCACHE_STATUS_NOT_IN_CACHE };
+    extra = ci->extra;
+  g_mutex_unlock ( shard->mutex );
+  return extra;
 }
 
 /**
- * Common function to remove cache items for keys starting with the specified string
+ * Appears this is only used when redownloading tiles (i.e. to invalidate old images)
  */
-static void flush_matching ( gchar *str )
+void a_mapcache_remove_all_shrinkfactors ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar* name )
 {
-  g_mutex_lock(mc_mutex);
+  mc_key_t key;
+  key_init ( &key, x, y, z, type, zoom, 0, 1.0, 1.0, name );
+  // All variants of this tile are in the same shard
+  mc_shard_t *shard = get_shard ( &key );
+  g_mutex_lock ( shard->mutex );
+  cache_item_t *ci = shard->pixbufs.head;
+  while ( ci ) {
+    cache_item_t *next = ci->next;
+    if ( key_tile_equal(&ci->key, &key) )
+      cache_remove ( shard, &shard->pixbufs, ci );
+    ci = next;
+  }
+  // Also the original tile data
+  ci = g_hash_table_lookup ( shard->encoded.items, &key );
+  if ( ci )
+    cache_remove ( shard, &shard->encoded, ci );
+  g_mutex_unlock ( shard->mutex );
+}
 
-  if ( queue_tail == NULL ) {
-    g_mutex_unlock(mc_mutex);
+/**
+ * a_mapcache_add_encoded:
+ *  @bytes: The original tile file data (e.g. PNG or JPEG)
+ *  @extra: Information to be returned with the data (i.e. the status when it was read)
+ *
+ * Second tier cache of the tile in its file format, which is typically 10-30 times smaller
+ *  than the uncompressed #GdkPixbuf. Thus many more tiles can be kept in memory
+ *  so at least the filesystem/database access can be avoided when tiles fall out of the main cache.
+ *
+ * Function increments reference counter of bytes.
+ */
+void a_mapcache_add_encoded ( GBytes *bytes, mapcache_extra_t extra, gint x, gint y, gint z, guint16 type, gint zoom, const gchar* name )
+{
+  if ( !bytes )
     return;
-  }
 
-  // The 'loop' variable must be assigned within the mutex lock section,
-  //  otherwise where it points to might not be valid anymore when the actual processing occurs
-  List *loop = queue_tail;
-  List *tmp;
-  gint len = strlen(str);
-
-  do {
-    tmp = loop->next;
-    if ( tmp ) {
-    if ( strncmp(tmp->key, str, len) == 0 )
-    {
-      cache_remove(tmp->key);
-      if ( tmp == loop ) /* we deleted the last thing in the queue! */
-        loop = queue_tail = NULL;
-      else {
-        loop->next = tmp->next;
-        if ( tmp == queue_tail )
-          queue_tail = tmp->next;
-      }
-      g_free ( tmp );
-      tmp = NULL;
-      queue_count--;
-    }
-    else
-      loop = tmp;
-    } else
-      loop = NULL;
-  } while ( loop && (loop != queue_tail || tmp == NULL) );
-  /* loop thru list, looking for the one, compare first whatever chars */
+  // TODO: that should be done on preference change only...
+  max_encoded_size = a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_encoded_size")->u * 1024 * 1024;
+  if ( max_encoded_size == 0 )
+    return;
+
+  cache_item_t *ci = g_malloc ( sizeof(cache_item_t) );
+  key_init ( &ci->key, x, y, z, type, zoom, 0, 1.0, 1.0, name );
+  ci->pixbuf = NULL;
+  ci->bytes = g_bytes_ref ( bytes );
+  ci->extra = extra;
+  ci->generation = g_atomic_int_get ( &type_generation[type] );
+  ci->size = g_bytes_get_size ( bytes ) + 100;
 
-  cache_remove(str);
-  g_mutex_unlock(mc_mutex);
+  mc_shard_t *shard = get_shard ( &ci->key );
+  g_mutex_lock ( shard->mutex );
+  cache_insert ( shard, &shard->encoded, ci, max_encoded_size / MC_NUM_SHARDS );
+  g_mutex_unlock ( shard->mutex );
 }
 
 /**
- * Appears this is only used when redownloading tiles (i.e. to invalidate old images)
+ * a_mapcache_encoded_enabled:
+ *
+ * Returns: Whether the second tier is in use, i.e. a_mapcache_add_encoded() keeps the data
  */
-void a_mapcache_remove_all_shrinkfactors ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar* name )
+gboolean a_mapcache_encoded_enabled ()
 {
-  char key[MC_KEY_SIZE];
-  guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING_NOSHRINK_NOR_ALPHA, type, x, y, z, zoom, nn );
-  flush_matching ( key );
+  return a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_encoded_size")->u != 0;
 }
 
-void a_mapcache_flush ()
+/**
+ * a_mapcache_get_encoded:
+ *  @extra: Optional, set to the information supplied when the data was added
+ *
+ * Function increases reference counter of the bytes in behalf of caller.
+ * Caller has to decrease references counter, when no longer needed.
+ * Returns the original tile file data, which maybe NULL.
+ */
+GBytes *a_mapcache_get_encoded ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar* name, mapcache_extra_t *extra )
 {
-  // Everything happens within the mutex lock section
-  g_mutex_lock(mc_mutex);
-
-  List *loop = queue_tail;
-  List *tmp;
-
-  while ( loop ) {
-    tmp = loop->next;
-    cache_remove(tmp->key);
-    if ( tmp == queue_tail ) /* we deleted the last thing in the queue */
-      loop = queue_tail = NULL;
-    else
-      loop->next = tmp->next;
-    g_free ( tmp );
-    tmp = NULL;
+  mc_key_t key;
+  key_init ( &key, x, y, z, type, zoom, 0, 1.0, 1.0, name );
+  GBytes *bytes = NULL;
+  mc_shard_t *shard = get_shard ( &key );
+  g_mutex_lock ( shard->mutex );
+  cache_item_t *ci = cache_lookup ( shard, &shard->encoded, &key );
+  if ( ci ) {
+    bytes = g_bytes_ref ( ci->bytes );
+    if ( extra )
+      *extra = ci->extra;
+    cache_promote ( &shard->encoded, ci );
   }
+  mapcache_stats_t *stats = get_stats ( shard, type );
+  if ( bytes )
+    stats->encoded_hits++;
+  else
+    stats->encoded_misses++;
+  g_mutex_unlock ( shard->mutex );
+  return bytes;
+}
 
-  g_mutex_unlock(mc_mutex);
+static void shard_flush ( mc_shard_t *shard )
+{
+  g_mutex_lock ( shard->mutex );
+  while ( shard->pixbufs.head )
+    cache_remove ( shard, &shard->pixbufs, shard->pixbufs.head );
+  while ( shard->encoded.head )
+    cache_remove ( shard, &shard->encoded, shard->encoded.head );
+  g_mutex_unlock ( shard->mutex );
+}
+
+void a_mapcache_flush ()
+{
+  for ( guint ii = 0; ii < MC_NUM_SHARDS; ii++ )
+    shard_flush ( &shards[ii] );
 }
 
 /**
@@ -317,27 +548,77 @@ void a_mapcache_flush ()
  */
 void a_mapcache_flush_type ( guint16 type )
 {
-  char key[MC_KEY_SIZE];
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING_TYPE, type );
-  flush_matching ( key );
+  g_atomic_int_inc ( &type_generation[type] );
 }
 
 void a_mapcache_uninit ()
 {
-  g_hash_table_destroy ( cache );
-  /* free list */
-  cache = NULL;
-  vik_mutex_free (mc_mutex);
+  for ( guint ii = 0; ii < MC_NUM_SHARDS; ii++ ) {
+    shard_flush ( &shards[ii] );
+    g_hash_table_destroy ( shards[ii].pixbufs.items );
+    shards[ii].pixbufs.items = NULL;
+    g_hash_table_destroy ( shards[ii].encoded.items );
+    shards[ii].encoded.items = NULL;
+    g_hash_table_destroy ( shards[ii].stats );
+    shards[ii].stats = NULL;
+    vik_mutex_free ( shards[ii].mutex );
+  }
 }
 
-// Size of mapcache in memory
+// Size of mapcache in memory (of the main pixbuf tier)
 guint a_mapcache_get_size ()
 {
-  return cache_size;
+  guint size = 0;
+  for ( guint ii = 0; ii < MC_NUM_SHARDS; ii++ ) {
+    g_mutex_lock ( shards[ii].mutex );
+    size += shards[ii].pixbufs.size;
+    g_mutex_unlock ( shards[ii].mutex );
+  }
+  return size;
 }
 
-// Count of items in the mapcache
+// Count of items in the mapcache (of the main pixbuf tier)
 guint a_mapcache_get_count ()
 {
-  return g_hash_table_size ( cache );
+  guint count = 0;
+  for ( guint ii = 0; ii < MC_NUM_SHARDS; ii++ ) {
+    g_mutex_lock ( shards[ii].mutex );
+    count += g_hash_table_size ( shards[ii].pixbufs.items );
+    g_mutex_unlock ( shards[ii].mutex );
+  }
+  return count;
+}
+
+/**
+ * a_mapcache_get_stats:
+ *  @type:  Specified map type
+ *  @stats: Filled in with the statistics for the map type
+ *
+ * Statistics are accumulated for the whole program run
+ *  (apart from the current bytes & count values)
+ */
+void a_mapcache_get_stats ( guint16 type, mapcache_stats_t *stats )
+{
+  memset ( stats, 0, sizeof(mapcache_stats_t) );
+  for ( guint ii = 0; ii < MC_NUM_SHARDS; ii++ ) {
+    g_mutex_lock ( shards[ii].mutex );
+    mapcache_stats_t *ss = g_hash_table_lookup ( shards[ii].stats, GUINT_TO_POINTER(type) );
+    if ( ss ) {
+      stats->hits += ss->hits;
+      stats->misses += ss->misses;
+      stats->fallback_hits += ss->fallback_hits;
+      stats->fallback_misses += ss->fallback_misses;
+      stats->evictions += ss->evictions;
+      stats->bytes += ss->bytes;
+      stats->count += ss->count;
+      stats->decodes += ss->decodes;
+      stats->decode_time += ss->decode_time;
+      stats->encoded_hits += ss->encoded_hits;
+      stats->encoded_misses += ss->encoded_misses;
+      stats->encoded_evictions += ss->encoded_evictions;
+      stats->encoded_bytes += ss->encoded_bytes;
+      stats->encoded_count += ss->encoded_count;
+    }
+    g_mutex_unlock ( shards[ii].mutex );
+  }
 }
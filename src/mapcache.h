@@ -34,19 +34,43 @@ G_BEGIN_DECLS
 typedef struct {
   gdouble duration; // Mostly for Mapnik Rendering duration - negative values indicate not rendered (i.e. read from disk)
   gint status;      // Tile download status - either a DownloadResult_t value or MAPCACHE_STATUS_*
+  gint64 mtime;     // Modification time of the tile file the data was read from (0 if not from a file)
 } mapcache_extra_t;
 
+typedef struct {
+  guint64 hits;        // Lookups returning an image
+  guint64 misses;      // Lookups without an image
+  guint64 fallback_hits;   // Lookups of tiles from other zoom levels, to use whilst the wanted tile is unavailable
+  guint64 fallback_misses;
+  guint64 evictions;   // Items removed to keep within the cache size
+  guint64 bytes;       // Current memory used
+  guint count;         // Current number of items
+  guint64 decodes;     // Number of images added with a known decode/render duration
+  gdouble decode_time; // Total of those durations (seconds)
+  // Second tier of tiles in their original file format
+  guint64 encoded_hits;
+  guint64 encoded_misses;
+  guint64 encoded_evictions;
+  guint64 encoded_bytes;
+  guint encoded_count;
+} mapcache_stats_t;
+
 void a_mapcache_init ();
 void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name );
 GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name );
+GdkPixbuf *a_mapcache_get_fallback ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name );
 mapcache_extra_t a_mapcache_get_extra ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name );
 void a_mapcache_remove_all_shrinkfactors ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar* name );
+void a_mapcache_add_encoded ( GBytes *bytes, mapcache_extra_t extra, gint x, gint y, gint z, guint16 type, gint zoom, const gchar* name );
+gboolean a_mapcache_encoded_enabled ();
+GBytes *a_mapcache_get_encoded ( gint x, gint y, gint z, guint16 type, gint zoom, const gchar* name, mapcache_extra_t *extra );
 void a_mapcache_flush ();
 void a_mapcache_flush_type ( guint16 type );
 void a_mapcache_uninit ();
 
 guint a_mapcache_get_size ();
 guint a_mapcache_get_count ();
+void a_mapcache_get_stats ( guint16 type, mapcache_stats_t *stats );
 
 G_END_DECLS
 
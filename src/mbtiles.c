@@ -0,0 +1,260 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sqlite3.h"
+#include "mbtiles.h"
+#include "vik_compat.h"
+
+// MBTiles stored internally with the flipping y thingy (i.e. TMS scheme).
+#define FLIP_Y(zoom,y) ((gint)((1 << (zoom)) - 1 - (y)))
+
+#define SQL_TILE "SELECT tile_data FROM tiles WHERE zoom_level=?1 AND tile_column=?2 AND tile_row=?3;"
+#define SQL_TILES "SELECT tile_column, tile_row, tile_data FROM tiles WHERE zoom_level=?1 AND tile_column BETWEEN ?2 AND ?3 AND tile_row BETWEEN ?4 AND ?5;"
+
+typedef struct {
+  GMutex *mutex;  // Held whilst the connection is in use
+  sqlite3 *sql;
+  sqlite3_stmt *tile_stmt;
+  sqlite3_stmt *tiles_stmt;
+} mbtiles_conn_t;
+
+struct _MBTilesReader {
+  gint ref_count;
+  gchar *filename;
+  gint64 mmap_size;
+  guint count;
+  mbtiles_conn_t *conns;
+  gint next;  // For sharing out connections when all are busy
+};
+
+/**
+ * Open the database connection
+ *
+ * As the connection is only ever used by one thread at a time
+ *  SQLite need not do any locking of its own.
+ */
+static gboolean conn_open ( MBTilesReader *mbr, mbtiles_conn_t *conn, gchar **errmsg )
+{
+  int ans = sqlite3_open_v2 ( mbr->filename, &conn->sql, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL );
+  if ( ans != SQLITE_OK ) {
+    g_warning ( "%s: %s", __FUNCTION__, sqlite3_errmsg(conn->sql) );
+    if ( errmsg )
+      *errmsg = g_strdup ( sqlite3_errmsg(conn->sql) );
+    (void)sqlite3_close ( conn->sql );
+    conn->sql = NULL;
+    return FALSE;
+  }
+
+  if ( mbr->mmap_size > 0 ) {
+    // Memory mapped I/O avoids a copy of each page read
+    gchar *statement = g_strdup_printf ( "PRAGMA mmap_size=%" G_GINT64_FORMAT ";", mbr->mmap_size );
+    char *errMsg = NULL;
+    if ( sqlite3_exec ( conn->sql, statement, NULL, NULL, &errMsg ) != SQLITE_OK ) {
+      // Only to console for information purposes only
+      g_warning ( "%s: %s - %s", __FUNCTION__, statement, errMsg );
+      sqlite3_free ( errMsg );
+    }
+    g_free ( statement );
+  }
+
+  ans = sqlite3_prepare_v2 ( conn->sql, SQL_TILE, -1, &conn->tile_stmt, NULL );
+  if ( ans != SQLITE_OK )
+    g_warning ( "%s: %s - %s: %s", __FUNCTION__, "prepare failure", sqlite3_errmsg(conn->sql), SQL_TILE );
+  ans = sqlite3_prepare_v2 ( conn->sql, SQL_TILES, -1, &conn->tiles_stmt, NULL );
+  if ( ans != SQLITE_OK )
+    g_warning ( "%s: %s - %s: %s", __FUNCTION__, "prepare failure", sqlite3_errmsg(conn->sql), SQL_TILES );
+  return TRUE;
+}
+
+static void conn_close ( mbtiles_conn_t *conn )
+{
+  (void)sqlite3_finalize ( conn->tile_stmt );
+  (void)sqlite3_finalize ( conn->tiles_stmt );
+  if ( conn->sql ) {
+    int ans = sqlite3_close ( conn->sql );
+    if ( ans != SQLITE_OK ) {
+      // Only to console for information purposes only
+      g_warning ( "%s: SQL Close problem: %s", __FUNCTION__, sqlite3_errstr(ans) );
+    }
+  }
+  conn->sql = NULL;
+  conn->tile_stmt = NULL;
+  conn->tiles_stmt = NULL;
+}
+
+/**
+ * mbtiles_reader_new:
+ * @max_connections: Maximum number of simultaneous readers
+ * @mmap_size:       Bytes of the file to memory map, 0 to not use memory mapping
+ * @errmsg:          Returned reason for failure, to be freed by the caller
+ *
+ * Returns: A new reader, or NULL if the file could not be opened
+ */
+MBTilesReader *mbtiles_reader_new ( const gchar *filename, guint max_connections, gint64 mmap_size, gchar **errmsg )
+{
+  MBTilesReader *mbr = g_malloc0 ( sizeof(MBTilesReader) );
+  mbr->ref_count = 1;
+  mbr->filename = g_strdup ( filename );
+  mbr->mmap_size = mmap_size;
+  mbr->count = MAX ( 1, max_connections );
+  mbr->conns = g_malloc0 ( mbr->count * sizeof(mbtiles_conn_t) );
+  for ( guint ii = 0; ii < mbr->count; ii++ )
+    mbr->conns[ii].mutex = vik_mutex_new ();
+
+  // Other connections are opened as and when needed
+  if ( !conn_open ( mbr, &mbr->conns[0], errmsg ) ) {
+    mbtiles_reader_unref ( mbr );
+    return NULL;
+  }
+  return mbr;
+}
+
+/**
+ * Take a reference, so a background job can keep reading
+ *  even if the owner of the reader has finished with it
+ */
+MBTilesReader *mbtiles_reader_ref ( MBTilesReader *mbr )
+{
+  g_atomic_int_inc ( &mbr->ref_count );
+  return mbr;
+}
+
+/**
+ * Drop a reference, the database is closed when the last one goes
+ */
+void mbtiles_reader_unref ( MBTilesReader *mbr )
+{
+  if ( !mbr )
+    return;
+  if ( !g_atomic_int_dec_and_test ( &mbr->ref_count ) )
+    return;
+  for ( guint ii = 0; ii < mbr->count; ii++ ) {
+    conn_close ( &mbr->conns[ii] );
+    vik_mutex_free ( mbr->conns[ii].mutex );
+  }
+  g_free ( mbr->conns );
+  g_free ( mbr->filename );
+  g_free ( mbr );
+}
+
+/**
+ * Get a connection for the exclusive use of the calling thread,
+ *  waiting if they are all in use
+ */
+static mbtiles_conn_t *conn_acquire ( MBTilesReader *mbr )
+{
+  mbtiles_conn_t *conn = NULL;
+  for ( guint ii = 0; ii < mbr->count && !conn; ii++ )
+    if ( g_mutex_trylock ( mbr->conns[ii].mutex ) )
+      conn = &mbr->conns[ii];
+
+  if ( !conn ) {
+    conn = &mbr->conns[(guint)g_atomic_int_add ( &mbr->next, 1 ) % mbr->count];
+    g_mutex_lock ( conn->mutex );
+  }
+
+  if ( !conn->sql )
+    (void)conn_open ( mbr, conn, NULL );
+  return conn;
+}
+
+static void conn_release ( mbtiles_conn_t *conn )
+{
+  g_mutex_unlock ( conn->mutex );
+}
+
+/**
+ * Returns the blob of the current row as new GBytes, or NULL if it is empty
+ */
+static GBytes *column_bytes ( sqlite3_stmt *stmt, int column )
+{
+  const void *data = sqlite3_column_blob ( stmt, column );
+  int bytes = sqlite3_column_bytes ( stmt, column );
+  if ( bytes < 1 ) {
+    g_warning ( "%s: %s (%d)", __FUNCTION__, "not enough bytes", bytes );
+    return NULL;
+  }
+  return g_bytes_new ( data, bytes );
+}
+
+/**
+ * mbtiles_reader_get_tile:
+ *
+ * Returns: The tile_data blob, which maybe NULL
+ */
+GBytes *mbtiles_reader_get_tile ( MBTilesReader *mbr, gint x, gint y, gint zoom )
+{
+  GBytes *tile_data = NULL;
+  mbtiles_conn_t *conn = conn_acquire ( mbr );
+  sqlite3_stmt *stmt = conn->tile_stmt;
+  if ( stmt ) {
+    sqlite3_bind_int ( stmt, 1, zoom );
+    sqlite3_bind_int ( stmt, 2, x );
+    sqlite3_bind_int ( stmt, 3, FLIP_Y(zoom, y) );
+    int ans = sqlite3_step ( stmt );
+    if ( ans == SQLITE_ROW )
+      tile_data = column_bytes ( stmt, 0 );
+    else if ( ans != SQLITE_DONE )
+      // Give up on any errors
+      g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
+    sqlite3_reset ( stmt );
+  }
+  conn_release ( conn );
+  return tile_data;
+}
+
+/**
+ * mbtiles_reader_get_tiles:
+ * @func: Called for each tile found in the range (inclusive),
+ *        which is responsible for unreferencing the tile data
+ *
+ * Read all available tiles of an area with a single query
+ *
+ * Returns: The number of tiles found
+ */
+guint mbtiles_reader_get_tiles ( MBTilesReader *mbr, gint zoom, gint xmin, gint xmax, gint ymin, gint ymax, MBTilesTileFunc func, gpointer user_data )
+{
+  guint found = 0;
+  mbtiles_conn_t *conn = conn_acquire ( mbr );
+  sqlite3_stmt *stmt = conn->tiles_stmt;
+  if ( stmt ) {
+    sqlite3_bind_int ( stmt, 1, zoom );
+    sqlite3_bind_int ( stmt, 2, xmin );
+    sqlite3_bind_int ( stmt, 3, xmax );
+    // Flipping swaps the ends of the range
+    sqlite3_bind_int ( stmt, 4, FLIP_Y(zoom, ymax) );
+    sqlite3_bind_int ( stmt, 5, FLIP_Y(zoom, ymin) );
+    int ans;
+    while ( (ans = sqlite3_step ( stmt )) == SQLITE_ROW ) {
+      GBytes *tile_data = column_bytes ( stmt, 2 );
+      if ( tile_data ) {
+        found++;
+        func ( sqlite3_column_int ( stmt, 0 ), FLIP_Y(zoom, sqlite3_column_int ( stmt, 1 )), tile_data, user_data );
+      }
+    }
+    if ( ans != SQLITE_DONE )
+      g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
+    sqlite3_reset ( stmt );
+  }
+  conn_release ( conn );
+  return found;
+}
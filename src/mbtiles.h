@@ -0,0 +1,45 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_MBTILES_H
+#define __VIKING_MBTILES_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * Read only access to an MBTiles file, usable from several threads at once.
+ *
+ * Each thread gets its own database connection from a small pool,
+ *  with the SQL statements prepared once per connection.
+ */
+typedef struct _MBTilesReader MBTilesReader;
+
+typedef void (*MBTilesTileFunc) ( gint x, gint y, GBytes *tile_data, gpointer user_data );
+
+MBTilesReader *mbtiles_reader_new ( const gchar *filename, guint max_connections, gint64 mmap_size, gchar **errmsg );
+GBytes *mbtiles_reader_get_tile ( MBTilesReader *mbr, gint x, gint y, gint zoom );
+guint mbtiles_reader_get_tiles ( MBTilesReader *mbr, gint zoom, gint xmin, gint xmax, gint ymin, gint ymax, MBTilesTileFunc func, gpointer user_data );
+MBTilesReader *mbtiles_reader_ref ( MBTilesReader *mbr );
+void mbtiles_reader_unref ( MBTilesReader *mbr );
+
+G_END_DECLS
+
+#endif
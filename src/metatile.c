@@ -54,9 +54,16 @@ struct meta_layout {
     // The index offsets are measured from the start of the file
 };
 
-// Use this to enable meta-tiles which will render NxN tiles at once
+// NB METATILE (the number of tiles along each side) is defined in metatile.h
 // Note: This should be a power of 2 (2, 4, 8, 16 ...)
-#define METATILE (8)
+
+struct _metatile {
+    GMappedFile *mapped;
+    const char *contents;
+    size_t length;
+    int compressed;
+    struct entry index[METATILE*METATILE];
+};
 
 /**
  * xyz_to_meta:
@@ -85,6 +92,30 @@ int xyz_to_meta(char *path, size_t len, const char *dir, int x, int y, int z)
     return offset;
 }
 
+/**
+ * Check the header is for a metatile this code can use
+ *
+ * Returns 0 when OK, otherwise a negative value (as metatile_read())
+ */
+static int metatile_check_header(const struct meta_layout *meta, const char *path, int * compressed, char * log_msg)
+{
+    if (memcmp(meta->magic, META_MAGIC, strlen(META_MAGIC))) {
+        if (memcmp(meta->magic, META_MAGIC_COMPRESSED, strlen(META_MAGIC_COMPRESSED))) {
+            snprintf(log_msg,PATH_MAX - 1, "Meta file %s header magic mismatch\n", path);
+            return -4;
+        } else {
+            *compressed = 1;
+        }
+    } else *compressed = 0;
+
+    // Currently this code only works with fixed metatile sizes (due to xyz_to_meta above)
+    if (meta->count != (METATILE * METATILE)) {
+        snprintf(log_msg, PATH_MAX - 1, "Meta file %s header bad count %d != %d\n", path, meta->count, METATILE * METATILE);
+        return -5;
+    }
+    return 0;
+}
+
 /**
  * metatile_read:
  * From function in mod_tile/src/store_file.c
@@ -137,23 +168,11 @@ int metatile_read(const char *dir, int x, int y, int z, char *buf, size_t sz, in
         free(meta);
         return -3;
     }
-    if (memcmp(meta->magic, META_MAGIC, strlen(META_MAGIC))) {
-        if (memcmp(meta->magic, META_MAGIC_COMPRESSED, strlen(META_MAGIC_COMPRESSED))) {
-            ignored = snprintf(log_msg,PATH_MAX - 1, "Meta file %s header magic mismatch\n", path);
-            close(fd);
-            free(meta);
-            return -4;
-        } else {
-            *compressed = 1;
-        }
-    } else *compressed = 0;
-
-    // Currently this code only works with fixed metatile sizes (due to xyz_to_meta above)
-    if (meta->count != (METATILE * METATILE)) {
-        ignored = snprintf(log_msg, PATH_MAX - 1, "Meta file %s header bad count %d != %d\n", path, meta->count, METATILE * METATILE);
+    int bad = metatile_check_header(meta, path, compressed, log_msg);
+    if (bad) {
         free(meta);
         close(fd);
-        return -5;
+        return bad;
     }
 
     file_offset = meta->index[meta_offset].offset;
@@ -191,3 +210,100 @@ int metatile_read(const char *dir, int x, int y, int z, char *buf, size_t sz, in
     close(fd);
     return pos;
 }
+
+/**
+ * metatile_open:
+ *
+ * Map the metatile file containing the tile x,y,z into memory
+ *  and check its index is valid.
+ *
+ * Returns NULL on failure, with the error message in log_msg
+ */
+metatile_t *metatile_open(const char *dir, int x, int y, int z, char * log_msg)
+{
+    char path[PATH_MAX];
+    unsigned int header_len = sizeof(struct meta_layout) + METATILE*METATILE*sizeof(struct entry);
+    GError *error = NULL;
+    int compressed, i;
+
+    (void)xyz_to_meta(path, sizeof(path), dir, x, y, z);
+
+    GMappedFile *mapped = g_mapped_file_new(path, FALSE, &error);
+    if (!mapped) {
+        snprintf(log_msg, PATH_MAX - 1, "Could not open metatile %s. Reason: %s\n", path, error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    size_t length = g_mapped_file_get_length(mapped);
+    const char *contents = g_mapped_file_get_contents(mapped);
+    if (length < header_len || !contents) {
+        snprintf(log_msg, PATH_MAX - 1, "Meta file %s too small to contain header\n", path);
+        g_mapped_file_unref(mapped);
+        return NULL;
+    }
+
+    // Copy the header, as the mapped data need not be suitably aligned
+    struct meta_layout *meta = (struct meta_layout *)malloc(header_len);
+    memcpy(meta, contents, header_len);
+    if (metatile_check_header(meta, path, &compressed, log_msg)) {
+        free(meta);
+        g_mapped_file_unref(mapped);
+        return NULL;
+    }
+
+    for (i = 0; i < METATILE*METATILE; i++) {
+        if (meta->index[i].offset < 0 || meta->index[i].size < 0 ||
+            (size_t)meta->index[i].offset + (size_t)meta->index[i].size > length) {
+            snprintf(log_msg, PATH_MAX - 1, "Meta file %s index entry %d beyond end of file\n", path, i);
+            free(meta);
+            g_mapped_file_unref(mapped);
+            return NULL;
+        }
+    }
+
+    metatile_t *mt = (metatile_t *)malloc(sizeof(metatile_t));
+    mt->mapped = mapped;
+    mt->contents = contents;
+    mt->length = length;
+    mt->compressed = compressed;
+    memcpy(mt->index, meta->index, sizeof(mt->index));
+    free(meta);
+    return mt;
+}
+
+/**
+ * metatile_is_compressed:
+ *
+ * Returns whether the tiles are in a compressed format (possibly only gzip)
+ */
+int metatile_is_compressed(metatile_t *mt)
+{
+    return mt->compressed;
+}
+
+/**
+ * metatile_get_bytes:
+ *
+ * Get the data of the tile x,y within the metatile
+ *  (without copying - the data refers to the mapped file, which is kept until no longer used)
+ *
+ * Returns NULL if the tile is empty or too big
+ */
+GBytes *metatile_get_bytes(metatile_t *mt, int x, int y)
+{
+    int mask = METATILE - 1;
+    struct entry *entry = &mt->index[(x & mask) * METATILE + (y & mask)];
+    if (entry->size < 1 || entry->size > METATILE_MAX_SIZE)
+        return NULL;
+    return g_bytes_new_with_free_func(mt->contents + entry->offset, entry->size,
+                                      (GDestroyNotify)g_mapped_file_unref, g_mapped_file_ref(mt->mapped));
+}
+
+void metatile_close(metatile_t *mt)
+{
+    if (!mt)
+        return;
+    g_mapped_file_unref(mt->mapped);
+    free(mt);
+}
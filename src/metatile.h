@@ -20,9 +20,25 @@
  *
  */
 
+#include <glib.h>
+
 // MAX_SIZE is the biggest file which we will return to the user
 #define METATILE_MAX_SIZE (1 * 1024 * 1024)
 
 int xyz_to_meta(char *path, size_t len, const char *dir, int x, int y, int z);
 
 int metatile_read(const char *dir, int x, int y, int z, char *buf, size_t sz, int * compressed, char * log_msg);
+
+// Number of tiles along each side of a metatile
+#define METATILE (8)
+
+// A whole metatile file mapped into memory, for reading any of its tiles without reopening it
+typedef struct _metatile metatile_t;
+
+metatile_t *metatile_open(const char *dir, int x, int y, int z, char * log_msg);
+
+int metatile_is_compressed(metatile_t *mt);
+
+GBytes *metatile_get_bytes(metatile_t *mt, int x, int y);
+
+void metatile_close(metatile_t *mt);
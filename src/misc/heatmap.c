@@ -29,6 +29,15 @@
 #include <math.h>   /* sqrtf */
 #include <assert.h> /* assert, #define NDEBUG to ignore. */
 
+/* The stamping and rendering loops use SSE2, or AVX2 when compiled for it,
+ * with the plain loops doing whatever is left over (or everything otherwise).
+ */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /* Having a default stamp ready makes it easier for simple usage of the library
  * since there is no need to create a new stamp.
  */
@@ -69,6 +78,57 @@ void heatmap_free(heatmap_t* h)
     free(h);
 }
 
+#if defined(__SSE2__)
+/* The highest of the four values. */
+static float max_of_4(__m128 v)
+{
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+#endif
+
+/* Adds n values of the stamp's line, times w, onto the heatmap's line.
+ * Returns the highest resulting heat, so the max is only updated once per line.
+ */
+static float add_stampline(float* line, const float* stampline, unsigned n, float w)
+{
+    unsigned i = 0;
+    float linemax = 0.0f;
+
+#if defined(__AVX2__)
+    {
+        const __m256 vw = _mm256_set1_ps(w);
+        __m256 vmax = _mm256_setzero_ps();
+        for( ; i + 8 <= n ; i += 8) {
+            const __m256 v = _mm256_add_ps(_mm256_loadu_ps(line + i), _mm256_mul_ps(_mm256_loadu_ps(stampline + i), vw));
+            _mm256_storeu_ps(line + i, v);
+            vmax = _mm256_max_ps(vmax, v);
+        }
+        linemax = max_of_4(_mm_max_ps(_mm256_castps256_ps128(vmax), _mm256_extractf128_ps(vmax, 1)));
+    }
+#endif
+#if defined(__SSE2__)
+    {
+        const __m128 vw = _mm_set1_ps(w);
+        __m128 vmax = _mm_set1_ps(linemax);
+        for( ; i + 4 <= n ; i += 4) {
+            const __m128 v = _mm_add_ps(_mm_loadu_ps(line + i), _mm_mul_ps(_mm_loadu_ps(stampline + i), vw));
+            _mm_storeu_ps(line + i, v);
+            vmax = _mm_max_ps(vmax, v);
+        }
+        linemax = max_of_4(vmax);
+    }
+#endif
+
+    for( ; i < n ; ++i) {
+        line[i] += stampline[i] * w;
+        if(line[i] > linemax) {linemax = line[i];}
+    }
+
+    return linemax;
+}
+
 void heatmap_add_point(heatmap_t* h, unsigned x, unsigned y)
 {
     heatmap_add_point_with_stamp(h, x, y, &stamp_default_4);
@@ -97,18 +157,12 @@ void heatmap_add_point_with_stamp(heatmap_t* h, unsigned x, unsigned y, const he
             float* line = h->buf + ((y + iy) - stamp->h/2)*h->w + (x + x0) - stamp->w/2;
             const float* stampline = stamp->buf + iy*stamp->w + x0;
 
-            unsigned ix;
-            for(ix = x0 ; ix < x1 ; ++ix, ++line, ++stampline) {
-                /* TODO: Let's actually accept negatives and try out funky stamps. */
-                /* Note that that might mess with the max though. */
-                /* And that we'll have to clamp the bottom to 0 when rendering. */
-                assert(*stampline >= 0.0f);
-
-                *line += *stampline;
-                if(*line > h->max) {h->max = *line;}
-
-                assert(*line >= 0.0f);
-            }
+            /* TODO: Let's actually accept negatives and try out funky stamps. */
+            /* Note that that might mess with the max though. */
+            /* And that we'll have to clamp the bottom to 0 when rendering. */
+            /* NB Multiplying by exactly one gives the same heat as just adding. */
+            const float linemax = add_stampline(line, stampline, x1 - x0, 1.0f);
+            if(linemax > h->max) {h->max = linemax;}
         }
     } /* I hate you very much! */
 }
@@ -118,11 +172,8 @@ void heatmap_add_weighted_point(heatmap_t* h, unsigned x, unsigned y, float w)
     heatmap_add_weighted_point_with_stamp(h, x, y, w, &stamp_default_4);
 }
 
-/* Initial timings do show a difference large enough (~10% slower without FMA)
- * that we do care about splitting the implementation,
- * even though JUST A SINGLE LINE OF CODE has changed!
- * And I don't want to spoil the readability by using macro-trickery to avoid duplication.
- * sad :-(
+/* The same as the unweighted function, with both now stamping a line at a time
+ * by the vectorized add_stampline().
  */
 void heatmap_add_weighted_point_with_stamp(heatmap_t* h, unsigned x, unsigned y, float w, const heatmap_stamp_t* stamp)
 {
@@ -150,16 +201,9 @@ void heatmap_add_weighted_point_with_stamp(heatmap_t* h, unsigned x, unsigned y,
             float* line = h->buf + ((y + iy) - stamp->h/2)*h->w + (x + x0) - stamp->w/2;
             const float* stampline = stamp->buf + iy*stamp->w + x0;
 
-            unsigned ix;
-            for(ix = x0 ; ix < x1 ; ++ix, ++line, ++stampline) {
-                /* TODO: see unweighted function */
-                assert(*stampline >= 0.0f);
-
-                *line += *stampline * w;
-                if(*line > h->max) {h->max = *line;}
-
-                assert(*line >= 0.0f);
-            }
+            /* TODO: see unweighted function */
+            const float linemax = add_stampline(line, stampline, x1 - x0, w);
+            if(linemax > h->max) {h->max = linemax;}
         }
     } /* I hate you very much! */
 }
@@ -183,7 +227,10 @@ unsigned char* heatmap_render_to(const heatmap_t* h, const heatmap_colorscheme_t
 
 unsigned char* heatmap_render_saturated_to(const heatmap_t* h, const heatmap_colorscheme_t* colorscheme, float saturation, unsigned char* colorbuf)
 {
-    unsigned y;
+    /* There's no padding (yet?), so the loop is flattened to go over all the pixels at once. */
+    const size_t n = (size_t)h->w*h->h;
+    const float maxidx = (float)(colorscheme->ncolors-1);
+    size_t i = 0;
     assert(saturation > 0.0f);
 
     /* For convenience, if no buffer is given, malloc a new one. */
@@ -194,36 +241,65 @@ unsigned char* heatmap_render_saturated_to(const heatmap_t* h, const heatmap_col
         }
     }
 
-    /* TODO: could actually even flatten this loop before parallelizing it. */
-    /* I.e., to go i = 0 ; i < h*w since I don't have any padding! (yet?) */
-    for(y = 0 ; y < h->h ; ++y) {
-        float* bufline = h->buf + y*h->w;
-        unsigned char* colorline = colorbuf + 4*y*h->w;
-
-        unsigned x;
-        for(x = 0 ; x < h->w ; ++x, ++bufline) {
-            /* Saturate the heat value to the given saturation, and then
-             * normalize by that.
-             */
-            const float val = (*bufline > saturation ? saturation : *bufline)/saturation;
-
-            /* We add 0.5 in order to do real rounding, not just dropping the
-             * decimal part. That way we are certain the highest value in the
-             * colorscheme is actually used.
-             */
-            const size_t idx = (size_t)((float)(colorscheme->ncolors-1)*val + 0.5f);
-
-            /* This is probably caused by a negative entry in the stamp! */
-            assert(val >= 0.0f);
-
-            /* This should never happen. It is likely a bug in this library. */
-            assert(idx < colorscheme->ncolors);
-
-            /* Just copy over the color from the colorscheme. */
-            memcpy(colorline, colorscheme->colors + idx*4, 4);
-            colorline += 4;
+    /* The vectorized loops do the same calculation as the plain loop below,
+     * clamping the bottom to 0 (and saturating NaNs) rather than asserting,
+     * so a bad heat value can never index outside of the colorscheme.
+     */
+#if defined(__AVX2__)
+    {
+        const __m256 vsat = _mm256_set1_ps(saturation);
+        const __m256 vmaxidx = _mm256_set1_ps(maxidx);
+        const __m256 vhalf = _mm256_set1_ps(0.5f);
+        const __m256 vzero = _mm256_setzero_ps();
+        for( ; i + 8 <= n ; i += 8) {
+            /* NB the saturation is the second operand, so it's what NaNs become. */
+            const __m256 val = _mm256_max_ps(_mm256_div_ps(_mm256_min_ps(_mm256_loadu_ps(h->buf + i), vsat), vsat), vzero);
+            const __m256i idx = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(vmaxidx, val), vhalf));
+            /* Each color is four chars, thus gather them as ints. */
+            const __m256i colors = _mm256_i32gather_epi32((const int*)colorscheme->colors, idx, 4);
+            _mm256_storeu_si256((__m256i*)(colorbuf + 4*i), colors);
         }
     }
+#endif
+#if defined(__SSE2__)
+    {
+        const __m128 vsat = _mm_set1_ps(saturation);
+        const __m128 vmaxidx = _mm_set1_ps(maxidx);
+        const __m128 vhalf = _mm_set1_ps(0.5f);
+        const __m128 vzero = _mm_setzero_ps();
+        int idx[4];
+        for( ; i + 4 <= n ; i += 4) {
+            const __m128 val = _mm_max_ps(_mm_div_ps(_mm_min_ps(_mm_loadu_ps(h->buf + i), vsat), vsat), vzero);
+            _mm_storeu_si128((__m128i*)idx, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(vmaxidx, val), vhalf)));
+            memcpy(colorbuf + 4*i,      colorscheme->colors + idx[0]*4, 4);
+            memcpy(colorbuf + 4*i + 4,  colorscheme->colors + idx[1]*4, 4);
+            memcpy(colorbuf + 4*i + 8,  colorscheme->colors + idx[2]*4, 4);
+            memcpy(colorbuf + 4*i + 12, colorscheme->colors + idx[3]*4, 4);
+        }
+    }
+#endif
+
+    for( ; i < n ; ++i) {
+        /* Saturate the heat value to the given saturation, and then
+         * normalize by that.
+         */
+        const float val = (h->buf[i] > saturation ? saturation : h->buf[i])/saturation;
+
+        /* We add 0.5 in order to do real rounding, not just dropping the
+         * decimal part. That way we are certain the highest value in the
+         * colorscheme is actually used.
+         */
+        const size_t idx = (size_t)(maxidx*val + 0.5f);
+
+        /* This is probably caused by a negative entry in the stamp! */
+        assert(val >= 0.0f);
+
+        /* This should never happen. It is likely a bug in this library. */
+        assert(idx < colorscheme->ncolors);
+
+        /* Just copy over the color from the colorscheme. */
+        memcpy(colorbuf + 4*i, colorscheme->colors + idx*4, 4);
+    }
 
     return colorbuf;
 }
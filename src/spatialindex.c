@@ -0,0 +1,249 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include "spatialindex.h"
+
+// Maximum children of each node
+#define NODE_CAPACITY 16
+
+// NB The bounding box is first in both so they can be sorted by the same functions
+typedef struct {
+  LatLonBBox bbox;
+  gpointer key;
+  gpointer value;
+  guint stamp;
+} si_entry_t;
+
+typedef struct {
+  LatLonBBox bbox;
+  guint first;   // Of the entries for a leaf, otherwise of the nodes
+  guint count;
+  gboolean leaf;
+} si_node_t;
+
+struct _SpatialIndex {
+  GArray *entries;
+  GArray *nodes;  // Each level after the one below it, thus the root is last
+  gboolean built;
+};
+
+SpatialIndex *spatial_index_new ()
+{
+  SpatialIndex *si = g_malloc0 ( sizeof(SpatialIndex) );
+  si->entries = g_array_new ( FALSE, FALSE, sizeof(si_entry_t) );
+  si->nodes = g_array_new ( FALSE, FALSE, sizeof(si_node_t) );
+  return si;
+}
+
+void spatial_index_free ( SpatialIndex *si )
+{
+  if ( !si )
+    return;
+  g_array_free ( si->entries, TRUE );
+  g_array_free ( si->nodes, TRUE );
+  g_free ( si );
+}
+
+void spatial_index_clear ( SpatialIndex *si )
+{
+  g_array_set_size ( si->entries, 0 );
+  g_array_set_size ( si->nodes, 0 );
+  si->built = FALSE;
+}
+
+/**
+ * spatial_index_add:
+ * @stamp: Any value by which the SpatialIndexCheckFunc can tell whether the item has since changed
+ *
+ * Duplicate keys are not checked for.
+ */
+void spatial_index_add ( SpatialIndex *si, gpointer key, gpointer value, LatLonBBox bbox, guint stamp )
+{
+  si_entry_t entry = { bbox, key, value, stamp };
+  g_array_append_val ( si->entries, entry );
+  si->built = FALSE;
+}
+
+guint spatial_index_size ( SpatialIndex *si )
+{
+  return si->entries->len;
+}
+
+/**
+ * spatial_index_check:
+ *
+ * Update the items which have changed, according to the function
+ *
+ * Returns: The number of changed items
+ */
+guint spatial_index_check ( SpatialIndex *si, SpatialIndexCheckFunc func )
+{
+  guint changed = 0;
+  for ( guint ii = 0; ii < si->entries->len; ii++ ) {
+    si_entry_t *entry = &g_array_index ( si->entries, si_entry_t, ii );
+    if ( func ( entry->key, entry->value, &entry->bbox, &entry->stamp ) )
+      changed++;
+  }
+  if ( changed )
+    si->built = FALSE;
+  return changed;
+}
+
+static int compare_east_west ( const void *a, const void *b )
+{
+  const LatLonBBox *bb1 = a, *bb2 = b;
+  gdouble c1 = bb1->east + bb1->west;
+  gdouble c2 = bb2->east + bb2->west;
+  return (c1 > c2) - (c1 < c2);
+}
+
+static int compare_north_south ( const void *a, const void *b )
+{
+  const LatLonBBox *bb1 = a, *bb2 = b;
+  gdouble c1 = bb1->north + bb1->south;
+  gdouble c2 = bb2->north + bb2->south;
+  return (c1 > c2) - (c1 < c2);
+}
+
+/**
+ * Sort-Tile-Recursive ordering of the items, such that each run of NODE_CAPACITY items
+ *  covers a small area: sorted into vertical slices by their centres,
+ *  then each slice sorted from south to north
+ */
+static void str_sort ( gpointer items, guint count, gsize size )
+{
+  if ( count <= NODE_CAPACITY )
+    return;
+  guint parents = (count + NODE_CAPACITY - 1) / NODE_CAPACITY;
+  guint slices = (guint)ceil ( sqrt ( parents ) );
+  guint per_slice = slices * NODE_CAPACITY;
+
+  qsort ( items, count, size, compare_east_west );
+  for ( guint start = 0; start < count; start += per_slice )
+    qsort ( (guint8*)items + start * size, MIN(per_slice, count - start), size, compare_north_south );
+}
+
+static void bbox_union ( LatLonBBox *bbox, const LatLonBBox *other, gboolean first )
+{
+  if ( first ) {
+    *bbox = *other;
+    return;
+  }
+  bbox->south = MIN ( bbox->south, other->south );
+  bbox->north = MAX ( bbox->north, other->north );
+  bbox->west = MIN ( bbox->west, other->west );
+  bbox->east = MAX ( bbox->east, other->east );
+}
+
+/**
+ * Bulk load the whole tree from the entries
+ */
+static void spatial_index_build ( SpatialIndex *si )
+{
+  g_array_set_size ( si->nodes, 0 );
+  si->built = TRUE;
+  if ( !si->entries->len )
+    return;
+
+  str_sort ( si->entries->data, si->entries->len, sizeof(si_entry_t) );
+  for ( guint start = 0; start < si->entries->len; start += NODE_CAPACITY ) {
+    si_node_t node = { { 0 }, start, MIN(NODE_CAPACITY, si->entries->len - start), TRUE };
+    for ( guint ii = 0; ii < node.count; ii++ )
+      bbox_union ( &node.bbox, &g_array_index(si->entries, si_entry_t, start+ii).bbox, ii == 0 );
+    g_array_append_val ( si->nodes, node );
+  }
+
+  // Then each level above until there is only the root
+  guint level = 0;
+  guint level_count = si->nodes->len;
+  while ( level_count > 1 ) {
+    // Sorting nodes of this level does not affect what they refer to
+    str_sort ( &g_array_index(si->nodes, si_node_t, level), level_count, sizeof(si_node_t) );
+    for ( guint start = level; start < level + level_count; start += NODE_CAPACITY ) {
+      si_node_t node = { { 0 }, start, MIN(NODE_CAPACITY, level + level_count - start), FALSE };
+      for ( guint ii = 0; ii < node.count; ii++ )
+        bbox_union ( &node.bbox, &g_array_index(si->nodes, si_node_t, start+ii).bbox, ii == 0 );
+      g_array_append_val ( si->nodes, node );
+    }
+    level += level_count;
+    level_count = si->nodes->len - level;
+  }
+}
+
+static guint search_node ( SpatialIndex *si, si_node_t *node, LatLonBBox *bbox, GHFunc func, gpointer user_data )
+{
+  guint found = 0;
+  if ( node->leaf ) {
+    for ( guint ii = node->first; ii < node->first + node->count; ii++ ) {
+      si_entry_t *entry = &g_array_index ( si->entries, si_entry_t, ii );
+      if ( BBOX_INTERSECT(entry->bbox, *bbox) ) {
+        func ( entry->key, entry->value, user_data );
+        found++;
+      }
+    }
+  }
+  else {
+    for ( guint ii = node->first; ii < node->first + node->count; ii++ ) {
+      si_node_t *child = &g_array_index ( si->nodes, si_node_t, ii );
+      if ( BBOX_INTERSECT(child->bbox, *bbox) )
+        found += search_node ( si, child, bbox, func, user_data );
+    }
+  }
+  return found;
+}
+
+/**
+ * spatial_index_foreach_in_bbox:
+ * @func: Called for each item whose bounding box intersects @bbox (as BBOX_INTERSECT)
+ *
+ * The items must not be added to or changed in the index by the function.
+ *
+ * Returns: The number of items found
+ */
+guint spatial_index_foreach_in_bbox ( SpatialIndex *si, LatLonBBox bbox, GHFunc func, gpointer user_data )
+{
+  if ( !si->built )
+    spatial_index_build ( si );
+  if ( !si->nodes->len )
+    return 0;
+  si_node_t *root = &g_array_index ( si->nodes, si_node_t, si->nodes->len - 1 );
+  if ( !BBOX_INTERSECT(root->bbox, bbox) )
+    return 0;
+  return search_node ( si, root, &bbox, func, user_data );
+}
+
+/**
+ * spatial_index_get_bbox:
+ *
+ * Returns: FALSE if there are no items, otherwise the bounding box of them all is set in @bbox
+ */
+gboolean spatial_index_get_bbox ( SpatialIndex *si, LatLonBBox *bbox )
+{
+  if ( !si->built )
+    spatial_index_build ( si );
+  if ( !si->nodes->len )
+    return FALSE;
+  *bbox = g_array_index ( si->nodes, si_node_t, si->nodes->len - 1 ).bbox;
+  return TRUE;
+}
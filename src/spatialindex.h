@@ -0,0 +1,53 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_SPATIALINDEX_H
+#define __VIKING_SPATIALINDEX_H
+
+#include <glib.h>
+#include "bbox.h"
+
+G_BEGIN_DECLS
+
+/**
+ * Bounding box index of key/value items (e.g. the tracks of a layer),
+ *  as a packed R-tree made by Sort-Tile-Recursive bulk loading.
+ *
+ * The tree is remade when first searched after any items have been added or changed,
+ *  so it suits many searches between changes (e.g. every redraw) rather than many small changes.
+ */
+typedef struct _SpatialIndex SpatialIndex;
+
+/**
+ * Returns: TRUE when the item has changed since (stamp), with the new (bbox) and (stamp) set
+ */
+typedef gboolean (*SpatialIndexCheckFunc) ( gpointer key, gpointer value, LatLonBBox *bbox, guint *stamp );
+
+SpatialIndex *spatial_index_new ();
+void spatial_index_free ( SpatialIndex *si );
+void spatial_index_clear ( SpatialIndex *si );
+void spatial_index_add ( SpatialIndex *si, gpointer key, gpointer value, LatLonBBox bbox, guint stamp );
+guint spatial_index_size ( SpatialIndex *si );
+guint spatial_index_check ( SpatialIndex *si, SpatialIndexCheckFunc func );
+guint spatial_index_foreach_in_bbox ( SpatialIndex *si, LatLonBBox bbox, GHFunc func, gpointer user_data );
+gboolean spatial_index_get_bbox ( SpatialIndex *si, LatLonBBox *bbox );
+
+G_END_DECLS
+
+#endif
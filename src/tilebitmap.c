@@ -0,0 +1,510 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "tilebitmap.h"
+
+#define SIZE TILE_BITMAP_CHUNK_SIZE
+#define SHIFT TILE_BITMAP_CHUNK_SHIFT
+
+typedef struct {
+  gint64 key;   // Of the position, as chunk_key()
+  gint cx, cy;  // Position in chunks, i.e. of its north west tile divided by the chunk size
+  guint64 rows[SIZE]; // Bit (x) of row (y) is set for each tile
+  guint *labels;      // Of each tile as [y*SIZE+x], only allocated once one is set
+} tb_chunk_t;
+
+struct _TileBitmap {
+  GHashTable *chunks; // Of tb_chunk_t keyed by their key
+  GPtrArray *order;   // The chunks in iteration order, remade after new chunks are added
+  guint count;
+};
+
+// NB Arithmetic shifts, so positions before zero are in negative chunks
+static inline gint64 chunk_key ( gint cx, gint cy )
+{
+  return (gint64)(((guint64)(guint32)cy << 32) | (guint32)cx);
+}
+
+static inline guint lowest_bit ( guint64 bits )
+{
+#ifdef __GNUC__
+  return __builtin_ctzll ( bits );
+#else
+  guint nn = 0;
+  while ( !(bits & 1) ) {
+    bits >>= 1;
+    nn++;
+  }
+  return nn;
+#endif
+}
+
+static inline guint highest_bit ( guint64 bits )
+{
+#ifdef __GNUC__
+  return 63 - __builtin_clzll ( bits );
+#else
+  guint nn = 63;
+  while ( !(bits & G_GUINT64_CONSTANT(0x8000000000000000)) ) {
+    bits <<= 1;
+    nn--;
+  }
+  return nn;
+#endif
+}
+
+static inline guint count_bits ( guint64 bits )
+{
+#ifdef __GNUC__
+  return __builtin_popcountll ( bits );
+#else
+  guint nn = 0;
+  for ( ; bits; bits &= bits - 1 )
+    nn++;
+  return nn;
+#endif
+}
+
+static void chunk_free ( tb_chunk_t *chunk )
+{
+  g_free ( chunk->labels );
+  g_free ( chunk );
+}
+
+static inline tb_chunk_t *get_chunk ( TileBitmap *tb, gint cx, gint cy )
+{
+  gint64 key = chunk_key ( cx, cy );
+  return g_hash_table_lookup ( tb->chunks, &key );
+}
+
+static tb_chunk_t *get_chunk_new ( TileBitmap *tb, gint cx, gint cy )
+{
+  tb_chunk_t *chunk = get_chunk ( tb, cx, cy );
+  if ( !chunk ) {
+    chunk = g_malloc0 ( sizeof(tb_chunk_t) );
+    chunk->cx = cx;
+    chunk->cy = cy;
+    chunk->key = chunk_key ( cx, cy );
+    g_hash_table_insert ( tb->chunks, &chunk->key, chunk );
+    if ( tb->order ) {
+      g_ptr_array_free ( tb->order, TRUE );
+      tb->order = NULL;
+    }
+  }
+  return chunk;
+}
+
+TileBitmap *tile_bitmap_new ()
+{
+  TileBitmap *tb = g_malloc0 ( sizeof(TileBitmap) );
+  tb->chunks = g_hash_table_new_full ( g_int64_hash, g_int64_equal, NULL, (GDestroyNotify)chunk_free );
+  return tb;
+}
+
+/**
+ * tile_bitmap_copy:
+ *
+ * Returns: A new bitmap of the same tiles and labels
+ */
+TileBitmap *tile_bitmap_copy ( TileBitmap *tb )
+{
+  TileBitmap *copy = tile_bitmap_new ();
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tb->chunks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    tb_chunk_t *chunk = get_chunk_new ( copy, ((tb_chunk_t*)value)->cx, ((tb_chunk_t*)value)->cy );
+    memcpy ( chunk->rows, ((tb_chunk_t*)value)->rows, sizeof(chunk->rows) );
+    if ( ((tb_chunk_t*)value)->labels )
+      chunk->labels = g_memdup ( ((tb_chunk_t*)value)->labels, SIZE * SIZE * sizeof(guint) );
+  }
+  copy->count = tb->count;
+  return copy;
+}
+
+void tile_bitmap_free ( TileBitmap *tb )
+{
+  if ( !tb )
+    return;
+  g_hash_table_destroy ( tb->chunks );
+  if ( tb->order )
+    g_ptr_array_free ( tb->order, TRUE );
+  g_free ( tb );
+}
+
+void tile_bitmap_clear ( TileBitmap *tb )
+{
+  g_hash_table_remove_all ( tb->chunks );
+  if ( tb->order ) {
+    g_ptr_array_free ( tb->order, TRUE );
+    tb->order = NULL;
+  }
+  tb->count = 0;
+}
+
+/**
+ * tile_bitmap_clear_labels:
+ *
+ * Reset all labels to 0 and release their storage
+ */
+void tile_bitmap_clear_labels ( TileBitmap *tb )
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tb->chunks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    g_free ( ((tb_chunk_t*)value)->labels );
+    ((tb_chunk_t*)value)->labels = NULL;
+  }
+}
+
+/**
+ * tile_bitmap_add:
+ *
+ * Returns: TRUE if the tile was not already in the bitmap
+ */
+gboolean tile_bitmap_add ( TileBitmap *tb, gint x, gint y )
+{
+  tb_chunk_t *chunk = get_chunk_new ( tb, x >> SHIFT, y >> SHIFT );
+  guint64 bit = G_GUINT64_CONSTANT(1) << (x & (SIZE-1));
+  guint64 *row = &chunk->rows[y & (SIZE-1)];
+  if ( *row & bit )
+    return FALSE;
+  *row |= bit;
+  tb->count++;
+  return TRUE;
+}
+
+/**
+ * tile_bitmap_remove:
+ *
+ * Any label of the tile is also reset
+ *
+ * Returns: TRUE if the tile was in the bitmap
+ */
+gboolean tile_bitmap_remove ( TileBitmap *tb, gint x, gint y )
+{
+  tb_chunk_t *chunk = get_chunk ( tb, x >> SHIFT, y >> SHIFT );
+  if ( !chunk )
+    return FALSE;
+  guint64 bit = G_GUINT64_CONSTANT(1) << (x & (SIZE-1));
+  guint64 *row = &chunk->rows[y & (SIZE-1)];
+  if ( !(*row & bit) )
+    return FALSE;
+  *row &= ~bit;
+  if ( chunk->labels )
+    chunk->labels[(y & (SIZE-1)) * SIZE + (x & (SIZE-1))] = 0;
+  tb->count--;
+  return TRUE;
+}
+
+gboolean tile_bitmap_contains ( TileBitmap *tb, gint x, gint y )
+{
+  tb_chunk_t *chunk = get_chunk ( tb, x >> SHIFT, y >> SHIFT );
+  if ( !chunk )
+    return FALSE;
+  return (chunk->rows[y & (SIZE-1)] >> (x & (SIZE-1))) & 1;
+}
+
+guint tile_bitmap_size ( TileBitmap *tb )
+{
+  return tb->count;
+}
+
+/**
+ * tile_bitmap_get_extents:
+ *
+ * Returns: FALSE when there are no tiles, otherwise the inclusive range of the tile positions is set
+ */
+gboolean tile_bitmap_get_extents ( TileBitmap *tb, gint *xmin, gint *ymin, gint *xmax, gint *ymax )
+{
+  gboolean found = FALSE;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tb->chunks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    tb_chunk_t *chunk = value;
+    guint64 cols = 0;
+    gint first = -1, last = -1;
+    for ( gint ii = 0; ii < SIZE; ii++ ) {
+      if ( chunk->rows[ii] ) {
+        cols |= chunk->rows[ii];
+        if ( first < 0 )
+          first = ii;
+        last = ii;
+      }
+    }
+    if ( !cols )
+      continue;
+    gint x1 = chunk->cx * SIZE + lowest_bit ( cols );
+    gint x2 = chunk->cx * SIZE + highest_bit ( cols );
+    gint y1 = chunk->cy * SIZE + first;
+    gint y2 = chunk->cy * SIZE + last;
+    if ( !found ) {
+      *xmin = x1; *xmax = x2;
+      *ymin = y1; *ymax = y2;
+      found = TRUE;
+    }
+    else {
+      *xmin = MIN ( *xmin, x1 ); *xmax = MAX ( *xmax, x2 );
+      *ymin = MIN ( *ymin, y1 ); *ymax = MAX ( *ymax, y2 );
+    }
+  }
+  return found;
+}
+
+/**
+ * tile_bitmap_set_label:
+ *
+ * Labels can only be given to tiles in the bitmap, otherwise this does nothing
+ */
+void tile_bitmap_set_label ( TileBitmap *tb, gint x, gint y, guint label )
+{
+  tb_chunk_t *chunk = get_chunk ( tb, x >> SHIFT, y >> SHIFT );
+  if ( !chunk )
+    return;
+  if ( !chunk->labels ) {
+    if ( !label )
+      return;
+    chunk->labels = g_malloc0 ( SIZE * SIZE * sizeof(guint) );
+  }
+  chunk->labels[(y & (SIZE-1)) * SIZE + (x & (SIZE-1))] = label;
+}
+
+/**
+ * tile_bitmap_get_label:
+ *
+ * Returns: The label of the tile, or 0 if none has been set
+ */
+guint tile_bitmap_get_label ( TileBitmap *tb, gint x, gint y )
+{
+  tb_chunk_t *chunk = get_chunk ( tb, x >> SHIFT, y >> SHIFT );
+  if ( !chunk || !chunk->labels )
+    return 0;
+  return chunk->labels[(y & (SIZE-1)) * SIZE + (x & (SIZE-1))];
+}
+
+/**
+ * Add the tiles set in (rows) to the chunk of (dest) at the position
+ *
+ * Returns: The number of tiles that were not already in (dest)
+ */
+static guint add_rows ( TileBitmap *dest, gint cx, gint cy, const guint64 *rows )
+{
+  tb_chunk_t *chunk = NULL;
+  guint added = 0;
+  for ( gint ii = 0; ii < SIZE; ii++ ) {
+    if ( !rows[ii] )
+      continue;
+    if ( !chunk )
+      chunk = get_chunk_new ( dest, cx, cy );
+    added += count_bits ( rows[ii] & ~chunk->rows[ii] );
+    chunk->rows[ii] |= rows[ii];
+  }
+  dest->count += added;
+  return added;
+}
+
+/**
+ * For the row (ry) of the chunks around the middle one,
+ *  where the row may be one outside the middle chunk to the north or south,
+ *  the tiles which are set along with both of their neighbours to the west and east
+ */
+static guint64 row_with_neighbours ( tb_chunk_t *around[3][3], gint ry )
+{
+  gint dy = ry < 0 ? 0 : ry >= SIZE ? 2 : 1;
+  gint rr = ry & (SIZE-1);
+  guint64 west = around[dy][0] ? around[dy][0]->rows[rr] : 0;
+  guint64 mid = around[dy][1] ? around[dy][1]->rows[rr] : 0;
+  guint64 east = around[dy][2] ? around[dy][2]->rows[rr] : 0;
+  // Bit (i-1) moved to (i), carrying the last bit of the chunk to the west; and likewise to the east
+  return mid & ((mid << 1) | (west >> (SIZE-1))) & ((mid >> 1) | (east << (SIZE-1)));
+}
+
+/**
+ * tile_bitmap_add_interior:
+ * @dest: Where to add the tiles, which must not be @tb
+ *
+ * Add the tiles of @tb whose eight neighbours are also all in @tb.
+ * Worked out a whole row of a chunk at a time.
+ *
+ * Returns: The number of tiles that were not already in @dest
+ */
+guint tile_bitmap_add_interior ( TileBitmap *dest, TileBitmap *tb )
+{
+  guint added = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tb->chunks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    tb_chunk_t *chunk = value;
+    tb_chunk_t *around[3][3];
+    for ( gint dy = 0; dy < 3; dy++ )
+      for ( gint dx = 0; dx < 3; dx++ )
+        around[dy][dx] = (dx == 1 && dy == 1) ? chunk : get_chunk ( tb, chunk->cx + dx - 1, chunk->cy + dy - 1 );
+
+    guint64 rows[SIZE];
+    guint64 above = row_with_neighbours ( around, -1 );
+    guint64 here = row_with_neighbours ( around, 0 );
+    for ( gint ii = 0; ii < SIZE; ii++ ) {
+      guint64 below = row_with_neighbours ( around, ii + 1 );
+      rows[ii] = above & here & below;
+      above = here;
+      here = below;
+    }
+    added += add_rows ( dest, chunk->cx, chunk->cy, rows );
+  }
+  return added;
+}
+
+/**
+ * tile_bitmap_add_difference:
+ * @dest: Where to add the tiles, which must not be @tb
+ *
+ * Add the tiles of @tb which are not in @other
+ *
+ * Returns: The number of tiles that were not already in @dest
+ */
+guint tile_bitmap_add_difference ( TileBitmap *dest, TileBitmap *tb, TileBitmap *other )
+{
+  guint added = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tb->chunks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    tb_chunk_t *chunk = value;
+    tb_chunk_t *exclude = get_chunk ( other, chunk->cx, chunk->cy );
+    guint64 rows[SIZE];
+    for ( gint ii = 0; ii < SIZE; ii++ )
+      rows[ii] = exclude ? chunk->rows[ii] & ~exclude->rows[ii] : chunk->rows[ii];
+    added += add_rows ( dest, chunk->cx, chunk->cy, rows );
+  }
+  return added;
+}
+
+/**
+ * tile_bitmap_add_union:
+ * @dest: Where to add the tiles, which must not be @tb
+ *
+ * Add all the tiles of @tb (but not their labels)
+ *
+ * Returns: The number of tiles that were not already in @dest
+ */
+guint tile_bitmap_add_union ( TileBitmap *dest, TileBitmap *tb )
+{
+  guint added = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tb->chunks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+    added += add_rows ( dest, ((tb_chunk_t*)value)->cx, ((tb_chunk_t*)value)->cy, ((tb_chunk_t*)value)->rows );
+  return added;
+}
+
+/**
+ * tile_bitmap_add_labels:
+ * @dest: Where to add the tiles, which must not be @tb
+ *
+ * Add all the tiles of @tb, with their labels added onto those in @dest
+ *  (e.g. when the labels are counts)
+ *
+ * Returns: The number of tiles that were not already in @dest
+ */
+guint tile_bitmap_add_labels ( TileBitmap *dest, TileBitmap *tb )
+{
+  guint added = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, tb->chunks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    tb_chunk_t *chunk = value;
+    added += add_rows ( dest, chunk->cx, chunk->cy, chunk->rows );
+    if ( !chunk->labels )
+      continue;
+    tb_chunk_t *dchunk = get_chunk ( dest, chunk->cx, chunk->cy );
+    if ( !dchunk ) // Only when there are labels without tiles
+      continue;
+    if ( !dchunk->labels )
+      dchunk->labels = g_malloc0 ( SIZE * SIZE * sizeof(guint) );
+    for ( guint ii = 0; ii < SIZE * SIZE; ii++ )
+      dchunk->labels[ii] += chunk->labels[ii];
+  }
+  return added;
+}
+
+static gint compare_chunks ( gconstpointer a, gconstpointer b )
+{
+  const tb_chunk_t *c1 = *(const tb_chunk_t**)a;
+  const tb_chunk_t *c2 = *(const tb_chunk_t**)b;
+  if ( c1->cy != c2->cy )
+    return (c1->cy > c2->cy) - (c1->cy < c2->cy);
+  return (c1->cx > c2->cx) - (c1->cx < c2->cx);
+}
+
+/**
+ * tile_bitmap_iter_init:
+ *
+ * NB Not to be used by different threads at the same time, as the order may have to be remade
+ */
+void tile_bitmap_iter_init ( TileBitmapIter *iter, TileBitmap *tb )
+{
+  if ( !tb->order ) {
+    tb->order = g_ptr_array_sized_new ( g_hash_table_size ( tb->chunks ) );
+    GHashTableIter hiter;
+    gpointer key, value;
+    g_hash_table_iter_init ( &hiter, tb->chunks );
+    while ( g_hash_table_iter_next ( &hiter, &key, &value ) )
+      g_ptr_array_add ( tb->order, value );
+    g_ptr_array_sort ( tb->order, compare_chunks );
+  }
+  iter->tb = tb;
+  iter->chunk = 0;
+  iter->row = 0;
+  iter->bits = tb->order->len ? ((tb_chunk_t*)g_ptr_array_index ( tb->order, 0 ))->rows[0] : 0;
+}
+
+/**
+ * tile_bitmap_iter_next:
+ *
+ * Returns: FALSE when there are no more tiles, otherwise the position of the next one is set
+ */
+gboolean tile_bitmap_iter_next ( TileBitmapIter *iter, gint *x, gint *y )
+{
+  GPtrArray *order = iter->tb->order;
+  while ( !iter->bits ) {
+    if ( iter->chunk >= order->len )
+      return FALSE;
+    if ( ++iter->row == SIZE ) {
+      iter->row = 0;
+      if ( ++iter->chunk >= order->len )
+        return FALSE;
+    }
+    iter->bits = ((tb_chunk_t*)g_ptr_array_index ( order, iter->chunk ))->rows[iter->row];
+  }
+  tb_chunk_t *chunk = g_ptr_array_index ( order, iter->chunk );
+  *x = chunk->cx * SIZE + lowest_bit ( iter->bits );
+  *y = chunk->cy * SIZE + iter->row;
+  // Clear the lowest bit
+  iter->bits &= iter->bits - 1;
+  return TRUE;
+}
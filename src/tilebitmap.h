@@ -0,0 +1,76 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TILEBITMAP_H
+#define __VIKING_TILEBITMAP_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * Sparse set of tile positions (e.g. those visited by tracks),
+ *  held as bitmaps of 64x64 tile chunks in a hash table keyed by the chunk position.
+ *
+ * Each tile can also be given a label, with the storage only allocated for chunks that use labels.
+ */
+typedef struct _TileBitmap TileBitmap;
+
+#define TILE_BITMAP_CHUNK_SHIFT 6
+#define TILE_BITMAP_CHUNK_SIZE (1 << TILE_BITMAP_CHUNK_SHIFT)
+
+/**
+ * Visits the tiles chunk by chunk, and within each chunk row by row from the west.
+ * Thus each tile comes after its neighbours to the west, the north and the north west.
+ *
+ * Tiles must not be added while iterating, although labels may be changed.
+ */
+typedef struct {
+  TileBitmap *tb;
+  guint chunk;
+  guint row;
+  guint64 bits;  // Those of the row yet to be visited
+} TileBitmapIter;
+
+TileBitmap *tile_bitmap_new ();
+TileBitmap *tile_bitmap_copy ( TileBitmap *tb );
+void tile_bitmap_free ( TileBitmap *tb );
+void tile_bitmap_clear ( TileBitmap *tb );
+void tile_bitmap_clear_labels ( TileBitmap *tb );
+
+gboolean tile_bitmap_add ( TileBitmap *tb, gint x, gint y );
+gboolean tile_bitmap_remove ( TileBitmap *tb, gint x, gint y );
+gboolean tile_bitmap_contains ( TileBitmap *tb, gint x, gint y );
+guint tile_bitmap_size ( TileBitmap *tb );
+gboolean tile_bitmap_get_extents ( TileBitmap *tb, gint *xmin, gint *ymin, gint *xmax, gint *ymax );
+
+void tile_bitmap_set_label ( TileBitmap *tb, gint x, gint y, guint label );
+guint tile_bitmap_get_label ( TileBitmap *tb, gint x, gint y );
+
+guint tile_bitmap_add_interior ( TileBitmap *dest, TileBitmap *tb );
+guint tile_bitmap_add_difference ( TileBitmap *dest, TileBitmap *tb, TileBitmap *other );
+guint tile_bitmap_add_union ( TileBitmap *dest, TileBitmap *tb );
+guint tile_bitmap_add_labels ( TileBitmap *dest, TileBitmap *tb );
+
+void tile_bitmap_iter_init ( TileBitmapIter *iter, TileBitmap *tb );
+gboolean tile_bitmap_iter_next ( TileBitmapIter *iter, gint *x, gint *y );
+
+G_END_DECLS
+
+#endif
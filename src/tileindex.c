@@ -0,0 +1,373 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib/gstdio.h>
+#include "tileindex.h"
+#include "settings.h"
+#include "vik_compat.h"
+
+#define VIK_SETTINGS_MAP_TILE_INDEX "maps_tile_index"
+#define VIK_SETTINGS_MAP_TILE_INDEX_RESCAN "maps_tile_index_rescan_interval"
+#define VIK_SETTINGS_MAP_TILE_INDEX_MAX_TILES "maps_tile_index_max_tiles"
+
+// Seconds after which a zoom level is scanned again, to notice changes made by other programs
+#define TI_RESCAN_INTERVAL_DEFAULT 600
+// Zoom levels with more files than this are not indexed (the filesystem is used instead)
+#define TI_MAX_TILES_DEFAULT 1000000
+
+typedef struct {
+  gint64 xy;    // Hash key - x and y packed together
+  gint64 mtime;
+  goffset size; // Negative for a removed tile (only in the changes table)
+} ti_entry_t;
+
+typedef struct {
+  const gchar *dir;     // Zoom level directory
+  const gchar *ext;     // File extension of the tiles
+} ti_key_t;
+
+typedef struct {
+  ti_key_t key;         // Hash key - owned by the level
+  GHashTable *tiles;    // Of ti_entry_t
+  GHashTable *changes;  // Of ti_entry_t - updates whilst a scan is in progress
+  gboolean ready;       // A scan has completed
+  gboolean too_big;     // Not indexed and not scanned again
+  gboolean scanning;    // Queued or in progress
+  gboolean orphaned;    // Flushed whilst scanning - the scan frees it
+  gint64 scan_time;     // Monotonic time of the last completed scan
+} ti_level_t;
+
+static gboolean enabled = TRUE;
+static gint rescan_interval = TI_RESCAN_INTERVAL_DEFAULT;
+static gint max_tiles = TI_MAX_TILES_DEFAULT;
+
+static GMutex *ti_mutex = NULL;
+static GHashTable *levels = NULL; // Of ti_level_t keyed by directory+extension
+static GSList *orphans = NULL;    // Flushed levels still queued or being scanned
+static GThreadPool *scan_pool = NULL;
+static volatile gboolean shutting_down = FALSE;
+
+static inline gint64 pack_xy ( gint x, gint y )
+{
+  return ((gint64)x << 32) | (guint32)y;
+}
+
+static GHashTable *tiles_new ()
+{
+  // Key is the start of the value
+  return g_hash_table_new_full ( g_int64_hash, g_int64_equal, NULL, g_free );
+}
+
+static void tiles_set ( GHashTable *tiles, gint64 xy, gint64 mtime, goffset size )
+{
+  ti_entry_t *entry = g_malloc ( sizeof(ti_entry_t) );
+  entry->xy = xy;
+  entry->mtime = mtime;
+  entry->size = size;
+  g_hash_table_replace ( tiles, entry, entry );
+}
+
+static void level_free ( ti_level_t *level )
+{
+  g_hash_table_destroy ( level->tiles );
+  g_hash_table_destroy ( level->changes );
+  g_free ( (gchar*)level->key.dir );
+  g_free ( (gchar*)level->key.ext );
+  g_free ( level );
+}
+
+static guint key_hash ( gconstpointer ptr )
+{
+  const ti_key_t *key = ptr;
+  return g_str_hash ( key->dir ) * 31 + g_str_hash ( key->ext );
+}
+
+static gboolean key_equal ( gconstpointer ptr1, gconstpointer ptr2 )
+{
+  const ti_key_t *k1 = ptr1;
+  const ti_key_t *k2 = ptr2;
+  return g_str_equal ( k1->dir, k2->dir ) && g_str_equal ( k1->ext, k2->ext );
+}
+
+/**
+ * Parse a file or directory name of the form <number><ext>
+ */
+static gboolean parse_name ( const gchar *name, const gchar *ext, gint *value )
+{
+  gchar *end = NULL;
+  gint64 val = g_ascii_strtoll ( name, &end, 10 );
+  if ( end == name || strcmp ( end, ext ) != 0 )
+    return FALSE;
+  if ( val < G_MININT || val > G_MAXINT )
+    return FALSE;
+  *value = (gint)val;
+  return TRUE;
+}
+
+/**
+ * Read the <x>/<y><ext> files of a zoom level directory
+ *
+ * Returns FALSE if the directory has more tiles than will be indexed
+ */
+static gboolean scan_dir ( const gchar *dir, const gchar *ext, GHashTable *tiles )
+{
+  GDir *zdir = g_dir_open ( dir, 0, NULL );
+  if ( !zdir )
+    return TRUE; // Nothing there (yet)
+
+  gboolean ok = TRUE;
+  const gchar *xname;
+  while ( ok && !shutting_down && (xname = g_dir_read_name ( zdir )) ) {
+    gint x;
+    if ( !parse_name ( xname, "", &x ) )
+      continue;
+    gchar *xpath = g_build_filename ( dir, xname, NULL );
+    GDir *xdir = g_dir_open ( xpath, 0, NULL );
+    if ( xdir ) {
+      const gchar *yname;
+      while ( (yname = g_dir_read_name ( xdir )) ) {
+        gint y;
+        if ( !parse_name ( yname, ext, &y ) )
+          continue;
+        gchar *ypath = g_build_filename ( xpath, yname, NULL );
+        GStatBuf buf;
+        if ( g_stat ( ypath, &buf ) == 0 )
+          tiles_set ( tiles, pack_xy(x,y), buf.st_mtime, buf.st_size );
+        g_free ( ypath );
+      }
+      g_dir_close ( xdir );
+    }
+    g_free ( xpath );
+    if ( max_tiles > 0 && g_hash_table_size(tiles) > (guint)max_tiles )
+      ok = FALSE;
+  }
+  g_dir_close ( zdir );
+  return ok;
+}
+
+static void scan_level ( ti_level_t *level, gpointer user_data )
+{
+  GHashTable *tiles = tiles_new ();
+  gboolean ok = scan_dir ( level->key.dir, level->key.ext, tiles );
+
+  g_mutex_lock ( ti_mutex );
+  if ( level->orphaned || shutting_down ) {
+    // Levels still in the hash table are freed on uninit
+    if ( level->orphaned ) {
+      orphans = g_slist_remove ( orphans, level );
+      level_free ( level );
+    }
+    else
+      level->scanning = FALSE;
+    g_mutex_unlock ( ti_mutex );
+    g_hash_table_destroy ( tiles );
+    return;
+  }
+
+  if ( ok ) {
+    // Apply any downloads (or removals) that happened during the scan
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init ( &iter, level->changes );
+    while ( g_hash_table_iter_next ( &iter, NULL, &value ) ) {
+      ti_entry_t *entry = (ti_entry_t*)value;
+      if ( entry->size < 0 )
+        g_hash_table_remove ( tiles, &entry->xy );
+      else
+        tiles_set ( tiles, entry->xy, entry->mtime, entry->size );
+    }
+    g_hash_table_destroy ( level->tiles );
+    level->tiles = tiles;
+    level->ready = TRUE;
+  }
+  else {
+    g_debug ( "%s: Not indexing %s as it has over %d tiles", __FUNCTION__, level->key.dir, max_tiles );
+    g_hash_table_remove_all ( level->tiles );
+    g_hash_table_destroy ( tiles );
+    level->ready = FALSE;
+    level->too_big = TRUE;
+  }
+  g_hash_table_remove_all ( level->changes );
+  level->scanning = FALSE;
+  level->scan_time = g_get_monotonic_time ();
+  g_mutex_unlock ( ti_mutex );
+}
+
+void a_tileindex_init ()
+{
+  gboolean gbtmp;
+  if ( a_settings_get_boolean ( VIK_SETTINGS_MAP_TILE_INDEX, &gbtmp ) )
+    enabled = gbtmp;
+
+  gint gitmp;
+  if ( a_settings_get_integer ( VIK_SETTINGS_MAP_TILE_INDEX_RESCAN, &gitmp ) )
+    rescan_interval = gitmp;
+
+  if ( a_settings_get_integer ( VIK_SETTINGS_MAP_TILE_INDEX_MAX_TILES, &gitmp ) )
+    max_tiles = gitmp;
+
+  ti_mutex = vik_mutex_new ();
+  // Key is the start of the value
+  levels = g_hash_table_new ( key_hash, key_equal );
+  // Scanning is mostly waiting on the filesystem, so one thread is plenty
+  scan_pool = g_thread_pool_new ( (GFunc)scan_level, NULL, 1, FALSE, NULL );
+}
+
+static void queue_scan ( ti_level_t *level )
+{
+  level->scanning = TRUE;
+  g_thread_pool_push ( scan_pool, level, NULL );
+}
+
+/**
+ * a_tileindex_lookup:
+ * @dir:  The zoom level directory
+ * @ext:  The file extension of the tiles
+ * @info: Returned details of the tile file
+ *
+ * The first lookup in a directory starts the background scan of it.
+ *
+ * Returns: TRUE if the index knows about the tile file <dir>/<x>/<y><ext> (whether it exists or not),
+ *          otherwise FALSE meaning the caller has to check the filesystem itself.
+ */
+gboolean a_tileindex_lookup ( const gchar *dir, const gchar *ext, gint x, gint y, tileindex_info_t *info )
+{
+  if ( !enabled || !levels )
+    return FALSE;
+
+  ti_key_t key = { dir, ext };
+  gboolean known = FALSE;
+
+  g_mutex_lock ( ti_mutex );
+  ti_level_t *level = g_hash_table_lookup ( levels, &key );
+  if ( !level ) {
+    level = g_malloc0 ( sizeof(ti_level_t) );
+    level->key.dir = g_strdup ( dir );
+    level->key.ext = g_strdup ( ext );
+    level->tiles = tiles_new ();
+    level->changes = tiles_new ();
+    g_hash_table_insert ( levels, level, level );
+    queue_scan ( level );
+  }
+  else if ( !level->scanning && !level->too_big && rescan_interval > 0 &&
+            (g_get_monotonic_time() - level->scan_time) > (gint64)rescan_interval * G_USEC_PER_SEC ) {
+    // Whilst rescanning the current index continues to be used
+    queue_scan ( level );
+  }
+
+  if ( level->ready ) {
+    gint64 xy = pack_xy ( x, y );
+    ti_entry_t *entry = g_hash_table_lookup ( level->tiles, &xy );
+    info->exists = (entry != NULL);
+    info->mtime = entry ? entry->mtime : 0;
+    info->size = entry ? entry->size : 0;
+    known = TRUE;
+  }
+  g_mutex_unlock ( ti_mutex );
+
+  return known;
+}
+
+/**
+ * a_tileindex_update:
+ *
+ * Refresh the index for the tile file <dir>/<x>/<y><ext>,
+ *  such as after it has been downloaded or removed.
+ */
+void a_tileindex_update ( const gchar *dir, const gchar *ext, gint x, gint y )
+{
+  if ( !enabled || !levels )
+    return;
+
+  ti_key_t key = { dir, ext };
+  g_mutex_lock ( ti_mutex );
+  gboolean indexed = g_hash_table_contains ( levels, &key );
+  g_mutex_unlock ( ti_mutex );
+  if ( !indexed )
+    // Will be found when the level gets scanned
+    return;
+
+  gchar *filename = g_strdup_printf ( "%s" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d%s", dir, x, y, ext );
+  GStatBuf buf;
+  gboolean exists = (g_stat ( filename, &buf ) == 0);
+  g_free ( filename );
+
+  g_mutex_lock ( ti_mutex );
+  // Might have been flushed in the meantime
+  ti_level_t *level = g_hash_table_lookup ( levels, &key );
+  if ( level ) {
+    gint64 xy = pack_xy ( x, y );
+    if ( exists )
+      tiles_set ( level->tiles, xy, buf.st_mtime, buf.st_size );
+    else
+      g_hash_table_remove ( level->tiles, &xy );
+    if ( level->scanning )
+      tiles_set ( level->changes, xy, exists ? buf.st_mtime : 0, exists ? buf.st_size : -1 );
+  }
+  g_mutex_unlock ( ti_mutex );
+}
+
+static gboolean level_remove ( gpointer key, gpointer value, gpointer user_data )
+{
+  ti_level_t *level = (ti_level_t*)value;
+  gboolean force = GPOINTER_TO_INT(user_data);
+  if ( level->scanning && !force ) {
+    level->orphaned = TRUE;
+    orphans = g_slist_prepend ( orphans, level );
+  }
+  else
+    level_free ( level );
+  return TRUE;
+}
+
+/**
+ * a_tileindex_flush:
+ *
+ * Forget everything, so directories will be scanned again when next used
+ */
+void a_tileindex_flush ()
+{
+  if ( !levels )
+    return;
+  g_mutex_lock ( ti_mutex );
+  g_hash_table_foreach_remove ( levels, level_remove, GINT_TO_POINTER(FALSE) );
+  g_mutex_unlock ( ti_mutex );
+}
+
+void a_tileindex_uninit ()
+{
+  if ( !levels )
+    return;
+  shutting_down = TRUE;
+  // Drop any queued scans and wait for the current one to stop
+  g_thread_pool_free ( scan_pool, TRUE, TRUE );
+  scan_pool = NULL;
+  // No scans remain so everything can be freed
+  g_hash_table_foreach_remove ( levels, level_remove, GINT_TO_POINTER(TRUE) );
+  g_hash_table_destroy ( levels );
+  levels = NULL;
+  // Including flushed levels whose scan was dropped from the queue
+  g_slist_free_full ( orphans, (GDestroyNotify)level_free );
+  orphans = NULL;
+  vik_mutex_free ( ti_mutex );
+}
@@ -0,0 +1,49 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __VIKING_TILEINDEX_H
+#define __VIKING_TILEINDEX_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * In memory index of which tile files exist in the on disk map cache.
+ *
+ * Each zoom level directory (containing <x>/<y><ext> files) is scanned once in the background,
+ *  and thereafter kept up to date as tiles are downloaded,
+ *  so drawing and download planning need not query the filesystem for every tile.
+ */
+
+typedef struct {
+  gboolean exists;
+  gint64 mtime;  // Modification time of the file (seconds since the epoch)
+  goffset size;
+} tileindex_info_t;
+
+void a_tileindex_init ();
+gboolean a_tileindex_lookup ( const gchar *dir, const gchar *ext, gint x, gint y, tileindex_info_t *info );
+void a_tileindex_update ( const gchar *dir, const gchar *ext, gint x, gint y );
+void a_tileindex_flush ();
+void a_tileindex_uninit ();
+
+G_END_DECLS
+
+#endif
@@ -30,6 +30,10 @@
 #include "background.h"
 #include "gpx.h"
 #include "dir.h"
+#include "tilebitmap.h"
+#include "heatpyramid.h"
+#include "mapcache.h"
+#include "map_ids.h"
 #ifdef HAVE_SQLITE3_H
 #include "sqlite3.h"
 #endif
@@ -312,35 +316,42 @@ struct _VikAggregateLayer {
   guint ew_size_prev;
 
   guint8 tac_time_range; // Years
-  // Maybe a sparse table would be more efficient
-  //  but this seems to work OK at least if all tracks are confined within a not too diverse area
-  GHashTable *tiles;
-  GHashTable *tiles_clust;
+  // The labels of the tiles are of their contiguous area (or cluster)
+  TileBitmap *tiles;
+  TileBitmap *tiles_clust;
+  // Sizes of the areas by their label, or NULL when the labels are not kept up to date
+  GHashTable *cont_sizes;
+  GHashTable *clust_sizes;
+  guint cont_next;  // Labels to be given to areas next
+  guint clust_next;
 
   // Enable to determine changed tiles (mainly for those added rather than removed)
-  GHashTable *prev;
-  GHashTable *tiles_new;
+  TileBitmap *tiles_new;
+
+  // To update the coverage by just the tracks that have changed since the last calculation
+  GHashTable *tac_tracks;  // Of #CalcTrackT by track
+  TileBitmap *tile_refs;   // The labels are the number of tracks (or unreachable) in each tile
+  guint num_unreachable;
+  gboolean tac_reset;      // Whether the next calculation must start again from nothing
+  struct _CalculateThreadT *tac_job; // Queued or running, see calc_job_stop()
 
   // Heatmap
   gboolean hm_calculating;
-  // Values as at original request
-  guint hm_scale;
-  gint hm_zoom;
-  gint hm_width;
-  gint hm_height;
-  LatLonBBox hm_bbox;
-  const VikCoord *hm_center;
-  VikCoord hm_tl;
-  // Drawing values (zoom level may have changed)
-  gint hm_scaled_zoom;
-  gint hm_zoom_max;
+  gboolean hm_shown;       // Whether generated (and not removed since)
   guint8 hm_alpha;
-  GdkPixbuf *hm_pixbuf;
-  GdkPixbuf *hm_pbf_scaled;
-  gboolean hm_scaled;
   guint8 hm_stamp_factor;
   guint8 hm_style;
   GdkColor hm_color;
+  // Unique to this layer (unlike its address which may be reused), to name its rendered tiles
+  guint hm_render_id;
+  // Changed whenever the drawing would change, so previously rendered tiles are no longer used
+  gint hm_render_generation;
+  // The heat over all the zoom levels, kept to update by just the tracks that have changed since
+  HeatPyramid *hm_heat;
+  GHashTable *hm_tracks;   // Of #CalcTrackT by track
+  guint hm_num_gens;
+  gboolean hm_reset;       // Whether the next generation must start again from nothing
+  struct _CalculateThreadT *hm_job; // Queued or running, see calc_job_stop()
 
   MapCoord rc_menu_mc; // Position of Right Click menu
 };
@@ -350,6 +361,11 @@ GHashTable *tiles_unreachable = NULL;
 
 static GdkColor black_color;
 
+// Heatmap tiles being rendered
+static GMutex *hm_tp_mutex;
+static GHashTable *hm_requests = NULL;
+static gint hm_last_render_id = 0;
+
 static void aggregate_layer_class_init ( VikAggregateLayerClass *klass )
 {
   gchar *fn = g_build_filename ( a_get_viking_dir(), "unreachable_tiles.txt", NULL );
@@ -386,6 +402,10 @@ static void aggregate_layer_class_init ( VikAggregateLayerClass *klass )
   g_free ( fn );
 
   gdk_color_parse ( "#000000", &black_color );
+
+  hm_tp_mutex = vik_mutex_new();
+  // Just storing keys only
+  hm_requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
 }
 
 void vik_aggregate_layer_uninit ()
@@ -468,12 +488,26 @@ const heatmap_colorscheme_t* hm_colorschemes[] =
     &d2, // Yellow/Orange/Red
   };
 
-// Ensure when 'apply' button heatmap regenerated to use new values
+/**
+ * Start a new generation of rendered heatmap tiles
+ *  and drop all the previous renderings from the map cache as these won't be used again
+ *
+ * NB Also drops the renderings of any other aggregate layers, but these are simply rendered again as needed.
+ */
+static void hm_render_changed ( VikAggregateLayer *val )
+{
+  g_atomic_int_inc ( &val->hm_render_generation );
+  a_mapcache_flush_type ( MAP_ID_HEATMAP_RENDER );
+}
+
+// Ensure when 'apply' button heatmap tiles are rendered again to use new values
+//  (the heat itself does not depend on any of the values)
 static void hm_apply ( VikAggregateLayer *val )
 {
+  hm_render_changed ( val );
   if ( VIK_LAYER(val)->realized )
-    if ( !val->hm_calculating && val->hm_pixbuf )
-      hm_calculate ( val );
+    if ( val->hm_shown )
+      vik_layer_emit_update ( VIK_LAYER(val), FALSE );
 }
 
 static void tac_apply ( VikAggregateLayer *val, VikLayerSetParam *vlsp )
@@ -738,10 +772,15 @@ VikAggregateLayer *vik_aggregate_layer_new (VikViewport *vvp)
   vik_layer_set_type ( VIK_LAYER(val), VIK_LAYER_AGGREGATE );
   vik_layer_set_defaults ( VIK_LAYER(val), vvp );
   val->children = NULL;
-  val->tiles = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
-  val->tiles_clust = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
-  val->tiles_new = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
-  val->prev = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  val->tiles = tile_bitmap_new ();
+  val->tiles_clust = tile_bitmap_new ();
+  val->tiles_new = tile_bitmap_new ();
+  val->tile_refs = tile_bitmap_new ();
+  val->tac_tracks = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  val->tac_reset = TRUE;
+  val->hm_tracks = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  val->hm_reset = TRUE;
+  val->hm_render_id = (guint)g_atomic_int_add ( &hm_last_render_id, 1 );
 
   return val;
 }
@@ -865,45 +904,6 @@ void vik_aggregate_layer_move_layer ( VikAggregateLayer *val, GtkTreeIter *child
     val->children = second;
 }
 
-static gboolean is_tile_occupied ( GHashTable *ght, gint x, gint y )
-{
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  gboolean ans = g_hash_table_contains ( ght, key );
-  g_free ( key );
-  return ans;
-}
-
-static guint tile_label ( GHashTable *ght, gint x, gint y )
-{
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  gpointer gp = g_hash_table_lookup ( ght, key );
-  g_free ( key );
-  if ( gp )
-    return GPOINTER_TO_UINT(gp);
-  else
-    return 0;
-}
-
-/**
- * is_cluster: returns whether a tile is surrounded by occupied tiles
- */
-static gboolean is_cluster ( GHashTable *val, gint x, gint y )
-{
-  //if ( !is_tile_occupied(val, x, y) ) return FALSE;
-  if ( !is_tile_occupied(val, x-1, y) ) return FALSE;
-  if ( !is_tile_occupied(val, x+1, y) ) return FALSE;
-
-  if ( !is_tile_occupied(val, x-1, y-1) ) return FALSE;
-  if ( !is_tile_occupied(val, x+1, y-1) ) return FALSE;
-  if ( !is_tile_occupied(val, x, y-1) ) return FALSE;
-
-  if ( !is_tile_occupied(val, x-1, y+1) ) return FALSE;
-  if ( !is_tile_occupied(val, x+1, y+1) ) return FALSE;
-  if ( !is_tile_occupied(val, x, y+1) ) return FALSE;
-
-  return TRUE;
-}
-
 static GdkPixbuf *setup_pixbuf ( GdkPixbuf *pixbuf, guint width, guint height )
 {
   if ( pixbuf )
@@ -1009,7 +1009,7 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
         ulm.x = x;
         ulm.y = y;
 
-        if ( is_tile_occupied(val->tiles, x, y) ) {
+        if ( tile_bitmap_contains(val->tiles, x, y) ) {
           //g_printf ( "%s1: %d, %d, %d, %d, %d, %d %0.2f\n", __FUNCTION__, xx, yy, tilesize_ceil, tilesize_ceil, width, height, shrinkfactor );
           if ( !is_big ) {
 
@@ -1023,12 +1023,12 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
 
             gdk_pixbuf_copy_area ( val->pixbuf[BASIC], 0, 0, sizex, sizey, val->full_pixbuf[BASIC], destx, desty );
 
-            if ( val->cont_label && (tile_label(val->tiles, x, y) == val->cont_label) )
+            if ( val->cont_label && (tile_bitmap_get_label(val->tiles, x, y) == val->cont_label) )
               gdk_pixbuf_copy_area ( val->pixbuf[CONTIG], 0, 0, sizex, sizey, val->full_pixbuf[CONTIG], destx, desty );
 
             // Cluster drawing
             if ( val->on[CLUSTER] )
-              if ( val->clust_label && (tile_label(val->tiles_clust, x, y) == val->clust_label) )
+              if ( val->clust_label && (tile_bitmap_get_label(val->tiles_clust, x, y) == val->clust_label) )
                 gdk_pixbuf_copy_area ( val->pixbuf[CLUSTER], 0, 0, sizex, sizey, val->full_pixbuf[CLUSTER], destx, desty );
 
             // Max Square drawing
@@ -1051,7 +1051,7 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
             }
 
             if ( val->on[TNEW] )
-              if ( is_tile_occupied(val->tiles_new, x, y) ) {
+              if ( tile_bitmap_contains(val->tiles_new, x, y) ) {
                 gdk_pixbuf_copy_area ( val->pixbuf[TNEW], 0, 0, sizex, sizey, val->full_pixbuf[TNEW], destx, desty );
               }
           } else {
@@ -1166,88 +1166,268 @@ static void tac_draw ( VikAggregateLayer *val, VikViewport *vp )
   tac_draw_section ( val, vp, &ul, &br );
 }
 
+// The most detailed zoom level of the heat, beyond which the heat of each pixel is stamped further apart
+//  (about 5 metres per pixel, c.f. the accuracy of GPS positions)
+#define HM_MAX_ZOOM 15
+#define HM_TILE_SIZE 256
+
 /**
- * c.f. vik_viewport_coord_to_screen() but for a separately configurable zoom level & Mercator only
+ * The pixel of the most detailed zoom level of the heat that contains the position
+ *
+ * Returns: FALSE if beyond the web mercator tiles (i.e. too near the poles)
  */
-static void coord_to_screen ( gint width, gint height, gdouble mf, struct LatLon *center, VikCoord *coord, gint *xx, gint *yy )
+static gboolean hm_coord_to_pixel ( const VikCoord *coord, gint *xx, gint *yy )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( coord, &ll );
+  gdouble size = (gdouble)(HM_TILE_SIZE << HM_MAX_ZOOM);
+  gdouble px = (ll.lon + 180.0) / 360.0 * size;
+  gdouble py = (180.0 - MERCLAT(ll.lat)) / 360.0 * size;
+  // NB Written to be false for NaN too
+  if ( !(px >= 0.0 && py >= 0.0 && px < size && py < size) )
+    return FALSE;
+  *xx = (gint)px;
+  *yy = (gint)py;
+  return TRUE;
+}
+
+static void rhomboidal (float *values, unsigned d, unsigned r)
 {
-  struct LatLon *ll = (struct LatLon *)coord;
-  *xx = (int)(width/2 + ( mf * (ll->lon - center->lon) ));
-  *yy = (int)(height/2 + ( mf * ( MERCLAT(center->lat) - MERCLAT(ll->lat) ) ));
+  for (guint y = 0 ; y < d ; ++y) {
+    for (guint x = 0 ; x < d ; ++x) {
+      values[y*d+x] = 1.0 - fmin(1.0, (float)(labs(x-(long)r)+labs(y-(long)r))/(r+1));
+    }
+  }
 }
 
+/* Everything needed to render a tile, so the layer can change whilst rendering */
+typedef struct {
+  GMutex *mutex;
+  VikAggregateLayer *val; /* NULL if not alive */
+  HeatPyramid *heat;  // A reference is held whilst rendering
+  MapCoord ulm;
+  gchar *name;        // Map cache name of the current rendering
+  gchar *request;
+  guint8 alpha;
+  guint8 style;
+  guint8 stamp_factor;
+} HmRenderInfo;
+
 /**
+ * Render the tile by stamping the heat of each of its pixels,
+ *  and of those around it as far as the stamps reach into the tile
  *
+ * The colours are scaled to the hottest pixel of the zoom level rather than of the tile, so adjoining tiles match.
+ * As the heat mostly follows the tracks, the hottest stamped heat is taken to be that of a line of the hottest pixels.
+ */
+static void hm_render_tile ( HmRenderInfo *ri )
+{
+  gint64 tt1 = g_get_real_time ();
+  guint zoom = 17 - ri->ulm.scale;
+
+  // Generate a stamp with a size relative to the zoom level
+  unsigned radius = zoom * (gdouble)ri->stamp_factor/(gdouble)width_default().u;
+  unsigned d = 2*radius + 1;
+  float pts[d * d];
+  rhomboidal ( pts, d, radius );
+  heatmap_stamp_t *stamp = heatmap_stamp_load ( d, d, pts );
+
+  // Stamps are only made for points within the heatmap, hence it includes the border
+  guint size = HM_TILE_SIZE + 2*radius;
+  guint32 *values = g_malloc ( size * size * sizeof(guint32) );
+  heatmap_t *hm = heatmap_new ( size, size );
+  if ( heat_pyramid_read ( ri->heat, zoom, ri->ulm.x*HM_TILE_SIZE - radius, ri->ulm.y*HM_TILE_SIZE - radius, size, size, values ) ) {
+    for ( guint ii = 0; ii < size*size; ii++ )
+      if ( values[ii] )
+        heatmap_add_weighted_point_with_stamp ( hm, ii % size, ii / size, (gfloat)values[ii], stamp );
+  }
+  g_free ( values );
+  heatmap_stamp_free ( stamp );
+
+  gfloat saturation = (gfloat)heat_pyramid_get_max ( ri->heat, zoom ) * (radius + 1);
+  if ( saturation <= 0.0f )
+    saturation = 1.0f;
+  guchar *image = g_malloc ( size * size * 4 );
+  if ( ri->style > 0 && ri->style < 4 )
+    heatmap_render_saturated_to ( hm, hm_colorschemes[ri->style-1], saturation, image );
+  else
+    heatmap_render_saturated_to ( hm, heatmap_cs_default, saturation, image );
+  heatmap_free ( hm );
+
+  // Just the tile itself
+  guchar *pixels = g_malloc ( HM_TILE_SIZE * HM_TILE_SIZE * 4 );
+  for ( guint yy = 0; yy < HM_TILE_SIZE; yy++ )
+    memcpy ( pixels + yy*HM_TILE_SIZE*4, image + ((yy+radius)*size + radius)*4, HM_TILE_SIZE*4 );
+  g_free ( image );
+
+  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data ( pixels, GDK_COLORSPACE_RGB, TRUE, 8, HM_TILE_SIZE, HM_TILE_SIZE, HM_TILE_SIZE*4,
+                                                 (GdkPixbufDestroyNotify)g_free, NULL );
+  pixbuf = ui_pixbuf_set_alpha ( pixbuf, ri->alpha );
+  gdouble tt = (gdouble)(g_get_real_time() - tt1) / G_USEC_PER_SEC;
+  a_mapcache_add ( pixbuf, (mapcache_extra_t){ tt, 0 }, ri->ulm.x, ri->ulm.y, ri->ulm.z, MAP_ID_HEATMAP_RENDER, ri->ulm.scale, ri->alpha, 0.0, 0.0, ri->name );
+  g_object_unref ( pixbuf );
+}
+
+static void hm_render_info_free ( HmRenderInfo *ri )
+{
+  vik_mutex_free ( ri->mutex );
+  heat_pyramid_unref ( ri->heat );
+  g_free ( ri->name );
+  // NB No need to free the request/key - as this is freed by the hash table destructor
+  g_free ( ri );
+}
+
+static void hm_render_weak_ref_cb ( gpointer ptr, GObject *dead_val )
+{
+  HmRenderInfo *ri = (HmRenderInfo*)ptr;
+  g_mutex_lock ( ri->mutex );
+  ri->val = NULL;
+  g_mutex_unlock ( ri->mutex );
+}
+
+static void hm_render_thread ( HmRenderInfo *ri, gpointer threaddata )
+{
+  int res = a_background_thread_progress ( threaddata, 0 );
+  if ( res == 0 )
+    hm_render_tile ( ri );
+
+  g_mutex_lock ( hm_tp_mutex );
+  g_hash_table_remove ( hm_requests, ri->request );
+  g_mutex_unlock ( hm_tp_mutex );
+
+  g_mutex_lock ( ri->mutex );
+  if ( ri->val ) {
+    g_object_weak_unref ( G_OBJECT(ri->val), hm_render_weak_ref_cb, ri );
+    if ( res == 0 )
+      vik_layer_emit_update ( VIK_LAYER(ri->val), FALSE ); // NB update display from background
+    ri->val = NULL;
+  }
+  g_mutex_unlock ( ri->mutex );
+}
+
+static void hm_render_cancel_cleanup ( HmRenderInfo *ri )
+{
+}
+
+#define HM_REQUEST_HASHKEY_FORMAT "%d-%d-%d-%d-%s"
+
+/**
+ * Render the tile in the background, unless already requested
+ */
+static void hm_render_thread_add ( VikAggregateLayer *val, MapCoord *ulm, const gchar *name )
+{
+  gchar *request = g_strdup_printf ( HM_REQUEST_HASHKEY_FORMAT, ulm->x, ulm->y, ulm->z, ulm->scale, name );
+
+  g_mutex_lock ( hm_tp_mutex );
+  if ( g_hash_table_lookup_extended ( hm_requests, request, NULL, NULL ) ) {
+    g_free ( request );
+    g_mutex_unlock ( hm_tp_mutex );
+    return;
+  }
+  g_hash_table_insert ( hm_requests, request, NULL );
+  g_mutex_unlock ( hm_tp_mutex );
+
+  HmRenderInfo *ri = g_malloc0 ( sizeof(HmRenderInfo) );
+  ri->mutex = vik_mutex_new ();
+  ri->val = val;
+  ri->heat = heat_pyramid_ref ( val->hm_heat );
+  ri->ulm = *ulm;
+  ri->name = g_strdup ( name );
+  ri->request = request;
+  ri->alpha = val->hm_alpha;
+  ri->style = val->hm_style;
+  ri->stamp_factor = val->hm_stamp_factor;
+
+  g_object_weak_ref ( G_OBJECT(val), hm_render_weak_ref_cb, ri );
+  gchar *description = g_strdup_printf ( _("Heatmap Render %d:%d:%d"), ulm->scale, ulm->x, ulm->y );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(val),
+                        description,
+                        (vik_thr_func) hm_render_thread,
+                        ri,
+                        (vik_thr_free_func) hm_render_info_free,
+                        (vik_thr_free_func) hm_render_cancel_cleanup,
+                        1 );
+  g_free ( description );
+}
+
+/**
+ * Stop drawing the heatmap
  */
 static void hm_clear ( VikAggregateLayer *val )
 {
-  if ( val->hm_pixbuf )
-    g_object_unref ( val->hm_pixbuf );
-  if ( val->hm_pbf_scaled )
-    g_object_unref ( val->hm_pbf_scaled );
-  val->hm_pixbuf = NULL;
-  val->hm_pbf_scaled = NULL;
+  val->hm_shown = FALSE;
 }
 
 /**
- * Draw heatmap
+ * Draw heatmap as tiles, which are kept in the map cache
+ *  so only tiles not drawn before need rendering (in the background)
+ * Thus panning or changing the zoom level doesn't need the heat to be generated again.
+ *
+ * Tiles are rendered for the zoom levels of the web mercator tiles,
+ *  so at any other zoom the nearest level is scaled to fit, in the manner of the maps layer.
  */
 static void hm_draw ( VikAggregateLayer *val, VikViewport *vp )
 {
-  LatLonBBox bbox = vik_viewport_get_bbox ( vp );
+  // Check compatible drawing mode
+  if ( vik_viewport_get_drawmode(vp) != VIK_VIEWPORT_DRAWMODE_MERCATOR )
+    return;
 
-  if ( BBOX_INTERSECT ( bbox, val->hm_bbox ) ) {
+  VikCoord ul, br;
+  vik_viewport_screen_to_coord ( vp, 0, 0, &ul );
+  vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), vik_viewport_get_height(vp), &br );
 
-    clock_t begin, end;
+  gdouble xzoom = vik_viewport_get_xmpp ( vp );
+  gdouble yzoom = vik_viewport_get_ympp ( vp );
 
-    gint zz = (gint)vik_viewport_get_zoom ( vp );
-    // Avoid excessive image scaling as it will be too slow
-    //  (and memory intensive) so simply avoid trying.
-    if ( zz < val->hm_zoom_max ) {
-      return;
-    }
+  gint scale = (gint)round ( log2 ( xzoom ) );
+  // Zoomed out beyond the whole world in one tile
+  if ( scale > 17 )
+    return;
+  scale = MAX ( scale, -5 );
+  gdouble tile_zoom = scale >= 0 ? VIK_GZ(scale) : 1.0/VIK_GZ(-scale);
+  gdouble xshrinkfactor = tile_zoom / xzoom;
+  gdouble yshrinkfactor = tile_zoom / yzoom;
+  gboolean shrink = ( xshrinkfactor != 1.0 || yshrinkfactor != 1.0 );
 
-    if ( val->hm_width != vik_viewport_get_width(vp) ||
-         val->hm_height != vik_viewport_get_height(vp) ) {
-      hm_clear ( val );
-      return;
-    }
+  MapCoord ulm, brm;
+  if ( !map_utils_vikcoord_to_iTMS ( &ul, tile_zoom, tile_zoom, &ulm ) ||
+       !map_utils_vikcoord_to_iTMS ( &br, tile_zoom, tile_zoom, &brm ) )
+    return;
 
-    // Calculate width & height (even if no scaling as not excessive computation)
-    gint ww = round (val->hm_width * (gdouble)val->hm_zoom/(gdouble)zz );
-    gint hh = round (val->hm_height * (gdouble)val->hm_zoom/(gdouble)zz );
-    // Scale only once as necessary when zoom level has changed
-    if ( val->hm_scaled_zoom != zz ) {
-      val->hm_scaled_zoom = zz;
-      // Different zoom level so generate new image from the original image
-      if ( val->hm_scaled_zoom != val->hm_zoom ) {
-        if ( val->hm_pbf_scaled )
-          g_object_unref ( val->hm_pbf_scaled );
-
-        val->hm_scaled = TRUE;
-        GdkInterpType interp_type = GDK_INTERP_BILINEAR;
-        // When scaling up: use the fastest method (as scaling up is much slower than scaling down)
-        //  especially since this is being performed in the main thread
-        if ( val->hm_scaled_zoom < val->hm_zoom )
-          interp_type = GDK_INTERP_NEAREST;
-        begin = clock();
-        val->hm_pbf_scaled = gdk_pixbuf_scale_simple ( val->hm_pixbuf, ww, hh, interp_type );
-        end = clock();
-        double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-        // Last usable zoom-level as the next one is going to be an order of magnitude worse or more
-        if ( interp_type == GDK_INTERP_NEAREST && time_spent > 0.05 )
-          val->hm_zoom_max = zz;
-        g_debug ( "%s: time %f scaling to %d, %d", __FUNCTION__, time_spent, ww, hh );
-      } else {
-        // Use original image
-        val->hm_scaled = FALSE;
+  gchar *name = g_strdup_printf ( "%u-%d", val->hm_render_id, g_atomic_int_get(&val->hm_render_generation) );
+
+  gint xmin = MIN(ulm.x, brm.x), xmax = MAX(ulm.x, brm.x);
+  gint ymin = MIN(ulm.y, brm.y), ymax = MAX(ulm.y, brm.y);
+  for ( gint x = xmin; x <= xmax; x++ ) {
+    for ( gint y = ymin; y <= ymax; y++ ) {
+      ulm.x = x;
+      ulm.y = y;
+      GdkPixbuf *pixbuf = NULL;
+      if ( shrink )
+        pixbuf = a_mapcache_get ( ulm.x, ulm.y, ulm.z, MAP_ID_HEATMAP_RENDER, ulm.scale, val->hm_alpha, xshrinkfactor, yshrinkfactor, name );
+      if ( !pixbuf ) {
+        pixbuf = a_mapcache_get ( ulm.x, ulm.y, ulm.z, MAP_ID_HEATMAP_RENDER, ulm.scale, val->hm_alpha, 0.0, 0.0, name );
+        if ( !pixbuf ) {
+          hm_render_thread_add ( val, &ulm, name );
+          continue;
+        }
+        if ( shrink ) {
+          GdkPixbuf *scaled = gdk_pixbuf_scale_simple ( pixbuf, ceil(HM_TILE_SIZE * xshrinkfactor), ceil(HM_TILE_SIZE * yshrinkfactor), GDK_INTERP_BILINEAR );
+          g_object_unref ( pixbuf );
+          pixbuf = scaled;
+          a_mapcache_add ( pixbuf, (mapcache_extra_t){ 0.0, 0 }, ulm.x, ulm.y, ulm.z, MAP_ID_HEATMAP_RENDER, ulm.scale, val->hm_alpha, xshrinkfactor, yshrinkfactor, name );
+        }
       }
+      VikCoord coord;
+      gint xx, yy;
+      map_utils_iTMS_to_vikcoord ( &ulm, &coord );
+      vik_viewport_coord_to_screen ( vp, &coord, &xx, &yy );
+      vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, xx, yy, gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf) );
+      g_object_unref ( pixbuf );
     }
-    gint xx, yy;
-    gdouble mf = mercator_factor ( val->hm_scaled_zoom, val->hm_scale );
-    coord_to_screen ( val->hm_width, val->hm_height, mf, (struct LatLon*)val->hm_center, &val->hm_tl, &xx, &yy);
-    vik_viewport_draw_pixbuf ( vp, val->hm_scaled ? val->hm_pbf_scaled : val->hm_pixbuf, 0, 0, xx, yy, ww, hh );
   }
+  g_free ( name );
 }
 
 /* Draw the aggregate layer. If vik viewport is in half_drawn mode, this means we are only
@@ -1264,8 +1444,9 @@ void vik_aggregate_layer_draw ( VikAggregateLayer *val, VikViewport *vp )
   GList *iter = val->children;
 #if GTK_CHECK_VERSION (3,0,0)
   // GTK3 Version does not use pixmaps, so no point in trigger layers ATM
+  //  instead each layer is kept as drawn, until it is updated or the view changes
   while ( iter ) {
-    vik_layer_draw ( VIK_LAYER(iter->data), vp );
+    vik_layer_draw_cached ( VIK_LAYER(iter->data), vp );
     iter = iter->next;
   }
 #else
@@ -1291,7 +1472,7 @@ void vik_aggregate_layer_draw ( VikAggregateLayer *val, VikViewport *vp )
     tac_draw ( val, vp );
   }
 
-  if ( !val->hm_calculating && val->hm_pixbuf ) {
+  if ( !val->hm_calculating && val->hm_shown ) {
     hm_draw ( val, vp );
   }
 }
@@ -1706,27 +1887,126 @@ static void aggregate_layer_export_gpx ( menu_array_values values )
   vik_aggregate_layer_export_gpx_setup ( val );
 }
 
+// Positions (e.g. of tiles) packed into one value, so they can be sorted
+#define POS_KEY(x,y) (((gint64)(y) << 32) | (guint32)(x))
+#define POS_X(key) ((gint)(guint32)((key) & 0xffffffff))
+#define POS_Y(key) ((gint)((key) >> 32))
+
+static gint compare_pos_keys ( gconstpointer a, gconstpointer b )
+{
+  gint64 k1 = *(const gint64*)a;
+  gint64 k2 = *(const gint64*)b;
+  return (k1 > k2) - (k1 < k2);
+}
+
 /**
- *
+ * The contribution of a track to a calculation,
+ *  kept so that it can be taken away again once the track is changed or removed
  */
-static void add_tile_label ( GHashTable *ght, gint x, gint y, guint id )
+typedef struct {
+  VikTrack *trk;      // A reference is held, so it can't be reused for another track
+  guint version;      // Of the track when its contribution was found
+  guint seen;         // Number of the calculation that the track was last included in
+  GArray *positions;  // Of POS_KEY()s: the tiles visited (each once) for TAC
+  GArray *pixels;     // Of #HmPixelT: the pixels given heat (each once) for the heatmap
+} CalcTrackT;
+
+typedef struct {
+  gint64 key;         // POS_KEY() of the pixel
+  guint count;        // Number of trackpoints in the pixel
+} HmPixelT;
+
+static CalcTrackT *calc_track_new ( VikTrack *trk, guint seen )
 {
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  (void)g_hash_table_insert ( ght, key, GUINT_TO_POINTER(id) );
+  CalcTrackT *ctt = g_malloc0 ( sizeof(CalcTrackT) );
+  vik_track_ref ( trk );
+  ctt->trk = trk;
+  ctt->version = trk->version;
+  ctt->seen = seen;
+  return ctt;
 }
 
 /**
- *
+ * Give up the reference to the track
+ * NB Must be in the main thread
  */
-static void add_tile ( GHashTable *ght, gint x, gint y )
+static void calc_track_release ( CalcTrackT *ctt )
 {
-  add_tile_label ( ght, x, y, 0 );
+  if ( ctt->trk )
+    vik_track_free ( ctt->trk );
+  ctt->trk = NULL;
+}
+
+static void calc_track_free ( CalcTrackT *ctt )
+{
+  calc_track_release ( ctt );
+  if ( ctt->positions )
+    g_array_free ( ctt->positions, TRUE );
+  if ( ctt->pixels )
+    g_array_free ( ctt->pixels, TRUE );
+  g_free ( ctt );
 }
 
 /**
+ * Remove all the track contributions
+ * NB Must be in the main thread
+ */
+static void calc_tracks_reset ( GHashTable *calc_tracks )
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, calc_tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    calc_track_free ( value );
+    g_hash_table_iter_steal ( &iter );
+  }
+}
+
+/**
+ * Compare the tracks to be included in a calculation with those of the previous one
  *
+ * Tracks that are new or have changed get new records, which are put in @added to be worked out.
+ * The records of tracks that have changed or are no longer included
+ *  are taken out of @calc_tracks and put in @removed, so their contributions can be taken away.
+ *
+ * NB Must be in the main thread
  */
-static void check_point ( VikAggregateLayer *val, VikCoord *coord )
+static void calc_tracks_diff ( GHashTable *calc_tracks, GList *tracks_and_layers, guint seen, GPtrArray *added, GPtrArray *removed )
+{
+  for ( GList *tl = tracks_and_layers; tl != NULL; tl = tl->next ) {
+    VikTrack *trk = ((vik_trw_and_track_t*)tl->data)->trk;
+    CalcTrackT *ctt = g_hash_table_lookup ( calc_tracks, trk );
+    if ( ctt && ctt->version == trk->version ) {
+      ctt->seen = seen;
+      continue;
+    }
+    if ( ctt ) {
+      (void)g_hash_table_steal ( calc_tracks, trk );
+      calc_track_release ( ctt );
+      g_ptr_array_add ( removed, ctt );
+    }
+    ctt = calc_track_new ( trk, seen );
+    g_hash_table_insert ( calc_tracks, trk, ctt );
+    g_ptr_array_add ( added, ctt );
+  }
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, calc_tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    CalcTrackT *ctt = value;
+    if ( ctt->seen != seen ) {
+      g_hash_table_iter_steal ( &iter );
+      calc_track_release ( ctt );
+      g_ptr_array_add ( removed, ctt );
+    }
+  }
+}
+
+/**
+ * Add the tile of the position
+ */
+static void check_point ( VikAggregateLayer *val, GArray *tiles, VikCoord *coord )
 {
   MapCoord mc;
   gdouble zoom = val->zoom_level;
@@ -1736,26 +2016,25 @@ static void check_point ( VikAggregateLayer *val, VikCoord *coord )
     return;
   }
 
-  if ( ! is_tile_occupied ( val->tiles, mc.x, mc.y ) ) {
-    add_tile ( val->tiles, mc.x, mc.y );
-    val->num_tiles[BASIC]++;
-  }
+  gint64 key = POS_KEY ( mc.x, mc.y );
+  g_array_append_val ( tiles, key );
 }
 
 /**
- *
+ * Find the tiles visited by the track, each listed once
  */
-static void check_track ( VikAggregateLayer *val, vik_trw_and_track_t *vtlist )
+static void check_track ( VikAggregateLayer *val, CalcTrackT *ctt )
 {
-  VikTrack *trk = vtlist->trk;
+  VikTrack *trk = ctt->trk;
   //g_debug ( "%s: %s", __FUNCTION__, trk->name );
+  GArray *tiles = g_array_new ( FALSE, FALSE, sizeof(gint64) );
   guint no_times = 0;
   GList *iter = trk->trackpoints;
   while ( iter ) {
     // Only do trackpoints with timestamps
     // - i.e. hopefully to avoid artificial tracks
     if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) ) {
-      check_point ( val, &VIK_TRACKPOINT(iter->data)->coord );
+      check_point ( val, tiles, &VIK_TRACKPOINT(iter->data)->coord );
     }
     else
       no_times++;
@@ -1764,59 +2043,253 @@ static void check_track ( VikAggregateLayer *val, vik_trw_and_track_t *vtlist )
   // Handy to find out if your not expecting any of these
   if ( no_times )
     g_debug ( "%s: %d points encountered with no times", __FUNCTION__, no_times );
+
+  // Consecutive points are mostly in the same tile
+  g_array_sort ( tiles, compare_pos_keys );
+  guint unique = 0;
+  for ( guint ii = 0; ii < tiles->len; ii++ )
+    if ( unique == 0 || g_array_index(tiles, gint64, ii) != g_array_index(tiles, gint64, unique-1) )
+      g_array_index ( tiles, gint64, unique++ ) = g_array_index ( tiles, gint64, ii );
+  g_array_set_size ( tiles, unique );
+  ctt->positions = tiles;
 }
 
-typedef struct {
-  GList *tracks_and_layers;
+typedef struct _CalculateThreadT {
   VikAggregateLayer *val;
-  guint num_of_tracks;
+  GPtrArray *added;      // Of #CalcTrackT to be worked out and added
+  GPtrArray *removed;    // Of #CalcTrackT to be taken away
+  gboolean full;         // Whether starting again from nothing
+  guint num_of_tracks;   // All those included
+  // The job's place in the layer, and its state as protected by calc_mutex
+  struct _CalculateThreadT **job;
+  gboolean running;
+  gint stopped;          // The layer is being freed, so it must not be used once this is set
 } CalculateThreadT;
 
+/*
+ * The layer may be freed whilst one of its calculations is queued or running.
+ * Then a running calculation is stopped and waited for,
+ *  whereas one yet to start is left to end without touching the layer or the records it keeps.
+ */
+static GMutex calc_mutex;
+static GCond calc_cond;
+
+/**
+ * Note the job is queued for the layer
+ * NB In the main thread
+ */
+static void calc_job_queued ( CalculateThreadT *ct, CalculateThreadT **job )
+{
+  g_mutex_lock ( &calc_mutex );
+  ct->job = job;
+  *job = ct;
+  g_mutex_unlock ( &calc_mutex );
+}
+
+/**
+ * Call at the start of the job
+ *
+ * Returns: FALSE when the layer has gone, so the job must do nothing
+ */
+static gboolean calc_job_start ( CalculateThreadT *ct )
+{
+  g_mutex_lock ( &calc_mutex );
+  ct->running = !g_atomic_int_get ( &ct->stopped );
+  gboolean running = ct->running;
+  g_mutex_unlock ( &calc_mutex );
+  return running;
+}
+
+static gboolean calc_job_stopped ( CalculateThreadT *ct )
+{
+  return g_atomic_int_get ( &ct->stopped );
+}
+
+/**
+ * Stop the job of the layer (if any), waiting for it when it is running
+ * NB In the main thread, when the layer is being freed
+ */
+static void calc_job_stop ( CalculateThreadT **job )
+{
+  g_mutex_lock ( &calc_mutex );
+  if ( *job ) {
+    g_atomic_int_set ( &(*job)->stopped, TRUE );
+    if ( !(*job)->running )
+      *job = NULL;
+    while ( *job )
+      g_cond_wait ( &calc_cond, &calc_mutex );
+  }
+  g_mutex_unlock ( &calc_mutex );
+}
+
 static void ct_free ( CalculateThreadT *ct )
 {
-  ct->val->calculating = FALSE;
-  g_list_free_full ( ct->tracks_and_layers, g_free );
+  g_mutex_lock ( &calc_mutex );
+  if ( ct->running ) {
+    // Hence the layer is still there
+    ct->val->calculating = FALSE;
+    *ct->job = NULL;
+    ct->running = FALSE;
+    g_cond_broadcast ( &calc_cond );
+  }
+  g_mutex_unlock ( &calc_mutex );
+
+  // The added records are kept by the layer
+  g_ptr_array_free ( ct->added, TRUE );
+  for ( guint ii = 0; ii < ct->removed->len; ii++ )
+    calc_track_free ( g_ptr_array_index(ct->removed, ii) );
+  g_ptr_array_free ( ct->removed, TRUE );
   g_free ( ct );
 }
 
 static void ct_cancel ( CalculateThreadT *ct )
 {
   // Draw as much as we have processed so far
-  vik_layer_emit_update ( VIK_LAYER(ct->val), FALSE ); // NB update display from background
+  if ( ct->running && !calc_job_stopped ( ct ) )
+    vik_layer_emit_update ( VIK_LAYER(ct->val), FALSE ); // NB update display from background
 }
 
-// Since previous square should have been checked, only need to consider the next outer row+column
-//  rather than rechecking the contents of the whole square again
-//  this is obviously gets more efficient as the square that needs checking gets bigger
-static gboolean is_square_next ( VikAggregateLayer *val, gint x, gint y, guint n )
+/**
+ * Work out which tracks need to be (re)calculated
+ * NB In the main thread
+ */
+static CalculateThreadT *ct_new ( VikAggregateLayer *val, GHashTable *calc_tracks, GList *tracks_and_layers, guint seen, gboolean full )
 {
-  gint tmpx = x;
-  gint tmpy = y + n - 1;
-  for ( tmpx = x; tmpx < (x + n); tmpx++ ) {
-    if ( ! is_tile_occupied(val->tiles, tmpx, tmpy) ) {
-      return FALSE;
-    }
-  }
-  tmpx = x + n - 1;
-  for ( gint tmpy = y; tmpy < (y + n); tmpy++ ) {
-    if ( ! is_tile_occupied(val->tiles, tmpx, tmpy) ) {
-      return FALSE;
-    }
-  }
-  // NB tile (tmpx+n-1, tmpy+n-1) gets checked twice, but this isn't too much of a waste
-  return TRUE;
+  CalculateThreadT *ct = g_malloc0 ( sizeof(CalculateThreadT) );
+  ct->val = val;
+  ct->full = full;
+  ct->added = g_ptr_array_new ();
+  ct->removed = g_ptr_array_new ();
+  ct->num_of_tracks = g_list_length ( tracks_and_layers );
+  if ( full )
+    calc_tracks_reset ( calc_tracks );
+  calc_tracks_diff ( calc_tracks, tracks_and_layers, seen, ct->added, ct->removed );
+  g_debug ( "%s: %d tracks, %d to add, %d to remove", __FUNCTION__, ct->num_of_tracks, ct->added->len, ct->removed->len );
+  return ct;
 }
 
-static gboolean is_square ( VikAggregateLayer *val, gint x, gint y, guint n )
+/*
+ * Calculations split over several workers
+ *
+ * Each worker repeatedly takes the next track from the shared list
+ *  and adds it into its own private tiles or heat, so no locking is needed for these.
+ * The workers run as parts of the job, see a_background_parts_new().
+ * Meanwhile the background job thread reports the progress and checks for cancellation,
+ *  since a_background_thread_progress() is not for use by several threads.
+ * Then the results of all the workers are merged, again split over the workers.
+ */
+typedef struct {
+  CalculateThreadT *ct;
+  gint next;           // Index of the next track to be taken by any worker
+  gint done;           // Number of tracks completed
+  gint cancel;
+  GMutex mutex;
+  GCond cond;
+  guint finished;      // Number of workers that have stopped
+} CalcSharedT;
+
+typedef struct _CalcWorkerT {
+  CalcSharedT *cs;
+  TileBitmap *tiles;
+  HeatPyramid *heat;
+  // For merging
+  struct _CalcWorkerT *others; // Workers whose results are to be merged into this one
+  guint n_others;
+} CalcWorkerT;
+
+/**
+ * Returns: The next track for the worker, or NULL when there are none left or the job has been cancelled
+ */
+static CalcTrackT *calc_next_track ( CalcSharedT *cs )
 {
-  for ( gint tmpx = x; tmpx < (x + n); tmpx++ ) {
-     for ( gint tmpy = y; tmpy < (y + n); tmpy++ ) {
-       if ( ! is_tile_occupied(val->tiles, tmpx, tmpy) ) {
-         return FALSE;
-      }
+  if ( g_atomic_int_get ( &cs->cancel ) )
+    return NULL;
+  gint ii = g_atomic_int_add ( &cs->next, 1 );
+  if ( ii >= (gint)cs->ct->added->len )
+    return NULL;
+  return g_ptr_array_index ( cs->ct->added, ii );
+}
+
+static void calc_worker_finished ( CalcSharedT *cs )
+{
+  g_mutex_lock ( &cs->mutex );
+  cs->finished++;
+  g_cond_signal ( &cs->cond );
+  g_mutex_unlock ( &cs->mutex );
+}
+
+static CalcSharedT *calc_shared_new ( CalculateThreadT *ct )
+{
+  CalcSharedT *cs = g_malloc0 ( sizeof(CalcSharedT) );
+  cs->ct = ct;
+  g_mutex_init ( &cs->mutex );
+  g_cond_init ( &cs->cond );
+  return cs;
+}
+
+static void calc_shared_free ( CalcSharedT *cs )
+{
+  g_mutex_clear ( &cs->mutex );
+  g_cond_clear ( &cs->cond );
+  g_free ( cs );
+}
+
+/**
+ * Number of workers to use, as many as the shared pool for parts of background jobs would run at once
+ *  but no more than there are tracks to work out
+ */
+static guint calc_num_workers ( CalculateThreadT *ct )
+{
+  guint workers = a_background_parts_get_max_threads ();
+  return MAX ( 1, MIN ( workers, ct->added->len ) );
+}
+
+/**
+ * Run the function for each of the workers, as parts of the background job, and wait for them all to complete
+ */
+static void calc_run ( GFunc func, CalcWorkerT *workers, guint n_workers )
+{
+  BackgroundParts *bp = a_background_parts_new ( func );
+  for ( guint ww = 0; ww < n_workers; ww++ )
+    a_background_parts_push ( bp, &workers[ww] );
+  a_background_parts_wait ( bp );
+}
+
+/**
+ * Run the track workers, reporting the progress of each track
+ *  through the background job until all the workers have stopped
+ *
+ * Returns: FALSE if the job has been cancelled
+ */
+static gboolean calc_run_tracks ( GFunc func, CalcWorkerT *workers, guint n_workers, gpointer threaddata, guint total )
+{
+  CalcSharedT *cs = workers[0].cs;
+  BackgroundParts *bp = a_background_parts_new ( func );
+  for ( guint ww = 0; ww < n_workers; ww++ )
+    a_background_parts_push ( bp, &workers[ww] );
+
+  guint reported = 0;
+  gboolean stopped = FALSE;
+  while ( !stopped ) {
+    g_mutex_lock ( &cs->mutex );
+    if ( cs->finished < n_workers )
+      (void)g_cond_wait_until ( &cs->cond, &cs->mutex, g_get_monotonic_time() + 100 * G_TIME_SPAN_MILLISECOND );
+    stopped = (cs->finished == n_workers);
+    g_mutex_unlock ( &cs->mutex );
+
+    if ( calc_job_stopped ( cs->ct ) )
+      g_atomic_int_set ( &cs->cancel, TRUE );
+
+    // Once per track as the job was given one item per track
+    guint done = g_atomic_int_get ( &cs->done );
+    for ( ; reported < done && !g_atomic_int_get(&cs->cancel); reported++ ) {
+      gint res = a_background_thread_progress ( threaddata, (gdouble)reported/(gdouble)total );
+      if ( res != 0 )
+        g_atomic_int_set ( &cs->cancel, TRUE );
     }
   }
-  return TRUE;
+  a_background_parts_wait ( bp );
+  return !g_atomic_int_get ( &cs->cancel );
 }
 
 /*
@@ -1885,189 +2358,236 @@ static void uf_finish ( void ) {
   labels = NULL;
 }
 
-// NB ATM This only tracks one such area
-//  (there might be multiple such areas)
-static void tac_contiguous_calc ( VikAggregateLayer *val )
+/**
+ * Label the tiles by their contiguous area (joined to the north, south, east or west),
+ *  according to 'labelling clusters on a grid'
+ * https://en.wikipedia.org/wiki/Hoshen%E2%80%93Kopelman_algorithm
+ *
+ * The size of each area is put in @sizes by its label,
+ *  with @next_label set to after the last label used.
+ *
+ * Returns: The number of areas
+ */
+static guint tac_label_areas ( TileBitmap *tb, GHashTable *sizes, guint *next_label )
 {
-  clock_t begin = clock();
-
-  GHashTableIter iter;
-  gpointer key, value;
-  gint x,y;
-  gint tlx=G_MAXINT,tly=G_MAXINT,brx=-G_MAXINT,bry=-G_MAXINT;
+  g_hash_table_remove_all ( sizes );
+  *next_label = 1;
+  tile_bitmap_clear_labels ( tb );
+  guint count = tile_bitmap_size ( tb );
+  if ( count == 0 )
+    return 0;
 
-  // Get grid extents
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( x < tlx ) tlx = x;
-    if ( x > brx ) brx = x;
-    if ( y < tly ) tly = y;
-    if ( y > bry ) bry = y;
+  // At most a new label for every tile
+  uf_init ( count + 1 );
+
+  // Tiles are visited after their neighbours to the west and north
+  TileBitmapIter iter;
+  gint xx, yy;
+  tile_bitmap_iter_init ( &iter, tb );
+  while ( tile_bitmap_iter_next ( &iter, &xx, &yy ) ) {
+    guint label_west = tile_bitmap_get_label ( tb, xx-1, yy );
+    guint label_north = tile_bitmap_get_label ( tb, xx, yy-1 );
+    switch ( !!label_west + !!label_north ) {
+    case 0: // New
+      tile_bitmap_set_label ( tb, xx, yy, uf_make_set() );
+      break;
+    case 1: // Existing
+      tile_bitmap_set_label ( tb, xx, yy, MAX(label_west, label_north) );
+      break;
+    case 2: // Bind existing
+      tile_bitmap_set_label ( tb, xx, yy, uf_union(label_west, label_north) );
+      break;
+    default: // Should not happen
+      g_critical ("%s: labelling algorithm broken", __FUNCTION__);
+      break;
+    }
   }
 
-  // Process the grid according to 'labelling clusters on a grid'
-  // https://en.wikipedia.org/wiki/Hoshen%E2%80%93Kopelman_algorithm
-  guint size = (abs(tlx-brx) * abs(tly-bry)) / 2;
-  if ( size == 0 )
-    return;
-
-  uf_init ( size );
+  // Reprocess the tiles to count the size of the labels
+  guint *new_labels = g_malloc0_n ( sizeof(guint), n_labels ); // allocate array, initialized to zero
+  guint *label_sizes = g_malloc0_n ( sizeof(guint), n_labels ); // allocate array, initialized to zero
 
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) ) {
-        guint label_up = tile_label (val->tiles, xx-1, yy ); // NB don't have to worry about -1 going out of bounds
-        guint label_left = tile_label (val->tiles, xx, yy-1 );
-        switch ( !!label_up + !!label_left ) {
-        case 0: // New
-          add_tile_label ( val->tiles, xx, yy, uf_make_set() );
-          break;
-        case 1: // Existing
-          add_tile_label ( val->tiles, xx, yy, MAX(label_up, label_left) );
-          break;
-        case 2: // Bind existing
-          add_tile_label ( val->tiles, xx, yy, uf_union(label_up, label_left) );
-          break;
-        default: // Should not happen
-          g_critical ("%s: labelling algorithm broken", __FUNCTION__);
-          break;
-        }
-      }
+  tile_bitmap_iter_init ( &iter, tb );
+  while ( tile_bitmap_iter_next ( &iter, &xx, &yy ) ) {
+    guint ll = uf_find ( tile_bitmap_get_label ( tb, xx, yy ) );
+    if ( new_labels[ll] == 0 ) {
+      new_labels[0]++;
+      new_labels[ll] = new_labels[0];
     }
+    label_sizes[new_labels[ll]]++;
+    tile_bitmap_set_label ( tb, xx, yy, new_labels[ll] );
   }
+  guint total_clusters = new_labels[0];
+
+  for ( guint ss = 1; ss <= total_clusters; ss++ )
+    g_hash_table_insert ( sizes, GUINT_TO_POINTER(ss), GUINT_TO_POINTER(label_sizes[ss]) );
+  *next_label = total_clusters + 1;
+
+  g_free ( new_labels );
+  g_free ( label_sizes );
+  uf_finish();
+
+  return total_clusters;
+}
 
-  // Reprocess the grid to compare the size of the labels
-  int *new_labels = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-  int *sizes = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
+/**
+ * Label again just the areas around the changed tiles (whether added or removed),
+ *  as the tiles in all other areas keep their labels.
+ * Each area is flood filled with a label not used before,
+ *  so the tiles that have already been done are those with labels from @next_label onwards.
+ *
+ * The labels of any areas (partly) removed must have been taken out of @sizes already.
+ *
+ * Returns: The number of areas labelled
+ */
+static guint tac_relabel_areas ( TileBitmap *tb, TileBitmap *changed, GHashTable *sizes, guint *next_label )
+{
+  static const gint dx[5] = { 0, -1, 1, 0, 0 };
+  static const gint dy[5] = { 0, 0, 0, -1, 1 };
+  guint first_label = *next_label;
+  guint areas = 0;
+  GArray *stack = g_array_new ( FALSE, FALSE, sizeof(gint64) );
+
+  TileBitmapIter iter;
+  gint x, y;
+  tile_bitmap_iter_init ( &iter, changed );
+  while ( tile_bitmap_iter_next ( &iter, &x, &y ) ) {
+    // From the tile itself and each of its neighbours
+    for ( guint nn = 0; nn < 5; nn++ ) {
+      gint sx = x + dx[nn];
+      gint sy = y + dy[nn];
+      if ( !tile_bitmap_contains ( tb, sx, sy ) || tile_bitmap_get_label ( tb, sx, sy ) >= first_label )
+        continue;
 
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) ) {
-        gint ll = uf_find(tile_label (val->tiles, xx, yy));
-        if (new_labels[ll] == 0) {
-          new_labels[0]++;
-          new_labels[ll] = new_labels[0];
+      guint label = (*next_label)++;
+      guint size = 0;
+      gint64 key = POS_KEY ( sx, sy );
+      g_array_append_val ( stack, key );
+      while ( stack->len ) {
+        key = g_array_index ( stack, gint64, stack->len-1 );
+        g_array_set_size ( stack, stack->len-1 );
+        gint tx = POS_X ( key );
+        gint ty = POS_Y ( key );
+        guint old = tile_bitmap_get_label ( tb, tx, ty );
+        if ( old >= first_label )
+          continue;
+        // The area this was in no longer exists as it was
+        if ( old )
+          (void)g_hash_table_remove ( sizes, GUINT_TO_POINTER(old) );
+        tile_bitmap_set_label ( tb, tx, ty, label );
+        size++;
+        for ( guint mm = 1; mm < 5; mm++ ) {
+          if ( tile_bitmap_contains ( tb, tx + dx[mm], ty + dy[mm] ) &&
+               tile_bitmap_get_label ( tb, tx + dx[mm], ty + dy[mm] ) < first_label ) {
+            key = POS_KEY ( tx + dx[mm], ty + dy[mm] );
+            g_array_append_val ( stack, key );
+          }
         }
-        sizes[new_labels[ll]]++;
-        add_tile_label ( val->tiles, xx, yy, new_labels[ll] );
       }
+      g_hash_table_insert ( sizes, GUINT_TO_POINTER(label), GUINT_TO_POINTER(size) );
+      areas++;
     }
   }
-  gint total_clusters = new_labels[0];
+  g_array_free ( stack, TRUE );
+  return areas;
+}
 
-  guint largist = 0;
-  for ( guint ss = 1; ss < n_labels; ss++ ) {
-    if ( sizes[ss] > largist ) {
-      largist = sizes[ss];
-      val->cont_label = ss;
-      val->num_tiles[CONTIG] = largist;
+/**
+ * Returns: The size of the largest area, with its label set
+ */
+static guint tac_largest_area ( GHashTable *sizes, guint *label )
+{
+  guint largest = 0;
+  *label = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, sizes );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    if ( GPOINTER_TO_UINT(value) > largest ) {
+      largest = GPOINTER_TO_UINT(value);
+      *label = GPOINTER_TO_UINT(key);
     }
   }
-  g_free ( new_labels );
-  g_free ( sizes );
-  uf_finish();
-
-  clock_t end = clock();
-  double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-  g_debug ( "%s: %f %d %d %d", __FUNCTION__, time_spent, total_clusters, largist, val->cont_label );
+  return largest;
 }
 
 // NB ATM This only tracks one such area
 //  (there might be multiple such areas)
-static void tac_cluster_calc ( VikAggregateLayer *val )
+static void tac_contiguous_calc ( VikAggregateLayer *val, TileBitmap *changed, gboolean full )
 {
   clock_t begin = clock();
 
-  GHashTableIter iter;
-  gpointer key, value;
-  gint x,y;
-
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( is_cluster(val->tiles, x, y) ) {
-      // Make new hashtable from just the tiles that are in a cluster
-      add_tile ( val->tiles_clust, x, y );
-      val->num_tiles[CLUSTER]++;
-    }
-  }
-
-  gint tlx=G_MAXINT,tly=G_MAXINT,brx=-G_MAXINT,bry=-G_MAXINT;
-
-  // Get grid extents
-  g_hash_table_iter_init ( &iter, val->tiles_clust );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( x < tlx ) tlx = x;
-    if ( x > brx ) brx = x;
-    if ( y < tly ) tly = y;
-    if ( y > bry ) bry = y;
+  guint total_clusters;
+  if ( full || !val->cont_sizes ) {
+    if ( !val->cont_sizes )
+      val->cont_sizes = g_hash_table_new ( g_direct_hash, g_direct_equal );
+    total_clusters = tac_label_areas ( val->tiles, val->cont_sizes, &val->cont_next );
   }
+  else
+    total_clusters = tac_relabel_areas ( val->tiles, changed, val->cont_sizes, &val->cont_next );
+  val->num_tiles[CONTIG] = tac_largest_area ( val->cont_sizes, &val->cont_label );
 
-  guint size = (abs(tlx-brx) * abs(tly-bry)) / 2;
-  if ( size == 0 )
-    return;
-
-  uf_init ( size );
+  clock_t end = clock();
+  double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
+  g_debug ( "%s: %f %d %d %d", __FUNCTION__, time_spent, total_clusters, val->num_tiles[CONTIG], val->cont_label );
+}
 
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles_clust, xx, yy) ) {
-        guint label_up = tile_label (val->tiles_clust, xx-1, yy ); // NB don't have to worry about -1 going out of bounds
-        guint label_left = tile_label (val->tiles_clust, xx, yy-1 );
-        switch ( !!label_up + !!label_left ) {
-        case 0: // New
-          add_tile_label ( val->tiles_clust, xx, yy, uf_make_set() );
-          break;
-        case 1: // Existing
-          add_tile_label ( val->tiles_clust, xx, yy, MAX(label_up, label_left) );
-          break;
-        case 2: // Bind existing
-          add_tile_label ( val->tiles_clust, xx, yy, uf_union(label_up, label_left) );
-          break;
-        default: // Should not happen
-          g_critical ("%s: labelling algorithm broken", __FUNCTION__);
-          break;
+/**
+ * Update the cluster tiles (those surrounded by occupied tiles)
+ *  around the changed tiles, noting which have changed in turn
+ */
+static void tac_update_interior ( VikAggregateLayer *val, TileBitmap *changed, TileBitmap *clust_changed )
+{
+  TileBitmapIter iter;
+  gint x, y;
+  tile_bitmap_iter_init ( &iter, changed );
+  while ( tile_bitmap_iter_next ( &iter, &x, &y ) ) {
+    for ( gint cy = y-1; cy <= y+1; cy++ ) {
+      for ( gint cx = x-1; cx <= x+1; cx++ ) {
+        gboolean interior = TRUE;
+        for ( gint ny = cy-1; ny <= cy+1 && interior; ny++ )
+          for ( gint nx = cx-1; nx <= cx+1 && interior; nx++ )
+            interior = tile_bitmap_contains ( val->tiles, nx, ny );
+        if ( interior == tile_bitmap_contains ( val->tiles_clust, cx, cy ) )
+          continue;
+        if ( interior )
+          (void)tile_bitmap_add ( val->tiles_clust, cx, cy );
+        else {
+          (void)g_hash_table_remove ( val->clust_sizes, GUINT_TO_POINTER(tile_bitmap_get_label(val->tiles_clust, cx, cy)) );
+          (void)tile_bitmap_remove ( val->tiles_clust, cx, cy );
         }
+        (void)tile_bitmap_add ( clust_changed, cx, cy );
       }
     }
   }
+}
 
-  // Reprocess the grid to compare the size of the labels
-  int *new_labels = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-  int *sizes = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
+// NB ATM This only tracks one such area
+//  (there might be multiple such areas)
+static void tac_cluster_calc ( VikAggregateLayer *val, TileBitmap *changed, gboolean full )
+{
+  clock_t begin = clock();
 
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles_clust, xx, yy) ) {
-        gint ll = uf_find(tile_label (val->tiles_clust, xx, yy));
-        if (new_labels[ll] == 0) {
-          new_labels[0]++;
-          new_labels[ll] = new_labels[0];
-        }
-        sizes[new_labels[ll]]++;
-        add_tile_label ( val->tiles_clust, xx, yy, new_labels[ll] );
-      }
-    }
+  guint total_clusters;
+  if ( full || !val->clust_sizes ) {
+    if ( !val->clust_sizes )
+      val->clust_sizes = g_hash_table_new ( g_direct_hash, g_direct_equal );
+    // Tiles that are surrounded by occupied tiles
+    tile_bitmap_clear ( val->tiles_clust );
+    (void)tile_bitmap_add_interior ( val->tiles_clust, val->tiles );
+    total_clusters = tac_label_areas ( val->tiles_clust, val->clust_sizes, &val->clust_next );
   }
-  gint total_clusters = new_labels[0];
-
-  guint largist = 0;
-  for ( guint ss = 1; ss < n_labels; ss++ ) {
-    if ( sizes[ss] > largist ) {
-      largist = sizes[ss];
-      val->clust_label = ss;
-      val->num_tiles[CLUSTER] = largist;
-    }
+  else {
+    TileBitmap *clust_changed = tile_bitmap_new ();
+    tac_update_interior ( val, changed, clust_changed );
+    total_clusters = tac_relabel_areas ( val->tiles_clust, clust_changed, val->clust_sizes, &val->clust_next );
+    tile_bitmap_free ( clust_changed );
   }
-  g_free ( new_labels );
-  g_free ( sizes );
-  uf_finish();
+  val->num_tiles[CLUSTER] = tac_largest_area ( val->clust_sizes, &val->clust_label );
 
   clock_t end = clock();
   double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-  g_debug ( "%s: %f %d %d %d", __FUNCTION__, time_spent, total_clusters, largist, val->clust_label );
+  g_debug ( "%s: %f %d %d %d", __FUNCTION__, time_spent, total_clusters, val->num_tiles[CLUSTER], val->clust_label );
 }
 
 
@@ -2075,33 +2595,31 @@ static void tac_cluster_calc ( VikAggregateLayer *val )
 //  (there might be multiple such squares)
 static void tac_square_calc ( VikAggregateLayer *val )
 {
-  val->max_square = 1;
+  val->max_square = 0;
   clock_t begin = clock();
 
-  GHashTableIter iter;
-  gpointer key, value;
+  // The label of each tile is used for the size of the largest square ending there,
+  //  as the tiles are visited after their neighbours to the west, north and north west
+  // NB A separate copy as the labels of the tiles themselves are of their areas
+  TileBitmap *squares = tile_bitmap_new ();
+  (void)tile_bitmap_add_union ( squares, val->tiles );
+  TileBitmapIter iter;
   gint x,y;
-
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( is_square(val, x, y, val->max_square) ) {
-      g_debug ( "%s: is_square %d at %d:%d", __FUNCTION__, val->max_square, x, y );
-      val->xx = x;
-      val->yy = y;
-      val->max_square++;
-      gboolean do_again = FALSE;
-      do {
-        do_again = FALSE;
-        if ( is_square_next(val, x, y, val->max_square) ) {
-          g_debug ( "%s: is_square_next %d at %d:%d", __FUNCTION__, val->max_square, x, y );
-          do_again = TRUE;
-          val->max_square++;
-        }
-      } while ( do_again );
+  tile_bitmap_iter_init ( &iter, squares );
+  while ( tile_bitmap_iter_next ( &iter, &x, &y ) ) {
+    guint west = tile_bitmap_get_label ( squares, x-1, y );
+    guint north = tile_bitmap_get_label ( squares, x, y-1 );
+    guint north_west = tile_bitmap_get_label ( squares, x-1, y-1 );
+    guint size = 1 + MIN ( west, MIN ( north, north_west ) );
+    tile_bitmap_set_label ( squares, x, y, size );
+    if ( size > val->max_square ) {
+      val->max_square = size;
+      val->xx = x - size + 1;
+      val->yy = y - size + 1;
     }
   }
-  val->max_square--;
+  tile_bitmap_free ( squares );
+  g_debug ( "%s: max square %d at %d:%d", __FUNCTION__, val->max_square, val->xx, val->yy );
 
   clock_t end = clock();
   double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
@@ -2114,76 +2632,41 @@ static void tac_square_calc ( VikAggregateLayer *val )
 static void tac_lines_calc ( VikAggregateLayer *val )
 {
   clock_t begin = clock();
+  val->ns_size = 0;
+  val->ew_size = 0;
 
-  GHashTableIter iter;
-  gpointer key, value;
-  gint x,y;
-  gint tlx=G_MAXINT,tly=G_MAXINT,brx=-G_MAXINT,bry=-G_MAXINT;
-
-  // Get extents of tile coverage
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( x < tlx ) tlx = x;
-    if ( x > brx ) brx = x;
-    if ( y < tly ) tly = y;
-    if ( y > bry ) bry = y;
-  }
-
-  // Simple brute force method
   // Detects the first instance of the biggest consective run of tiles
   //  in both vertical and horizontal directions
-  guint crt_sz = 0;
-
-  // North/South passage...
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    gint yy;
-    for ( yy = tly ; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) )
-        crt_sz++;
-      else {
-        if ( crt_sz > val->ns_size ) {
-          val->ns_size = crt_sz;
-          val->ns_x = xx;
-          val->ns_y = yy-1;
-        }
-        crt_sz = 0;
+  // Each run is followed from its first tile,
+  //  and the position stored is of the last tile in it
+  TileBitmapIter iter;
+  gint x,y;
+  tile_bitmap_iter_init ( &iter, val->tiles );
+  while ( tile_bitmap_iter_next ( &iter, &x, &y ) ) {
+    // North/South passage...
+    if ( !tile_bitmap_contains ( val->tiles, x, y-1 ) ) {
+      gint yy = y;
+      while ( tile_bitmap_contains ( val->tiles, x, yy+1 ) )
+        yy++;
+      guint crt_sz = yy - y + 1;
+      if ( crt_sz > val->ns_size ) {
+        val->ns_size = crt_sz;
+        val->ns_x = x;
+        val->ns_y = yy;
       }
     }
-    // Detect finish at edge of extents
-    if ( crt_sz > val->ns_size ) {
-      val->ns_size = crt_sz;
-      val->ns_x = xx;
-      val->ns_y = yy;
-    }
-    // Reset for next line
-    crt_sz = 0;
-  }
-
-  crt_sz = 0;
-  // East/West passage...
-  for ( gint yy = tly; yy <= bry; yy++ ) {
-    gint xx;
-    for ( xx = tlx; xx <= brx; xx++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) )
-        crt_sz++;
-      else {
-        if ( crt_sz > val->ew_size ) {
-          val->ew_size = crt_sz;
-          val->ew_x = xx-1;
-          val->ew_y = yy;
-        }
-        crt_sz = 0;
+    // East/West passage...
+    if ( !tile_bitmap_contains ( val->tiles, x-1, y ) ) {
+      gint xx = x;
+      while ( tile_bitmap_contains ( val->tiles, xx+1, y ) )
+        xx++;
+      guint crt_sz = xx - x + 1;
+      if ( crt_sz > val->ew_size ) {
+        val->ew_size = crt_sz;
+        val->ew_x = xx;
+        val->ew_y = y;
       }
     }
-    // Detect finish at edge of extents
-    if ( crt_sz > val->ew_size ) {
-      val->ew_size = crt_sz;
-      val->ew_x = xx;
-      val->ew_y = yy;
-    }
-    // Reset for next line
-    crt_sz = 0;
   }
 
   g_debug ( "%s: ns_x %d, ns_y %d, ns_size %d | ew_x %d, ew_y %d, ew_size %d:",
@@ -2200,149 +2683,252 @@ static void tac_lines_calc ( VikAggregateLayer *val )
  * NB: ATM this doesn't effect the numbers reported too much as it uses the
  *  separate count 'num_tiles' rather than the number in the hash table
  */
-static void tac_unreachable ( VikAggregateLayer *val )
+static guint tac_unreachable ( VikAggregateLayer *val )
 {
-  if ( !tiles_unreachable ) return;
+  if ( !tiles_unreachable ) return 0;
 
   GHashTableIter iter;
   gpointer key, value;
   gint z,x,y;
+  guint added = 0;
 
   guint zoom = (guint)map_utils_mpp_to_zoom_level(val->zoom_level);
 
   g_hash_table_iter_init ( &iter, tiles_unreachable );
   while ( g_hash_table_iter_next(&iter, &key, &value) ) {
     (void)sscanf ( key, "%d %d %d", &z, &x, &y );
-    if ( z == zoom )
-      add_tile ( val->tiles, x, y );
+    if ( z == zoom ) {
+      if ( tile_bitmap_add ( val->tiles, x, y ) )
+        added++;
+      // Counted as if a track, so they are never taken away
+      (void)tile_bitmap_add ( val->tile_refs, x, y );
+      tile_bitmap_set_label ( val->tile_refs, x, y, tile_bitmap_get_label(val->tile_refs, x, y) + 1 );
+    }
   }
+  return added;
 }
 
 // Fwd declaration
 static void tac_clear ( VikAggregateLayer *val );
 
+static void tac_worker ( CalcWorkerT *cw, gpointer user_data )
+{
+  CalcTrackT *ctt;
+  while ( (ctt = calc_next_track ( cw->cs )) ) {
+    check_track ( cw->cs->ct->val, ctt );
+    // Count the tracks in each tile
+    for ( guint ii = 0; ii < ctt->positions->len; ii++ ) {
+      gint64 key = g_array_index ( ctt->positions, gint64, ii );
+      (void)tile_bitmap_add ( cw->tiles, POS_X(key), POS_Y(key) );
+      tile_bitmap_set_label ( cw->tiles, POS_X(key), POS_Y(key), tile_bitmap_get_label(cw->tiles, POS_X(key), POS_Y(key)) + 1 );
+    }
+    g_atomic_int_inc ( &cw->cs->done );
+  }
+  calc_worker_finished ( cw->cs );
+}
+
+static void tac_merge_worker ( CalcWorkerT *cw, gpointer user_data )
+{
+  for ( guint oo = 0; oo < cw->n_others; oo++ )
+    (void)tile_bitmap_add_labels ( cw->tiles, cw->others[oo].tiles );
+}
+
+/**
+ * Merge the tiles (and their counts) of all the workers into those of the first one,
+ *  as pairs at the same time, then pairs of those results and so on
+ */
+static void tac_merge ( CalcWorkerT *workers, guint n_workers )
+{
+  CalcWorkerT *pairs = g_malloc0_n ( n_workers, sizeof(CalcWorkerT) );
+  for ( guint step = 1; step < n_workers; step *= 2 ) {
+    guint n_pairs = 0;
+    for ( guint ww = 0; ww + step < n_workers; ww += 2*step ) {
+      pairs[n_pairs].tiles = workers[ww].tiles;
+      pairs[n_pairs].others = &workers[ww+step];
+      pairs[n_pairs].n_others = 1;
+      n_pairs++;
+    }
+    calc_run ( (GFunc)tac_merge_worker, pairs, n_pairs );
+  }
+  g_free ( pairs );
+}
+
+/**
+ * Take away the tiles of the tracks that have changed or gone,
+ *  noting the tiles that are no longer visited at all
+ */
+static void tac_remove_tracks ( VikAggregateLayer *val, GPtrArray *removed, TileBitmap *gone )
+{
+  for ( guint ii = 0; ii < removed->len; ii++ ) {
+    CalcTrackT *ctt = g_ptr_array_index ( removed, ii );
+    if ( !ctt->positions )
+      continue;
+    for ( guint jj = 0; jj < ctt->positions->len; jj++ ) {
+      gint64 key = g_array_index ( ctt->positions, gint64, jj );
+      gint x = POS_X ( key );
+      gint y = POS_Y ( key );
+      guint refs = tile_bitmap_get_label ( val->tile_refs, x, y );
+      if ( refs > 1 ) {
+        tile_bitmap_set_label ( val->tile_refs, x, y, refs - 1 );
+        continue;
+      }
+      (void)tile_bitmap_remove ( val->tile_refs, x, y );
+      // The area the tile was in will be labelled again
+      if ( val->cont_sizes )
+        (void)g_hash_table_remove ( val->cont_sizes, GUINT_TO_POINTER(tile_bitmap_get_label(val->tiles, x, y)) );
+      (void)tile_bitmap_remove ( val->tiles, x, y );
+      (void)tile_bitmap_add ( gone, x, y );
+    }
+  }
+}
+
 /**
  *
  */
 static gint tac_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
 {
-  clock_t begin = clock();
+  if ( !calc_job_start ( ct ) )
+    return -1;
 
-  g_hash_table_remove_all ( ct->val->prev );
-  g_hash_table_remove_all ( ct->val->tiles_new );
-  ct->val->num_tiles[TNEW] = 0;
+  // Wall clock time, as clock() would include the time of every worker
+  gint64 begin = g_get_monotonic_time ();
+  VikAggregateLayer *val = ct->val;
+
+  tile_bitmap_clear ( val->tiles_new );
+  val->num_tiles[TNEW] = 0;
 
   // Only if there's something before then 'turn on' detection of new tiles...
   //  (too otherwise avoid marking everything new on first time calculation
   //   on particularly initial file loads)
-  // Also don't try to find new ones when the zoom level has changed
-  //  and discount the number of unreachable tiles
-  gboolean zoom_level_chgd = (ct->val->zoom_level_prev != ct->val->zoom_level);
-  if ( zoom_level_chgd )
-    ct->val->zoom_level_prev = ct->val->zoom_level;
-  guint sz = 0;
-  if ( tiles_unreachable )
-    sz = g_hash_table_size ( tiles_unreachable );
-  if ( (ct->val->num_tiles[BASIC] > sz) && ct->val->on[TNEW]) {
-    // Copy current tiles into prev
-    GHashTableIter iter;
-    gpointer key, value;
-    g_hash_table_iter_init ( &iter, ct->val->tiles );
-    while ( g_hash_table_iter_next(&iter, &key, &value) )
-      (void)g_hash_table_insert ( ct->val->prev, g_strdup(key), GUINT_TO_POINTER(0) );
-
+  // Also don't try to find new ones when starting again (e.g. the zoom level has changed)
+  gboolean detect_new = !ct->full && (val->num_tiles[BASIC] > 0) && val->on[TNEW];
+  if ( detect_new ) {
     for (gint x = 0; x<CP_NUM; x++ )
-      ct->val->num_prev[x] = ct->val->num_tiles[x];
+      val->num_prev[x] = val->num_tiles[x];
   }
-  ct->val->max_square_prev = ct->val->max_square;
-  ct->val->ns_size_prev = ct->val->ns_size;
-  ct->val->ew_size_prev = ct->val->ew_size;
+  val->max_square_prev = val->max_square;
+  val->ns_size_prev = val->ns_size;
+  val->ew_size_prev = val->ew_size;
 
-  tac_clear ( ct->val );
+  if ( ct->full ) {
+    tac_clear ( val );
+    val->num_unreachable = tac_unreachable ( val );
+  }
 
-  tac_unreachable ( ct->val );
+  // Tiles no longer or newly visited
+  TileBitmap *gone = tile_bitmap_new ();
+  TileBitmap *added = tile_bitmap_new ();
+  tac_remove_tracks ( val, ct->removed, gone );
 
-  guint tracks_processed = 0;
   // This is used to prevent the progress going negative or otherwise over 100%
   // It's difficult to get an estimate for the total and track progress of each of these parts
   //  and then combine it in a coherent single thread progress meter.
   // So for simplicity they are considered the same as processing extra set of tracks
-  guint extras = (ct->val->on[MAX_SQR] * ct->num_of_tracks) +
-    (ct->val->on[CONTIG] * ct->num_of_tracks) +
-    (ct->val->on[CLUSTER] * ct->num_of_tracks) +
-    (ct->val->on[LINES] * ct->num_of_tracks);
+  guint num_of_tracks = MAX ( 1, ct->added->len );
+  guint extras = (val->on[MAX_SQR] * num_of_tracks) +
+    (val->on[CONTIG] * num_of_tracks) +
+    (val->on[CLUSTER] * num_of_tracks) +
+    (val->on[LINES] * num_of_tracks);
+
+  CalcSharedT *cs = calc_shared_new ( ct );
+  guint n_workers = calc_num_workers ( ct );
+  CalcWorkerT *workers = g_malloc0_n ( n_workers, sizeof(CalcWorkerT) );
+  for ( guint ww = 0; ww < n_workers; ww++ ) {
+    workers[ww].cs = cs;
+    workers[ww].tiles = tile_bitmap_new ();
+  }
+  gboolean completed = calc_run_tracks ( (GFunc)tac_worker, workers, n_workers, threaddata, num_of_tracks+extras );
+
+  // Even when cancelled, so as much as has been processed can be drawn
+  tac_merge ( workers, n_workers );
+  (void)tile_bitmap_add_difference ( added, workers[0].tiles, val->tiles );
+  (void)tile_bitmap_add_labels ( val->tile_refs, workers[0].tiles );
+  (void)tile_bitmap_add_union ( val->tiles, workers[0].tiles );
+  // NB Not counting unreachable tiles
+  val->num_tiles[BASIC] = tile_bitmap_size ( val->tiles ) - val->num_unreachable;
+  for ( guint ww = 0; ww < n_workers; ww++ )
+    tile_bitmap_free ( workers[ww].tiles );
+  g_free ( workers );
+  calc_shared_free ( cs );
+  g_debug ( "%s: %d workers", __FUNCTION__, n_workers );
+
+  if ( detect_new )
+    // Those that were not there before (rather than taken away and added back again)
+    val->num_tiles[TNEW] = tile_bitmap_add_difference ( val->tiles_new, added, gone );
+
+  // All the changed tiles, around which the areas need to be labelled again
+  (void)tile_bitmap_add_union ( gone, added );
+  tile_bitmap_free ( added );
+  TileBitmap *changed = gone;
 
-  for ( GList *tl = ct->tracks_and_layers; tl != NULL; tl = tl->next ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
+  gint result = 0;
+  guint tracks_processed = num_of_tracks;
+  if ( !completed ) {
+    vik_layer_emit_update ( VIK_LAYER(val), FALSE ); // NB update display from background
+    result = -1;
+    goto done;
+  }
+
+  if ( val->on[MAX_SQR] ) {
+    gdouble percent = (gdouble)tracks_processed/(gdouble)(num_of_tracks+extras);
     gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
+    if ( res != 0 || calc_job_stopped ( ct ) ) { result = -1; goto done; }
 
-    check_track ( ct->val, tl->data );
-    tracks_processed++;
+    tac_square_calc ( val );
+    tracks_processed = tracks_processed + num_of_tracks;
   }
 
-  if ( ct->val->on[MAX_SQR] ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
+  if ( val->on[CONTIG] ) {
+    gdouble percent = (gdouble)tracks_processed/(gdouble)(num_of_tracks+extras);
     gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
+    if ( res != 0 || calc_job_stopped ( ct ) ) { result = -1; goto done; }
 
-    tac_square_calc ( ct->val );
-    tracks_processed = tracks_processed + ct->num_of_tracks;
+    tac_contiguous_calc ( val, changed, ct->full );
+    tracks_processed = tracks_processed + num_of_tracks;
+  }
+  else if ( val->cont_sizes ) {
+    // The labels will not be kept up to date
+    g_hash_table_destroy ( val->cont_sizes );
+    val->cont_sizes = NULL;
   }
 
-  if ( ct->val->on[CONTIG] ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
+  if ( val->on[CLUSTER] ) {
+    gdouble percent = (gdouble)tracks_processed/(gdouble)(num_of_tracks+extras);
     gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
+    if ( res != 0 || calc_job_stopped ( ct ) ) { result = -1; goto done; }
 
-    tac_contiguous_calc ( ct->val );
-    tracks_processed = tracks_processed + ct->num_of_tracks;
+    tac_cluster_calc ( val, changed, ct->full );
+    tracks_processed = tracks_processed + num_of_tracks;
+  }
+  else if ( val->clust_sizes ) {
+    g_hash_table_destroy ( val->clust_sizes );
+    val->clust_sizes = NULL;
   }
 
-  if ( ct->val->on[CLUSTER] ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
+  if ( val->on[LINES] ) {
+    gdouble percent = (gdouble)tracks_processed/(gdouble)(num_of_tracks+extras);
     gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
+    if ( res != 0 || calc_job_stopped ( ct ) ) { result = -1; goto done; }
 
-    tac_cluster_calc ( ct->val );
-    tracks_processed = tracks_processed + ct->num_of_tracks;
+    tac_lines_calc ( val );
+    tracks_processed = tracks_processed + num_of_tracks;
   }
 
-  if ( ct->val->on[LINES] ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks+extras);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
-
-    tac_lines_calc ( ct->val );
-    tracks_processed = tracks_processed + ct->num_of_tracks;
-  }
-
-  if ( (ct->val->num_prev[BASIC] > sz) && ct->val->on[TNEW] && !zoom_level_chgd ) {
-    // Determine difference in latest tiles vs prev
-    // Could be slow, but seems not too bad
-    GHashTableIter iter;
-    gpointer key, value;
-    g_hash_table_iter_init ( &iter, ct->val->tiles );
-    while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-      gboolean contained = g_hash_table_contains ( ct->val->prev, key );
-      if ( !contained ) {
-        (void)g_hash_table_insert ( ct->val->tiles_new, g_strdup(key), GUINT_TO_POINTER(0) );
-        ct->val->num_tiles[TNEW]++;
-      }
-    }
-    // Also doing it here means the detection is only done for the 'first' calculation update
-    // (this calculation alsootherwise gets done for any config change - even if just colour changed).
-    //  so ATM the new tiles get reset for such subsequent recalculations
-    g_hash_table_remove_all ( ct->val->prev );
+ done:
+  tile_bitmap_free ( changed );
+  // Any part done cannot be relied upon to be updated next time
+  if ( result != 0 ) {
+    val->tac_reset = TRUE;
+    return result;
   }
 
   // Timing for all tile calcs
-  clock_t end = clock();
-  double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
+  double time_spent = (double)(g_get_monotonic_time() - begin) / G_USEC_PER_SEC;
   g_debug ( "%s: %f", __FUNCTION__, time_spent );
 
-  ct->val->calculating = FALSE;
-  vik_layer_emit_update ( VIK_LAYER(ct->val), FALSE ); // NB update display from background
+  val->calculating = FALSE;
+  if ( !calc_job_stopped ( ct ) )
+    vik_layer_emit_update ( VIK_LAYER(val), FALSE ); // NB update display from background
 
   return 0;
 }
@@ -2358,16 +2944,24 @@ static void tac_clear ( VikAggregateLayer *val )
   }
   val->cont_label = 0;
   val->clust_label = 0;
-  g_hash_table_remove_all ( val->tiles ); // No memory to remove ATM
-  g_hash_table_remove_all ( val->tiles_clust ); // No memory to remove ATM
-  g_hash_table_remove_all ( val->tiles_new ); // No memory to remove ATM
-  // NB val->prev is not cleared at this point as needed for the later comparison
+  tile_bitmap_clear ( val->tiles );
+  tile_bitmap_clear ( val->tiles_clust );
+  tile_bitmap_clear ( val->tiles_new );
+  tile_bitmap_clear ( val->tile_refs );
+  val->num_unreachable = 0;
+  if ( val->cont_sizes )
+    g_hash_table_remove_all ( val->cont_sizes );
+  if ( val->clust_sizes )
+    g_hash_table_remove_all ( val->clust_sizes );
   val->ns_size = 0;
   val->ew_size = 0;
 }
 
 /**
+ * Start the calculation in the background
  *
+ * Just the tracks that have been added, changed or removed since the last calculation are processed,
+ *  unless the zoom level has changed (or the last one did not finish)
  */
 static void tac_calculate ( VikAggregateLayer *val )
 {
@@ -2413,11 +3007,13 @@ static void tac_calculate ( VikAggregateLayer *val )
   g_list_free ( layers );
   g_date_free ( now );
 
-  CalculateThreadT *ct = g_malloc ( sizeof(CalculateThreadT) );
-  ct->tracks_and_layers = tracks_and_layers;
-  ct->val = val;
-  ct->num_of_tracks = g_list_length (tracks_and_layers);
+  gboolean full = val->tac_reset || (val->zoom_level_prev != val->zoom_level);
+  val->zoom_level_prev = val->zoom_level;
+  val->tac_reset = FALSE;
+  CalculateThreadT *ct = ct_new ( val, val->tac_tracks, tracks_and_layers, val->num_calcs, full );
+  g_list_free_full ( tracks_and_layers, g_free );
   guint extras = ct->val->on[MAX_SQR] + ct->val->on[CONTIG] + ct->val->on[CLUSTER];
+  calc_job_queued ( ct, &val->tac_job );
 
   a_background_thread ( BACKGROUND_POOL_LOCAL,
                         VIK_GTK_WINDOW_FROM_LAYER(val),
@@ -2426,47 +3022,93 @@ static void tac_calculate ( VikAggregateLayer *val )
                         ct,
                         (vik_thr_free_func)ct_free,
                         (vik_thr_free_func)ct_cancel,
-                        ct->num_of_tracks + extras );
+                        ct->added->len + extras );
 }
 
-static void rhomboidal (float *values, unsigned d, unsigned r)
+static gint compare_hm_pixels ( gconstpointer a, gconstpointer b )
 {
-  for (guint y = 0 ; y < d ; ++y) {
-    for (guint x = 0 ; x < d ; ++x) {
-      values[y*d+x] = 1.0 - fmin(1.0, (float)(labs(x-(long)r)+labs(y-(long)r))/(r+1));
-    }
-  }
+  return compare_pos_keys ( &((const HmPixelT*)a)->key, &((const HmPixelT*)b)->key );
 }
 
 /**
- *
+ * Add the heat of the track, noting where it was added
  */
-static void hm_track ( VikAggregateLayer *val, vik_trw_and_track_t *vtlist, gdouble mf, heatmap_t* hm, heatmap_stamp_t *stamp )
+static void hm_track ( CalcTrackT *ctt, HeatPyramid *heat )
 {
-  int xx, yy;
-  VikTrack *trk = vtlist->trk;
-  GList *iter = trk->trackpoints;
+  gint xx, yy;
+  GArray *pixels = g_array_new ( FALSE, FALSE, sizeof(HmPixelT) );
+  GList *iter = ctt->trk->trackpoints;
   while ( iter ) {
     // Only do trackpoints with timestamps
     // - i.e. hopefully to avoid artificial tracks
     if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) ) {
-      coord_to_screen (val->hm_width, val->hm_height, mf, (struct LatLon*)val->hm_center, &VIK_TRACKPOINT(iter->data)->coord, &xx, &yy);
-      /*
-      struct LatLon *ll = (struct LatLon *)&VIK_TRACKPOINT(iter->data)->coord;
-      xx = (int)(val->hm_width/2 + ( mf * (ll->lon - center->lon) ));
-      yy = (int)(val->hm_height/2 + ( mf * ( MERCLAT(center->lat) - MERCLAT(ll->lat) ) ));
-      */
-      //heatmap_add_point ( hm, xx, yy );
-      heatmap_add_point_with_stamp ( hm, xx, yy, stamp );
-      //hm_point ( val, &VIK_TRACKPOINT(iter->data)->coord, hm );
+      if ( hm_coord_to_pixel ( &VIK_TRACKPOINT(iter->data)->coord, &xx, &yy ) ) {
+        heat_pyramid_add ( heat, xx, yy, 1 );
+        // Consecutive points are often in the same pixel
+        HmPixelT pixel = { POS_KEY ( xx, yy ), 1 };
+        if ( pixels->len && g_array_index(pixels, HmPixelT, pixels->len-1).key == pixel.key )
+          g_array_index(pixels, HmPixelT, pixels->len-1).count++;
+        else
+          g_array_append_val ( pixels, pixel );
+      }
     }
     iter = iter->next;
   }
+
+  // Then each pixel once, with all its points
+  g_array_sort ( pixels, compare_hm_pixels );
+  guint unique = 0;
+  for ( guint ii = 0; ii < pixels->len; ii++ ) {
+    HmPixelT *pixel = &g_array_index ( pixels, HmPixelT, ii );
+    if ( unique && g_array_index(pixels, HmPixelT, unique-1).key == pixel->key )
+      g_array_index(pixels, HmPixelT, unique-1).count += pixel->count;
+    else
+      g_array_index(pixels, HmPixelT, unique++) = *pixel;
+  }
+  g_array_set_size ( pixels, unique );
+  ctt->pixels = pixels;
+}
+
+// Chunks of heat a worker may build up before merging it into the layer's heat
+//  (about 4MB), so the memory used by the workers is bounded however many tracks there are
+#define HM_WORKER_MAX_CHUNKS 4096
+
+static void hm_worker ( CalcWorkerT *cw, gpointer user_data )
+{
+  CalcSharedT *cs = cw->cs;
+  HeatPyramid *heat = cs->ct->val->hm_heat;
+  CalcTrackT *ctt;
+  while ( (ctt = calc_next_track ( cs )) ) {
+    hm_track ( ctt, cw->heat );
+    g_atomic_int_inc ( &cs->done );
+    if ( heat_pyramid_size ( cw->heat ) >= HM_WORKER_MAX_CHUNKS ) {
+      heat_pyramid_merge ( heat, cw->heat );
+      heat_pyramid_clear ( cw->heat );
+    }
+  }
+  heat_pyramid_merge ( heat, cw->heat );
+  calc_worker_finished ( cs );
 }
 
-static void hm_img_free ( guchar *pixels, gpointer data )
+/**
+ * Take away the heat of the tracks that have changed or gone
+ */
+static void hm_remove_tracks ( HeatPyramid *heat, GPtrArray *removed )
 {
-  g_free ( pixels );
+  if ( removed->len == 0 )
+    return;
+  HeatPyramid *gone = heat_pyramid_new ( heat_pyramid_get_max_zoom(heat) );
+  for ( guint ii = 0; ii < removed->len; ii++ ) {
+    CalcTrackT *ctt = g_ptr_array_index ( removed, ii );
+    if ( !ctt->pixels )
+      continue;
+    for ( guint jj = 0; jj < ctt->pixels->len; jj++ ) {
+      HmPixelT *pixel = &g_array_index ( ctt->pixels, HmPixelT, jj );
+      heat_pyramid_add ( gone, POS_X(pixel->key), POS_Y(pixel->key), pixel->count );
+    }
+  }
+  heat_pyramid_subtract ( heat, gone );
+  heat_pyramid_unref ( gone );
 }
 
 /**
@@ -2474,90 +3116,72 @@ static void hm_img_free ( guchar *pixels, gpointer data )
  */
 static gint hm_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
 {
-  VikAggregateLayer *val = ct->val;
-
-  clock_t begin = clock();
+  if ( !calc_job_start ( ct ) )
+    return -1;
 
-  // Generate a stamp with a size relative to the zoom level
-  unsigned radius = map_utils_mpp_to_zoom_level ( val->hm_zoom ) *
-    (gdouble)val->hm_stamp_factor/(gdouble)width_default().u;
-  unsigned d = 2*radius + 1;
-  float pts[d * d];
-  rhomboidal ( pts, d, radius );
-  heatmap_stamp_t *stamp = heatmap_stamp_load ( d, d, pts );
-  heatmap_t* hm = heatmap_new ( val->hm_width, val->hm_height );
-
-  int ww = val->hm_width;
-  int hh = val->hm_height;
+  VikAggregateLayer *val = ct->val;
 
-  // Only needs calculating once
-  gdouble mf = mercator_factor ( val->hm_zoom, val->hm_scale );
+  // Wall clock time, as clock() would include the time of every worker
+  gint64 begin = g_get_monotonic_time ();
 
-  guint tracks_processed = 0;
-  for ( GList *tl = ct->tracks_and_layers; tl != NULL; tl = tl->next ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
+  hm_remove_tracks ( val->hm_heat, ct->removed );
 
-    vik_trw_and_track_t *vtlist = tl->data;
-    if ( BBOX_INTERSECT ( vtlist->trk->bbox, val->hm_bbox ) )
-      hm_track ( ct->val, vtlist, mf, hm, stamp );
+  CalcSharedT *cs = calc_shared_new ( ct );
 
-    tracks_processed++;
+  // Each worker adds to its own heat, which is merged into that kept from before
+  //  whenever it grows large and once the worker is finished
+  guint n_workers = calc_num_workers ( ct );
+  CalcWorkerT *workers = g_malloc0_n ( n_workers, sizeof(CalcWorkerT) );
+  for ( guint nn = 0; nn < n_workers; nn++ ) {
+    workers[nn].cs = cs;
+    workers[nn].heat = heat_pyramid_new ( HM_MAX_ZOOM );
   }
-
-  // Would be better if testing for any tracks actually used
-  if ( tracks_processed > 0 ) {
-    unsigned char *image = g_malloc ( ww*hh*4 );
-
-    if ( val->hm_style > 0 && val->hm_style < 4 )
-      heatmap_render_to ( hm, hm_colorschemes[val->hm_style-1], image );
-    else
-      heatmap_render_default_to ( hm, image );
-
-    val->hm_pixbuf = gdk_pixbuf_new_from_data ( image, GDK_COLORSPACE_RGB, TRUE, 8, ww, hh, 4*ww, hm_img_free, NULL );
-    val->hm_pixbuf = ui_pixbuf_set_alpha ( val->hm_pixbuf, val->hm_alpha );
+  gboolean completed = calc_run_tracks ( (GFunc)hm_worker, workers, n_workers, threaddata, MAX(1, ct->added->len) );
+  for ( guint nn = 0; nn < n_workers; nn++ )
+    heat_pyramid_unref ( workers[nn].heat );
+  g_free ( workers );
+  calc_shared_free ( cs );
+  g_debug ( "%s: %d workers, %d chunks", __FUNCTION__, n_workers, heat_pyramid_size(val->hm_heat) );
+
+  if ( !completed ) {
+    // Only some of the tracks have been included
+    val->hm_reset = TRUE;
+    val->hm_calculating = FALSE;
+    return -1;
   }
 
-  heatmap_free ( hm );
-  heatmap_stamp_free ( stamp );
+  // Tiles rendered before are of the previous heat
+  hm_render_changed ( val );
 
   // Timing
-  clock_t end = clock();
-  double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
+  double time_spent = (double)(g_get_monotonic_time() - begin) / G_USEC_PER_SEC;
   g_debug ( "%s: %f", __FUNCTION__, time_spent );
 
   ct->val->hm_calculating = FALSE;
-  vik_layer_emit_update ( VIK_LAYER(ct->val), FALSE ); // NB update display from background
+  if ( !calc_job_stopped ( ct ) )
+    vik_layer_emit_update ( VIK_LAYER(ct->val), FALSE ); // NB update display from background
 
   return 0;
 }
 
 /**
+ * Generate the heat of all the tracks in the background,
+ *  which is then drawn at any position or zoom level
  *
+ * The heat of the previous generation is updated by just the tracks that have changed,
+ *  unless the last one did not finish or the heatmap has been removed since
  */
 static void hm_calculate ( VikAggregateLayer *val )
 {
-  VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(val));
-  VikViewport *vvp = vik_window_viewport ( vw );
-
-  val->hm_width = vik_viewport_get_width ( vvp );
-  val->hm_height = vik_viewport_get_height ( vvp );
-  val->hm_bbox = vik_viewport_get_bbox ( vvp );
-  val->hm_zoom = (gint)vik_viewport_get_zoom ( vvp );
-  val->hm_scaled_zoom = val->hm_zoom;
-  val->hm_center = vik_viewport_get_center ( vvp );
-  vik_viewport_screen_to_coord ( vvp, 0, 0, &val->hm_tl );
-  val->hm_scale = vik_viewport_get_scale ( vvp );
-  val->hm_scaled = FALSE;
-  val->hm_zoom_max = 0;
-  if ( val->hm_zoom == 0 ) {
-    g_warning ( "%s: Zoom invalid", __FUNCTION__ );
-    return;
-  }
+  gboolean full = val->hm_reset || !val->hm_heat;
+  if ( !val->hm_heat )
+    val->hm_heat = heat_pyramid_new ( HM_MAX_ZOOM );
+  else if ( full )
+    heat_pyramid_clear ( val->hm_heat );
+  val->hm_reset = FALSE;
 
-  hm_clear ( val );
   val->hm_calculating = TRUE;
+  val->hm_shown = TRUE;
 
   GList *layers = NULL;
   layers = vik_aggregate_layer_get_all_layers_of_type ( val, layers, VIK_LAYER_TRW, TRUE );
@@ -2571,10 +3195,10 @@ static void hm_calculate ( VikAggregateLayer *val )
   }
   g_list_free ( layers );
 
-  CalculateThreadT *ct = g_malloc ( sizeof(CalculateThreadT) );
-  ct->tracks_and_layers = tracks_and_layers;
-  ct->val = val;
-  ct->num_of_tracks = g_list_length ( tracks_and_layers );
+  val->hm_num_gens++;
+  CalculateThreadT *ct = ct_new ( val, val->hm_tracks, tracks_and_layers, val->hm_num_gens, full );
+  g_list_free_full ( tracks_and_layers, g_free );
+  calc_job_queued ( ct, &val->hm_job );
 
   a_background_thread ( BACKGROUND_POOL_LOCAL,
                         VIK_GTK_WINDOW_FROM_LAYER(val),
@@ -2583,7 +3207,17 @@ static void hm_calculate ( VikAggregateLayer *val )
                         ct,
                         (vik_thr_free_func)ct_free,
                         (vik_thr_free_func)ct_cancel,
-                        ct->num_of_tracks );
+                        MAX(1, ct->added->len) );
+}
+
+/**
+ * Update the heatmap for the tracks that have changed
+ */
+static void hm_update ( VikAggregateLayer *val )
+{
+  if ( val->hm_calculating || !val->hm_shown )
+    return;
+  hm_calculate ( val );
 }
 
 /**
@@ -2602,12 +3236,14 @@ static void aggregate_layer_post_read ( VikAggregateLayer *val, VikViewport *vvp
 void vik_aggregate_layer_file_load_complete ( VikAggregateLayer *val )
 {
   aggregate_layer_post_read ( val, NULL, TRUE );
+  hm_update ( val );
 }
 
 static void tac_clear_cb ( menu_array_values values )
 {
   VikAggregateLayer *val = VIK_AGGREGATE_LAYER(values[MA_VAL]);
   tac_clear ( val );
+  val->tac_reset = TRUE;
   vik_layer_emit_update ( VIK_LAYER(val), FALSE ); // NB update display from background
 }
 
@@ -2664,14 +3300,13 @@ static gint tac_mbtiles_thread ( MBT_T *mbt, gpointer threaddata  )
 
   guint zoom = (guint)map_utils_mpp_to_zoom_level(val->zoom_level);
 
-  GHashTableIter iter;
-  gpointer key, value;
+  TileBitmapIter iter;
   gint x,y;
   GdkPixbuf *pixbuf = NULL;
-  guint sz = g_hash_table_size ( val->tiles );
+  guint sz = tile_bitmap_size ( val->tiles );
 
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
+  tile_bitmap_iter_init ( &iter, val->tiles );
+  while ( tile_bitmap_iter_next ( &iter, &x, &y ) ) {
 
     num_tiles++;
     gdouble percent = (gdouble)num_tiles/(gdouble)sz;
@@ -2681,8 +3316,6 @@ static gint tac_mbtiles_thread ( MBT_T *mbt, gpointer threaddata  )
       goto cleanup;
     }
 
-    (void)sscanf ( key, "%d:%d", &x, &y );
-
     pixbuf = layer_pixbuf_update ( pixbuf, val->color[BASIC], 256, 256, val->alpha[BASIC] );
 
     gint flip_y = (gint) pow(2, zoom)-1 - y;
@@ -2781,7 +3414,7 @@ static void tac_generate_mbtiles_cb ( menu_array_values values )
                         mbt,
                         (vik_thr_free_func)mbt_free,
                         NULL, // cancel() nothing to do, could delete file but ATM leave as progressed
-                        g_hash_table_size(val->tiles) );
+                        tile_bitmap_size(val->tiles) );
 }
 #endif
 
@@ -2947,6 +3580,10 @@ static void hm_clear_cb ( menu_array_values values )
 {
   VikAggregateLayer *val = VIK_AGGREGATE_LAYER(values[MA_VAL]);
   hm_clear ( val );
+  val->hm_reset = TRUE;
+  // Release the memory now rather than at the next generation
+  if ( val->hm_heat )
+    heat_pyramid_clear ( val->hm_heat );
   vik_layer_emit_update ( VIK_LAYER(val), FALSE );
 }
 
@@ -3011,7 +3648,7 @@ static void aggregate_build_submenu_hm ( VikAggregateLayer *val, GtkMenu *menu,
     gtk_widget_set_sensitive ( itemhmc, hm_available );
 
     GtkWidget *itemhmlr = vu_menu_add_item ( hm_submenu, _("_Remove"), GTK_STOCK_DELETE, G_CALLBACK(hm_clear_cb), values );
-    gtk_widget_set_sensitive ( itemhmlr, (val->hm_pixbuf != NULL) );
+    gtk_widget_set_sensitive ( itemhmlr, (val->hm_shown && hm_available) );
   }
 }
 
@@ -3112,7 +3749,7 @@ static gboolean aggregate_layer_selected_viewport_menu ( VikAggregateLayer *val,
 
     if ( map_utils_vikcoord_to_iTMS(&coord, val->zoom_level, val->zoom_level, &val->rc_menu_mc) ) {
       GtkWidget *itemtt = vu_menu_add_item ( sm, _("_Tracks in this Tile"), GTK_STOCK_INFO, G_CALLBACK(tac_track_list_cb), values );
-      available = available && is_tile_occupied ( val->tiles, val->rc_menu_mc.x, val->rc_menu_mc.y );
+      available = available && tile_bitmap_contains ( val->tiles, val->rc_menu_mc.x, val->rc_menu_mc.y );
       gtk_widget_set_sensitive ( itemtt, available );
     }
 
@@ -3195,13 +3832,17 @@ static void disconnect_layer_signal ( VikLayer *vl, VikAggregateLayer *val )
 
 void vik_aggregate_layer_free ( VikAggregateLayer *val )
 {
+  // Calculations use the layer and the track records it keeps
+  calc_job_stop ( &val->tac_job );
+  calc_job_stop ( &val->hm_job );
+
   g_list_foreach ( val->children, (GFunc)(disconnect_layer_signal), val );
   g_list_foreach ( val->children, (GFunc)(g_object_unref), NULL );
   g_list_free ( val->children );
   if ( val->tracks_analysis_dialog != NULL )
     gtk_widget_destroy ( val->tracks_analysis_dialog );
 
-  g_hash_table_destroy ( val->tiles );
+  tile_bitmap_free ( val->tiles );
   for ( guint ii=0; ii<CP_NUM; ii++ ) {
     if ( val->pixbuf[ii] )
       g_object_unref ( val->pixbuf[ii] );
@@ -3210,14 +3851,21 @@ void vik_aggregate_layer_free ( VikAggregateLayer *val )
   }
   if ( val->unreachable_pixbuf )
     g_object_unref ( val->unreachable_pixbuf );
-  g_hash_table_destroy ( val->tiles_clust );
-  g_hash_table_destroy ( val->tiles_new );
-  g_hash_table_destroy ( val->prev );
-
-  if ( val->hm_pixbuf )
-    g_object_unref ( val->hm_pixbuf );
-  if ( val->hm_pbf_scaled )
-    g_object_unref ( val->hm_pbf_scaled );
+  tile_bitmap_free ( val->tiles_clust );
+  tile_bitmap_free ( val->tiles_new );
+  tile_bitmap_free ( val->tile_refs );
+  if ( val->cont_sizes )
+    g_hash_table_destroy ( val->cont_sizes );
+  if ( val->clust_sizes )
+    g_hash_table_destroy ( val->clust_sizes );
+  calc_tracks_reset ( val->tac_tracks );
+  g_hash_table_destroy ( val->tac_tracks );
+  calc_tracks_reset ( val->hm_tracks );
+  g_hash_table_destroy ( val->hm_tracks );
+  // NB Tiles still being rendered hold their own reference
+  heat_pyramid_unref ( val->hm_heat );
+  // Its renderings will never be used again
+  a_mapcache_flush_type ( MAP_ID_HEATMAP_RENDER );
 }
 
 static void delete_layer_iter ( VikLayer *vl )
@@ -251,16 +251,21 @@ static void coord_layer_draw ( VikCoordLayer *vcl, VikViewport *vp )
     GdkGC *dgc = vik_viewport_new_gc_from_color(vp, &(vcl->color), vcl->line_thickness);
     GdkGC *mgc = vik_viewport_new_gc_from_color(vp, &(vcl->color), mlt);
     GdkGC *sgc = vik_viewport_new_gc_from_color(vp, &(vcl->color), slt);
+    // The lines of each thickness, drawn together at the end
+    GArray *dlines = g_array_new ( FALSE, FALSE, sizeof(GdkPoint) );
+    GArray *mlines = g_array_new ( FALSE, FALSE, sizeof(GdkPoint) );
+    GArray *slines = g_array_new ( FALSE, FALSE, sizeof(GdkPoint) );
 
     vik_viewport_screen_to_coord ( vp, 0, 0, &left );
     vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), 0, &right );
     vik_viewport_screen_to_coord ( vp, 0, vik_viewport_get_height(vp), &left2 );
     vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), vik_viewport_get_height(vp), &right2 );
 
-#define CLINE(gc, c1, c2, lt) {                              \
+#define CLINE(lines, c1, c2) {                               \
 	  vik_viewport_coord_to_screen(vp, (c1), &x1, &y1);  \
 	  vik_viewport_coord_to_screen(vp, (c2), &x2, &y2);  \
-	  vik_viewport_draw_line (vp, (gc), x1, y1, x2, y2, &vcl->color, lt); \
+	  GdkPoint pts[2] = { { x1, y1 }, { x2, y2 } };      \
+	  g_array_append_vals ( (lines), pts, 2 );           \
 	}
 
     l = left.east_west;
@@ -278,18 +283,18 @@ static void coord_layer_draw ( VikCoordLayer *vcl, VikViewport *vp )
 	for (j=i*60+1; j<(i+1)*60; j+=1.0) {
 	  left.east_west = j/3600.0;
 	  left2.east_west = j/3600.0;
-	  if ((int)j % smod == 0) CLINE(sgc, &left, &left2, slt);
+	  if ((int)j % smod == 0) CLINE(slines, &left, &left2);
 	}
       }
       if (mins) {
 	left.east_west = i/60.0;
 	left2.east_west = i/60.0;
-	if ((int)i % mmod == 0) CLINE(mgc, &left, &left2, mlt);
+	if ((int)i % mmod == 0) CLINE(mlines, &left, &left2);
       }
       if ((int)i % 60 == 0) {
 	left.east_west = i/60.0;
 	left2.east_west = i/60.0;
-	CLINE(dgc, &left, &left2, vcl->line_thickness);
+	CLINE(dlines, &left, &left2);
       }
     }
 
@@ -301,21 +306,27 @@ static void coord_layer_draw ( VikCoordLayer *vcl, VikViewport *vp )
 	for (j=i*60+1; j<(i+1)*60; j+=1.0) {
 	  left.north_south = j/3600.0;
 	  right.north_south = j/3600.0;
-	  if ((int)j % smod == 0) CLINE(sgc, &left, &right, slt);
+	  if ((int)j % smod == 0) CLINE(slines, &left, &right);
 	}
       }
       if (mins) {
 	left.north_south = i/60.0;
 	right.north_south = i/60.0;
-	if ((int)i % mmod == 0) CLINE(mgc, &left, &right, mlt);
+	if ((int)i % mmod == 0) CLINE(mlines, &left, &right);
       }
       if ((int)i % 60 == 0) {
 	left.north_south = i/60.0;
 	right.north_south = i/60.0;
-	CLINE(dgc, &left, &right, vcl->line_thickness);
+	CLINE(dlines, &left, &right);
       }
     }
 #undef CLINE
+    vik_viewport_draw_segments ( vp, sgc, (GdkPoint*)slines->data, slines->len, &vcl->color, slt );
+    vik_viewport_draw_segments ( vp, mgc, (GdkPoint*)mlines->data, mlines->len, &vcl->color, mlt );
+    vik_viewport_draw_segments ( vp, dgc, (GdkPoint*)dlines->data, dlines->len, &vcl->color, vcl->line_thickness );
+    g_array_free ( slines, TRUE );
+    g_array_free ( mlines, TRUE );
+    g_array_free ( dlines, TRUE );
     ui_gc_unref(dgc);
     ui_gc_unref(sgc);
     ui_gc_unref(mgc);
@@ -331,6 +342,8 @@ static void coord_layer_draw ( VikCoordLayer *vcl, VikViewport *vp )
     double lon;
     int x1, x2;
     struct UTM utm;
+    GArray *lines = g_array_new ( FALSE, FALSE, sizeof(GdkPoint) );
+    GdkPoint pts[2];
 
     utm = *center;
     utm.northing = center->northing - ( ympp * height / 2 );
@@ -383,7 +396,9 @@ static void coord_layer_draw ( VikCoordLayer *vcl, VikViewport *vp )
       x1 = ( (utm.easting - center->easting) / xmpp ) + (width / 2);
       a_coords_latlon_to_utm ( &ll2, &utm );
       x2 = ( (utm.easting - center->easting) / xmpp ) + (width / 2);
-      vik_viewport_draw_line (vp, vcl->gc, x1, height, x2, 0, &(vcl->color), vcl->line_thickness);
+      pts[0].x = x1; pts[0].y = height;
+      pts[1].x = x2; pts[1].y = 0;
+      g_array_append_vals ( lines, pts, 2 );
     }
 
     utm = *center;
@@ -405,8 +420,13 @@ static void coord_layer_draw ( VikCoordLayer *vcl, VikViewport *vp )
       x1 = (height / 2) - ( (utm.northing - center->northing) / ympp );
       a_coords_latlon_to_utm ( &ll2, &utm );
       x2 = (height / 2) - ( (utm.northing - center->northing) / ympp );
-      vik_viewport_draw_line (vp, vcl->gc, width, x2, 0, x1, &(vcl->color), vcl->line_thickness);
+      pts[0].x = width; pts[0].y = x2;
+      pts[1].x = 0; pts[1].y = x1;
+      g_array_append_vals ( lines, pts, 2 );
     }
+
+    vik_viewport_draw_segments ( vp, vcl->gc, (GdkPoint*)lines->data, lines->len, &(vcl->color), vcl->line_thickness );
+    g_array_free ( lines, TRUE );
   }
 }
 
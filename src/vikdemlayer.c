@@ -37,6 +37,9 @@
 #include "dem.h"
 #include "dems.h"
 #include "bbox.h"
+#include "map_ids.h"
+#include "maputils.h"
+#include "mapcache.h"
 
 #define DEM_FIXED_NAME "DEM"
 #define MAPS_CACHE_DIR maps_layer_default_dir()
@@ -367,6 +370,11 @@ struct _VikDEMLayer {
 
   guchar *pixels;
 
+  // Unique to this layer (unlike its address which may be reused), to name its rendered tiles
+  guint render_id;
+  // Changed whenever the drawing would change, so previously rendered tiles are no longer used
+  gint render_generation;
+
   // right click menu only stuff - similar to mapslayer
   GtkMenu *right_click_menu;
 };
@@ -406,10 +414,19 @@ void vik_dem_layer_init ()
 
 static GdkColor black_color;
 
+// Tiles being rendered
+static GMutex *tp_mutex;
+static GHashTable *requests = NULL;
+static gint last_render_id = 0;
+
 // NB Only performed once per program run
 static void vik_dem_class_init ( VikDEMLayerClass *klass )
 {
   gdk_color_parse ( "#000000", &black_color );
+
+  tp_mutex = vik_mutex_new();
+  // Just storing keys only
+  requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
 }
 
 #define VIK_SETTINGS_DEM_USERNAME "dem_basic_auth_username"
@@ -477,6 +494,18 @@ static VikDEMLayer *dem_layer_unmarshall( guint8 *data, guint len, VikViewport *
   return rv;
 }
 
+/**
+ * Start a new generation of rendered tiles
+ *  and drop all the previous renderings from the map cache as these won't be used again
+ *
+ * NB Also drops the renderings of any other DEM layers, but these are simply rendered again as needed.
+ */
+static void dem_layer_render_changed ( VikDEMLayer *vdl )
+{
+  g_atomic_int_inc ( &vdl->render_generation );
+  a_mapcache_flush_type ( MAP_ID_DEM_RENDER );
+}
+
 /* Structure for DEM data used in background thread */
 typedef struct {
   VikDEMLayer *vdl;
@@ -497,8 +526,11 @@ static int dem_layer_load_list_thread ( dem_load_thread_data *dltd, gpointer thr
   // ATM as each file is processed the screen is not updated (no mechanism exposed to a_dems_load_list)
   // Thus force draw only at the end, as loading is complete/aborted
   // Test is helpful to prevent Gtk-CRITICAL warnings if the program is exitted whilst loading
-  if ( IS_VIK_LAYER(dltd->vdl) )
+  if ( IS_VIK_LAYER(dltd->vdl) ) {
+    // Tiles rendered whilst loading may be missing some DEMs
+    dem_layer_render_changed ( dltd->vdl );
     vik_layer_emit_update ( VIK_LAYER(dltd->vdl), FALSE ); // NB update requested from background thread
+  }
 
   return result;
 }
@@ -655,6 +687,8 @@ gboolean dem_layer_set_param ( VikDEMLayer *vdl, VikLayerSetParam *vlsp )
     }
     default: break;
   }
+  if ( changed )
+    dem_layer_render_changed ( vdl );
   if ( vik_debug && changed )
     g_debug ( "%s: Detected change on param %d", __FUNCTION__, vlsp->id );
   return changed;
@@ -803,6 +837,7 @@ static VikDEMLayer *dem_layer_new ( VikViewport *vvp )
   vik_layer_set_type ( VIK_LAYER(vdl), VIK_LAYER_DEM );
 
   vdl->files = NULL;
+  vdl->render_id = (guint)g_atomic_int_add ( &last_render_id, 1 );
 
   vdl->height_colors = g_malloc0 ( sizeof(GdkColor) * DEM_N_HEIGHT_COLORS );
   vdl->gradient_colors = g_malloc0 ( sizeof(GdkColor) * DEM_N_GRADIENT_COLORS );
@@ -847,8 +882,6 @@ static inline void pixels_set_area ( guchar* pixels, GdkColor gcolor, guint alph
 
 static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *dem )
 {
-  VikDEMColumn *column, *prevcolumn, *nextcolumn;
-
   LatLonBBox vp_bbox = vik_viewport_get_bbox ( vp );
   LatLonBBox dem_bbox = vik_dem_get_bbox ( dem );
 
@@ -902,6 +935,8 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
     gint16 elev;
 
     guint skip_factor = ceil ( vik_viewport_get_xmpp(vp) / 80 ); /* todo: smarter calculation. */
+    // Each drawn box covers skip_factor samples, so read the matching overview
+    guint level = vik_dem_get_overview_level ( dem, skip_factor );
 
     gdouble nscale_deg = dem->north_scale / ((gdouble) 3600);
     gdouble escale_deg = dem->east_scale / ((gdouble) 3600);
@@ -934,26 +969,26 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
       // NOTE: ( counter.lon <= end_lon + ESCALE_DEG*SKIP_FACTOR ) is neccessary so in high zoom modes,
       // the leftmost column does also get drawn, if the center point is out of viewport.
       if ( x < dem->n_columns ) {
-        column = g_ptr_array_index ( dem->columns, x );
         // get previous and next column. catch out-of-bound.
+        guint prev_x, next_x;
 	gint32 new_x = x;
 	new_x -= gradient_skip_factor;
         if(new_x < 0)
-          prevcolumn = g_ptr_array_index ( dem->columns, 0);
+          prev_x = 0;
         else
-          prevcolumn = g_ptr_array_index ( dem->columns, new_x);
+          prev_x = new_x;
 	new_x = x;
 	new_x += gradient_skip_factor;
         if(new_x >= dem->n_columns)
-          nextcolumn = g_ptr_array_index ( dem->columns, dem->n_columns-1);
+          next_x = dem->n_columns-1;
         else
-          nextcolumn = g_ptr_array_index ( dem->columns, new_x);
+          next_x = new_x;
 
         for ( y=start_y, counter.lat = start_lat; counter.lat <= end_lat; counter.lat += nscale_deg * skip_factor, y += skip_factor ) {
-          if ( y > column->n_points )
+          if ( y >= dem->n_rows )
             break;
 
-          elev = column->points[y];
+          elev = vik_dem_get_xy_level ( dem, level, x, y );
 
 	  // calculate bounding box for drawing
 	  gint box_x, box_y, box_width, box_height;
@@ -1013,19 +1048,19 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
 		new_y = y - gradient_skip_factor;
 		if(new_y < 0)
                   new_y = 0;
-		change += get_height_difference(elev, prevcolumn->points[new_y]);
-		change += get_height_difference(elev, column->points[new_y]);
-		change += get_height_difference(elev, nextcolumn->points[new_y]);
+		change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, prev_x, new_y));
+		change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, x, new_y));
+		change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, next_x, new_y));
 
-		change += get_height_difference(elev, prevcolumn->points[y]);
-		change += get_height_difference(elev, nextcolumn->points[y]);
+		change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, prev_x, y));
+		change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, next_x, y));
 
 		new_y = y + gradient_skip_factor;
-		if(new_y >= column->n_points)
+		if(new_y >= dem->n_rows)
 			new_y = y;
-		change += get_height_difference(elev, prevcolumn->points[new_y]);
-		change += get_height_difference(elev, column->points[new_y]);
-		change += get_height_difference(elev, nextcolumn->points[new_y]);
+		change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, prev_x, new_y));
+		change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, x, new_y));
+		change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, next_x, new_y));
 
 		change = change / ((skip_factor > 1) ? log(skip_factor) : 0.55); // FIXME: better calc.
 
@@ -1077,6 +1112,7 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
     struct UTM counter;
 
     guint skip_factor = ceil ( vik_viewport_get_xmpp(vp) / 10 ); /* todo: smarter calculation. */
+    guint level = vik_dem_get_overview_level ( dem, skip_factor );
 
     VikCoord tleft, tright, bleft, bright;
 
@@ -1125,11 +1161,10 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
 
     for ( x=start_x, counter.easting = start_eas; counter.easting <= end_eas; counter.easting += dem->east_scale * skip_factor, x += skip_factor ) {
       if ( x >= 0 && x < dem->n_columns ) {
-        column = g_ptr_array_index ( dem->columns, x );
         for ( y=start_y, counter.northing = start_nor; counter.northing <= end_nor; counter.northing += dem->north_scale * skip_factor, y += skip_factor ) {
-          if ( y > column->n_points )
+          if ( y >= dem->n_rows )
             continue;
-          elev = column->points[y];
+          elev = vik_dem_get_xy_level ( dem, level, x, y );
           if ( elev != VIK_DEM_INVALID_ELEVATION && elev < vdl->min_elev )
             elev=vdl->min_elev;
           if ( elev != VIK_DEM_INVALID_ELEVATION && elev > vdl->max_elev )
@@ -1159,6 +1194,306 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
   }
 }
 
+#define DEM_TILE_SIZE 256
+
+/* Everything needed to render a tile, so the layer can change whilst rendering */
+typedef struct {
+  GMutex *mutex;
+  VikDEMLayer *vdl; /* NULL if not alive */
+  MapCoord ulm;
+  GList *files;  // DEMs with a reference held whilst rendering
+  gchar *name;   // Map cache name of the current rendering
+  gchar *request;
+  guint type;
+  gdouble min_elev;
+  gdouble max_elev;
+  guint alpha;
+  GdkColor color;
+  GdkColor *height_colors;
+  GdkColor *gradient_colors;
+} DEMRenderInfo;
+
+static inline void pixel_set ( guchar *pixel, GdkColor gcolor, guint alpha )
+{
+  pixel[0] = gcolor.red / 256;
+  pixel[1] = gcolor.green / 256;
+  pixel[2] = gcolor.blue / 256;
+  pixel[3] = alpha;
+}
+
+/**
+ * Sum of the height changes to the samples around (skip samples away),
+ *  read from the overview level
+ */
+static gdouble dem_get_gradient ( VikDEM *dem, guint level, guint x, guint y, gint16 elev, guint skip )
+{
+  guint prev_x = x >= skip ? x - skip : 0;
+  guint next_x = x + skip < dem->n_columns ? x + skip : dem->n_columns - 1;
+  // Same edge handling as vik_dem_layer_draw_dem()
+  guint prev_y = y >= skip ? y - skip : 0;
+  guint next_y = y + skip < dem->n_rows ? y + skip : y;
+  gdouble change = 0;
+  change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, prev_x, prev_y));
+  change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, x, prev_y));
+  change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, next_x, prev_y));
+  change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, prev_x, y));
+  change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, next_x, y));
+  change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, prev_x, next_y));
+  change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, x, next_y));
+  change += get_height_difference(elev, vik_dem_get_xy_level(dem, level, next_x, next_y));
+  return change / ((skip > 1) ? log(skip) : 0.55);
+}
+
+/**
+ * Render one DEM into the tile
+ *
+ * Each pixel is coloured by the DEM sample it falls in,
+ *  with the position of each pixel row and column calculated only once.
+ */
+static void dem_render_tile_dem ( DEMRenderInfo *ri, VikDEM *dem, guchar *pixels, const gdouble *lats, const gdouble *lons, gdouble mpp )
+{
+  LatLonBBox dem_bbox = vik_dem_get_bbox ( dem );
+  LatLonBBox tile_bbox = { lats[DEM_TILE_SIZE-1], lats[0], lons[DEM_TILE_SIZE-1], lons[0] };
+  if ( ! BBOX_INTERSECT(dem_bbox, tile_bbox) )
+    return;
+
+  // Distance between pixels, in the units of the DEM
+  gdouble pixel_size;
+  if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS )
+    pixel_size = (lons[1] - lons[0]) * 3600;
+  else
+    pixel_size = mpp;
+  guint skip = MAX ( 1, (guint)ceil(pixel_size / dem->east_scale) );
+  // Zoomed out, so read the overview of about one sample per pixel
+  guint level = vik_dem_get_overview_level ( dem, pixel_size / dem->east_scale );
+
+  for ( guint yy = 0; yy < DEM_TILE_SIZE; yy++ ) {
+    if ( lats[yy] < dem_bbox.south || lats[yy] > dem_bbox.north )
+      continue;
+    guchar *row = pixels + (yy * DEM_TILE_SIZE * 4);
+    for ( guint xx = 0; xx < DEM_TILE_SIZE; xx++ ) {
+      gdouble east, north;
+      if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
+        east = lons[xx] * 3600;
+        north = lats[yy] * 3600;
+      }
+      else {
+        struct LatLon ll = { lats[yy], lons[xx] };
+        struct UTM utm;
+        a_coords_latlon_to_utm ( &ll, &utm );
+        if ( utm.zone != dem->utm_zone )
+          continue;
+        east = utm.easting;
+        north = utm.northing;
+      }
+      if ( east < dem->min_east || east > dem->max_east || north < dem->min_north || north > dem->max_north )
+        continue;
+
+      guint x, y;
+      vik_dem_east_north_to_xy ( dem, east, north, &x, &y );
+      gint16 elev = vik_dem_get_xy_level ( dem, level, x, y );
+      if ( elev == VIK_DEM_INVALID_ELEVATION )
+        continue; /* don't draw it */
+
+      if ( ri->type == DEM_TYPE_GRADIENT ) {
+        gdouble change = dem_get_gradient ( dem, level, x, y, elev, skip );
+        if ( change < ri->min_elev )
+          // Prevent 'change - min_elev' from being negative so can safely use as array index
+          change = ceil ( ri->min_elev );
+        if ( change > ri->max_elev )
+          change = ri->max_elev;
+        guint index = (gint)floor(((change - ri->min_elev)/(ri->max_elev - ri->min_elev))*(DEM_N_GRADIENT_COLORS-2))+1;
+        pixel_set ( row + (xx * 4), ri->gradient_colors[index], ri->alpha );
+      }
+      else if ( ri->type == DEM_TYPE_HEIGHT ) {
+        /* If 'sea' colour or below the defined mininum draw in the configurable colour */
+        if ( elev <= ri->min_elev )
+          pixel_set ( row + (xx * 4), ri->color, ri->alpha );
+        else {
+          gdouble height = MIN ( elev, ri->max_elev );
+          guint index = (gint)floor(((height - ri->min_elev)/(ri->max_elev - ri->min_elev))*(DEM_N_HEIGHT_COLORS-2))+1;
+          pixel_set ( row + (xx * 4), ri->height_colors[index], ri->alpha );
+        }
+      }
+    }
+  }
+}
+
+static void dem_render_tile ( DEMRenderInfo *ri )
+{
+  gint64 tt1 = g_get_real_time ();
+  gdouble mpp = ri->ulm.scale >= 0 ? VIK_GZ(ri->ulm.scale) : 1.0/VIK_GZ(-ri->ulm.scale);
+
+  // Centre position of each pixel row and column
+  gdouble lats[DEM_TILE_SIZE], lons[DEM_TILE_SIZE];
+  for ( guint ii = 0; ii < DEM_TILE_SIZE; ii++ ) {
+    gdouble offset = (ii + 0.5) / DEM_TILE_SIZE;
+    lons[ii] = ((ri->ulm.x + offset) / VIK_GZ(17) * mpp * 360) - 180;
+    lats[ii] = DEMERCLAT(180 - ((ri->ulm.y + offset) / VIK_GZ(17) * mpp * 360));
+  }
+
+  // RGBA, fully transparent where there is no DEM
+  guchar *pixels = g_malloc0 ( DEM_TILE_SIZE * DEM_TILE_SIZE * 4 );
+  for ( GList *iter = ri->files; iter; iter = iter->next ) {
+    VikDEM *dem = a_dems_get ( (const gchar*)iter->data );
+    if ( dem )
+      dem_render_tile_dem ( ri, dem, pixels, lats, lons, mpp );
+  }
+
+  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data ( pixels, GDK_COLORSPACE_RGB, TRUE, 8, DEM_TILE_SIZE, DEM_TILE_SIZE, DEM_TILE_SIZE*4,
+                                                 (GdkPixbufDestroyNotify)g_free, NULL );
+  gdouble tt = (gdouble)(g_get_real_time() - tt1) / G_USEC_PER_SEC;
+  a_mapcache_add ( pixbuf, (mapcache_extra_t){ tt, 0 }, ri->ulm.x, ri->ulm.y, ri->ulm.z, MAP_ID_DEM_RENDER, ri->ulm.scale, ri->alpha, 0.0, 0.0, ri->name );
+  g_object_unref ( pixbuf );
+}
+
+static void dem_render_info_free ( DEMRenderInfo *ri )
+{
+  vik_mutex_free ( ri->mutex );
+  a_dems_list_free ( ri->files );
+  g_free ( ri->name );
+  g_free ( ri->height_colors );
+  g_free ( ri->gradient_colors );
+  // NB No need to free the request/key - as this is freed by the hash table destructor
+  g_free ( ri );
+}
+
+static void render_weak_ref_cb ( gpointer ptr, GObject *dead_vdl )
+{
+  DEMRenderInfo *ri = (DEMRenderInfo*)ptr;
+  g_mutex_lock ( ri->mutex );
+  ri->vdl = NULL;
+  g_mutex_unlock ( ri->mutex );
+}
+
+static void dem_render_thread ( DEMRenderInfo *ri, gpointer threaddata )
+{
+  int res = a_background_thread_progress ( threaddata, 0 );
+  if ( res == 0 )
+    dem_render_tile ( ri );
+
+  g_mutex_lock ( tp_mutex );
+  g_hash_table_remove ( requests, ri->request );
+  g_mutex_unlock ( tp_mutex );
+
+  g_mutex_lock ( ri->mutex );
+  if ( ri->vdl ) {
+    g_object_weak_unref ( G_OBJECT(ri->vdl), render_weak_ref_cb, ri );
+    if ( res == 0 )
+      vik_layer_emit_update ( VIK_LAYER(ri->vdl), FALSE ); // NB update display from background
+    ri->vdl = NULL;
+  }
+  g_mutex_unlock ( ri->mutex );
+}
+
+static void dem_render_cancel_cleanup ( DEMRenderInfo *ri )
+{
+}
+
+#define REQUEST_HASHKEY_FORMAT "%d-%d-%d-%d-%s"
+
+/**
+ * Render the tile in the background, unless already requested
+ */
+static void dem_render_thread_add ( VikDEMLayer *vdl, MapCoord *ulm, const gchar *name )
+{
+  gchar *request = g_strdup_printf ( REQUEST_HASHKEY_FORMAT, ulm->x, ulm->y, ulm->z, ulm->scale, name );
+
+  g_mutex_lock ( tp_mutex );
+  if ( g_hash_table_lookup_extended ( requests, request, NULL, NULL ) ) {
+    g_free ( request );
+    g_mutex_unlock ( tp_mutex );
+    return;
+  }
+  g_hash_table_insert ( requests, request, NULL );
+  g_mutex_unlock ( tp_mutex );
+
+  DEMRenderInfo *ri = g_malloc0 ( sizeof(DEMRenderInfo) );
+  ri->mutex = vik_mutex_new ();
+  ri->vdl = vdl;
+  ri->ulm = *ulm;
+  ri->name = g_strdup ( name );
+  ri->request = request;
+  // Only use DEMs that have been loaded
+  for ( GList *iter = vdl->files; iter; iter = iter->next )
+    if ( a_dems_ref ( (const gchar*)iter->data ) )
+      ri->files = g_list_prepend ( ri->files, g_strdup ( (const gchar*)iter->data ) );
+  ri->files = g_list_reverse ( ri->files );
+  ri->type = vdl->type;
+  ri->min_elev = vdl->min_elev;
+  ri->max_elev = vdl->max_elev;
+  ri->alpha = vdl->alpha;
+  ri->color = vdl->color;
+  ri->height_colors = g_malloc ( sizeof(GdkColor) * DEM_N_HEIGHT_COLORS );
+  memcpy ( ri->height_colors, vdl->height_colors, sizeof(GdkColor) * DEM_N_HEIGHT_COLORS );
+  ri->gradient_colors = g_malloc ( sizeof(GdkColor) * DEM_N_GRADIENT_COLORS );
+  memcpy ( ri->gradient_colors, vdl->gradient_colors, sizeof(GdkColor) * DEM_N_GRADIENT_COLORS );
+
+  g_object_weak_ref ( G_OBJECT(vdl), render_weak_ref_cb, ri );
+  gchar *description = g_strdup_printf ( _("DEM Render %d:%d:%d"), ulm->scale, ulm->x, ulm->y );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(vdl),
+                        description,
+                        (vik_thr_func) dem_render_thread,
+                        ri,
+                        (vik_thr_free_func) dem_render_info_free,
+                        (vik_thr_free_func) dem_render_cancel_cleanup,
+                        1 );
+  g_free ( description );
+}
+
+/**
+ * Draw the DEMs as tiles, which are kept in the map cache
+ *  so only tiles not drawn before need rendering (in the background)
+ *
+ * Returns: FALSE if the viewport is not suitable for drawing with tiles
+ */
+static gboolean dem_layer_draw_tiles ( VikDEMLayer *vdl, VikViewport *vp )
+{
+  if ( vik_viewport_get_drawmode(vp) != VIK_VIEWPORT_DRAWMODE_MERCATOR )
+    return FALSE;
+
+  VikCoord ul, br;
+  vik_viewport_screen_to_coord ( vp, 0, 0, &ul );
+  vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), vik_viewport_get_height(vp), &br );
+
+  gdouble xzoom = vik_viewport_get_xmpp ( vp );
+  gdouble yzoom = vik_viewport_get_ympp ( vp );
+
+  MapCoord ulm, brm;
+  if ( !map_utils_vikcoord_to_iTMS ( &ul, xzoom, yzoom, &ulm ) ||
+       !map_utils_vikcoord_to_iTMS ( &br, xzoom, yzoom, &brm ) )
+    return FALSE;
+
+  /* verify sane elev interval */
+  if ( vdl->max_elev <= vdl->min_elev )
+    vdl->max_elev = vdl->min_elev + 1;
+
+  gchar *name = g_strdup_printf ( "%u-%d", vdl->render_id, g_atomic_int_get(&vdl->render_generation) );
+
+  gint xmin = MIN(ulm.x, brm.x), xmax = MAX(ulm.x, brm.x);
+  gint ymin = MIN(ulm.y, brm.y), ymax = MAX(ulm.y, brm.y);
+  for ( gint x = xmin; x <= xmax; x++ ) {
+    for ( gint y = ymin; y <= ymax; y++ ) {
+      ulm.x = x;
+      ulm.y = y;
+      GdkPixbuf *pixbuf = a_mapcache_get ( ulm.x, ulm.y, ulm.z, MAP_ID_DEM_RENDER, ulm.scale, vdl->alpha, 0.0, 0.0, name );
+      if ( pixbuf ) {
+        VikCoord coord;
+        gint xx, yy;
+        map_utils_iTMS_to_vikcoord ( &ulm, &coord );
+        vik_viewport_coord_to_screen ( vp, &coord, &xx, &yy );
+        vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, xx, yy, DEM_TILE_SIZE, DEM_TILE_SIZE );
+        g_object_unref ( pixbuf );
+      }
+      else
+        dem_render_thread_add ( vdl, &ulm, name );
+    }
+  }
+  g_free ( name );
+  return TRUE;
+}
+
 /* return the continent for the specified lat, lon */
 /* TODO */
 static const gchar *srtm_continent_dir ( gint lat, gint lon )
@@ -1204,6 +1539,10 @@ static void dem_layer_draw ( VikDEMLayer *vdl, VikViewport *vp )
     dem24k_draw_existence ( vp );
 #endif
 
+  if ( dem_layer_draw_tiles ( vdl, vp ) )
+    return;
+
+  // Otherwise draw directly for the current view
   const guint width = vik_viewport_get_width ( vp );
   const guint height = vik_viewport_get_height ( vp );
 
@@ -1226,6 +1565,8 @@ static void dem_layer_draw ( VikDEMLayer *vdl, VikViewport *vp )
 static void dem_layer_free ( VikDEMLayer *vdl )
 {
   a_dems_list_free ( vdl->files );
+  // Its renderings will never be used again
+  a_mapcache_flush_type ( MAP_ID_DEM_RENDER );
 
   g_free ( vdl->srtm_base_url );
   g_free ( vdl->height_colors );
@@ -107,6 +107,9 @@ static VikLayerInterface *vik_layer_interfaces[VIK_LAYER_NUM_TYPES] = {
  */
 void vik_layer_redraw ( VikLayer *vl )
 {
+  // Even when not drawn now, what was drawn before is out of date
+  vik_layer_invalidate_cache ( vl );
+
   if ( vl->visible && vl->realized ) {
     GThread *thread = vik_window_get_thread ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vl)) );
     if ( !thread )
@@ -133,6 +136,9 @@ void vik_layer_redraw ( VikLayer *vl )
  */
 void vik_layer_emit_update ( VikLayer *vl, gboolean is_modified )
 {
+  // Even when not drawn now, what was drawn before is out of date
+  vik_layer_invalidate_cache ( vl );
+
   if ( vl->visible && vl->realized ) {
     GThread *thread = vik_window_get_thread ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vl)) );
     if ( !thread )
@@ -174,6 +180,7 @@ void vik_layer_emit_update ( VikLayer *vl, gboolean is_modified )
  */
 void vik_layer_emit_update_although_invisible ( VikLayer *vl )
 {
+  vik_layer_invalidate_cache ( vl );
   vik_window_set_redraw_trigger(vl);
   (void)g_idle_add ( (GSourceFunc)idle_draw, vl );
 }
@@ -181,6 +188,7 @@ void vik_layer_emit_update_although_invisible ( VikLayer *vl )
 /* doesn't set the trigger. should be done by aggregate layer when child emits update. */
 void vik_layer_emit_update_secondary ( VikLayer *vl )
 {
+  vik_layer_invalidate_cache ( vl );
   if ( vl->visible )
     // TODO: this can used from the background - eg in acquire
     //       so will need to flow background update status through too
@@ -227,6 +235,8 @@ static void vik_layer_init ( VikLayer *vl )
   vl->visible = TRUE;
   vl->name = NULL;
   vl->realized = FALSE;
+  // Kept for the lifetime of the layer, as it may be invalidated from any thread
+  vl->cache = vik_viewport_cache_new ();
 }
 
 void vik_layer_set_type ( VikLayer *vl, VikLayerTypeEnum type )
@@ -309,6 +319,45 @@ void vik_layer_draw ( VikLayer *l, VikViewport *vp )
       vik_layer_interfaces[l->type]->draw ( l, vp );
 }
 
+/**
+ * vik_layer_draw_cached:
+ *
+ * Draw the layer as vik_layer_draw(),
+ *  but reusing the image from last time when neither the layer nor the view has changed since.
+ * Thus when only one layer emits an update, the others need not be drawn all over again.
+ *
+ * Layers containing other layers are always drawn,
+ *  as updates from their sublayers do not invalidate them.
+ * The image of a hidden layer is not kept.
+ */
+void vik_layer_draw_cached ( VikLayer *l, VikViewport *vp )
+{
+  if ( !l->visible ) {
+    vik_viewport_cache_clear ( l->cache );
+    return;
+  }
+  if ( l->type == VIK_LAYER_AGGREGATE || l->type == VIK_LAYER_GPS ) {
+    vik_layer_draw ( l, vp );
+    return;
+  }
+  if ( vik_viewport_cache_paint ( vp, l->cache ) )
+    return;
+  vik_viewport_cache_begin ( vp, l->cache );
+  vik_layer_draw ( l, vp );
+  vik_viewport_cache_end ( vp, l->cache );
+}
+
+/**
+ * vik_layer_invalidate_cache:
+ *
+ * The layer has changed, so it must be drawn again rather than using the image from before.
+ * This may be called from a background thread.
+ */
+void vik_layer_invalidate_cache ( VikLayer *l )
+{
+  vik_viewport_cache_invalidate ( l->cache );
+}
+
 void vik_layer_configure ( VikLayer *l, VikViewport *vp )
 {
   if ( l->visible )
@@ -502,6 +551,7 @@ static void vik_layer_finalize ( VikLayer *vl )
     vik_layer_interfaces[vl->type]->free ( vl );
   if ( vl->name )
     g_free ( vl->name );
+  vik_viewport_cache_free ( vl->cache );
   G_OBJECT_CLASS(parent_class)->finalize(G_OBJECT(vl));
 }
 
@@ -62,6 +62,8 @@ struct _VikLayer {
 
   /* for explicit "polymorphism" (function type switching) */
   VikLayerTypeEnum type;
+
+  VikViewportCache *cache; /* what was last drawn, see vik_layer_draw_cached() */
 };
 
 /* I think most of these are ignored,
@@ -277,6 +279,8 @@ VikLayerInterface *vik_layer_get_interface ( VikLayerTypeEnum type );
 
 void vik_layer_set_type ( VikLayer *vl, VikLayerTypeEnum type );
 void vik_layer_draw ( VikLayer *l, VikViewport *vp );
+void vik_layer_draw_cached ( VikLayer *l, VikViewport *vp );
+void vik_layer_invalidate_cache ( VikLayer *l );
 void vik_layer_configure ( VikLayer *l, VikViewport *vp );
 void vik_layer_change_coord_mode ( VikLayer *l, VikCoordMode mode );
 void vik_layer_rename ( VikLayer *l, const gchar *new_name );
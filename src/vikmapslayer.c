@@ -35,13 +35,15 @@
 #include "vikmapsourcedefault.h"
 #include "maputils.h"
 #include "mapcache.h"
+#include "tileindex.h"
 #include "background.h"
 #include "vikmapslayer.h"
 #include "metatile.h"
+#include "compression.h"
 #include "map_ids.h"
 
 #ifdef HAVE_SQLITE3_H
-#include "sqlite3.h"
+#include "mbtiles.h"
 #include <gio/gio.h>
 #endif
 
@@ -64,6 +66,16 @@ static guint SCALE_INC_UP = 2;
 static guint SCALE_INC_DOWN = 4;
 #define VIK_SETTINGS_MAP_SCALE_SMALLER_ZOOM_FIRST "maps_scale_smaller_zoom_first"
 static gboolean SCALE_SMALLER_ZOOM_FIRST = TRUE;
+#define VIK_SETTINGS_MAP_ASYNC_DECODE "maps_async_decode"
+static gboolean ASYNC_DECODE = TRUE;
+// Minimum time between redraws whilst tiles are being read in the background (in microseconds)
+#define DECODE_REDRAW_INTERVAL 100000
+// Maximum number of tile downloads queued at once for concurrent downloading
+#define DOWNLOAD_MULTI_QUEUE 32
+#define VIK_SETTINGS_MAP_MBTILES_CONNECTIONS "maps_mbtiles_connections"
+static guint MBTILES_CONNECTIONS = 4;
+#define VIK_SETTINGS_MAP_MBTILES_MMAP_SIZE "maps_mbtiles_mmap_size"
+static guint MBTILES_MMAP_SIZE = 256; // MB
 
 #define VIK_SETTINGS_MAP_CACHE_NO_FILE_COLOR "maps_cache_status_no_file_color"
 #define VIK_SETTINGS_MAP_CACHE_EXPIRED_COLOR "maps_cache_status_expired_color"
@@ -320,8 +332,13 @@ struct _VikMapsLayer {
   VikCoord redownload_ul, redownload_br; /* right click menu only */
   VikViewport *redownload_vvp;
   gchar *filename;
+
+  // Tile range of the last draw - so background reads of tiles no longer on screen can be skipped
+  // Access protected via the dq_mutex
+  gint visible_xmin, visible_xmax, visible_ymin, visible_ymax, visible_scale;
+
 #ifdef HAVE_SQLITE3_H
-  sqlite3 *mbtiles;
+  MBTilesReader *mbtiles;
 #endif
 };
 
@@ -345,6 +362,24 @@ static VikLayerParam prefs[] = {
 static GMutex *rq_mutex;
 static GHashTable *requests = NULL;
 
+// Similarly for tiles being read from disk in the background
+static GMutex *dq_mutex;
+
+// Recently used metatiles are kept open, so their other tiles can be read without accessing the file again
+#define METATILE_CACHE_SIZE 16
+typedef struct {
+  gchar *dir;
+  gint x, y, z; // Of the lowest tile in the metatile
+  metatile_t *mt;
+  // Of the file when opened, as renderd replaces metatiles by renaming a new file over the old one
+  time_t mtime;
+  guint64 inode;
+} MetatileItem;
+static GMutex *mt_mutex;
+static GQueue *metatiles = NULL; // Of MetatileItem, most recently used first
+static void metatile_item_free ( MetatileItem *mi );
+static GHashTable *decode_requests = NULL;
+
 static GdkColor black_color;
 
 static GdkColor cache_no_file_color;
@@ -390,10 +425,23 @@ void maps_layer_init ()
   if ( a_settings_get_boolean ( VIK_SETTINGS_MAP_SCALE_SMALLER_ZOOM_FIRST, &gbtmp ) )
     SCALE_SMALLER_ZOOM_FIRST = gbtmp;
 
+  if ( a_settings_get_boolean ( VIK_SETTINGS_MAP_ASYNC_DECODE, &gbtmp ) )
+    ASYNC_DECODE = gbtmp;
+
+  if ( a_settings_get_integer ( VIK_SETTINGS_MAP_MBTILES_CONNECTIONS, &gitmp ) )
+    MBTILES_CONNECTIONS = gitmp;
+
+  if ( a_settings_get_integer ( VIK_SETTINGS_MAP_MBTILES_MMAP_SIZE, &gitmp ) )
+    MBTILES_MMAP_SIZE = gitmp;
+
   rq_mutex = vik_mutex_new();
+  dq_mutex = vik_mutex_new();
+  mt_mutex = vik_mutex_new();
+  metatiles = g_queue_new ();
 
   // Just storing keys only
   requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  decode_requests = g_hash_table_new_full ( decode_request_hash, decode_request_equal, g_free, NULL );
 
   (void)gdk_color_parse ( "#000000", &black_color );
 
@@ -414,6 +462,10 @@ void maps_layer_uninit ()
 {
   vik_mutex_free ( rq_mutex );
   g_hash_table_destroy ( requests );
+  vik_mutex_free ( dq_mutex );
+  g_hash_table_destroy ( decode_requests );
+  vik_mutex_free ( mt_mutex );
+  g_queue_free_full ( metatiles, (GDestroyNotify)metatile_item_free );
 }
 
 /****************************************/
@@ -556,6 +608,10 @@ gchar *vik_maps_layer_get_map_label(VikMapsLayer *vml)
 #define DIRECTDIRACCESS "%s%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d%s"
 #define DIRECTDIRACCESS_WITH_NAME "%s%s" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d%s"
 #define DIRSTRUCTURE "%st%ds%dz%d" G_DIR_SEPARATOR_S "%d" G_DIR_SEPARATOR_S "%d"
+// The zoom level directories of the above, which contain the <x>/<y> tile files
+#define DIRECTDIRACCESS_ZOOM "%s%d"
+#define DIRECTDIRACCESS_WITH_NAME_ZOOM "%s%s" G_DIR_SEPARATOR_S "%d"
+#define DIRSTRUCTURE_ZOOM "%st%ds%dz%d"
 #define MAPS_CACHE_DIR maps_layer_default_dir()
 
 #ifdef WINDOWS
@@ -923,6 +979,10 @@ static VikMapsLayer *maps_layer_new ( VikViewport *vvp )
   vml->last_xmpp = 0.0;
   vml->last_ympp = 0.0;
 
+  vml->visible_xmin = vml->visible_ymin = G_MAXINT;
+  vml->visible_xmax = vml->visible_ymax = G_MININT;
+  vml->visible_scale = G_MININT;
+
   vml->dl_right_click_menu = NULL;
   return vml;
 }
@@ -941,13 +1001,8 @@ static void maps_layer_free ( VikMapsLayer *vml )
 #ifdef HAVE_SQLITE3_H
   VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
   if ( vik_map_source_is_mbtiles ( map ) ) {
-    if ( vml->mbtiles ) {
-      int ans = sqlite3_close ( vml->mbtiles );
-      if ( ans != SQLITE_OK ) {
-        // Only to console for information purposes only
-        g_warning ( "%s: SQL Close problem: %s", __FUNCTION__, sqlite3_errstr(ans) );
-      }
-    }
+    mbtiles_reader_unref ( vml->mbtiles );
+    vml->mbtiles = NULL;
   }
 #endif
 }
@@ -957,19 +1012,13 @@ static void maps_layer_mbtiles_open ( VikMapsLayer *vml, VikViewport *vp, VikMap
 #ifdef HAVE_SQLITE3_H
   // Do some SQL stuff
   if ( vik_map_source_is_mbtiles ( map ) ) {
-    int ans = sqlite3_open_v2 ( vml->filename,
-                                &(vml->mbtiles),
-                                SQLITE_OPEN_READONLY,
-                                NULL );
-    if ( ans != SQLITE_OK ) {
-      // That didn't work, so here's why:
-      g_warning ( "%s: %s", __FUNCTION__, sqlite3_errmsg ( vml->mbtiles ) );
-
+    // Several connections so tiles can be read by the background threads simultaneously
+    vml->mbtiles = mbtiles_reader_new ( vml->filename, MBTILES_CONNECTIONS,
+                                        (gint64)MBTILES_MMAP_SIZE * 1024 * 1024, NULL );
+    if ( !vml->mbtiles ) {
       a_dialog_error_msg_extra ( VIK_GTK_WINDOW_FROM_WIDGET(vp),
                                  _("Failed to open MBTiles file: %s"),
                                  vml->filename );
-      (void)sqlite3_close ( vml->mbtiles );
-      vml->mbtiles = NULL;
     }
   }
 #endif
@@ -1049,172 +1098,251 @@ static GdkPixbuf *pixbuf_shrink ( GdkPixbuf *pixbuf, gdouble xshrinkfactor, gdou
   return tmp;
 }
 
+/**
+ * The layer values used to read a tile.
+ * The background reading takes its own copy of these,
+ *  so it need not access the layer itself whilst reading.
+ */
+typedef struct {
+  VikMapSource *map;
+  guint8 alpha;
+  gchar *filename;
+  gchar *cache_dir;
+  VikMapsCacheLayout cache_layout;
+  guint cache_expiry_age;
 #ifdef HAVE_SQLITE3_H
-/*
-static int sql_select_tile_dump_cb (void *data, int cols, char **fields, char **col_names )
-{
-  g_warning ( "Found %d columns", cols );
-  int i;
-  for ( i = 0; i < cols; i++ ) {
-    g_warning ( "SQL processing %s = %s", col_names[i], fields[i] );
-  }
-  return 0;
+  MBTilesReader *mbtiles;
+#endif
+  VikWindow *vw; // For reporting problems; NULL when not in the main thread
+} MapTileSettings;
+
+/**
+ * Borrow the current values of the layer for immediate use
+ */
+static void tile_settings_from_layer ( MapTileSettings *mts, VikMapsLayer *vml )
+{
+  mts->map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+  mts->alpha = vml->alpha;
+  mts->filename = vml->filename;
+  mts->cache_dir = vml->cache_dir;
+  mts->cache_layout = vml->cache_layout;
+  mts->cache_expiry_age = vml->cache_expiry_age;
+#ifdef HAVE_SQLITE3_H
+  mts->mbtiles = vml->mbtiles;
+#endif
+  mts->vw = (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml);
 }
-*/
 
 /**
- *
+ * Take a copy of the current values of the layer, for use in another thread.
+ * Free via tile_settings_clear()
  */
-static GdkPixbuf *get_pixbuf_sql_exec ( sqlite3 *sql, gint xx, gint yy, gint zoom )
+static void tile_settings_copy ( MapTileSettings *mts, VikMapsLayer *vml )
 {
-  GdkPixbuf *pixbuf = NULL;
-
-  // MBTiles stored internally with the flipping y thingy (i.e. TMS scheme).
-  gint flip_y = (gint) pow(2, zoom)-1 - yy;
-  gchar *statement = g_strdup_printf ( "SELECT tile_data FROM tiles WHERE zoom_level=%d AND tile_column=%d AND tile_row=%d;", zoom, xx, flip_y );
+  tile_settings_from_layer ( mts, vml );
+  g_object_ref ( mts->map );
+  mts->filename = g_strdup ( mts->filename );
+  mts->cache_dir = g_strdup ( mts->cache_dir );
+#ifdef HAVE_SQLITE3_H
+  if ( mts->mbtiles )
+    mts->mbtiles = mbtiles_reader_ref ( mts->mbtiles );
+#endif
+  mts->vw = NULL;
+}
 
-  gboolean finished = FALSE;
+static void tile_settings_clear ( MapTileSettings *mts )
+{
+  g_object_unref ( mts->map );
+  g_free ( mts->filename );
+  g_free ( mts->cache_dir );
+#ifdef HAVE_SQLITE3_H
+  mbtiles_reader_unref ( mts->mbtiles );
+#endif
+}
 
-  sqlite3_stmt *sql_stmt = NULL;
-  int ans = sqlite3_prepare_v2 ( sql, statement, -1, &sql_stmt, NULL );
-  if ( ans != SQLITE_OK ) {
-    g_warning ( "%s: %s - %s: %s", __FUNCTION__, "prepare failure", sqlite3_errstr(ans), statement );
-    finished = TRUE;
-  }
+static GBytes *get_mbtiles_bytes ( MapTileSettings *mts, gint xx, gint yy, gint zoom )
+{
+  GBytes *tile_data = NULL;
 
-  while ( !finished ) {
-    ans = sqlite3_step ( sql_stmt );
-    switch (ans) {
-      case SQLITE_ROW: {
-        // Get tile_data blob
-        int count = sqlite3_column_count(sql_stmt);
-        if ( count != 1 )  {
-          g_warning ( "%s: %s - %d", __FUNCTION__, "count not one", count );
-          finished = TRUE;
-        }
-        else {
-          const void *data = sqlite3_column_blob ( sql_stmt, 0 );
-          int bytes = sqlite3_column_bytes ( sql_stmt, 0 );
-          if ( bytes < 1 )  {
-            g_warning ( "%s: %s (%d)", __FUNCTION__, "not enough bytes", bytes );
-            finished = TRUE;
-          }
-          else {
-            // Convert these blob bytes into a pixbuf via these streaming operations
-            GInputStream *stream = g_memory_input_stream_new_from_data ( data, bytes, NULL );
-            GError *error = NULL;
-            pixbuf = gdk_pixbuf_new_from_stream ( stream, NULL, &error );
-            if ( error ) {
-              g_warning ( "%s: %s", __FUNCTION__, error->message );
-              g_error_free ( error );
-            }
-            g_input_stream_close ( stream, NULL, NULL );
-          }
-        }
-        break;
-      }
-      default:
-       // e.g. SQLITE_DONE | SQLITE_ERROR | SQLITE_MISUSE | etc...
-       // Finished normally
-       //  and give up on any errors
-       if ( ans != SQLITE_DONE )
-         g_warning ( "%s: %s - %s", __FUNCTION__, "step issue", sqlite3_errstr(ans) );
-       finished = TRUE;
-       break;
-    }
+#ifdef HAVE_SQLITE3_H
+  if ( mts->mbtiles ) {
+    tile_data = mbtiles_reader_get_tile ( mts->mbtiles, xx, yy, zoom );
   }
-  (void)sqlite3_finalize ( sql_stmt );
+#endif
 
-  g_free ( statement );
+  return tile_data;
+}
 
-  return pixbuf;
+/**
+ * Get the tile data of the tile x,y from the metatile,
+ *  uncompressing it if necessary
+ */
+static GBytes *metatile_tile_bytes ( metatile_t *mt, gint x, gint y )
+{
+  GBytes *tile_data = metatile_get_bytes ( mt, x, y );
+  if ( tile_data && metatile_is_compressed(mt) ) {
+    gsize size = 0;
+    void *data = uncompress_gzip_data ( g_bytes_get_data(tile_data, NULL), g_bytes_get_size(tile_data), &size );
+    g_bytes_unref ( tile_data );
+    tile_data = data ? g_bytes_new_take ( data, size ) : NULL;
+  }
+  return tile_data;
 }
-#endif
 
-static GdkPixbuf *get_mbtiles_pixbuf ( VikMapsLayer *vml, gint xx, gint yy, gint zoom )
+static void metatile_item_free ( MetatileItem *mi )
 {
-  GdkPixbuf *pixbuf = NULL;
+  metatile_close ( mi->mt );
+  g_free ( mi->dir );
+  g_free ( mi );
+}
 
-#ifdef HAVE_SQLITE3_H
-  if ( vml->mbtiles ) {
-    /*
-    gchar *statement = g_strdup_printf ( "SELECT name FROM sqlite_master WHERE type='table';" );
-    char *errMsg = NULL;
-    int ans = sqlite3_exec ( vml->mbtiles, statement, sql_select_tile_dump_cb, pixbuf, &errMsg );
-    if ( ans != SQLITE_OK ) {
-      // Only to console for information purposes only
-      g_warning ( "SQL problem: %d for %s - error: %s", ans, statement, errMsg );
-      sqlite3_free( errMsg );
+/**
+ * Get the metatile containing the tile, opening it if not recently used.
+ *
+ * Must be called with the mt_mutex held
+ *
+ * Returns NULL on failure with the reason in err_msg
+ */
+static MetatileItem *metatile_cache_get ( const gchar *dir, gint xx, gint yy, gint zz, gboolean *opened, char *err_msg )
+{
+  const gint mx = xx & ~(METATILE-1);
+  const gint my = yy & ~(METATILE-1);
+  *opened = FALSE;
+
+  char path[PATH_MAX];
+  GStatBuf buf;
+  (void)xyz_to_meta ( path, sizeof(path), dir, xx, yy, zz );
+  gboolean exists = (g_stat ( path, &buf ) == 0);
+
+  for ( GList *iter = metatiles->head; iter; iter = iter->next ) {
+    MetatileItem *mi = (MetatileItem*)iter->data;
+    if ( mi->x == mx && mi->y == my && mi->z == zz && !g_strcmp0(mi->dir, dir) ) {
+      if ( exists && buf.st_mtime == mi->mtime && (guint64)buf.st_ino == mi->inode ) {
+        // Now the most recently used
+        g_queue_unlink ( metatiles, iter );
+        g_queue_push_head_link ( metatiles, iter );
+        return mi;
+      }
+      // The file has been replaced (or removed) since it was opened
+      g_queue_delete_link ( metatiles, iter );
+      metatile_item_free ( mi );
+      break;
     }
-    g_free ( statement );
-    */
-
-    // Reading BLOBS is a bit more involved and so can't use the simpler sqlite3_exec ()
-    // Hence this specific function
-    pixbuf = get_pixbuf_sql_exec ( vml->mbtiles, xx, yy, zoom );
   }
-#endif
 
-  return pixbuf;
+  metatile_t *mt = metatile_open ( dir, xx, yy, zz, err_msg );
+  if ( !mt )
+    return NULL;
+
+  MetatileItem *mi = g_malloc ( sizeof(MetatileItem) );
+  mi->dir = g_strdup ( dir );
+  mi->x = mx;
+  mi->y = my;
+  mi->z = zz;
+  mi->mt = mt;
+  mi->mtime = exists ? buf.st_mtime : 0;
+  mi->inode = exists ? (guint64)buf.st_ino : 0;
+  g_queue_push_head ( metatiles, mi );
+  while ( g_queue_get_length(metatiles) > METATILE_CACHE_SIZE )
+    metatile_item_free ( g_queue_pop_tail(metatiles) );
+  *opened = TRUE;
+  return mi;
 }
 
-static GdkPixbuf *get_pixbuf_from_metatile ( VikMapsLayer *vml, gint xx, gint yy, gint zz )
+/**
+ * When the metatile is first read, all its other tiles are put into the mapcache's second tier as well,
+ *  since these are likely to be wanted next.
+ * Without the second tier this is not done, as decoding them all would be slower than reading them when needed.
+ */
+static GBytes *get_bytes_from_metatile ( MapTileSettings *mts, guint16 id, MapCoord *mapcoord )
 {
-  const int tile_max = METATILE_MAX_SIZE;
   char err_msg[PATH_MAX];
-  char *buf;
-  int len;
-  int compressed;
-
-  buf = g_malloc(tile_max);
-  if (!buf) {
-      return NULL;
-  }
+  gboolean opened;
+  const gint zz = 17 - mapcoord->scale;
+  GBytes *tile_data = NULL;
 
   err_msg[0] = 0;
-  len = metatile_read(vml->cache_dir, xx, yy, zz, buf, tile_max, &compressed, err_msg);
-
-  if (len > 0) {
-    if (compressed) {
-      // Not handled yet - I don't think this is used often - so implement later if necessary
-      g_warning ( "Compressed metatiles not implemented:%s", __FUNCTION__);
-      g_free(buf);
-      return NULL;
+  g_mutex_lock ( mt_mutex );
+  MetatileItem *mi = metatile_cache_get ( mts->cache_dir, mapcoord->x, mapcoord->y, zz, &opened, err_msg );
+  if ( mi ) {
+    tile_data = metatile_tile_bytes ( mi->mt, mapcoord->x, mapcoord->y );
+    if ( opened && a_mapcache_encoded_enabled() ) {
+      for ( gint xx = mi->x; xx < mi->x + METATILE; xx++ ) {
+        for ( gint yy = mi->y; yy < mi->y + METATILE; yy++ ) {
+          if ( xx == mapcoord->x && yy == mapcoord->y )
+            continue;
+          GBytes *other = metatile_tile_bytes ( mi->mt, xx, yy );
+          if ( other ) {
+            a_mapcache_add_encoded ( other, (mapcache_extra_t){0.0, DOWNLOAD_SUCCESS}, xx, yy, mapcoord->z,
+                                     id, mapcoord->scale, mts->filename );
+            g_bytes_unref ( other );
+          }
+        }
+      }
     }
+  }
+  g_mutex_unlock ( mt_mutex );
 
-    // Convert these buf bytes into a pixbuf via these streaming operations
-    GdkPixbuf *pixbuf = NULL;
+  if ( !mi )
+    g_warning ( "FAILED:%s %s", __FUNCTION__, err_msg );
+  return tile_data;
+}
 
-    GInputStream *stream = g_memory_input_stream_new_from_data ( buf, len, NULL );
-    GError *error = NULL;
-    pixbuf = gdk_pixbuf_new_from_stream ( stream, NULL, &error );
-    if (error) {
-      g_warning ( "%s: %s", __FUNCTION__, error->message );
-      g_error_free ( error );
-    }
-    g_input_stream_close ( stream, NULL, NULL );
+/**
+ * Convert the tile file data into a pixbuf via these streaming operations
+ */
+static GdkPixbuf *pixbuf_from_bytes ( GBytes *tile_data, GError **error )
+{
+  gsize size = 0;
+  gconstpointer data = g_bytes_get_data ( tile_data, &size );
+  GInputStream *stream = g_memory_input_stream_new_from_data ( data, size, NULL );
+  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_stream ( stream, NULL, error );
+  g_input_stream_close ( stream, NULL, NULL );
+  g_object_unref ( stream );
+  return pixbuf;
+}
 
-    g_free(buf);
-    return pixbuf;
-  }
-  else {
-    g_free(buf);
-    g_warning ( "FAILED:%s %s", __FUNCTION__, err_msg);
+/**
+ * Decode data from the direct access sources (MBTiles or metatiles),
+ *  keeping the original data in the mapcache's second tier
+ */
+static GdkPixbuf *pixbuf_from_direct_bytes ( GBytes *tile_data, MapTileSettings *mts, guint16 id, MapCoord *mapcoord, gboolean from_cache )
+{
+  if ( !tile_data )
     return NULL;
+
+  if ( !from_cache )
+    a_mapcache_add_encoded ( tile_data, (mapcache_extra_t){0.0, DOWNLOAD_SUCCESS}, mapcoord->x, mapcoord->y,
+                             mapcoord->z, id, mapcoord->scale, mts->filename );
+
+  GError *error = NULL;
+  GdkPixbuf *pixbuf = pixbuf_from_bytes ( tile_data, &error );
+  if ( error ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+    if ( pixbuf )
+      g_object_unref ( G_OBJECT(pixbuf) );
+    pixbuf = NULL;
   }
+  g_bytes_unref ( tile_data );
+  return pixbuf;
 }
 
 /**
+ * @start_time: When reading of the image began (monotonic time),
+ *  so the decode cost is recorded in the mapcache
+ *
  * Caller has to decrease reference counter of returned
  * GdkPixbuf, when buffer is no longer needed.
  */
-static GdkPixbuf *pixbuf_apply_settings ( GdkPixbuf *pixbuf, VikMapsLayer *vml, guint vp_scale,
-                                          MapCoord *mapcoord, gdouble xshrinkfactor, gdouble yshrinkfactor, guint status )
+static GdkPixbuf *pixbuf_apply_settings ( GdkPixbuf *pixbuf, MapTileSettings *mts, guint vp_scale,
+                                          MapCoord *mapcoord, gdouble xshrinkfactor, gdouble yshrinkfactor, guint status,
+                                          gint64 start_time )
 {
-  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+  VikMapSource *map = mts->map;
   // Apply alpha setting
-  if ( pixbuf && vml->alpha < 255 )
-    pixbuf = ui_pixbuf_set_alpha ( pixbuf, vml->alpha );
+  if ( pixbuf && mts->alpha < 255 )
+    pixbuf = ui_pixbuf_set_alpha ( pixbuf, mts->alpha );
 
   if ( pixbuf && ( xshrinkfactor != 1.0 || yshrinkfactor != 1.0 ) )
      pixbuf = pixbuf_shrink ( pixbuf, xshrinkfactor, yshrinkfactor );
@@ -1230,10 +1358,12 @@ static GdkPixbuf *pixbuf_apply_settings ( GdkPixbuf *pixbuf, VikMapsLayer *vml,
     pixbuf = pixbuf_shrink ( pixbuf, xscale, yscale );
   }
 
-  if ( pixbuf )
-    a_mapcache_add ( pixbuf, (mapcache_extra_t){0.0, status}, mapcoord->x, mapcoord->y,
+  if ( pixbuf ) {
+    gdouble duration = (gdouble)(g_get_monotonic_time() - start_time) / G_USEC_PER_SEC;
+    a_mapcache_add ( pixbuf, (mapcache_extra_t){duration, status}, mapcoord->x, mapcoord->y,
                      mapcoord->z, vik_map_source_get_uniq_id(map),
-                     mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
+                     mapcoord->scale, mts->alpha, xshrinkfactor, yshrinkfactor, mts->filename );
+  }
 
   return pixbuf;
 }
@@ -1269,59 +1399,193 @@ static void get_filename ( const gchar *cache_dir,
   }
 }
 
+static void get_zoom_dirname ( const gchar *cache_dir,
+                               VikMapsCacheLayout cl,
+                               guint16 id,
+                               const gchar *name,
+                               gint scale,
+                               gint z,
+                               gchar *dirname_buf,
+                               gint buf_len )
+{
+  switch ( cl ) {
+    case VIK_MAPS_CACHE_LAYOUT_OSM:
+      if ( name && !g_strcmp0 ( cache_dir, MAPS_CACHE_DIR ) )
+        g_snprintf ( dirname_buf, buf_len, DIRECTDIRACCESS_WITH_NAME_ZOOM, cache_dir, name, (17 - scale) );
+      else
+        g_snprintf ( dirname_buf, buf_len, DIRECTDIRACCESS_ZOOM, cache_dir, (17 - scale) );
+      break;
+    default:
+      g_snprintf ( dirname_buf, buf_len, DIRSTRUCTURE_ZOOM, cache_dir, id, scale, z );
+      break;
+  }
+}
+
 /**
+ * Generate the tile filename and check whether it exists,
+ *  using the tile index when available rather than querying the filesystem.
+ *
+ * Optionally returns the modification time of the file.
+ */
+static gboolean tile_file_exists ( const gchar *cache_dir,
+                                   VikMapsCacheLayout cl,
+                                   guint16 id,
+                                   const gchar *name,
+                                   gint scale,
+                                   gint z,
+                                   gint x,
+                                   gint y,
+                                   gchar *filename_buf,
+                                   gint buf_len,
+                                   const gchar* file_extension,
+                                   gint64 *mtime )
+{
+  get_filename ( cache_dir, cl, id, name, scale, z, x, y, filename_buf, buf_len, file_extension );
+
+  gchar dirname_buf[PATH_MAX];
+  get_zoom_dirname ( cache_dir, cl, id, name, scale, z, dirname_buf, sizeof(dirname_buf) );
+  tileindex_info_t info;
+  if ( a_tileindex_lookup ( dirname_buf, cl == VIK_MAPS_CACHE_LAYOUT_OSM ? file_extension : "", x, y, &info ) ) {
+    if ( mtime )
+      *mtime = info.mtime;
+    return info.exists;
+  }
+
+  GStatBuf buf;
+  if ( g_stat ( filename_buf, &buf ) != 0 )
+    return FALSE;
+  if ( mtime )
+    *mtime = buf.st_mtime;
+  return TRUE;
+}
+
+/**
+ * Let the tile index know the tile file has been changed
+ */
+static void tile_file_changed ( const gchar *cache_dir,
+                                VikMapsCacheLayout cl,
+                                guint16 id,
+                                const gchar *name,
+                                gint scale,
+                                gint z,
+                                gint x,
+                                gint y,
+                                const gchar* file_extension )
+{
+  gchar dirname_buf[PATH_MAX];
+  get_zoom_dirname ( cache_dir, cl, id, name, scale, z, dirname_buf, sizeof(dirname_buf) );
+  a_tileindex_update ( dirname_buf, cl == VIK_MAPS_CACHE_LAYOUT_OSM ? file_extension : "", x, y );
+}
+
+/**
+ * The status of a successfully read tile file, according to its age
+ */
+static guint tile_file_status ( gint64 file_time, guint cache_expiry_age )
+{
+  if ( (time(NULL) - file_time) > cache_expiry_age )
+    return MAPCACHE_STATUS_FILE_EXPIRED;
+  return DOWNLOAD_SUCCESS;
+}
+
+/**
+ * Get the tile from the cache, or otherwise read it in, using only the given settings
+ *  (so this may be used from a background thread)
+ *
  * Caller has to decrease reference counter of returned
  * GdkPixbuf, when buffer is no longer needed.
  */
-static GdkPixbuf *get_pixbuf ( VikMapsLayer *vml, guint16 id, guint vp_scale, const gchar* mapname, MapCoord *mapcoord,
-                               gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor )
+static GdkPixbuf *get_pixbuf_with_settings ( MapTileSettings *mts, guint16 id, guint vp_scale, const gchar* mapname, MapCoord *mapcoord,
+                                             gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor )
 {
   GdkPixbuf *pixbuf;
 
   /* get the thing */
   pixbuf = a_mapcache_get ( mapcoord->x, mapcoord->y, mapcoord->z,
-                            id, mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
+                            id, mapcoord->scale, mts->alpha, xshrinkfactor, yshrinkfactor, mts->filename );
 
   if ( ! pixbuf ) {
-    VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+    gint64 start_time = g_get_monotonic_time ();
+    VikMapSource *map = mts->map;
+
+    // Try the original file data kept in memory before going to the filesystem or database
+    mapcache_extra_t encoded_extra;
+    GBytes *tile_data = a_mapcache_get_encoded ( mapcoord->x, mapcoord->y, mapcoord->z, id, mapcoord->scale,
+                                                 mts->filename, &encoded_extra );
+    VikMapsCacheLayout cl = mts->cache_layout;
+    const gchar *name = mapname;
+
     if ( vik_map_source_is_direct_file_access(map) ) {
       // ATM MBTiles must be 'a direct access type'
       if ( vik_map_source_is_mbtiles(map) ) {
-        pixbuf = get_mbtiles_pixbuf ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, DOWNLOAD_SUCCESS );
+        gboolean from_cache = (tile_data != NULL);
+        if ( !tile_data )
+          tile_data = get_mbtiles_bytes ( mts, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
+        pixbuf = pixbuf_from_direct_bytes ( tile_data, mts, id, mapcoord, from_cache );
+        pixbuf = pixbuf_apply_settings ( pixbuf, mts, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, DOWNLOAD_SUCCESS, start_time );
         // return now to avoid file tests that aren't appropriate for this map type
         return pixbuf;
       }
       else if ( vik_map_source_is_osm_meta_tiles(map) ) {
-        pixbuf = get_pixbuf_from_metatile ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, DOWNLOAD_SUCCESS );
+        gboolean from_cache = (tile_data != NULL);
+        if ( !tile_data )
+          tile_data = get_bytes_from_metatile ( mts, id, mapcoord );
+        pixbuf = pixbuf_from_direct_bytes ( tile_data, mts, id, mapcoord, from_cache );
+        pixbuf = pixbuf_apply_settings ( pixbuf, mts, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, DOWNLOAD_SUCCESS, start_time );
         return pixbuf;
       }
-      else
-        get_filename ( vml->cache_dir, VIK_MAPS_CACHE_LAYOUT_OSM, id, NULL,
-                       mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
-                       vik_map_source_get_file_extension(map) );
+      else {
+        cl = VIK_MAPS_CACHE_LAYOUT_OSM;
+        name = NULL;
+      }
     }
-    else
-      get_filename ( vml->cache_dir, vml->cache_layout, id, mapname,
-                     mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
-                     vik_map_source_get_file_extension(map) );
 
-    if ( g_file_test ( filename_buf, G_FILE_TEST_EXISTS ) == TRUE)
+    gint64 file_time = 0;
+    if ( tile_data ) {
+      GError *gx = NULL;
+      pixbuf = pixbuf_from_bytes ( tile_data, &gx );
+      if ( gx ) {
+        g_warning ( "%s: %s", __FUNCTION__, gx->message );
+        g_error_free ( gx );
+        if ( pixbuf )
+          g_object_unref ( G_OBJECT(pixbuf) );
+        pixbuf = NULL;
+      }
+      else {
+        // As per reading from the file, check the expiry value against the file's time
+        guint status = encoded_extra.status;
+        if ( encoded_extra.mtime && encoded_extra.status >= DOWNLOAD_SUCCESS )
+          status = tile_file_status ( encoded_extra.mtime, mts->cache_expiry_age );
+        pixbuf = pixbuf_apply_settings ( pixbuf, mts, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, status, start_time );
+      }
+      g_bytes_unref ( tile_data );
+    }
+    else if ( tile_file_exists ( mts->cache_dir, cl, id, name, mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y,
+                                 filename_buf, buf_len, vik_map_source_get_file_extension(map), &file_time ) )
     {
       GError *gx = NULL;
-      pixbuf = gdk_pixbuf_new_from_file ( filename_buf, &gx );
+      gchar *contents = NULL;
+      gsize length = 0;
+      if ( g_file_get_contents ( filename_buf, &contents, &length, &gx ) ) {
+        tile_data = g_bytes_new_take ( contents, length );
+        pixbuf = pixbuf_from_bytes ( tile_data, &gx );
+      }
 
       /* free the pixbuf on error */
       if (gx)
       {
+        if ( gx->domain == G_FILE_ERROR )
+          // Perhaps removed by something else, so correct the tile index
+          tile_file_changed ( mts->cache_dir, cl, id, name, mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y,
+                              vik_map_source_get_file_extension(map) );
         if ( gx->domain != GDK_PIXBUF_ERROR || gx->code != GDK_PIXBUF_ERROR_CORRUPT_IMAGE ) {
           // Report a warning
-          if ( IS_VIK_WINDOW ((VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml)) ) {
+          if ( mts->vw && IS_VIK_WINDOW(mts->vw) ) {
             gchar* msg = g_strdup_printf ( _("Couldn't open image file: %s"), gx->message );
-            vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml), msg, VIK_STATUSBAR_INFO );
+            vik_window_statusbar_update ( mts->vw, msg, VIK_STATUSBAR_INFO );
             g_free (msg);
           }
+          else
+            g_warning ( "%s: %s", __FUNCTION__, gx->message );
         }
 
         g_error_free ( gx );
@@ -1331,25 +1595,401 @@ static GdkPixbuf *get_pixbuf ( VikMapsLayer *vml, guint16 id, guint vp_scale, co
       } else {
         // Maintain any download result status value that is already in the mapcache
         mapcache_extra_t extra = a_mapcache_get_extra ( mapcoord->x, mapcoord->y, mapcoord->z, id, mapcoord->scale,
-                                                        vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
+                                                        mts->alpha, xshrinkfactor, yshrinkfactor, mts->filename );
         guint status = extra.status;
-        if ( extra.status >= DOWNLOAD_SUCCESS ) {
+        if ( extra.status >= DOWNLOAD_SUCCESS )
           // On read in from file, check expiry value
-          GStatBuf buf;
-          if ( g_stat(filename_buf, &buf) == 0 ) {
-            status = DOWNLOAD_SUCCESS;
-            time_t file_time = buf.st_mtime;
-            if ( (time(NULL) - file_time) > vml->cache_expiry_age )
-              status = MAPCACHE_STATUS_FILE_EXPIRED;
-          }
-        }
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, status );
+          status = tile_file_status ( file_time, mts->cache_expiry_age );
+        a_mapcache_add_encoded ( tile_data, (mapcache_extra_t){0.0, status, file_time}, mapcoord->x, mapcoord->y,
+                                 mapcoord->z, id, mapcoord->scale, mts->filename );
+        pixbuf = pixbuf_apply_settings ( pixbuf, mts, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, status, start_time );
       }
+      if ( tile_data )
+        g_bytes_unref ( tile_data );
     }
   }
   return pixbuf;
 }
 
+/**
+ * Caller has to decrease reference counter of returned
+ * GdkPixbuf, when buffer is no longer needed.
+ */
+static GdkPixbuf *get_pixbuf ( VikMapsLayer *vml, guint16 id, guint vp_scale, const gchar* mapname, MapCoord *mapcoord,
+                               gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  MapTileSettings mts;
+  tile_settings_from_layer ( &mts, vml );
+  return get_pixbuf_with_settings ( &mts, id, vp_scale, mapname, mapcoord, filename_buf, buf_len, xshrinkfactor, yshrinkfactor );
+}
+
+/****************************************/
+/****** BACKGROUND TILE READING *********/
+/****************************************/
+
+/* pass along data to the decode thread, exists even if layer is deleted.
+   The layer itself is only accessed (with the mutex held) to check whether it still wants the tiles,
+   the reading uses the copy of the layer settings taken when the job was created. */
+typedef struct {
+  VikMapsLayer *vml;
+  gboolean map_layer_alive;
+  GMutex *mutex;
+  MapTileSettings settings;
+  guint16 id;
+  guint vp_scale;
+  gdouble xshrinkfactor, yshrinkfactor;
+  gchar *mapname;
+  gchar *filename_buf;
+  gint maxlen;
+  GArray *tiles; // Of MapCoord
+  GPtrArray *requests; // Of #DecodeRequest keys, in the same order as the tiles
+} MapDecodeInfo;
+
+/**
+ * Identity of a tile being read, in the manner of the mapcache keys
+ */
+typedef struct {
+  gint x, y, z;
+  gint scale;
+  guint name_hash;
+  guint16 id;
+  guint8 alpha;
+  gint xshrink; // Shrinkfactors quantized to 1/1000th
+  gint yshrink;
+} DecodeRequest;
+
+static void decode_request_init ( DecodeRequest *dr, guint16 id, MapCoord *mc, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar *name )
+{
+  dr->x = mc->x;
+  dr->y = mc->y;
+  dr->z = mc->z;
+  dr->scale = mc->scale;
+  dr->name_hash = name ? g_str_hash ( name ) : 0;
+  dr->id = id;
+  dr->alpha = alpha;
+  dr->xshrink = (gint)round ( xshrinkfactor * 1000 );
+  dr->yshrink = (gint)round ( yshrinkfactor * 1000 );
+}
+
+static guint decode_request_hash ( gconstpointer ptr )
+{
+  const DecodeRequest *dr = ptr;
+  guint hh = dr->id;
+  hh = hh * 31 + dr->x;
+  hh = hh * 31 + dr->y;
+  hh = hh * 31 + dr->z;
+  hh = hh * 31 + dr->scale;
+  hh = hh * 31 + dr->name_hash;
+  hh = hh * 31 + dr->alpha;
+  hh = hh * 31 + dr->xshrink;
+  hh = hh * 31 + dr->yshrink;
+  return hh;
+}
+
+static gboolean decode_request_equal ( gconstpointer ptr1, gconstpointer ptr2 )
+{
+  const DecodeRequest *d1 = ptr1;
+  const DecodeRequest *d2 = ptr2;
+  return d1->x == d2->x && d1->y == d2->y && d1->z == d2->z && d1->scale == d2->scale &&
+         d1->name_hash == d2->name_hash && d1->id == d2->id && d1->alpha == d2->alpha &&
+         d1->xshrink == d2->xshrink && d1->yshrink == d2->yshrink;
+}
+
+static void decode_weak_ref_cb ( gpointer ptr, GObject *dead_vml )
+{
+  MapDecodeInfo *mdi = ptr;
+  g_mutex_lock ( mdi->mutex );
+  mdi->map_layer_alive = FALSE;
+  g_mutex_unlock ( mdi->mutex );
+}
+
+static void decode_unref_weak_ref_cb ( MapDecodeInfo *mdi )
+{
+  g_mutex_lock ( mdi->mutex );
+  if ( mdi->map_layer_alive )
+    g_object_weak_unref ( G_OBJECT(mdi->vml), decode_weak_ref_cb, mdi );
+  mdi->map_layer_alive = FALSE;
+  g_mutex_unlock ( mdi->mutex );
+}
+
+static void mdei_free ( MapDecodeInfo *mdi )
+{
+  vik_mutex_free ( mdi->mutex );
+  tile_settings_clear ( &mdi->settings );
+  g_free ( mdi->mapname );
+  g_free ( mdi->filename_buf );
+  g_array_free ( mdi->tiles, TRUE );
+  // NB No need to free the request keys - as these are freed by the hash table destructor
+  g_ptr_array_free ( mdi->requests, TRUE );
+  g_free ( mdi );
+}
+
+/**
+ * Remove the request of the tile once it has been dealt with,
+ *  thus it can be requested again by a subsequent draw
+ * NB The dq_mutex must be held
+ */
+static void decode_request_remove ( MapDecodeInfo *mdi, guint index )
+{
+  DecodeRequest *request = g_ptr_array_index ( mdi->requests, index );
+  if ( request )
+    (void)g_hash_table_remove ( decode_requests, request );
+  g_ptr_array_index ( mdi->requests, index ) = NULL;
+}
+
+static void decode_request_done ( MapDecodeInfo *mdi, guint index )
+{
+  g_mutex_lock ( dq_mutex );
+  decode_request_remove ( mdi, index );
+  g_mutex_unlock ( dq_mutex );
+}
+
+/**
+ * Remove any outstanding requests from the index onwards,
+ *  i.e. when the remaining tiles of the job will not be read
+ */
+static void decode_requests_clear ( MapDecodeInfo *mdi, guint index )
+{
+  g_mutex_lock ( dq_mutex );
+  for ( guint ii = index; ii < mdi->requests->len; ii++ )
+    decode_request_remove ( mdi, ii );
+  g_mutex_unlock ( dq_mutex );
+}
+
+/**
+ * Is the tile still of any interest,
+ *  i.e. the map type hasn't changed and it's still within the last drawn area
+ *
+ * Must be called with the mdi->mutex held and the layer alive
+ */
+static gboolean decode_tile_wanted ( MapDecodeInfo *mdi, MapCoord *mc )
+{
+  VikMapsLayer *vml = mdi->vml;
+  if ( vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(vml->maptype)) != mdi->id )
+    return FALSE;
+  g_mutex_lock ( dq_mutex );
+  gboolean wanted = ( mc->scale == vml->visible_scale &&
+                      mc->x >= vml->visible_xmin && mc->x <= vml->visible_xmax &&
+                      mc->y >= vml->visible_ymin && mc->y <= vml->visible_ymax );
+  g_mutex_unlock ( dq_mutex );
+  return wanted;
+}
+
+#ifdef HAVE_SQLITE3_H
+typedef struct {
+  MapDecodeInfo *mdi;
+  MapCoord mc;
+} MBTilesPrefetch;
+
+static void mbtiles_prefetch_cb ( gint x, gint y, GBytes *tile_data, gpointer user_data )
+{
+  MBTilesPrefetch *mp = (MBTilesPrefetch*)user_data;
+  a_mapcache_add_encoded ( tile_data, (mapcache_extra_t){0.0, DOWNLOAD_SUCCESS}, x, y, mp->mc.z,
+                           mp->mdi->id, mp->mc.scale, mp->mdi->settings.filename );
+  g_bytes_unref ( tile_data );
+}
+
+/**
+ * Read the MBTiles tiles of the job with a single query,
+ *  putting them into the mapcache ready for decoding.
+ * Only worthwhile when the tiles wanted are most of the area covered
+ */
+static void mbtiles_prefetch ( MapDecodeInfo *mdi )
+{
+  if ( !mdi->settings.mbtiles || !vik_map_source_is_mbtiles(mdi->settings.map) )
+    return;
+  if ( a_preferences_get(VIKING_PREFERENCES_NAMESPACE "mapcache_encoded_size")->u == 0 )
+    return;
+
+  MBTilesPrefetch mp;
+  mp.mdi = mdi;
+  mp.mc = g_array_index ( mdi->tiles, MapCoord, 0 );
+  gint xmin = mp.mc.x, xmax = mp.mc.x, ymin = mp.mc.y, ymax = mp.mc.y;
+  guint count = 0;
+  for ( guint ii = 0; ii < mdi->tiles->len; ii++ ) {
+    MapCoord *mc = &g_array_index ( mdi->tiles, MapCoord, ii );
+    if ( mc->scale != mp.mc.scale )
+      continue;
+    xmin = MIN ( xmin, mc->x ); xmax = MAX ( xmax, mc->x );
+    ymin = MIN ( ymin, mc->y ); ymax = MAX ( ymax, mc->y );
+    count++;
+  }
+  if ( count < 2 || (gint64)count * 2 < (gint64)(xmax-xmin+1) * (ymax-ymin+1) )
+    return;
+
+  guint found = mbtiles_reader_get_tiles ( mdi->settings.mbtiles, 17 - mp.mc.scale, xmin, xmax, ymin, ymax, mbtiles_prefetch_cb, &mp );
+  if ( vik_verbose )
+    g_debug ( "%s: %d tiles read for %d wanted", __FUNCTION__, found, count );
+}
+#endif
+
+static int map_decode_thread ( MapDecodeInfo *mdi, gpointer threaddata )
+{
+  gint64 last_update = g_get_monotonic_time ();
+  gboolean pending_update = FALSE;
+
+#ifdef HAVE_SQLITE3_H
+  mbtiles_prefetch ( mdi );
+#endif
+
+  for ( guint ii = 0; ii < mdi->tiles->len; ii++ ) {
+    int res = a_background_thread_progress ( threaddata, ((gdouble)(ii+1)) / mdi->tiles->len ); /* this also calls testcancel */
+    if ( res != 0 ) {
+      decode_requests_clear ( mdi, ii );
+      decode_unref_weak_ref_cb ( mdi );
+      return -1;
+    }
+
+    MapCoord *mc = &g_array_index ( mdi->tiles, MapCoord, ii );
+    gboolean got_tile = FALSE;
+
+    // Only hold the lock for the check, so destroying the layer never waits on a read
+    g_mutex_lock ( mdi->mutex );
+    gboolean alive = mdi->map_layer_alive;
+    gboolean wanted = alive && decode_tile_wanted ( mdi, mc );
+    g_mutex_unlock ( mdi->mutex );
+
+    // The layer has gone, so nothing more to do
+    if ( !alive ) {
+      decode_requests_clear ( mdi, ii );
+      return -1;
+    }
+
+    if ( wanted ) {
+      // NB this puts the tile into the mapcache
+      GdkPixbuf *pixbuf = get_pixbuf_with_settings ( &mdi->settings, mdi->id, mdi->vp_scale, mdi->mapname, mc, mdi->filename_buf, mdi->maxlen,
+                                                     mdi->xshrinkfactor, mdi->yshrinkfactor );
+      if ( pixbuf ) {
+        g_object_unref ( pixbuf );
+        got_tile = TRUE;
+      }
+    }
+
+    decode_request_done ( mdi, ii );
+
+    if ( got_tile )
+      pending_update = TRUE;
+
+    // Redraw incrementally as tiles become available, but not excessively so
+    if ( pending_update ) {
+      gint64 now = g_get_monotonic_time ();
+      if ( (now - last_update) > DECODE_REDRAW_INTERVAL || ii == mdi->tiles->len-1 ) {
+        g_mutex_lock ( mdi->mutex );
+        if ( mdi->map_layer_alive )
+          vik_layer_emit_update ( VIK_LAYER(mdi->vml), FALSE ); // NB update display from background
+        g_mutex_unlock ( mdi->mutex );
+        last_update = now;
+        pending_update = FALSE;
+      }
+    }
+  }
+
+  decode_unref_weak_ref_cb ( mdi );
+  return 0;
+}
+
+static void mdei_cancel_cleanup ( MapDecodeInfo *mdi )
+{
+  decode_requests_clear ( mdi, 0 );
+  decode_unref_weak_ref_cb ( mdi );
+}
+
+/**
+ * Add the tile to the list of tiles to be read in the background,
+ *  unless it is already being requested
+ */
+static void decode_queue_add ( VikMapsLayer *vml, MapDecodeInfo **pmdi, guint16 id, guint vp_scale, const gchar *mapname,
+                               MapCoord *mapcoord, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  DecodeRequest dr;
+  decode_request_init ( &dr, id, mapcoord, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
+
+  g_mutex_lock ( dq_mutex );
+  if ( g_hash_table_lookup_extended(decode_requests, &dr, NULL, NULL) ) {
+    g_mutex_unlock ( dq_mutex );
+    return;
+  }
+  DecodeRequest *request = g_memdup ( &dr, sizeof(DecodeRequest) );
+  g_hash_table_insert ( decode_requests, request, NULL );
+  g_mutex_unlock ( dq_mutex );
+
+  if ( !*pmdi ) {
+    MapDecodeInfo *mdi = g_malloc0 ( sizeof(MapDecodeInfo) );
+    mdi->vml = vml;
+    mdi->map_layer_alive = TRUE;
+    mdi->mutex = vik_mutex_new ();
+    tile_settings_copy ( &mdi->settings, vml );
+    mdi->id = id;
+    mdi->vp_scale = vp_scale;
+    mdi->xshrinkfactor = xshrinkfactor;
+    mdi->yshrinkfactor = yshrinkfactor;
+    mdi->mapname = g_strdup ( mapname );
+    mdi->maxlen = strlen ( vml->cache_dir ) + 40;
+    mdi->filename_buf = g_malloc ( mdi->maxlen * sizeof(gchar) );
+    mdi->tiles = g_array_new ( FALSE, FALSE, sizeof(MapCoord) );
+    mdi->requests = g_ptr_array_new ();
+    *pmdi = mdi;
+  }
+  g_array_append_val ( (*pmdi)->tiles, *mapcoord );
+  g_ptr_array_add ( (*pmdi)->requests, request );
+}
+
+/**
+ * Start reading the collected tiles in the background (if any)
+ */
+static void decode_queue_start ( VikMapsLayer *vml, MapDecodeInfo *mdi )
+{
+  if ( !mdi )
+    return;
+
+  gchar *tmp = g_strdup_printf ( ngettext("Reading %d %s map...", "Reading %d %s maps...", mdi->tiles->len),
+                                 mdi->tiles->len, MAPS_LAYER_NTH_LABEL(vml->maptype) );
+
+  g_object_weak_ref ( G_OBJECT(vml), decode_weak_ref_cb, mdi );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(vml), /* parent window */
+                        tmp,                                /* description string */
+                        (vik_thr_func) map_decode_thread,   /* function to call within thread */
+                        mdi,                                /* pass along data */
+                        (vik_thr_free_func) mdei_free,      /* function to free pass along data */
+                        (vik_thr_free_func) mdei_cancel_cleanup,
+                        mdi->tiles->len );
+  g_free ( tmp );
+}
+
+/**
+ * Get the tile from the cache, otherwise either read it now or queue it for reading in the background
+ *
+ * Caller has to decrease reference counter of returned
+ * GdkPixbuf, when buffer is no longer needed.
+ */
+static GdkPixbuf *get_pixbuf_or_queue ( VikMapsLayer *vml, MapDecodeInfo **pmdi, guint16 id, guint vp_scale, const gchar* mapname, MapCoord *mapcoord,
+                                        gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  if ( !ASYNC_DECODE )
+    return get_pixbuf ( vml, id, vp_scale, mapname, mapcoord, filename_buf, buf_len, xshrinkfactor, yshrinkfactor );
+
+  GdkPixbuf *pixbuf = a_mapcache_get ( mapcoord->x, mapcoord->y, mapcoord->z,
+                                       id, mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
+  if ( !pixbuf )
+    decode_queue_add ( vml, pmdi, id, vp_scale, mapname, mapcoord, xshrinkfactor, yshrinkfactor );
+  return pixbuf;
+}
+
+/**
+ * Get the tile only if it is already available in the cache,
+ *  (or read it now when not using background reading)
+ */
+static GdkPixbuf *get_pixbuf_fallback ( VikMapsLayer *vml, guint16 id, guint vp_scale, const gchar* mapname, MapCoord *mapcoord,
+                                        gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  if ( !ASYNC_DECODE )
+    return get_pixbuf ( vml, id, vp_scale, mapname, mapcoord, filename_buf, buf_len, xshrinkfactor, yshrinkfactor );
+
+  return a_mapcache_get_fallback ( mapcoord->x, mapcoord->y, mapcoord->z,
+                                   id, mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
+}
+
 static gboolean should_start_autodownload(VikMapsLayer *vml, VikViewport *vvp)
 {
   const VikCoord *center = vik_viewport_get_center ( vvp );
@@ -1401,7 +2041,7 @@ gboolean try_draw_scale_down (VikMapsLayer *vml, VikViewport *vvp, guint vp_scal
     ulm2.x = ulm.x / scale_factor;
     ulm2.y = ulm.y / scale_factor;
     ulm2.scale = ulm.scale + scale_inc;
-    pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm2, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor );
+    pixbuf = get_pixbuf_fallback ( vml, id, vp_scale, mapname, &ulm2, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor );
     if ( pixbuf ) {
       gint src_x = (ulm.x % scale_factor) * tilesize_x_ceil;
       gint src_y = (ulm.y % scale_factor) * tilesize_y_ceil;
@@ -1446,7 +2086,7 @@ gboolean try_draw_scale_up (VikMapsLayer *vml, VikViewport *vvp, guint vp_scale,
         MapCoord ulm3 = ulm2;
         ulm3.x += pict_x;
         ulm3.y += pict_y;
-        pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm3, path_buf, max_path_len, xshrinkfactor / scale_factor, yshrinkfactor / scale_factor );
+        pixbuf = get_pixbuf_fallback ( vml, id, vp_scale, mapname, &ulm3, path_buf, max_path_len, xshrinkfactor / scale_factor, yshrinkfactor / scale_factor );
         if ( pixbuf ) {
           gint dest_x = xx + pict_x * (tilesize_x_ceil / scale_factor);
           gint dest_y = yy + pict_y * (tilesize_y_ceil / scale_factor);
@@ -1523,6 +2163,23 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
 
     guint vp_scale = vik_viewport_get_scale ( vvp );
 
+    // Tiles not yet in the cache - to be read in the background
+    MapDecodeInfo *mdi = NULL;
+
+    // Remember what is now on screen
+    //  (extending the area covered by any other sections in this draw)
+    g_mutex_lock ( dq_mutex );
+    if ( vml->visible_scale != ulm.scale ) {
+      vml->visible_xmin = vml->visible_ymin = G_MAXINT;
+      vml->visible_xmax = vml->visible_ymax = G_MININT;
+      vml->visible_scale = ulm.scale;
+    }
+    vml->visible_xmin = MIN ( vml->visible_xmin, xmin );
+    vml->visible_xmax = MAX ( vml->visible_xmax, xmax );
+    vml->visible_ymin = MIN ( vml->visible_ymin, ymin );
+    vml->visible_ymax = MAX ( vml->visible_ymax, ymax );
+    g_mutex_unlock ( dq_mutex );
+
     if ( (!existence_only) && vml->autodownload  && should_start_autodownload(vml, vvp)) {
       g_debug("%s: Starting autodownload", __FUNCTION__);
       if ( !vml->adl_only_missing && vik_map_source_supports_download_only_new (map) )
@@ -1543,7 +2200,7 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
         for ( y = ymin; y <= ymax; y++ ) {
           ulm.x = x;
           ulm.y = y;
-          pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm, path_buf, max_path_len, xshrinkfactor, yshrinkfactor );
+          pixbuf = get_pixbuf_or_queue ( vml, &mdi, id, vp_scale, mapname, &ulm, path_buf, max_path_len, xshrinkfactor, yshrinkfactor );
           if ( pixbuf ) {
             width = gdk_pixbuf_get_width ( pixbuf );
             height = gdk_pixbuf_get_height ( pixbuf );
@@ -1586,21 +2243,19 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
           ulm.y = y;
 
           if ( existence_only ) {
+            VikMapsCacheLayout cl = vml->cache_layout;
             if ( vik_map_source_is_direct_file_access (MAPS_LAYER_NTH_TYPE(vml->maptype)) )
-              get_filename ( vml->cache_dir, VIK_MAPS_CACHE_LAYOUT_OSM, id, mapname,
-                             ulm.scale, ulm.z, ulm.x, ulm.y, path_buf, max_path_len, vik_map_source_get_file_extension(map) );
-            else
-              get_filename ( vml->cache_dir, vml->cache_layout, id, mapname,
-                             ulm.scale, ulm.z, ulm.x, ulm.y, path_buf, max_path_len, vik_map_source_get_file_extension(map) );
+              cl = VIK_MAPS_CACHE_LAYOUT_OSM;
 
-            if ( g_file_test ( path_buf, G_FILE_TEST_EXISTS ) == TRUE ) {
+            if ( tile_file_exists ( vml->cache_dir, cl, id, mapname, ulm.scale, ulm.z, ulm.x, ulm.y,
+                                    path_buf, max_path_len, vik_map_source_get_file_extension(map), NULL ) ) {
 	      GdkGC *black_gc = vik_viewport_get_black_gc(vvp);
               vik_viewport_draw_line ( vvp, black_gc, xx+tilesize_x_ceil, yy, xx, yy+tilesize_y_ceil, &black_color, 1 );
             }
           } else {
             // Try correct scale first
             int scale_factor = 1;
-            pixbuf = get_pixbuf ( vml, id, vp_scale, mapname, &ulm, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor );
+            pixbuf = get_pixbuf_or_queue ( vml, &mdi, id, vp_scale, mapname, &ulm, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor );
             if ( pixbuf ) {
               gint src_x = (ulm.x % scale_factor) * tilesize_x_ceil;
               gint src_y = (ulm.y % scale_factor) * tilesize_y_ceil;
@@ -1692,6 +2347,8 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
 
     }
     g_free ( path_buf );
+
+    decode_queue_start ( vml, mdi );
   }
 }
 
@@ -1710,6 +2367,11 @@ static void maps_layer_draw ( VikMapsLayer *vml, VikViewport *vvp )
     const GdkPixbuf *logo = vik_map_source_get_logo ( MAPS_LAYER_NTH_TYPE(vml->maptype) );
     vik_viewport_add_logo ( vvp, logo );
 
+    // Reset the on screen area, as it's built up again by each section
+    g_mutex_lock ( dq_mutex );
+    vml->visible_scale = G_MININT;
+    g_mutex_unlock ( dq_mutex );
+
     /* get corner coords */
     if ( vik_viewport_get_coord_mode ( vvp ) == VIK_COORD_UTM && ! vik_viewport_is_one_zone ( vvp ) ) {
       /* UTM multi-zone stuff by Kit Transue */
@@ -1749,6 +2411,7 @@ typedef struct {
   VikMapsLayer *vml;
   VikViewport *vvp;
   gboolean map_layer_alive;
+  gboolean cancelled;
   GMutex *mutex;
 } MapDownloadInfo;
 
@@ -1814,10 +2477,96 @@ static void unref_weak_ref_cb ( MapDownloadInfo *mdi )
   g_mutex_unlock ( mdi->mutex );
 }
 
+/**
+ * Update the display and the mapcache state after a tile has been downloaded (or not)
+ */
+static void map_download_complete ( MapDownloadInfo *mdi, guint16 id, gint x, gint y, DownloadResult_t dr, gboolean remove_mem_cache )
+{
+  switch ( dr ) {
+    case DOWNLOAD_PARAMETERS_ERROR:
+    case DOWNLOAD_HTTP_ERROR:
+    case DOWNLOAD_CONTENT_ERROR: {
+      // TODO: ?? count up the number of download errors somehow...
+      gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), _("Failed to download tile") );
+      vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
+      g_free (msg);
+      break;
+    }
+    case DOWNLOAD_FILE_WRITE_ERROR: {
+      gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), _("Unable to save tile") );
+      vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
+      g_free (msg);
+      break;
+    }
+    case DOWNLOAD_SUCCESS: {
+      VikMapSource *map = MAPS_LAYER_NTH_TYPE(mdi->maptype);
+      tile_file_changed ( mdi->cache_dir, mdi->cache_layout, id, vik_map_source_get_name(map),
+                          mdi->mapcoord.scale, mdi->mapcoord.z, x, y,
+                          vik_map_source_get_file_extension(map) );
+      break;
+    }
+    default:
+      break;
+  }
+
+  mark_request_complete ( mdi, id, x, y );
+
+  g_mutex_lock(mdi->mutex);
+  if (remove_mem_cache)
+      a_mapcache_remove_all_shrinkfactors ( x, y, mdi->mapcoord.z, id, mdi->mapcoord.scale, mdi->vml->filename );
+
+  // Save download result - must be after remove_all_shrinkfactors() otherwise that would remove this result!
+  a_mapcache_add ( NULL, (mapcache_extra_t){0.0, dr}, x, y, mdi->mapcoord.z, id,
+                   mdi->mapcoord.scale, mdi->vml->alpha, 1.0, 1.0, mdi->vml->filename );
+
+  if (mdi->refresh_display && mdi->map_layer_alive) {
+    /* TODO: check if it's on visible area */
+    if ( dr != DOWNLOAD_NOT_REQUIRED ) {
+      vik_layer_emit_update ( VIK_LAYER(mdi->vml), FALSE ); // NB update display from background
+    }
+  }
+
+  g_mutex_unlock(mdi->mutex);
+}
+
+/* A tile being downloaded concurrently */
+typedef struct {
+  MapDownloadInfo *mdi;
+  guint16 id;
+  gint x;
+  gint y;
+  gboolean remove_mem_cache;
+} MapDownloadTile;
+
+static void map_download_tile_done ( DownloadResult_t dr, gpointer user_data )
+{
+  MapDownloadTile *mdt = (MapDownloadTile*)user_data;
+  // When cancelled the outstanding requests have already been cleared
+  if ( !mdt->mdi->cancelled )
+    map_download_complete ( mdt->mdi, mdt->id, mdt->x, mdt->y, dr, mdt->remove_mem_cache );
+  g_free ( mdt );
+}
+
+/**
+ * Progress the concurrent downloads until there are no more than the specified number outstanding
+ *
+ * Returns 0 or -1 if the job was cancelled
+ */
+static int map_download_multi_wait ( void *multi, gpointer threaddata, guint outstanding )
+{
+  while ( a_download_multi_perform ( multi, 100 ) > outstanding ) {
+    if ( a_background_testcancel ( threaddata ) != 0 )
+      return -1;
+  }
+  return 0;
+}
+
 static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
 {
   VikMapSource *map = MAPS_LAYER_NTH_TYPE(mdi->maptype);
   void *handle = vik_map_source_download_handle_init ( map );
+  // Tiles are downloaded concurrently when the map source supports it
+  void *multi = vik_map_source_download_multi_init ( map );
   guint donemaps = 0;
   MapCoord mcoord = mdi->mapcoord;
   gint x, y;
@@ -1864,7 +2613,12 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
         gboolean need_download = FALSE;
         donemaps++;
         int res = a_background_thread_progress ( threaddata, ((gdouble)donemaps) / mdi->mapstoget ); /* this also calls testcancel */
+        if ( res == 0 && multi )
+          res = map_download_multi_wait ( multi, threaddata, DOWNLOAD_MULTI_QUEUE );
         if (res != 0) {
+          mdi->cancelled = TRUE;
+          if ( multi )
+            a_download_multi_cleanup ( multi );
           requests_clear ( mdi->maptype );
           vik_map_source_download_handle_cleanup ( map, handle );
           return -1;
@@ -1874,12 +2628,9 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
           continue;
         }
 
-        get_filename ( mdi->cache_dir, mdi->cache_layout, id,
-                       vik_map_source_get_name(map),
-                       mdi->mapcoord.scale, mdi->mapcoord.z, x, y, mdi->filename_buf, mdi->maxlen,
-                       vik_map_source_get_file_extension(map) );
-
-        if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
+        if ( !tile_file_exists ( mdi->cache_dir, mdi->cache_layout, id, vik_map_source_get_name(map),
+                                 mdi->mapcoord.scale, mdi->mapcoord.z, x, y, mdi->filename_buf, mdi->maxlen,
+                                 vik_map_source_get_file_extension(map), NULL ) ) {
           need_download = TRUE;
           remove_mem_cache = TRUE;
 
@@ -1897,6 +2648,9 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
               if (gx || (!pixbuf)) {
                 if ( g_remove ( mdi->filename_buf ) )
                   g_warning ( "REDOWNLOAD failed to remove: %s", mdi->filename_buf );
+                tile_file_changed ( mdi->cache_dir, mdi->cache_layout, id, vik_map_source_get_name(map),
+                                    mdi->mapcoord.scale, mdi->mapcoord.z, x, y,
+                                    vik_map_source_get_file_extension(map) );
                 need_download = TRUE;
                 remove_mem_cache = TRUE;
                 g_error_free ( gx );
@@ -1926,58 +2680,37 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
           }
         }
 
+        if ( need_download && multi ) {
+          MapDownloadTile *mdt = g_malloc ( sizeof(MapDownloadTile) );
+          mdt->mdi = mdi;
+          mdt->id = id;
+          mdt->x = x;
+          mdt->y = y;
+          mdt->remove_mem_cache = remove_mem_cache;
+          vik_map_source_download_multi ( map, &mcoord, mdi->filename_buf, multi, map_download_tile_done, mdt );
+          continue;
+        }
+
         mdi->mapcoord.x = x; mdi->mapcoord.y = y;
 
         DownloadResult_t dr = DOWNLOAD_NOT_REQUIRED;
-        if (need_download) {
+        if (need_download)
           dr = vik_map_source_download ( map, &(mdi->mapcoord), mdi->filename_buf, handle );
-          switch ( dr ) {
-            case DOWNLOAD_PARAMETERS_ERROR:
-            case DOWNLOAD_HTTP_ERROR:
-            case DOWNLOAD_CONTENT_ERROR: {
-              // TODO: ?? count up the number of download errors somehow...
-              gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), _("Failed to download tile") );
-              vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
-              g_free (msg);
-              break;
-            }
-            case DOWNLOAD_FILE_WRITE_ERROR: {
-              gchar* msg = g_strdup_printf ( "%s: %s", vik_maps_layer_get_map_label (mdi->vml), _("Unable to save tile") );
-              vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(mdi->vml), msg, VIK_STATUSBAR_INFO );
-              g_free (msg);
-              break;
-            }
-            case DOWNLOAD_SUCCESS: break;
-            case DOWNLOAD_NOT_REQUIRED:
-	      need_download = FALSE;
-	      break;
-            default:
-              break;
-          }
-        }
-
-        mark_request_complete ( mdi, id, x, y );
-
-        g_mutex_lock(mdi->mutex);
-        if (remove_mem_cache)
-            a_mapcache_remove_all_shrinkfactors ( x, y, mdi->mapcoord.z, id, mdi->mapcoord.scale, mdi->vml->filename );
 
-        // Save download result - must be after remove_all_shrinkfactors() otherwise that would remove this result!
-        a_mapcache_add ( NULL, (mapcache_extra_t){0.0, dr}, mdi->mapcoord.x, mdi->mapcoord.y, mdi->mapcoord.z, id,
-                         mdi->mapcoord.scale, mdi->vml->alpha, 1.0, 1.0, mdi->vml->filename );
-
-        if (mdi->refresh_display && mdi->map_layer_alive) {
-          /* TODO: check if it's on visible area */
-          if ( need_download ) {
-            vik_layer_emit_update ( VIK_LAYER(mdi->vml), FALSE ); // NB update display from background
-          }
-        }
+        map_download_complete ( mdi, id, x, y, dr, remove_mem_cache );
 
-        g_mutex_unlock(mdi->mutex);
         mdi->mapcoord.x = mdi->mapcoord.y = 0; /* we're temporarily between downloads */
       }
     }
   }
+
+  if ( multi ) {
+    if ( map_download_multi_wait ( multi, threaddata, 0 ) != 0 ) {
+      mdi->cancelled = TRUE;
+      requests_clear ( mdi->maptype );
+    }
+    a_download_multi_cleanup ( multi );
+  }
   vik_map_source_download_handle_cleanup ( map, handle );
 
   unref_weak_ref_cb ( mdi );
@@ -1998,6 +2731,11 @@ static void mdi_cancel_cleanup ( MapDownloadInfo *mdi )
     {
       if ( g_remove ( mdi->filename_buf ) )
         g_warning ( "Cleanup failed to remove: %s", mdi->filename_buf );
+      tile_file_changed ( mdi->cache_dir, mdi->cache_layout,
+                          vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(mdi->maptype)),
+                          vik_map_source_get_name(MAPS_LAYER_NTH_TYPE(mdi->maptype)),
+                          mdi->mapcoord.scale, mdi->mapcoord.z, mdi->mapcoord.x, mdi->mapcoord.y,
+                          vik_map_source_get_file_extension(MAPS_LAYER_NTH_TYPE(mdi->maptype)) );
     }
   }
 
@@ -2026,6 +2764,7 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
     mdi->vml = vml;
     mdi->vvp = vvp;
     mdi->map_layer_alive = TRUE;
+    mdi->cancelled = FALSE;
     mdi->mutex = vik_mutex_new();
     mdi->refresh_display = TRUE;
 
@@ -2067,11 +2806,9 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
               mdi->mapstoget++;
             else {
               // Otherwise only if file is missing
-              get_filename ( mdi->cache_dir, mdi->cache_layout, id,
-                             vik_map_source_get_name(map),
-                             ulm.scale, ulm.z, a, b, mdi->filename_buf, mdi->maxlen,
-                             vik_map_source_get_file_extension(map) );
-              if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
+              if ( !tile_file_exists ( mdi->cache_dir, mdi->cache_layout, id, vik_map_source_get_name(map),
+                                       ulm.scale, ulm.z, a, b, mdi->filename_buf, mdi->maxlen,
+                                       vik_map_source_get_file_extension(map), NULL ) ) {
                 mdi->mapstoget++;
               }
             }
@@ -2139,6 +2876,7 @@ static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, V
   mdi->vml = vml;
   mdi->vvp = vvp;
   mdi->map_layer_alive = TRUE;
+  mdi->cancelled = FALSE;
   mdi->mutex = vik_mutex_new();
   mdi->refresh_display = TRUE;
 
@@ -2166,12 +2904,11 @@ static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, V
       mcoord.y = j;
       // Only count tiles from supported areas
       if ( is_in_area (map, mcoord) ) {
-        get_filename ( mdi->cache_dir, mdi->cache_layout,
-                       vik_map_source_get_uniq_id(map),
-                       vik_map_source_get_name(map),
-                       ulm.scale, ulm.z, i, j, mdi->filename_buf, mdi->maxlen,
-                       vik_map_source_get_file_extension(map) );
-        if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE )
+        if ( !tile_file_exists ( mdi->cache_dir, mdi->cache_layout,
+                                 vik_map_source_get_uniq_id(map),
+                                 vik_map_source_get_name(map),
+                                 ulm.scale, ulm.z, i, j, mdi->filename_buf, mdi->maxlen,
+                                 vik_map_source_get_file_extension(map), NULL ) )
               mdi->mapstoget++;
       }
     }
@@ -2259,10 +2996,10 @@ static void maps_layer_tile_info ( VikMapsLayer *vml )
       gchar *exists = NULL;
       gint zoom = 17 - ulm.scale;
       if ( vml->mbtiles ) {
-        GdkPixbuf *pixbuf = get_pixbuf_sql_exec ( vml->mbtiles, ulm.x, ulm.y, zoom );
-        if ( pixbuf ) {
+        GBytes *tile_data = mbtiles_reader_get_tile ( vml->mbtiles, ulm.x, ulm.y, zoom );
+        if ( tile_data ) {
           exists = g_strdup ( _("YES") );
-          g_object_unref ( G_OBJECT(pixbuf) );
+          g_bytes_unref ( tile_data );
         }
         else {
           exists = g_strdup ( _("NO") );
@@ -2493,7 +3230,33 @@ static void maps_layer_about_debug ( menu_array_values values )
   VikViewport *vvp = VIK_VIEWPORT(values[MA_VVP]);
   gdouble xzoom = vml->xmapzoom ? vml->xmapzoom : vik_viewport_get_xmpp ( vvp );
 
-  gchar *msg = g_strdup_printf ( "%s id=%d OSMzoom=%d", label, id, map_utils_mpp_to_zoom_level(xzoom) );
+  mapcache_stats_t stats;
+  a_mapcache_get_stats ( id, &stats );
+  guint64 lookups = stats.hits + stats.misses;
+  guint64 encoded_lookups = stats.encoded_hits + stats.encoded_misses;
+  gchar *size_str = g_format_size ( stats.bytes );
+  gchar *encoded_size_str = g_format_size ( stats.encoded_bytes );
+
+  gchar *msg = g_strdup_printf ( "%s id=%d OSMzoom=%d\n\n"
+                                 "Cache: %u items using %s\n"
+                                 "Hits: %" G_GUINT64_FORMAT " Misses: %" G_GUINT64_FORMAT " (%.1f%% hit rate)\n"
+                                 "Other zoom level lookups: %" G_GUINT64_FORMAT " Found: %" G_GUINT64_FORMAT "\n"
+                                 "Evictions: %" G_GUINT64_FORMAT "\n"
+                                 "Average decode time: %.1fms\n\n"
+                                 "Compressed cache: %u items using %s\n"
+                                 "Hits: %" G_GUINT64_FORMAT " Misses: %" G_GUINT64_FORMAT " (%.1f%% hit rate)\n"
+                                 "Evictions: %" G_GUINT64_FORMAT,
+                                 label, id, map_utils_mpp_to_zoom_level(xzoom),
+                                 stats.count, size_str,
+                                 stats.hits, stats.misses, lookups ? 100.0 * stats.hits / lookups : 0.0,
+                                 stats.fallback_hits + stats.fallback_misses, stats.fallback_hits,
+                                 stats.evictions,
+                                 stats.decodes ? 1000.0 * stats.decode_time / stats.decodes : 0.0,
+                                 stats.encoded_count, encoded_size_str,
+                                 stats.encoded_hits, stats.encoded_misses, encoded_lookups ? 100.0 * stats.encoded_hits / encoded_lookups : 0.0,
+                                 stats.encoded_evictions );
+  g_free ( size_str );
+  g_free ( encoded_size_str );
   a_dialog_info_msg ( VIK_GTK_WINDOW_FROM_LAYER(vml), msg );
   g_free ( msg );
 }
@@ -2534,6 +3297,7 @@ static gint maps_layer_how_many_maps ( VikMapsLayer *vml, VikViewport *vvp, VikC
   mdi->vml = vml;
   mdi->vvp = vvp;
   mdi->map_layer_alive = TRUE;
+  mdi->cancelled = FALSE;
   mdi->mutex = vik_mutex_new();
   mdi->refresh_display = FALSE;
 
@@ -2565,18 +3329,17 @@ static gint maps_layer_how_many_maps ( VikMapsLayer *vml, VikViewport *vvp, VikC
         mcoord.y = j;
         // Only count tiles from supported areas
         if ( is_in_area ( map, mcoord ) ) {
-          get_filename ( mdi->cache_dir, mdi->cache_layout,
-                         vik_map_source_get_uniq_id(map),
-                         vik_map_source_get_name(map),
-                         ulm.scale, ulm.z, i, j, mdi->filename_buf, mdi->maxlen,
-                         vik_map_source_get_file_extension(map) );
           if ( mdi->redownload == REDOWNLOAD_NEW ) {
             // Assume the worst - always a new file
             // Absolute value would require a server lookup - but that is too slow
             mdi->mapstoget++;
           }
           else {
-            if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
+            if ( !tile_file_exists ( mdi->cache_dir, mdi->cache_layout,
+                                     vik_map_source_get_uniq_id(map),
+                                     vik_map_source_get_name(map),
+                                     ulm.scale, ulm.z, i, j, mdi->filename_buf, mdi->maxlen,
+                                     vik_map_source_get_file_extension(map), NULL ) ) {
               // Missing
               mdi->mapstoget++;
             }
@@ -2795,6 +3558,8 @@ static void maps_layer_flush ( menu_array_values values )
 {
   VikMapsLayer *vml = VIK_MAPS_LAYER(values[MA_VML]);
   a_mapcache_flush_type ( vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(vml->maptype)) );
+  // Also rescan the disk cache, in case it has been changed by something else
+  a_tileindex_flush ();
 }
 
 static void maps_layer_add_menu_items ( VikMapsLayer *vml, GtkMenu *menu, VikLayersPanel *vlp )
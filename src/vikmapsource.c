@@ -87,6 +87,8 @@ vik_map_source_class_init (VikMapSourceClass *klass)
 	klass->download = NULL;
 	klass->download_handle_init = NULL;
 	klass->download_handle_cleanup = NULL;
+	klass->download_multi_init = NULL;
+	klass->download_multi = NULL;
 
 	object_class->finalize = vik_map_source_finalize;
 }
@@ -528,3 +530,47 @@ vik_map_source_download_handle_cleanup (VikMapSource * self, void * handle)
 
 	(*klass->download_handle_cleanup)(self, handle);
 }
+
+/**
+ * vik_map_source_download_multi_init:
+ * @self:    The VikMapSource of interest.
+ *
+ * Returns: A handle for concurrent downloads (to be freed with a_download_multi_cleanup())
+ *          or NULL if the map source does not support concurrent downloads
+ */
+void *
+vik_map_source_download_multi_init (VikMapSource *self)
+{
+	VikMapSourceClass *klass;
+	g_return_val_if_fail (self != NULL, NULL);
+	g_return_val_if_fail (VIK_IS_MAP_SOURCE (self), NULL);
+	klass = VIK_MAP_SOURCE_GET_CLASS(self);
+
+	if (klass->download_multi_init == NULL || klass->download_multi == NULL)
+		return NULL;
+
+	return (*klass->download_multi_init)(self);
+}
+
+/**
+ * vik_map_source_download_multi:
+ * @self:    The VikMapSource of interest.
+ * @src:     The map location to download
+ * @dest_fn: The filename to save the result in
+ * @multi:   The handle from vik_map_source_download_multi_init()
+ * @done:    Function called with the result once the download has finished
+ *
+ * Queue a download, which is progressed by a_download_multi_perform()
+ */
+void
+vik_map_source_download_multi (VikMapSource * self, MapCoord * src, const gchar * dest_fn, void *multi, DownloadDoneFunc done, gpointer user_data)
+{
+	VikMapSourceClass *klass;
+	g_return_if_fail (self != NULL);
+	g_return_if_fail (VIK_IS_MAP_SOURCE (self));
+	klass = VIK_MAP_SOURCE_GET_CLASS(self);
+
+	g_return_if_fail (klass->download_multi != NULL);
+
+	(*klass->download_multi)(self, src, dest_fn, multi, done, user_data);
+}
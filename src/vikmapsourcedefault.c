@@ -50,6 +50,8 @@ static gdouble map_source_get_offset_y (VikMapSource *self);
 static DownloadResult_t _download ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, void *handle );
 static void * _download_handle_init ( VikMapSource *self );
 static void _download_handle_cleanup ( VikMapSource *self, void *handle );
+static void * _download_multi_init ( VikMapSource *self );
+static void _download_multi ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, void *multi, DownloadDoneFunc done, gpointer user_data );
 
 typedef struct _VikMapSourceDefaultPrivate VikMapSourceDefaultPrivate;
 struct _VikMapSourceDefaultPrivate
@@ -70,6 +72,9 @@ struct _VikMapSourceDefaultPrivate
 	gchar *file_extension;
 	gdouble offset_x;
 	gdouble offset_y;
+	/* Politeness limits for concurrent downloads */
+	guint download_max_transfers;
+	guint download_interval;
 };
 
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (VikMapSourceDefault, vik_map_source_default, VIK_TYPE_MAP_SOURCE);
@@ -93,6 +98,8 @@ enum
   PROP_FILE_EXTENSION,
   PROP_OFFSET_X,
   PROP_OFFSET_Y,
+  PROP_DOWNLOAD_MAX_TRANSFERS,
+  PROP_DOWNLOAD_INTERVAL,
 };
 
 static void
@@ -204,6 +211,14 @@ vik_map_source_default_set_property (GObject      *object,
       priv->offset_y = g_value_get_double (value);
       break;
 
+    case PROP_DOWNLOAD_MAX_TRANSFERS:
+      priv->download_max_transfers = g_value_get_uint (value);
+      break;
+
+    case PROP_DOWNLOAD_INTERVAL:
+      priv->download_interval = g_value_get_uint (value);
+      break;
+
     default:
       /* We don't have any other property... */
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -273,6 +288,14 @@ vik_map_source_default_get_property (GObject    *object,
       g_value_set_double (value, priv->offset_y);
       break;
 
+    case PROP_DOWNLOAD_MAX_TRANSFERS:
+      g_value_set_uint (value, priv->download_max_transfers);
+      break;
+
+    case PROP_DOWNLOAD_INTERVAL:
+      g_value_set_uint (value, priv->download_interval);
+      break;
+
     default:
       /* We don't have any other property... */
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -308,6 +331,8 @@ vik_map_source_default_class_init (VikMapSourceDefaultClass *klass)
 	parent_class->download =                 _download;
 	parent_class->download_handle_init =     _download_handle_init;
 	parent_class->download_handle_cleanup =  _download_handle_cleanup;
+	parent_class->download_multi_init =      _download_multi_init;
+	parent_class->download_multi =           _download_multi;
 
 	/* Default implementation of methods */
 	klass->get_uri = NULL;
@@ -419,6 +444,24 @@ vik_map_source_default_class_init (VikMapSourceDefaultClass *klass)
 	                             G_PARAM_READWRITE);
 	g_object_class_install_property (object_class, PROP_OFFSET_Y, pspec);
 
+	pspec = g_param_spec_uint ("download-max-transfers",
+	                           "Download max transfers",
+	                           "The maximum number of simultaneous downloads from the server (0 for the default)",
+	                           0  /* minimum value */,
+	                           G_MAXUINT16 /* maximum value */,
+	                           0  /* default value */,
+	                           G_PARAM_READWRITE);
+	g_object_class_install_property (object_class, PROP_DOWNLOAD_MAX_TRANSFERS, pspec);
+
+	pspec = g_param_spec_uint ("download-interval",
+	                           "Download interval",
+	                           "The minimum time between starting each download from the server in milliseconds",
+	                           0  /* minimum value */,
+	                           G_MAXUINT16 /* maximum value */,
+	                           0  /* default value */,
+	                           G_PARAM_READWRITE);
+	g_object_class_install_property (object_class, PROP_DOWNLOAD_INTERVAL, pspec);
+
 	object_class->finalize = vik_map_source_default_finalize;
 }
 
@@ -588,6 +631,25 @@ _download_handle_cleanup ( VikMapSource *self, void *handle )
    a_download_handle_cleanup ( handle );
 }
 
+static void *
+_download_multi_init ( VikMapSource *self )
+{
+   VikMapSourceDefaultPrivate *priv = VIK_MAP_SOURCE_DEFAULT_PRIVATE(self);
+   return a_download_multi_init ( priv->download_max_transfers, priv->download_interval );
+}
+
+static void
+_download_multi ( VikMapSource *self, MapCoord *src, const gchar *dest_fn, void *multi, DownloadDoneFunc done, gpointer user_data )
+{
+   gchar *uri = vik_map_source_default_get_uri(VIK_MAP_SOURCE_DEFAULT(self), src);
+   gchar *host = vik_map_source_default_get_hostname(VIK_MAP_SOURCE_DEFAULT(self));
+   DownloadFileOptions *options = vik_map_source_default_get_download_options(VIK_MAP_SOURCE_DEFAULT(self), src);
+   // Takes ownership of the options
+   a_http_download_get_url_multi ( host, uri, dest_fn, options, multi, done, user_data );
+   g_free ( uri );
+   g_free ( host );
+}
+
 gchar *
 vik_map_source_default_get_uri( VikMapSourceDefault *self, MapCoord *src )
 {
@@ -35,6 +35,306 @@
 #include "dems.h"
 #include "settings.h"
 
+typedef enum {
+  TRACK_STAT_LENGTH = 1 << 0,
+  TRACK_STAT_LENGTH_GAPS = 1 << 1,
+  TRACK_STAT_DURATION = 1 << 2,
+  TRACK_STAT_DURATION_GAPS = 1 << 3,
+  TRACK_STAT_AVG_SPEED = 1 << 4,
+  TRACK_STAT_AVG_SPEED_MOVING = 1 << 5,
+  TRACK_STAT_MAX_SPEED = 1 << 6,
+  TRACK_STAT_MINMAX_ALT = 1 << 7,
+  TRACK_STAT_ELEV_GAIN = 1 << 8,
+  TRACK_STAT_MAX_HEART_RATE = 1 << 9,
+  TRACK_STAT_AVG_HEART_RATE = 1 << 10,
+  TRACK_STAT_MAX_CADENCE = 1 << 11,
+  TRACK_STAT_AVG_CADENCE = 1 << 12,
+  TRACK_STAT_MAX_POWER = 1 << 13,
+  TRACK_STAT_AVG_POWER = 1 << 14,
+} TrackStatFlags;
+
+// Running totals at each trackpoint (as in the columns), for finding positions along the track by binary search
+typedef struct {
+  gdouble *dist;         // Distance from the start, including gaps between segments
+  gdouble *dist_in_segs; // Distance from the start, excluding gaps between segments
+  gboolean times_sorted; // All timestamps available and never decreasing
+} TrackIndex;
+
+struct _VikTrackStats {
+  guint version; // Of the track when the values were calculated
+  guint valid;   // TrackStatFlags of the values calculated
+  gdouble length;
+  gdouble length_gaps;
+  gdouble duration;
+  gdouble duration_gaps;
+  gdouble avg_speed;
+  int stop_length_seconds; // Of the moving average
+  gdouble avg_speed_moving;
+  gdouble max_speed;
+  gboolean has_alt;
+  gdouble min_alt;
+  gdouble max_alt;
+  gdouble elev_up;
+  gdouble elev_down;
+  guint max_heart_rate;
+  gdouble avg_heart_rate;
+  gint max_cadence;
+  gdouble avg_cadence;
+  gint max_power;
+  gdouble avg_power;
+  TrackIndex *index;
+  VikTrackColumns *columns;
+  guint n_runs;
+  LatLonBBox *runs;       // Bounds of each run of points, see vik_track_get_runs()
+  VikTrackLevels *levels; // Simplified versions, see vik_track_levels_new()
+};
+
+static void track_columns_free ( VikTrackColumns *tc )
+{
+  g_free ( tc->newsegments );
+  g_free ( tc->speeds );
+  g_free ( tc->altitudes );
+  g_free ( tc->timestamps );
+  g_free ( tc->coords );
+  g_free ( tc->tps );
+  g_free ( tc );
+}
+
+static void track_index_free ( TrackIndex *ti )
+{
+  g_free ( ti->dist_in_segs );
+  g_free ( ti->dist );
+  g_free ( ti );
+}
+
+/**
+ * Forget the values derived from the trackpoints of an earlier version
+ */
+static void track_stats_clear ( VikTrackStats *st )
+{
+  st->valid = 0;
+  if ( st->index ) {
+    track_index_free ( st->index );
+    st->index = NULL;
+  }
+  if ( st->columns ) {
+    track_columns_free ( st->columns );
+    st->columns = NULL;
+  }
+  g_free ( st->runs );
+  st->runs = NULL;
+  st->n_runs = 0;
+  if ( st->levels ) {
+    vik_track_levels_unref ( st->levels );
+    st->levels = NULL;
+  }
+}
+
+static void track_stats_free ( VikTrackStats *st )
+{
+  if ( !st )
+    return;
+  track_stats_clear ( st );
+  g_free ( st );
+}
+
+/**
+ * The statistics block of the track, with any values from an earlier version forgotten
+ */
+static VikTrackStats *track_get_stats ( const VikTrack *tr )
+{
+  // Only the cache is modified, not the track itself
+  VikTrack *trk = (VikTrack*)tr;
+  if ( !trk->stats )
+    trk->stats = g_malloc0 ( sizeof(VikTrackStats) );
+  if ( trk->stats->version != trk->version ) {
+    trk->stats->version = trk->version;
+    track_stats_clear ( trk->stats );
+  }
+  return trk->stats;
+}
+
+/**
+ * vik_track_get_columns:
+ *
+ * The trackpoints copied into contiguous arrays, in a single pass along the list
+ *  when first needed for this version of the track.
+ * These are shared by the statistics, the running totals and the simplified levels,
+ *  so the list is only walked once.
+ *
+ * Returns: The columns, which remain valid until the track changes
+ */
+const VikTrackColumns *vik_track_get_columns ( const VikTrack *tr )
+{
+  VikTrackStats *st = track_get_stats ( tr );
+  if ( st->columns )
+    return st->columns;
+
+  VikTrackColumns *tc = g_malloc ( sizeof(VikTrackColumns) );
+  tc->count = g_list_length ( tr->trackpoints );
+  tc->tps = g_malloc ( sizeof(VikTrackpoint*) * MAX(1, tc->count) );
+  tc->coords = g_malloc ( sizeof(VikCoord) * tc->count );
+  tc->timestamps = g_malloc ( sizeof(gdouble) * tc->count );
+  tc->altitudes = g_malloc ( sizeof(gdouble) * tc->count );
+  tc->speeds = g_malloc ( sizeof(gdouble) * tc->count );
+  tc->newsegments = g_malloc0 ( (tc->count + 7) / 8 );
+
+  guint ii = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next, ii++ ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    tc->tps[ii] = tp;
+    tc->coords[ii] = tp->coord;
+    tc->timestamps[ii] = tp->timestamp;
+    tc->altitudes[ii] = tp->altitude;
+    tc->speeds[ii] = tp->speed;
+    if ( tp->newsegment )
+      tc->newsegments[ii>>3] |= 1 << (ii&7);
+  }
+  st->columns = tc;
+  return tc;
+}
+
+/**
+ * vik_track_get_runs:
+ * @count: Set to the number of runs
+ *
+ * The bounds of each run of #VIK_TRACK_RUN_POINTS consecutive points (the last run may be shorter),
+ *  made from the columns when first needed for this version of the track.
+ * Thus searches for points near a position need only look at the points of the runs nearby.
+ *
+ * Returns: The bounds, which remain valid until the track changes
+ */
+const LatLonBBox *vik_track_get_runs ( const VikTrack *tr, guint *count )
+{
+  VikTrackStats *st = track_get_stats ( tr );
+  if ( !st->runs ) {
+    const VikTrackColumns *tc = vik_track_get_columns ( tr );
+    st->n_runs = (tc->count + VIK_TRACK_RUN_POINTS - 1) / VIK_TRACK_RUN_POINTS;
+    st->runs = g_malloc ( sizeof(LatLonBBox) * MAX(1, st->n_runs) );
+    VIK_TRACK_COLUMNS_FOREACH(tc, ii) {
+      struct LatLon ll;
+      vik_coord_to_latlon ( &tc->coords[ii], &ll );
+      LatLonBBox *bbox = &st->runs[ii / VIK_TRACK_RUN_POINTS];
+      if ( ii % VIK_TRACK_RUN_POINTS == 0 ) {
+        bbox->north = bbox->south = ll.lat;
+        bbox->east = bbox->west = ll.lon;
+      }
+      else {
+        bbox->north = MAX ( bbox->north, ll.lat );
+        bbox->south = MIN ( bbox->south, ll.lat );
+        bbox->east = MAX ( bbox->east, ll.lon );
+        bbox->west = MIN ( bbox->west, ll.lon );
+      }
+    }
+  }
+  *count = st->n_runs;
+  return st->runs;
+}
+
+// Return the statistic, only calculating it when not known for this version of the track
+#define TRACK_STAT(tr,flag,field,calc) \
+  VikTrackStats *st = track_get_stats ( tr ); \
+  if ( !(st->valid & (flag)) ) { \
+    st->field = (calc); \
+    st->valid |= (flag); \
+  } \
+  return st->field;
+
+/**
+ * The running totals of the track, made from its columns when first needed for this version of the track
+ */
+static TrackIndex *track_get_index ( const VikTrack *tr )
+{
+  VikTrackStats *st = track_get_stats ( tr );
+  if ( st->index )
+    return st->index;
+
+  const VikTrackColumns *tc = vik_track_get_columns ( tr );
+  TrackIndex *ti = g_malloc ( sizeof(TrackIndex) );
+  ti->dist = g_malloc ( sizeof(gdouble) * MAX(1, tc->count) );
+  ti->dist_in_segs = g_malloc ( sizeof(gdouble) * MAX(1, tc->count) );
+  ti->times_sorted = TRUE;
+  ti->dist[0] = ti->dist_in_segs[0] = 0.0;
+
+  VIK_TRACK_COLUMNS_FOREACH(tc, ii) {
+    if ( isnan(tc->timestamps[ii]) || (ii > 0 && tc->timestamps[ii] < tc->timestamps[ii-1]) )
+      ti->times_sorted = FALSE;
+    if ( ii > 0 ) {
+      gdouble diff = vik_coord_diff ( &tc->coords[ii], &tc->coords[ii-1] );
+      ti->dist[ii] = ti->dist[ii-1] + diff;
+      ti->dist_in_segs[ii] = ti->dist_in_segs[ii-1] + (VIK_TRACK_COLUMNS_NEWSEGMENT(tc, ii) ? 0.0 : diff);
+    }
+  }
+  st->index = ti;
+  return ti;
+}
+
+/**
+ * Returns: The first index from (first) where the values are at least (value),
+ *  or (count) if none are
+ */
+static guint index_lower_bound ( const gdouble *values, guint first, guint count, gdouble value )
+{
+  guint lo = first, hi = count;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    if ( values[mid] < value )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * Returns: The index of the first occurrence of the trackpoint in the track,
+ *  or the number of points if it is not in the track
+ */
+static guint track_find_trackpoint ( const VikTrackColumns *tc, const TrackIndex *ti, const VikTrackpoint *tp )
+{
+  guint ii = 0;
+  // Can go straight to the points at the same time
+  if ( ti->times_sorted && !isnan(tp->timestamp) ) {
+    for ( ii = index_lower_bound ( tc->timestamps, 0, tc->count, tp->timestamp );
+          ii < tc->count && tc->timestamps[ii] == tp->timestamp; ii++ )
+      if ( tc->tps[ii] == tp )
+        return ii;
+    // Otherwise not in the track, or its time has been changed without the track knowing
+    ii = 0;
+  }
+  for ( ; ii < tc->count; ii++ )
+    if ( tc->tps[ii] == tp )
+      break;
+  return ii;
+}
+
+// Of all tracks, see vik_track_get_changes()
+static gint track_changes = 0;
+
+/**
+ * vik_track_changed:
+ *
+ * Must be called after modifying the trackpoints directly (rather than via the vik_track_*() functions),
+ *  so that values derived from them are recalculated.
+ * NB vik_track_calculate_bounds() also does this.
+ */
+void vik_track_changed ( VikTrack *tr )
+{
+  tr->version++;
+  g_atomic_int_inc ( &track_changes );
+}
+
+/**
+ * vik_track_get_changes:
+ *
+ * Returns: A count of the changes to any track, so users of many tracks
+ *  can tell when none of them have changed without checking each one
+ */
+guint vik_track_get_changes ( void )
+{
+  return (guint)g_atomic_int_get ( &track_changes );
+}
+
 VikTrack *vik_track_new()
 {
   VikTrack *tr = g_malloc0 ( sizeof ( VikTrack ) );
@@ -196,6 +496,7 @@ void vik_track_free(VikTrack *tr)
     g_free ( tr->extensions );
   g_list_foreach ( tr->trackpoints, (GFunc) vik_trackpoint_free, NULL );
   g_list_free( tr->trackpoints );
+  track_stats_free ( tr->stats );
   if (tr->property_dialog)
     if ( GTK_IS_WIDGET(tr->property_dialog) )
       gtk_widget_destroy ( GTK_WIDGET(tr->property_dialog) );
@@ -344,6 +645,7 @@ static void track_recalculate_bounds_last_tp ( VikTrack *trk )
  */
 void vik_track_add_trackpoint ( VikTrack *tr, VikTrackpoint *tp, gboolean recalculate )
 {
+  vik_track_changed ( tr );
   // When it's the first trackpoint need to ensure the bounding box is initialized correctly
   gboolean adding_first_point = tr->trackpoints ? FALSE : TRUE;
   tr->trackpoints = g_list_append ( tr->trackpoints, tp );
@@ -359,62 +661,35 @@ void vik_track_add_trackpoint ( VikTrack *tr, VikTrackpoint *tp, gboolean recalc
  */
 gdouble vik_track_get_length_to_trackpoint (const VikTrack *tr, const VikTrackpoint *tp)
 {
-  gdouble len = 0.0;
-  if ( tr->trackpoints )
-  {
-    // Is it the very first track point?
-    if ( VIK_TRACKPOINT(tr->trackpoints->data) == tp )
-      return len;
-
-    GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      VikTrackpoint *tp1 = VIK_TRACKPOINT(iter->data);
-      if ( ! tp1->newsegment )
-        len += vik_coord_diff ( &(tp1->coord),
-                                &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-
-      // Exit when we reach the desired point
-      if ( tp1 == tp )
-        break;
+  if ( !tr->trackpoints )
+    return 0.0;
+  const VikTrackColumns *tc = vik_track_get_columns ( tr );
+  TrackIndex *ti = track_get_index ( tr );
+  guint ii = track_find_trackpoint ( tc, ti, tp );
+  // When not in the track, it is the whole length
+  return ii < tc->count ? ti->dist_in_segs[ii] : ti->dist_in_segs[tc->count-1];
+}
 
-      iter = iter->next;
-    }
-  }
-  return len;
+static gdouble track_calc_length ( const VikTrack *tr )
+{
+  const VikTrackColumns *tc = vik_track_get_columns ( tr );
+  return tc->count ? track_get_index(tr)->dist_in_segs[tc->count-1] : 0.0;
 }
 
 gdouble vik_track_get_length(const VikTrack *tr)
 {
-  gdouble len = 0.0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      if ( ! VIK_TRACKPOINT(iter->data)->newsegment )
-        len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      iter = iter->next;
-    }
-  }
-  return len;
+  TRACK_STAT ( tr, TRACK_STAT_LENGTH, length, track_calc_length(tr) );
+}
+
+static gdouble track_calc_length_including_gaps ( const VikTrack *tr )
+{
+  const VikTrackColumns *tc = vik_track_get_columns ( tr );
+  return tc->count ? track_get_index(tr)->dist[tc->count-1] : 0.0;
 }
 
 gdouble vik_track_get_length_including_gaps(const VikTrack *tr)
 {
-  gdouble len = 0.0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
-    {
-      len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                              &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      iter = iter->next;
-    }
-  }
-  return len;
+  TRACK_STAT ( tr, TRACK_STAT_LENGTH_GAPS, length_gaps, track_calc_length_including_gaps(tr) );
 }
 
 gulong vik_track_get_tp_count(const VikTrack *tr)
@@ -442,6 +717,7 @@ gulong vik_track_get_dup_point_count ( const VikTrack *tr )
  */
 gulong vik_track_remove_dup_points ( VikTrack *tr )
 {
+  vik_track_changed ( tr );
   gulong num = 0;
   GList *iter = tr->trackpoints;
   while ( iter )
@@ -493,6 +769,7 @@ gulong vik_track_get_same_time_point_count ( const VikTrack *tr )
  */
 gulong vik_track_remove_same_time_points ( VikTrack *tr )
 {
+  vik_track_changed ( tr );
   gulong num = 0;
   GList *iter = tr->trackpoints;
   while ( iter ) {
@@ -539,6 +816,7 @@ gulong vik_track_remove_same_time_points ( VikTrack *tr )
  */
 gboolean vik_track_remove_dodgy_first_point ( VikTrack *vt, guint speed, gboolean recalc_bounds )
 {
+  vik_track_changed ( vt );
   gboolean deleted = FALSE;
 
   if ( vt->trackpoints ) {
@@ -575,6 +853,7 @@ gboolean vik_track_remove_dodgy_first_point ( VikTrack *vt, guint speed, gboolea
  */
 void vik_track_to_routepoints ( VikTrack *tr )
 {
+  vik_track_changed ( tr );
   GList *iter = tr->trackpoints;
   while ( iter ) {
 
@@ -668,6 +947,7 @@ VikTrack **vik_track_split_into_segments(VikTrack *t, guint *ret_len)
  */
 guint vik_track_merge_segments(VikTrack *tr)
 {
+  vik_track_changed ( tr );
   guint num = 0;
   GList *iter = tr->trackpoints;
   if ( !iter )
@@ -688,6 +968,7 @@ guint vik_track_merge_segments(VikTrack *tr)
 
 void vik_track_reverse ( VikTrack *tr )
 {
+  vik_track_changed ( tr );
   if ( ! tr->trackpoints )
     return;
 
@@ -718,7 +999,7 @@ void vik_track_reverse ( VikTrack *tr )
  * Returns: The time in seconds
  *  NB this may be negative particularly if the track has been reversed
  */
-gdouble vik_track_get_duration(const VikTrack *trk, gboolean segment_gaps)
+static gdouble track_calc_duration ( const VikTrack *trk, gboolean segment_gaps )
 {
   gdouble duration = 0;
   if ( trk->trackpoints ) {
@@ -736,14 +1017,11 @@ gdouble vik_track_get_duration(const VikTrack *trk, gboolean segment_gaps)
       }
       else {
         // Total within segments
-        GList *iter = trk->trackpoints->next;
-        while (iter) {
-          if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) &&
-               !isnan(VIK_TRACKPOINT(iter->prev->data)->timestamp) &&
-              (!VIK_TRACKPOINT(iter->data)->newsegment) ) {
-            duration += ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
-          }
-          iter = iter->next;
+        const VikTrackColumns *tc = vik_track_get_columns ( trk );
+        const gdouble *ts = tc->timestamps;
+        VIK_TRACK_COLUMNS_FOREACH_PAIR(tc, ii) {
+          if ( !isnan(ts[ii]) && !isnan(ts[ii-1]) && !VIK_TRACK_COLUMNS_NEWSEGMENT(tc, ii) )
+            duration += ABS(ts[ii] - ts[ii-1]);
         }
       }
     }
@@ -751,6 +1029,16 @@ gdouble vik_track_get_duration(const VikTrack *trk, gboolean segment_gaps)
   return duration;
 }
 
+gdouble vik_track_get_duration(const VikTrack *trk, gboolean segment_gaps)
+{
+  if ( segment_gaps ) {
+    TRACK_STAT ( trk, TRACK_STAT_DURATION_GAPS, duration_gaps, track_calc_duration(trk, TRUE) );
+  }
+  else {
+    TRACK_STAT ( trk, TRACK_STAT_DURATION, duration, track_calc_duration(trk, FALSE) );
+  }
+}
+
 /**
  * Notional center of a track is simply an average of the bounding box extremities
  * ATM this shouldn't be used if the track has no trackpoints
@@ -766,29 +1054,28 @@ VikCoord vik_track_get_center ( VikTrack *trk, VikCoordMode cmode )
   return vc;
 }
 
-gdouble vik_track_get_average_speed(const VikTrack *tr)
+static gdouble track_calc_average_speed ( const VikTrack *tr )
 {
   gdouble len = 0.0;
   gdouble time = 0;
-  if ( tr->trackpoints )
+  const VikTrackColumns *tc = vik_track_get_columns ( tr );
+  const gdouble *ts = tc->timestamps;
+  VIK_TRACK_COLUMNS_FOREACH_PAIR(tc, ii)
   {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
+    if ( !isnan(ts[ii]) && !isnan(ts[ii-1]) && !VIK_TRACK_COLUMNS_NEWSEGMENT(tc, ii) )
     {
-      if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) &&
-           !isnan(VIK_TRACKPOINT(iter->prev->data)->timestamp) &&
-          (! VIK_TRACKPOINT(iter->data)->newsegment) )
-      {
-        len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-        time += ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
-      }
-      iter = iter->next;
+      len += vik_coord_diff ( &tc->coords[ii], &tc->coords[ii-1] );
+      time += ABS(ts[ii] - ts[ii-1]);
     }
   }
   return (time == 0) ? 0 : ABS(len/time);
 }
 
+gdouble vik_track_get_average_speed(const VikTrack *tr)
+{
+  TRACK_STAT ( tr, TRACK_STAT_AVG_SPEED, avg_speed, track_calc_average_speed(tr) );
+}
+
 /**
  * Based on a simple average speed, but with a twist - to give a moving average.
  *  . GPSs often report a moving average in their statistics output
@@ -799,32 +1086,37 @@ gdouble vik_track_get_average_speed(const VikTrack *tr)
  *
  * Suggest to use 60 seconds as the stop length (as the default used in the TrackWaypoint draw stops factor)
  */
-gdouble vik_track_get_average_speed_moving (const VikTrack *tr, int stop_length_seconds)
+static gdouble track_calc_average_speed_moving ( const VikTrack *tr, int stop_length_seconds )
 {
   gdouble len = 0.0;
   gdouble time = 0;
-  if ( tr->trackpoints )
+  const VikTrackColumns *tc = vik_track_get_columns ( tr );
+  const gdouble *ts = tc->timestamps;
+  VIK_TRACK_COLUMNS_FOREACH_PAIR(tc, ii)
   {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
+    if ( !isnan(ts[ii]) && !isnan(ts[ii-1]) && !VIK_TRACK_COLUMNS_NEWSEGMENT(tc, ii) )
     {
-      if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) &&
-           !isnan(VIK_TRACKPOINT(iter->prev->data)->timestamp) &&
-          (! VIK_TRACKPOINT(iter->data)->newsegment) )
-      {
-	if ( ( VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp ) < stop_length_seconds ) {
-	  len += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-				  &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-
-	  time += ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
-	}
+      if ( ( ts[ii] - ts[ii-1] ) < stop_length_seconds ) {
+        len += vik_coord_diff ( &tc->coords[ii], &tc->coords[ii-1] );
+        time += ABS(ts[ii] - ts[ii-1]);
       }
-      iter = iter->next;
     }
   }
   return (time == 0) ? 0 : ABS(len/time);
 }
 
+gdouble vik_track_get_average_speed_moving (const VikTrack *tr, int stop_length_seconds)
+{
+  // Only the value for the most recently used stop length is kept
+  VikTrackStats *st = track_get_stats ( tr );
+  if ( !(st->valid & TRACK_STAT_AVG_SPEED_MOVING) || st->stop_length_seconds != stop_length_seconds ) {
+    st->avg_speed_moving = track_calc_average_speed_moving ( tr, stop_length_seconds );
+    st->stop_length_seconds = stop_length_seconds;
+    st->valid |= TRACK_STAT_AVG_SPEED_MOVING;
+  }
+  return st->avg_speed_moving;
+}
+
 /**
  * This uses the raw positioning and so can give improbably high maximum speeds due to either
  *  general inaccuracy in the position and/or if timestamps are rounded to nearest second
@@ -836,24 +1128,18 @@ gdouble vik_track_get_average_speed_moving (const VikTrack *tr, int stop_length_
  *
  * Returns: speed in m/s or NAN if not available
  */
-gdouble vik_track_get_max_speed(const VikTrack *tr)
+static gdouble track_calc_max_speed ( const VikTrack *tr )
 {
   gdouble maxspeed = -1.0, speed = 0.0;
-  if ( tr->trackpoints )
+  const VikTrackColumns *tc = vik_track_get_columns ( tr );
+  const gdouble *ts = tc->timestamps;
+  VIK_TRACK_COLUMNS_FOREACH_PAIR(tc, ii)
   {
-    GList *iter = tr->trackpoints->next;
-    while (iter)
+    if ( !isnan(ts[ii]) && !isnan(ts[ii-1]) && !VIK_TRACK_COLUMNS_NEWSEGMENT(tc, ii) )
     {
-      if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) &&
-           !isnan(VIK_TRACKPOINT(iter->prev->data)->timestamp) &&
-          (! VIK_TRACKPOINT(iter->data)->newsegment) )
-      {
-        speed =  vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) )
-                 / ABS(VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(iter->prev->data)->timestamp);
-        if ( speed > maxspeed )
-          maxspeed = speed;
-      }
-      iter = iter->next;
+      speed = vik_coord_diff ( &tc->coords[ii], &tc->coords[ii-1] ) / ABS(ts[ii] - ts[ii-1]);
+      if ( speed > maxspeed )
+        maxspeed = speed;
     }
   }
   if ( maxspeed < 0.0 )
@@ -861,6 +1147,11 @@ gdouble vik_track_get_max_speed(const VikTrack *tr)
   return maxspeed;
 }
 
+gdouble vik_track_get_max_speed(const VikTrack *tr)
+{
+  TRACK_STAT ( tr, TRACK_STAT_MAX_SPEED, max_speed, track_calc_max_speed(tr) );
+}
+
 /**
  * This uses the speed as reported in the data itself (if available),
  *  rather than being derived from coordinate differences (as above).
@@ -890,7 +1181,7 @@ gdouble vik_track_get_max_speed_by_gps(const VikTrack *tr)
 }
 
 // Returns 0 if not available
-guint vik_track_get_max_heart_rate ( const VikTrack *tr )
+static guint track_calc_max_heart_rate ( const VikTrack *tr )
 {
   guint max = 0, val;
   if ( tr->trackpoints ) {
@@ -905,6 +1196,11 @@ guint vik_track_get_max_heart_rate ( const VikTrack *tr )
   return max;
 }
 
+guint vik_track_get_max_heart_rate ( const VikTrack *tr )
+{
+  TRACK_STAT ( tr, TRACK_STAT_MAX_HEART_RATE, max_heart_rate, track_calc_max_heart_rate(tr) );
+}
+
 // "Average comment", for heart rate / cadence / temperature / power
 // NB A more complicated average could attempt to consider time between points/segments
 //  and possibly assume that value applies until the next (or halfway to) the next point
@@ -914,7 +1210,7 @@ guint vik_track_get_max_heart_rate ( const VikTrack *tr )
 
 // Simple average across those points that have it
 // Returns NAN if not available
-gdouble vik_track_get_avg_heart_rate ( const VikTrack *tr )
+static gdouble track_calc_avg_heart_rate ( const VikTrack *tr )
 {
   gdouble avg = 0.0;
   gulong count = 0;
@@ -935,6 +1231,11 @@ gdouble vik_track_get_avg_heart_rate ( const VikTrack *tr )
   return NAN;
 }
 
+gdouble vik_track_get_avg_heart_rate ( const VikTrack *tr )
+{
+  TRACK_STAT ( tr, TRACK_STAT_AVG_HEART_RATE, avg_heart_rate, track_calc_avg_heart_rate(tr) );
+}
+
 VikTrackpoint *vik_track_get_tp_by_max_heart_rate ( const VikTrack *tr )
 {
   VikTrackpoint *tp = NULL;
@@ -1085,7 +1386,7 @@ gdouble *vik_track_make_time_map_for ( const VikTrack *tr, guint16 num_chunks, V
 }
 
 // Returns VIK_TRKPT_CADENCE_NONE if not valid
-gint vik_track_get_max_cadence ( const VikTrack *tr )
+static gint track_calc_max_cadence ( const VikTrack *tr )
 {
   gint max = VIK_TRKPT_CADENCE_NONE, val;
   if ( tr->trackpoints ) {
@@ -1099,9 +1400,14 @@ gint vik_track_get_max_cadence ( const VikTrack *tr )
   }
   return max;
 }
+
+gint vik_track_get_max_cadence ( const VikTrack *tr )
+{
+  TRACK_STAT ( tr, TRACK_STAT_MAX_CADENCE, max_cadence, track_calc_max_cadence(tr) );
+}
 // Simple average across those points that have it
 // Returns VIK_TRKPT_CADENCE_NONE if not valid
-gdouble vik_track_get_avg_cadence ( const VikTrack *tr )
+static gdouble track_calc_avg_cadence ( const VikTrack *tr )
 {
   gdouble avg = 0;
   gint val;
@@ -1122,6 +1428,11 @@ gdouble vik_track_get_avg_cadence ( const VikTrack *tr )
   return NAN;
 }
 
+gdouble vik_track_get_avg_cadence ( const VikTrack *tr )
+{
+  TRACK_STAT ( tr, TRACK_STAT_AVG_CADENCE, avg_cadence, track_calc_avg_cadence(tr) );
+}
+
 VikTrackpoint *vik_track_get_tp_by_max_cadence ( const VikTrack *tr )
 {
   VikTrackpoint *tp = NULL;
@@ -1235,7 +1546,7 @@ gdouble vik_track_get_avg_temp ( const VikTrack *tr )
 }
 
 // Returns VIK_TRKPT_POWER_NONE if not valid
-gint vik_track_get_max_power ( const VikTrack *tr )
+static gint track_calc_max_power ( const VikTrack *tr )
 {
   gint max = VIK_TRKPT_POWER_NONE, val;
   if ( tr->trackpoints ) {
@@ -1250,9 +1561,14 @@ gint vik_track_get_max_power ( const VikTrack *tr )
   return max;
 }
 
+gint vik_track_get_max_power ( const VikTrack *tr )
+{
+  TRACK_STAT ( tr, TRACK_STAT_MAX_POWER, max_power, track_calc_max_power(tr) );
+}
+
 // Simple average across those points that have it
 // Returns VIK_TRKPT_POWER_NONE if not valid
-gdouble vik_track_get_avg_power ( const VikTrack *tr )
+static gdouble track_calc_avg_power ( const VikTrack *tr )
 {
   gdouble avg = 0;
   gint val;
@@ -1273,6 +1589,11 @@ gdouble vik_track_get_avg_power ( const VikTrack *tr )
   return NAN;
 }
 
+gdouble vik_track_get_avg_power ( const VikTrack *tr )
+{
+  TRACK_STAT ( tr, TRACK_STAT_AVG_POWER, avg_power, track_calc_avg_power(tr) );
+}
+
 VikTrackpoint *vik_track_get_tp_by_max_power ( const VikTrack *tr )
 {
   VikTrackpoint *tp = NULL;
@@ -1293,6 +1614,7 @@ VikTrackpoint *vik_track_get_tp_by_max_power ( const VikTrack *tr )
 
 void vik_track_convert ( VikTrack *tr, VikCoordMode dest_mode )
 {
+  vik_track_changed ( tr );
   GList *iter = tr->trackpoints;
   while (iter)
   {
@@ -1311,35 +1633,36 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
   guint16 current_chunk;
   gboolean ignore_it = FALSE;
 
-  GList *iter = tr->trackpoints;
-
-  if (!iter || !iter->next) /* zero- or one-point track */
+  if (!tr->trackpoints || !tr->trackpoints->next) /* zero- or one-point track */
 	  return NULL;
   g_return_val_if_fail ( num_chunks < MAX_NUM_CHUNKS, NULL );
 
+  // Several passes are made over the points, so use them in contiguous form
+  const VikTrackColumns *tc = vik_track_get_columns ( tr );
+  const gdouble *alts = tc->altitudes;
+  guint ii;
+
   { /* test if there's anything worth calculating */
     gboolean okay = FALSE;
-    while ( iter )
+    VIK_TRACK_COLUMNS_FOREACH(tc, jj)
     {
       // Sometimes a GPS device (or indeed any random file) can have stupid numbers for elevations
       // Since when is 9.9999e+24 a valid elevation!!
       // This can happen when a track (with no elevations) is uploaded to a GPS device and then redownloaded (e.g. using a Garmin Legend EtrexHCx)
       // Some protection against trying to work with crazily massive numbers (otherwise get SIGFPE, Arithmetic exception)
-      if ( !isnan(VIK_TRACKPOINT(iter->data)->altitude) &&
-	   VIK_TRACKPOINT(iter->data)->altitude < 1E9 ) {
+      if ( !isnan(alts[jj]) && alts[jj] < 1E9 ) {
         okay = TRUE; break;
       }
-      iter = iter->next;
     }
     if ( ! okay )
       return NULL;
   }
 
-  iter = tr->trackpoints;
-
   pts = g_malloc ( sizeof(gdouble) * num_chunks );
 
-  total_length = vik_track_get_length_including_gaps ( tr );
+  total_length = 0.0;
+  VIK_TRACK_COLUMNS_FOREACH_PAIR(tc, jj)
+    total_length += vik_coord_diff ( &tc->coords[jj], &tc->coords[jj-1] );
   chunk_length = total_length / num_chunks;
 
   /* Zero chunk_length (eg, track of 2 tp with the same loc) will cause crash */
@@ -1353,10 +1676,10 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
   current_chunk = 0;
   current_seg_length = 0;
 
-  current_seg_length = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-      &(VIK_TRACKPOINT(iter->next->data)->coord) );
-  altitude1 = VIK_TRACKPOINT(iter->data)->altitude;
-  altitude2 = VIK_TRACKPOINT(iter->next->data)->altitude;
+  ii = 0;
+  current_seg_length = vik_coord_diff ( &tc->coords[ii], &tc->coords[ii+1] );
+  altitude1 = alts[ii];
+  altitude2 = alts[ii+1];
   dist_along_seg = 0;
 
   while ( current_chunk < num_chunks ) {
@@ -1390,18 +1713,17 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
       } else { current_dist = current_area_under_curve = 0; } /* should only happen if first current_seg_length == 0 */
 
       /* get intervening segs */
-      iter = iter->next;
-      while ( iter && iter->next ) {
-        current_seg_length = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-            &(VIK_TRACKPOINT(iter->next->data)->coord) );
-        altitude1 = VIK_TRACKPOINT(iter->data)->altitude;
-        altitude2 = VIK_TRACKPOINT(iter->next->data)->altitude;
-        ignore_it = VIK_TRACKPOINT(iter->next->data)->newsegment;
+      ii++;
+      while ( ii + 1 < tc->count ) {
+        current_seg_length = vik_coord_diff ( &tc->coords[ii], &tc->coords[ii+1] );
+        altitude1 = alts[ii];
+        altitude2 = alts[ii+1];
+        ignore_it = VIK_TRACK_COLUMNS_NEWSEGMENT(tc, ii+1);
 
         if ( chunk_length - current_dist >= current_seg_length ) {
           current_dist += current_seg_length;
           current_area_under_curve += current_seg_length * (altitude1+altitude2) * 0.5;
-          iter = iter->next;
+          ii++;
         } else {
           break;
         }
@@ -1409,9 +1731,9 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
 
       /* final seg */
       dist_along_seg = chunk_length - current_dist;
-      if ( ignore_it || ( iter && !iter->next ) ) {
+      if ( ignore_it || ii + 1 >= tc->count ) {
         pts[current_chunk] = current_area_under_curve / current_dist;
-        if (!iter->next) {
+        if ( ii + 1 >= tc->count ) {
           int i;
           for (i = current_chunk + 1; i < num_chunks; i++)
             pts[i] = pts[current_chunk];
@@ -1437,28 +1759,37 @@ gdouble *vik_track_make_elevation_map ( const VikTrack *tr, guint16 num_chunks )
  * elevation gains and losses may be NAN if no elevations are available
  *
  */
-void vik_track_get_total_elevation_gain(const VikTrack *tr, gdouble *up, gdouble *down)
+static void track_calc_total_elevation_gain ( const VikTrack *tr, gdouble *up, gdouble *down )
 {
   gdouble diff;
   *up = *down = 0;
   if ( tr->trackpoints ) {
-    GList *iter = tr->trackpoints->next;
-    while (iter) {
-      VikTrackpoint *tp1 = VIK_TRACKPOINT(iter->data);
-      VikTrackpoint *tp2 = VIK_TRACKPOINT(iter->prev->data);
-      if ( !isnan(tp1->altitude) && !isnan(tp2->altitude) ) {
-        diff = tp1->altitude - tp2->altitude;
+    const VikTrackColumns *tc = vik_track_get_columns ( tr );
+    const gdouble *alts = tc->altitudes;
+    VIK_TRACK_COLUMNS_FOREACH_PAIR(tc, ii) {
+      if ( !isnan(alts[ii]) && !isnan(alts[ii-1]) ) {
+        diff = alts[ii] - alts[ii-1];
         if ( diff > 0 )
           *up += diff;
         else
           *down -= diff;
       }
-      iter = iter->next;
     }
   } else
     *up = *down = NAN;
 }
 
+void vik_track_get_total_elevation_gain(const VikTrack *tr, gdouble *up, gdouble *down)
+{
+  VikTrackStats *st = track_get_stats ( tr );
+  if ( !(st->valid & TRACK_STAT_ELEV_GAIN) ) {
+    track_calc_total_elevation_gain ( tr, &st->elev_up, &st->elev_down );
+    st->valid |= TRACK_STAT_ELEV_GAIN;
+  }
+  *up = st->elev_up;
+  *down = st->elev_down;
+}
+
 gdouble *vik_track_make_gradient_map ( const VikTrack *tr, guint16 num_chunks )
 {
   gdouble *pts;
@@ -1736,37 +2067,24 @@ gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks
  */
 VikTrackpoint *vik_track_get_tp_by_dist ( VikTrack *trk, gdouble meters_from_start, gboolean get_next_point, gdouble *tp_metres_from_start )
 {
-  gdouble current_dist = 0.0;
-  gdouble current_inc = 0.0;
   if ( tp_metres_from_start )
     *tp_metres_from_start = 0.0;
 
   if ( trk->trackpoints ) {
-    GList *iter = g_list_next ( g_list_first ( trk->trackpoints ) );
-    while (iter) {
-      current_inc = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                     &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      current_dist += current_inc;
-      if ( current_dist >= meters_from_start )
-        break;
-      iter = g_list_next ( iter );
-    }
+    const VikTrackColumns *tc = vik_track_get_columns ( trk );
+    TrackIndex *ti = track_get_index ( trk );
+    // The first point that reaches the distance
+    guint ii = index_lower_bound ( ti->dist, 1, tc->count, meters_from_start );
     // passed the end of the track
-    if ( !iter )
+    if ( ii >= tc->count || isnan(meters_from_start) )
       return NULL;
 
-    if ( tp_metres_from_start )
-      *tp_metres_from_start = current_dist;
-
     // we've gone past the distance already, is the previous trackpoint wanted?
-    if ( !get_next_point ) {
-      if ( iter->prev ) {
-        if ( tp_metres_from_start )
-          *tp_metres_from_start = current_dist-current_inc;
-        return VIK_TRACKPOINT(iter->prev->data);
-      }
-    }
-    return VIK_TRACKPOINT(iter->data);
+    if ( !get_next_point )
+      ii--;
+    if ( tp_metres_from_start )
+      *tp_metres_from_start = ti->dist[ii];
+    return tc->tps[ii];
   }
 
   return NULL;
@@ -1776,46 +2094,27 @@ VikTrackpoint *vik_track_get_tp_by_dist ( VikTrack *trk, gdouble meters_from_sta
 VikTrackpoint *vik_track_get_closest_tp_by_percentage_dist ( VikTrack *tr, gdouble reldist, gdouble *meters_from_start )
 {
   gdouble dist = vik_track_get_length_including_gaps(tr) * reldist;
-  gdouble current_dist = 0.0;
-  gdouble current_inc = 0.0;
   if ( tr->trackpoints )
   {
-    GList *iter = tr->trackpoints->next;
-    GList *last_iter = NULL;
-    gdouble last_dist = 0.0;
-    while (iter)
-    {
-      current_inc = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                     &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      last_dist = current_dist;
-      current_dist += current_inc;
-      if ( current_dist >= dist )
-        break;
-      last_iter = iter;
-      iter = iter->next;
-    }
-    if (!iter) { /* passing the end the track */
-      if (last_iter) {
+    const VikTrackColumns *tc = vik_track_get_columns ( tr );
+    TrackIndex *ti = track_get_index ( tr );
+    guint ii = index_lower_bound ( ti->dist, 1, tc->count, dist );
+    if ( ii >= tc->count || isnan(dist) ) { /* passing the end the track */
+      if ( tc->count > 1 ) {
         if (meters_from_start)
-          *meters_from_start = last_dist;
-        return(VIK_TRACKPOINT(last_iter->data));
+          *meters_from_start = ti->dist[tc->count-2];
+        return tc->tps[tc->count-1];
       }
       else
         return NULL;
     }
     /* we've gone past the dist already, was prev trackpoint closer? */
     /* should do a vik_coord_average_weighted() thingy. */
-    if ( iter->prev && fabs(current_dist-current_inc-dist) < fabs(current_dist-dist) ) {
-      if (meters_from_start)
-        *meters_from_start = last_dist;
-      iter = iter->prev;
-    }
-    else
-      if (meters_from_start)
-        *meters_from_start = current_dist;
-
-    return VIK_TRACKPOINT(iter->data);
-
+    if ( fabs(ti->dist[ii-1]-dist) < fabs(ti->dist[ii]-dist) )
+      ii--;
+    if (meters_from_start)
+      *meters_from_start = ti->dist[ii];
+    return tc->tps[ii];
   }
   return NULL;
 }
@@ -1825,37 +2124,51 @@ VikTrackpoint *vik_track_get_closest_tp_by_percentage_time ( VikTrack *tr, gdoub
   if ( !tr->trackpoints )
     return NULL;
 
+  const VikTrackColumns *tc = vik_track_get_columns ( tr );
+  TrackIndex *ti = track_get_index ( tr );
+
   gdouble t_pos, t_start, t_end, t_total;
-  t_start = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  t_end = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
+  t_start = tc->timestamps[0];
+  t_end = tc->timestamps[tc->count-1];
   t_total = t_end - t_start;
 
   t_pos = t_start + t_total * reltime;
+  VikTrackpoint *tp = NULL;
 
-  GList *iter = tr->trackpoints;
-
-  while (iter) {
-    if (VIK_TRACKPOINT(iter->data)->timestamp == t_pos)
-      break;
-    if (VIK_TRACKPOINT(iter->data)->timestamp > t_pos) {
-      if (iter->prev == NULL)  /* first trackpoint */
+  if ( ti->times_sorted ) {
+    if ( isnan(t_pos) )
+      return NULL;
+    guint ii = index_lower_bound ( tc->timestamps, 0, tc->count, t_pos );
+    if ( ii < tc->count ) {
+      // First point at or beyond the time, or the one before if that is closer
+      if ( tc->timestamps[ii] > t_pos && ii > 0 && (t_pos - tc->timestamps[ii-1]) <= (tc->timestamps[ii] - t_pos) )
+        ii--;
+      tp = tc->tps[ii];
+    }
+    else if ( t_pos < tc->timestamps[tc->count-1] + 3 ) /* last trackpoint: accommodate for round-off */
+      tp = tc->tps[tc->count-1];
+  }
+  else {
+    // Times in no particular order, so have to consider each one
+    for ( guint ii = 0; ii < tc->count; ii++ ) {
+      if ( tc->timestamps[ii] == t_pos ) {
+        tp = tc->tps[ii];
         break;
-      gdouble t_before = t_pos - VIK_TRACKPOINT(iter->prev->data)->timestamp;
-      gdouble t_after = VIK_TRACKPOINT(iter->data)->timestamp - t_pos;
-      if (t_before <= t_after)
-        iter = iter->prev;
-      break;
+      }
+      if ( tc->timestamps[ii] > t_pos ) {
+        if ( ii > 0 && (t_pos - tc->timestamps[ii-1]) <= (tc->timestamps[ii] - t_pos) )
+          ii--;
+        tp = tc->tps[ii];
+        break;
+      }
+      else if ( ii == tc->count-1 && t_pos < tc->timestamps[ii] + 3 ) /* last trackpoint: accommodate for round-off */
+        tp = tc->tps[ii];
     }
-    else if ((iter->next == NULL) && (t_pos < (VIK_TRACKPOINT(iter->data)->timestamp + 3))) /* last trackpoint: accommodate for round-off */
-      break;
-    iter = iter->next;
   }
 
-  if (!iter)
-    return NULL;
-  if (seconds_from_start)
-    *seconds_from_start = VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  return VIK_TRACKPOINT(iter->data);
+  if ( tp && seconds_from_start )
+    *seconds_from_start = tp->timestamp - t_start;
+  return tp;
 }
 
 /**
@@ -1997,29 +2310,40 @@ VikTrackpoint *vik_track_get_tp_prev ( const VikTrack *tr, VikTrackpoint *tp )
  *
  * Returns: Whether any altitudes where found
  */
-gboolean vik_track_get_minmax_alt ( const VikTrack *tr, gdouble *min_alt, gdouble *max_alt )
+static gboolean track_calc_minmax_alt ( const VikTrack *tr, gdouble *min_alt, gdouble *max_alt )
 {
   *min_alt = 25000;
   *max_alt = -5000;
   if ( tr && tr->trackpoints ) {
-    GList *iter = tr->trackpoints;
-    gdouble tmp_alt;
-    while (iter) {
-      VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
-      if ( !isnan(tp->altitude) ) {
-	tmp_alt = tp->altitude;
+    const VikTrackColumns *tc = vik_track_get_columns ( tr );
+    VIK_TRACK_COLUMNS_FOREACH(tc, ii) {
+      gdouble tmp_alt = tc->altitudes[ii];
+      if ( !isnan(tmp_alt) ) {
 	if ( tmp_alt > *max_alt )
 	  *max_alt = tmp_alt;
 	if ( tmp_alt < *min_alt )
 	  *min_alt = tmp_alt;
       }
-      iter = iter->next;
     }
     return (*min_alt != 25000);
   }
   return FALSE;
 }
 
+gboolean vik_track_get_minmax_alt ( const VikTrack *tr, gdouble *min_alt, gdouble *max_alt )
+{
+  if ( !tr )
+    return track_calc_minmax_alt ( tr, min_alt, max_alt );
+  VikTrackStats *st = track_get_stats ( tr );
+  if ( !(st->valid & TRACK_STAT_MINMAX_ALT) ) {
+    st->has_alt = track_calc_minmax_alt ( tr, &st->min_alt, &st->max_alt );
+    st->valid |= TRACK_STAT_MINMAX_ALT;
+  }
+  *min_alt = st->min_alt;
+  *max_alt = st->max_alt;
+  return st->has_alt;
+}
+
 void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *datalen)
 {
   GList *tps;
@@ -2132,6 +2456,7 @@ VikTrack *vik_track_unmarshall (const guint8 *data_in, guint datalen)
  */
 void vik_track_calculate_bounds ( VikTrack *trk )
 {
+  vik_track_changed ( trk );
   GList *tp_iter;
   tp_iter = trk->trackpoints;
 
@@ -2163,6 +2488,242 @@ void vik_track_calculate_bounds ( VikTrack *trk )
   trk->bbox.west = topleft.lon;
 }
 
+#define TRACK_LEVELS_MAX 24
+#define TRACK_LEVELS_METRES_PER_DEGREE (6378137.0 * M_PI / 180.0)
+
+struct _VikTrackLevels {
+  gint ref_count;
+  gint ready;            // Set once the levels have been calculated
+  guint count;
+  VikTrackpoint **tps;   // The points when simplified, which are only referred to
+  gdouble *xy;           // Position of each point in metres on a flat projection local to the track
+  guint8 *starts;        // Whether each point starts a segment
+  guint8 *stops;         // Whether each point is followed by a stop
+  gdouble stop_length;   // Seconds between points for a stop
+  guint n_levels;
+  VikTrackLevel levels[TRACK_LEVELS_MAX];
+};
+
+/**
+ * vik_track_get_level:
+ * @tolerance:   Metres that the simplified lines may stray from the points left out
+ * @stop_length: Seconds between points for a stop, which must be kept
+ * @level:       Set to the most simplified level within the tolerance,
+ *               which remains valid until the track changes
+ *
+ * All the points are given until the levels have been made by vik_track_levels_calculate()
+ *  for the same stop length
+ */
+void vik_track_get_level ( VikTrack *tr, gdouble tolerance, gdouble stop_length, VikTrackLevel *level )
+{
+  VikTrackStats *st = track_get_stats ( tr );
+  const VikTrackColumns *tc = vik_track_get_columns ( tr );
+  level->tolerance = 0.0;
+  level->count = tc->count;
+  level->tps = tc->tps;
+  level->indices = NULL;
+  level->whole = tc->tps;
+
+  VikTrackLevels *tl = st->levels;
+  if ( tl && g_atomic_int_get ( &tl->ready ) && tl->stop_length == stop_length ) {
+    for ( guint ii = tl->n_levels; ii > 0; ii-- ) {
+      if ( tl->levels[ii-1].tolerance <= tolerance ) {
+        *level = tl->levels[ii-1];
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * vik_track_levels_new:
+ * @stop_length: Seconds between points for a stop, where the point before is always kept
+ *
+ * Copy the positions of the trackpoints, ready for making the simplified levels of the track
+ *  with vik_track_levels_calculate(), which may be done in another thread.
+ * The levels are then used by vik_track_get_level() for this version of the track.
+ * Levels made for a different stop length are replaced.
+ *
+ * Returns: A reference to the levels to be calculated,
+ *  or NULL when the track is too small to need them or they are already made or being made
+ */
+VikTrackLevels *vik_track_levels_new ( VikTrack *tr, gdouble stop_length )
+{
+  VikTrackStats *st = track_get_stats ( tr );
+  const VikTrackColumns *tc = vik_track_get_columns ( tr );
+  if ( tc->count < VIK_TRACK_LEVELS_MIN_POINTS )
+    return NULL;
+  if ( st->levels ) {
+    if ( !g_atomic_int_get ( &st->levels->ready ) || st->levels->stop_length == stop_length )
+      return NULL;
+    vik_track_levels_unref ( st->levels );
+    st->levels = NULL;
+  }
+
+  VikTrackLevels *tl = g_malloc0 ( sizeof(VikTrackLevels) );
+  tl->ref_count = 2; // The track and the caller
+  tl->count = tc->count;
+  tl->tps = g_memdup ( tc->tps, sizeof(VikTrackpoint*) * tl->count );
+  tl->xy = g_malloc ( sizeof(gdouble) * 2 * tl->count );
+  tl->starts = g_malloc ( tl->count );
+  tl->stops = g_malloc ( tl->count );
+  tl->stop_length = stop_length;
+
+  // Near enough to flat over the extent of a track
+  gdouble kx = TRACK_LEVELS_METRES_PER_DEGREE * cos ( DEG2RAD((tr->bbox.north + tr->bbox.south) / 2) );
+  VIK_TRACK_COLUMNS_FOREACH(tc, ii) {
+    struct LatLon ll;
+    vik_coord_to_latlon ( &tc->coords[ii], &ll );
+    tl->xy[2*ii] = ll.lon * kx;
+    tl->xy[2*ii+1] = ll.lat * TRACK_LEVELS_METRES_PER_DEGREE;
+    tl->starts[ii] = ii == 0 || VIK_TRACK_COLUMNS_NEWSEGMENT(tc, ii);
+    // As drawn, including when the next point starts a new segment
+    tl->stops[ii] = ii+1 < tc->count && tc->timestamps[ii+1] - tc->timestamps[ii] > stop_length;
+  }
+  st->levels = tl;
+  return tl;
+}
+
+void vik_track_levels_unref ( VikTrackLevels *tl )
+{
+  if ( !g_atomic_int_dec_and_test ( &tl->ref_count ) )
+    return;
+  for ( guint ii = 0; ii < tl->n_levels; ii++ ) {
+    g_free ( tl->levels[ii].tps );
+    g_free ( tl->levels[ii].indices );
+  }
+  g_free ( tl->stops );
+  g_free ( tl->starts );
+  g_free ( tl->xy );
+  g_free ( tl->tps );
+  g_free ( tl );
+}
+
+/**
+ * Squared distance of point (p) from the line between (a) and (b)
+ */
+static gdouble segment_distance2 ( const gdouble *p, const gdouble *a, const gdouble *b )
+{
+  gdouble dx = b[0] - a[0];
+  gdouble dy = b[1] - a[1];
+  gdouble len2 = dx * dx + dy * dy;
+  gdouble t = 0.0;
+  if ( len2 > 0.0 )
+    t = CLAMP ( ((p[0] - a[0]) * dx + (p[1] - a[1]) * dy) / len2, 0.0, 1.0 );
+  gdouble ex = a[0] + t * dx - p[0];
+  gdouble ey = a[1] + t * dy - p[1];
+  return ex * ex + ey * ey;
+}
+
+typedef struct {
+  guint first, last;
+  gdouble limit;
+} dp_range_t;
+
+/**
+ * Douglas-Peucker simplification of the points from (first) to (last),
+ *  giving each point between them the largest tolerance at which it would be kept.
+ * Thus the simplification for any tolerance is the points with a larger value.
+ */
+static void track_levels_significance ( const gdouble *xy, gdouble *sig, guint first, guint last, GArray *stack )
+{
+  dp_range_t range = { first, last, G_MAXDOUBLE };
+  g_array_append_val ( stack, range );
+  while ( stack->len ) {
+    range = g_array_index ( stack, dp_range_t, stack->len - 1 );
+    g_array_set_size ( stack, stack->len - 1 );
+
+    gdouble max2 = -1.0;
+    guint split = range.first;
+    for ( guint ii = range.first + 1; ii < range.last; ii++ ) {
+      gdouble d2 = segment_distance2 ( &xy[2*ii], &xy[2*range.first], &xy[2*range.last] );
+      if ( d2 > max2 ) {
+        max2 = d2;
+        split = ii;
+      }
+    }
+    if ( split == range.first )
+      continue;
+
+    // Never more than the point it was kept after, so simplifications are nested
+    sig[split] = MIN ( sqrt ( max2 ), range.limit );
+    dp_range_t before = { range.first, split, sig[split] };
+    dp_range_t after = { split, range.last, sig[split] };
+    g_array_append_val ( stack, before );
+    g_array_append_val ( stack, after );
+  }
+}
+
+/**
+ * vik_track_levels_calculate:
+ *
+ * Make the simplified levels of the track, at successively doubled tolerances
+ *  from VIK_TRACK_LEVELS_MIN_TOLERANCE.
+ * Each segment is split at its stops, which are kept along with the ends of the segment.
+ * A level is only kept when it has at most half the points of the previous one.
+ *
+ * This only uses the copy made by vik_track_levels_new() and so may be run in any thread.
+ */
+void vik_track_levels_calculate ( VikTrackLevels *tl )
+{
+  gdouble *sig = g_malloc ( sizeof(gdouble) * tl->count );
+  GArray *stack = g_array_new ( FALSE, FALSE, sizeof(dp_range_t) );
+  for ( guint first = 0; first < tl->count; ) {
+    // Up to the end of the segment or the next stop
+    guint last = first;
+    while ( last + 1 < tl->count && !tl->starts[last+1] ) {
+      last++;
+      if ( tl->stops[last] )
+        break;
+    }
+    // Which are always kept, with the lines between them simplified separately
+    sig[first] = sig[last] = G_MAXDOUBLE;
+    for ( guint ii = first + 1; ii < last; ii++ )
+      sig[ii] = 0.0;
+    track_levels_significance ( tl->xy, sig, first, last, stack );
+    // A stop also starts the next part of the segment
+    first = ( last + 1 < tl->count && !tl->starts[last+1] ) ? last : last + 1;
+  }
+  g_array_free ( stack, TRUE );
+
+  guint ends = 0;
+  for ( guint ii = 0; ii < tl->count; ii++ )
+    if ( sig[ii] == G_MAXDOUBLE )
+      ends++;
+
+  guint previous = tl->count;
+  gdouble tolerance = VIK_TRACK_LEVELS_MIN_TOLERANCE;
+  for ( guint nn = 0; nn < TRACK_LEVELS_MAX && previous > ends; nn++, tolerance *= 2 ) {
+    guint kept = 0;
+    for ( guint ii = 0; ii < tl->count; ii++ )
+      if ( sig[ii] > tolerance )
+        kept++;
+    if ( kept > previous / 2 && kept > ends )
+      continue;
+
+    VikTrackLevel *level = &tl->levels[tl->n_levels++];
+    level->tolerance = tolerance;
+    level->count = kept;
+    level->tps = g_malloc ( sizeof(VikTrackpoint*) * kept );
+    level->indices = g_malloc ( sizeof(guint) * kept );
+    level->whole = tl->tps;
+    kept = 0;
+    for ( guint ii = 0; ii < tl->count; ii++ ) {
+      if ( sig[ii] > tolerance ) {
+        level->tps[kept] = tl->tps[ii];
+        level->indices[kept++] = ii;
+      }
+    }
+    previous = kept;
+  }
+  g_free ( sig );
+
+  // Positions are no longer needed
+  g_free ( tl->xy );
+  tl->xy = NULL;
+  g_atomic_int_set ( &tl->ready, 1 );
+}
+
 /**
  * vik_track_anonymize_times:
  *
@@ -2170,6 +2731,7 @@ void vik_track_calculate_bounds ( VikTrack *trk )
  */
 void vik_track_anonymize_times ( VikTrack *tr )
 {
+  vik_track_changed ( tr );
   GTimeVal gtv;
   // Check result just to please Coverity - even though it shouldn't fail as it's a hard coded value here!
   if ( !g_time_val_from_iso8601 ( "1901-01-01T00:00:00Z", &gtv ) ) {
@@ -2239,6 +2801,7 @@ void vik_track_interpolate_times ( VikTrack *tr )
 
           tp->timestamp = (cur_dist / tr_dist) * tsdiff + tsfirst;
         }
+        vik_track_changed ( tr );
         // Some points may now have the same time so remove them.
         vik_track_remove_same_time_points ( tr );
       }
@@ -2254,25 +2817,38 @@ void vik_track_interpolate_times ( VikTrack *tr )
  */
 gulong vik_track_apply_dem_data ( VikTrack *tr, gboolean skip_existing )
 {
+  vik_track_changed ( tr );
   gulong num = 0;
   GList *tp_iter;
-  gint16 elev;
-  tp_iter = tr->trackpoints;
-  while ( tp_iter ) {
+  // Gather the positions wanted so the DEMs can be looked up in one go
+  GPtrArray *tps = g_ptr_array_new ();
+  GArray *coords = g_array_new ( FALSE, FALSE, sizeof(VikCoord) );
+  for ( tp_iter = tr->trackpoints; tp_iter; tp_iter = tp_iter->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(tp_iter->data);
     // Don't apply if the point already has a value and the overwrite is off
-    if ( !(skip_existing && !isnan(VIK_TRACKPOINT(tp_iter->data)->altitude)) ) {
-      /* TODO: of the 4 possible choices we have for choosing an elevation
-       * (trackpoint in between samples), choose the one with the least elevation change
-       * as the last */
-      elev = a_dems_get_elev_by_coord ( &(VIK_TRACKPOINT(tp_iter->data)->coord), VIK_DEM_INTERPOL_BEST );
-
-      if ( elev != VIK_DEM_INVALID_ELEVATION ) {
-        VIK_TRACKPOINT(tp_iter->data)->altitude = elev;
-	num++;
+    if ( !(skip_existing && !isnan(tp->altitude)) ) {
+      g_ptr_array_add ( tps, tp );
+      g_array_append_val ( coords, tp->coord );
+    }
+  }
+
+  if ( tps->len ) {
+    /* TODO: of the 4 possible choices we have for choosing an elevation
+     * (trackpoint in between samples), choose the one with the least elevation change
+     * as the last */
+    gint16 *elevs = g_new ( gint16, tps->len );
+    if ( a_dems_get_elev_by_coords ( (VikCoord*)coords->data, tps->len, a_dems_get_track_interpol(VIK_DEM_INTERPOL_BEST), elevs ) ) {
+      for ( guint ii = 0; ii < tps->len; ii++ ) {
+        if ( elevs[ii] != VIK_DEM_INVALID_ELEVATION ) {
+          VIK_TRACKPOINT(g_ptr_array_index(tps, ii))->altitude = elevs[ii];
+          num++;
+        }
       }
     }
-    tp_iter = tp_iter->next;
+    g_free ( elevs );
   }
+  g_array_free ( coords, TRUE );
+  g_ptr_array_free ( tps, TRUE );
   return num;
 }
 
@@ -2284,7 +2860,7 @@ gulong vik_track_apply_dem_data ( VikTrack *tr, gboolean skip_existing )
 gboolean vik_trackpoint_apply_dem_data ( VikTrackpoint *tp )
 {
   if ( tp ) {
-    gint16 elev = a_dems_get_elev_by_coord ( &(tp->coord), VIK_DEM_INTERPOL_BEST );
+    gint16 elev = a_dems_get_elev_by_coord ( &(tp->coord), a_dems_get_track_interpol(VIK_DEM_INTERPOL_BEST) );
     if ( elev != VIK_DEM_INVALID_ELEVATION ) {
       tp->altitude = elev;
       return TRUE;
@@ -2346,6 +2922,7 @@ static void smoothie ( GList *tp1, GList *tp2, gdouble elev1, gdouble elev2, gui
  */
 gulong vik_track_smooth_missing_elevation_data ( VikTrack *tr, gboolean flat )
 {
+  vik_track_changed ( tr );
   gulong num = 0;
 
   GList *tp_iter;
@@ -2411,6 +2988,8 @@ gulong vik_track_smooth_missing_elevation_data ( VikTrack *tr, gboolean flat )
  */
 void vik_track_steal_and_append_trackpoints ( VikTrack *t1, VikTrack *t2 )
 {
+  vik_track_changed ( t1 );
+  vik_track_changed ( t2 );
   if ( t1->trackpoints ) {
     t1->trackpoints = g_list_concat ( t1->trackpoints, t2->trackpoints );
   } else
@@ -2431,6 +3010,7 @@ void vik_track_steal_and_append_trackpoints ( VikTrack *t1, VikTrack *t2 )
  */
 VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr )
 {
+  vik_track_changed ( tr );
   GList *iter = tr->trackpoints;
   VikCoord *rv;
 
@@ -76,6 +76,8 @@ typedef enum {
 //  This is simpler than having to rewrite particularly every track function for route version
 //   given that they do the same things
 //  Mostly this matters in the display in deciding where and how they are shown
+typedef struct _VikTrackStats VikTrackStats;
+
 typedef struct _VikTrack VikTrack;
 struct _VikTrack {
   GList *trackpoints;
@@ -97,8 +99,57 @@ struct _VikTrack {
   gboolean has_color;
   GdkColor color;
   LatLonBBox bbox;
+  guint version;       // Incremented whenever the trackpoints change, see vik_track_changed()
+  VikTrackStats *stats; // Derived values calculated when first wanted for the current version
 };
 
+/**
+ * Contiguous (column per field) copy of the main values of the trackpoints,
+ *  so passes over the whole track do not chase list pointers around the heap.
+ * See vik_track_get_columns()
+ */
+typedef struct {
+  guint count;
+  VikTrackpoint **tps; // The trackpoints themselves, which are only referred to
+  VikCoord *coords;
+  gdouble *timestamps; // NAN if data unavailable
+  gdouble *altitudes;  // NAN if data unavailable
+  gdouble *speeds;     // NAN if data unavailable
+  guint8 *newsegments; // Bit per point
+} VikTrackColumns;
+
+#define VIK_TRACK_COLUMNS_NEWSEGMENT(tc,ii) ((tc)->newsegments[(ii)>>3] & (1 << ((ii)&7)))
+
+// Visit each point, as index (ii)
+#define VIK_TRACK_COLUMNS_FOREACH(tc,ii) for ( guint ii = 0; ii < (tc)->count; ii++ )
+// Visit each pair of consecutive points, as the index (ii) of the second of them
+#define VIK_TRACK_COLUMNS_FOREACH_PAIR(tc,ii) for ( guint ii = 1; ii < (tc)->count; ii++ )
+
+/**
+ * The track simplified for drawing at a lower level of detail,
+ *  where the points left out are all within (tolerance) metres of the lines between the points kept.
+ *
+ * The first and last points of each segment are always kept,
+ *  as are the points followed by a stop so these can still be shown.
+ */
+typedef struct {
+  gdouble tolerance;
+  guint count;
+  VikTrackpoint **tps;   // The points kept
+  guint *indices;        // Of the points kept within the whole track, or NULL when all are kept
+  VikTrackpoint **whole; // All the points of the track
+} VikTrackLevel;
+
+#define VIK_TRACK_LEVEL_INDEX(level,ii) ((level)->indices ? (level)->indices[(ii)] : (ii))
+
+// Successively simplified versions of a track, see vik_track_levels_new()
+typedef struct _VikTrackLevels VikTrackLevels;
+
+// Tracks with fewer points are always drawn in full
+#define VIK_TRACK_LEVELS_MIN_POINTS 500
+// Tolerance (metres) of the least simplified level
+#define VIK_TRACK_LEVELS_MIN_TOLERANCE 1.0
+
 typedef struct {
   gdouble length; // Metres
   guint time;     // Seconds
@@ -118,6 +169,8 @@ void vik_track_set_url_name(VikTrack *tr, const gchar *url_name);
 void vik_track_set_type(VikTrack *tr, const gchar *type);
 void vik_track_set_extensions(VikTrack *tr, const gchar *value);
 void vik_track_ref(VikTrack *tr);
+void vik_track_changed(VikTrack *tr);
+guint vik_track_get_changes ( void );
 void vik_track_free(VikTrack *tr);
 VikTrack *vik_track_copy ( const VikTrack *tr, gboolean copy_points );
 void vik_track_set_comment_no_copy(VikTrack *tr, gchar *comment);
@@ -205,6 +258,17 @@ VikTrack *vik_track_unmarshall (const guint8 *data_in, guint datalen);
 
 void vik_track_calculate_bounds ( VikTrack *trk );
 
+const VikTrackColumns *vik_track_get_columns ( const VikTrack *tr );
+
+// Number of consecutive points in each run of vik_track_get_runs()
+#define VIK_TRACK_RUN_POINTS 64
+const LatLonBBox *vik_track_get_runs ( const VikTrack *tr, guint *count );
+
+void vik_track_get_level ( VikTrack *tr, gdouble tolerance, gdouble stop_length, VikTrackLevel *level );
+VikTrackLevels *vik_track_levels_new ( VikTrack *tr, gdouble stop_length );
+void vik_track_levels_calculate ( VikTrackLevels *tl );
+void vik_track_levels_unref ( VikTrackLevels *tl );
+
 void vik_track_anonymize_times ( VikTrack *tr );
 void vik_track_interpolate_times ( VikTrack *tr );
 gulong vik_track_apply_dem_data ( VikTrack *tr, gboolean skip_existing );
@@ -47,6 +47,7 @@
 #include "babel.h"
 #include "dem.h"
 #include "dems.h"
+#include "spatialindex.h"
 #include "geonamessearch.h"
 #ifdef VIK_CONFIG_OPENSTREETMAP
 #include "osm-traces.h"
@@ -123,6 +124,12 @@ struct _VikTrwLayer {
   GtkTreeIter tracks_iter, routes_iter, waypoints_iter;
   gboolean tracks_visible, routes_visible, waypoints_visible;
   LatLonBBox waypoints_bbox;
+  // Bounding boxes of the above, remade from the hash tables when items are added, removed or waypoints moved
+  SpatialIndex *tracks_index, *routes_index, *waypoints_index;
+  gboolean tracks_index_dirty, routes_index_dirty, waypoints_index_dirty;
+  guint tracks_index_changes, routes_index_changes; // vik_track_get_changes() when last checked
+  gint wp_symbol_extent; // Largest half size of the waypoint symbols drawn so far
+  gint wp_label_extent;  // Furthest reach from its waypoint of any label drawn so far
 
   gboolean track_draw_labels;
   guint8 drawmode;
@@ -266,7 +273,10 @@ struct DrawingParams {
   gboolean one_zone, lat_lon;
   gdouble ce1, ce2, cn1, cn2;
   LatLonBBox bbox;
+  LatLonBBox wp_bbox;
   gboolean highlight;
+  gdouble tolerance;       // Metres that track lines may stray without it being visible
+  GPtrArray *levels_todo;  // Of VikTrackLevels wanted for drawing at the tolerance
 };
 
 static gboolean trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp );
@@ -1943,6 +1953,9 @@ static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
   rv->tracks_iters = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
   rv->routes = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) vik_track_free );
   rv->routes_iters = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
+  rv->waypoints_index = spatial_index_new ();
+  rv->tracks_index = spatial_index_new ();
+  rv->routes_index = spatial_index_new ();
 
   rv->image_cache = g_hash_table_new_full ( g_str_hash, g_str_equal, NULL, (GDestroyNotify) pixbuf_free ); // Must be performed before set_params via set_defaults
 
@@ -1970,6 +1983,9 @@ static void trw_layer_free ( VikTrwLayer *trwlayer )
   g_hash_table_destroy(trwlayer->tracks_iters);
   g_hash_table_destroy(trwlayer->routes);
   g_hash_table_destroy(trwlayer->routes_iters);
+  spatial_index_free ( trwlayer->waypoints_index );
+  spatial_index_free ( trwlayer->tracks_index );
+  spatial_index_free ( trwlayer->routes_index );
 
   trw_layer_free_track_gcs ( trwlayer );
 
@@ -2025,6 +2041,124 @@ static void trw_layer_free ( VikTrwLayer *trwlayer )
   g_free ( trwlayer->gpx_extensions );
 }
 
+/**
+ * Tracks in the spatial index are stamped with the track version,
+ *  thus showing whether they have since changed
+ */
+static gboolean trw_layer_index_check_track ( gpointer id, gpointer trk, LatLonBBox *bbox, guint *stamp )
+{
+  if ( VIK_TRACK(trk)->version == *stamp )
+    return FALSE;
+  *bbox = VIK_TRACK(trk)->bbox;
+  *stamp = VIK_TRACK(trk)->version;
+  return TRUE;
+}
+
+static void trw_layer_index_add_track ( gpointer id, VikTrack *trk, SpatialIndex *si )
+{
+  spatial_index_add ( si, id, trk, trk->bbox, trk->version );
+}
+
+static LatLonBBox waypoint_bbox ( VikWaypoint *wp )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( &wp->coord, &ll );
+  LatLonBBox bbox = { ll.lat, ll.lat, ll.lon, ll.lon };
+  return bbox;
+}
+
+static void trw_layer_index_add_waypoint ( gpointer id, VikWaypoint *wp, SpatialIndex *si )
+{
+  spatial_index_add ( si, id, wp, waypoint_bbox(wp), 0 );
+}
+
+/**
+ * Bring the index up to date with the tracks (or routes):
+ *  completely remade when any have been added or removed,
+ *  otherwise the changed ones are updated but only once some track has changed
+ */
+static SpatialIndex *trw_layer_index_update_tracks ( SpatialIndex *si, gboolean *dirty, guint *checked, GHashTable *tracks )
+{
+  guint changes = vik_track_get_changes ();
+  if ( *dirty ) {
+    spatial_index_clear ( si );
+    g_hash_table_foreach ( tracks, (GHFunc)trw_layer_index_add_track, si );
+    *dirty = FALSE;
+  }
+  else if ( *checked != changes )
+    (void)spatial_index_check ( si, trw_layer_index_check_track );
+  *checked = changes;
+  return si;
+}
+
+static SpatialIndex *trw_layer_get_tracks_index ( VikTrwLayer *vtl )
+{
+  return trw_layer_index_update_tracks ( vtl->tracks_index, &vtl->tracks_index_dirty, &vtl->tracks_index_changes, vtl->tracks );
+}
+
+static SpatialIndex *trw_layer_get_routes_index ( VikTrwLayer *vtl )
+{
+  return trw_layer_index_update_tracks ( vtl->routes_index, &vtl->routes_index_dirty, &vtl->routes_index_changes, vtl->routes );
+}
+
+/**
+ * Waypoints are moved by simply changing the coordinate,
+ *  so the index is remade whenever trw_layer_calculate_bounds_waypoints() is called
+ */
+static SpatialIndex *trw_layer_get_waypoints_index ( VikTrwLayer *vtl )
+{
+  if ( vtl->waypoints_index_dirty ) {
+    spatial_index_clear ( vtl->waypoints_index );
+    g_hash_table_foreach ( vtl->waypoints, (GHFunc)trw_layer_index_add_waypoint, vtl->waypoints_index );
+    vtl->waypoints_index_dirty = FALSE;
+  }
+  return vtl->waypoints_index;
+}
+
+/**
+ * The furthest in pixels that anything drawn for a waypoint may reach from its position
+ */
+static gint trw_layer_waypoint_extent ( VikTrwLayer *vtl, gboolean labels )
+{
+  gint extent = MAX ( vtl->wp_size, vtl->wp_symbol_extent );
+  if ( vtl->drawimages )
+    // Including the highlight border
+    extent = MAX ( extent, vtl->image_size / 2 + 2 );
+  if ( labels && vtl->drawlabels )
+    extent = MAX ( extent, vtl->wp_label_extent );
+  return extent;
+}
+
+/**
+ * The area covered by the rectangle of the screen,
+ *  which may extend beyond the edges of the viewport
+ */
+static LatLonBBox trw_layer_screen_bbox ( VikViewport *vvp, gint x1, gint y1, gint x2, gint y2 )
+{
+  VikCoord corners[4];
+  vik_viewport_screen_to_coord ( vvp, x1, y1, &corners[0] );
+  vik_viewport_screen_to_coord ( vvp, x2, y1, &corners[1] );
+  vik_viewport_screen_to_coord ( vvp, x1, y2, &corners[2] );
+  vik_viewport_screen_to_coord ( vvp, x2, y2, &corners[3] );
+
+  LatLonBBox bbox;
+  for ( guint ii = 0; ii < G_N_ELEMENTS(corners); ii++ ) {
+    struct LatLon ll;
+    vik_coord_to_latlon ( &corners[ii], &ll );
+    if ( ii == 0 ) {
+      bbox.south = bbox.north = ll.lat;
+      bbox.east = bbox.west = ll.lon;
+    }
+    else {
+      bbox.south = MIN ( bbox.south, ll.lat );
+      bbox.north = MAX ( bbox.north, ll.lat );
+      bbox.east = MAX ( bbox.east, ll.lon );
+      bbox.west = MIN ( bbox.west, ll.lon );
+    }
+  }
+  return bbox;
+}
+
 static void init_drawing_params ( struct DrawingParams *dp, VikTrwLayer *vtl, VikViewport *vp, gboolean highlight )
 {
   dp->vtl = vtl;
@@ -2042,6 +2176,11 @@ static void init_drawing_params ( struct DrawingParams *dp, VikTrwLayer *vtl, Vi
   dp->one_zone = vik_viewport_is_one_zone ( vp ); /* false if some other projection besides UTM */
   dp->lat_lon = vik_viewport_get_coord_mode ( vp ) == VIK_COORD_LATLON;
 
+  // Waypoints just off screen may still have some of their image, label or proximity circle showing
+  gint wp_margin = trw_layer_waypoint_extent ( vtl, TRUE );
+  if ( vtl->wp_draw_proximity )
+    wp_margin = MAX ( wp_margin, dp->width / 2 );
+
   if ( dp->one_zone )
   {
     gint w2, h2;
@@ -2056,8 +2195,9 @@ static void init_drawing_params ( struct DrawingParams *dp, VikTrwLayer *vtl, Vi
     VikCoord upperleft, bottomright;
     /* quick & dirty calculation; really want to check all corners due to lat/lon smaller at top in northern hemisphere */
     /* this also DOESN'T WORK if you are crossing 180/-180 lon. I don't plan to in the near future...  */
-    vik_viewport_screen_to_coord ( vp, -500, -500, &upperleft );
-    vik_viewport_screen_to_coord ( vp, dp->width+500, dp->height+500, &bottomright );
+    gint lenience = MAX ( 500, wp_margin );
+    vik_viewport_screen_to_coord ( vp, -lenience, -lenience, &upperleft );
+    vik_viewport_screen_to_coord ( vp, dp->width+lenience, dp->height+lenience, &bottomright );
     dp->ce1 = upperleft.east_west;
     dp->ce2 = bottomright.east_west;
     dp->cn1 = bottomright.north_south;
@@ -2065,6 +2205,14 @@ static void init_drawing_params ( struct DrawingParams *dp, VikTrwLayer *vtl, Vi
   }
 
   dp->bbox = vik_viewport_get_bbox ( vp );
+  dp->wp_bbox = trw_layer_screen_bbox ( vp, -wp_margin, -wp_margin, dp->width+wp_margin, dp->height+wp_margin );
+
+  // Half a pixel about the centre
+  VikCoord c1, c2;
+  vik_viewport_screen_to_coord ( vp, dp->width/2, dp->height/2, &c1 );
+  vik_viewport_screen_to_coord ( vp, dp->width/2 + 1, dp->height/2, &c2 );
+  dp->tolerance = vik_coord_diff ( &c1, &c2 ) / 2;
+  dp->levels_todo = NULL;
 }
 
 /*
@@ -2422,13 +2570,55 @@ static void trw_layer_draw_point_names ( struct DrawingParams *dp, VikTrack *trk
   g_free ( bgcolour );
 }
 
+/**
+ * Lines of a track which join on to each other in the same colour,
+ *  gathered up to be drawn together by vik_viewport_draw_lines()
+ */
+typedef struct {
+  GArray *points; // Of GdkPoint
+  GdkGC *gc;
+  GdkColor color;
+  guint thickness;
+} TrackLineRun;
+
+static void track_line_run_flush ( TrackLineRun *run, VikViewport *vp )
+{
+  if ( run->points->len > 1 )
+    vik_viewport_draw_lines ( vp, run->gc, (GdkPoint*)run->points->data, run->points->len, &run->color, run->thickness );
+  g_array_set_size ( run->points, 0 );
+}
+
+/**
+ * Add the line to the run, first drawing the run so far when the line does not carry on from it
+ */
+static void track_line_run_add ( TrackLineRun *run, VikViewport *vp, GdkGC *gc, GdkColor *color, guint thickness, gint x1, gint y1, gint x2, gint y2 )
+{
+  if ( run->points->len ) {
+    GdkPoint *last = &g_array_index ( run->points, GdkPoint, run->points->len - 1 );
+    if ( gc != run->gc || thickness != run->thickness || !gdk_color_equal ( color, &run->color ) ||
+         last->x != x1 || last->y != y1 )
+      track_line_run_flush ( run, vp );
+  }
+  GdkPoint pt;
+  if ( !run->points->len ) {
+    run->gc = gc;
+    run->color = *color;
+    run->thickness = thickness;
+    pt.x = x1;
+    pt.y = y1;
+    g_array_append_val ( run->points, pt );
+  }
+  pt.x = x2;
+  pt.y = y2;
+  g_array_append_val ( run->points, pt );
+}
+
 static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct DrawingParams *dp, gboolean draw_track_outline )
 {
   if ( ! track->visible )
     return;
 
   /* TODO: this function is a mess, get rid of any redundancy */
-  GList *list = track->trackpoints;
   gboolean useoldvals = TRUE;
 
   gboolean drawpoints;
@@ -2495,11 +2685,24 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
     }
   }
 
-  if (list) {
+  // When zoomed out only a simplified version of the track need be drawn
+  VikTrackLevel level;
+  vik_track_get_level ( track, dp->tolerance, dp->vtl->stop_length, &level );
+  if ( !level.indices && dp->tolerance >= VIK_TRACK_LEVELS_MIN_TOLERANCE && track != dp->vtl->current_track ) {
+    VikTrackLevels *tl = vik_track_levels_new ( track, dp->vtl->stop_length );
+    if ( tl ) {
+      if ( !dp->levels_todo )
+        dp->levels_todo = g_ptr_array_new ();
+      g_ptr_array_add ( dp->levels_todo, tl );
+    }
+  }
+  VikTrackpoint *current_tp = dp->vtl->current_tpl ? VIK_TRACKPOINT(dp->vtl->current_tpl->data) : NULL;
+
+  if ( level.count ) {
     int x, y, oldx, oldy;
-    VikTrackpoint *tp = VIK_TRACKPOINT(list->data);
+    VikTrackpoint *tp = level.tps[0];
 
-    tp_size = (list == dp->vtl->current_tpl) ? tp_size_cur : tp_size_reg;
+    tp_size = (tp == current_tp) ? tp_size_cur : tp_size_reg;
 
     vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
 
@@ -2513,6 +2716,9 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
     oldx = x;
     oldy = y;
 
+    // Rather than stroking each line on its own
+    TrackLineRun run = { g_array_new ( FALSE, FALSE, sizeof(GdkPoint) ), NULL, { 0, 0, 0, 0 }, 0 };
+
     gdouble average_speed = 0.0;
     gdouble low_speed = 0.0;
     gdouble high_speed = 0.0;
@@ -2524,12 +2730,14 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
       high_speed = average_speed + (average_speed*(dp->vtl->track_draw_speed_factor/100.0));
     }
 
-    while ((list = g_list_next(list)))
+    for ( guint ii = 1; ii < level.count; ii++ )
     {
-      tp = VIK_TRACKPOINT(list->data);
-      tp_size = (list == dp->vtl->current_tpl) ? tp_size_cur : tp_size_reg;
+      tp = level.tps[ii];
+      tp_size = (tp == current_tp) ? tp_size_cur : tp_size_reg;
 
-      VikTrackpoint *tp2 = VIK_TRACKPOINT(list->prev->data);
+      VikTrackpoint *tp2 = level.tps[ii-1];
+      // Following point of the whole track, for the time stopped here
+      VikTrackpoint *tp_next = (ii+1 < level.count) ? level.whole[VIK_TRACK_LEVEL_INDEX(&level, ii)+1] : NULL;
       // See if in a different lat/lon 'quadrant' so don't draw massively long lines (presumably wrong way around the Earth)
       //  Mainly to prevent wrong lines drawn when a track crosses the 180 degrees East-West longitude boundary
       //  (since vik_viewport_draw_line() only copes with pixel value and has no concept of the globe)
@@ -2553,8 +2761,8 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 	if ( useoldvals && x == oldx && y == oldy )
 	{
 	  // Still need to process points to ensure 'stops' are drawn if required
-	  if ( drawstops && drawpoints && ! draw_track_outline && list->next &&
-	       (VIK_TRACKPOINT(list->next->data)->timestamp - VIK_TRACKPOINT(list->data)->timestamp > dp->vtl->stop_length) )
+	  if ( drawstops && drawpoints && ! draw_track_outline && tp_next &&
+	       (tp_next->timestamp - tp->timestamp > dp->vtl->stop_length) )
 	    vik_viewport_draw_arc ( dp->vp, g_array_index(dp->vtl->track_gc, GdkGC *, VIK_TRW_LAYER_TRACK_GC_STOP), TRUE, x-(3*tp_size), y-(3*tp_size), 6*tp_size, 6*tp_size, 0, 360*64, NULL );
 
 	  goto skip;
@@ -2574,7 +2782,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
         if ( drawpoints && ! draw_track_outline )
         {
 
-          if ( list->next ) {
+          if ( tp_next ) {
 	    /*
 	     * The concept of drawing stops is that a trackpoint
 	     * that is if the next trackpoint has a timestamp far into
@@ -2583,7 +2791,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 	     * This is drawn first so the trackpoint will be drawn on top
 	     */
             /* stops */
-            if ( drawstops && VIK_TRACKPOINT(list->next->data)->timestamp - VIK_TRACKPOINT(list->data)->timestamp > dp->vtl->stop_length )
+            if ( drawstops && tp_next->timestamp - tp->timestamp > dp->vtl->stop_length )
 	      /* Stop point.  Draw 6x circle. Always in redish colour */
               vik_viewport_draw_arc ( dp->vp, g_array_index(dp->vtl->track_gc, GdkGC *, VIK_TRW_LAYER_TRACK_GC_STOP), TRUE, x-(3*tp_size), y-(3*tp_size), 6*tp_size, 6*tp_size, 0, 360*64, NULL );
 
@@ -2606,22 +2814,24 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
             vik_viewport_coord_to_screen ( dp->vp, &(tp2->coord), &oldx, &oldy );
 
           if ( draw_track_outline ) {
-            vik_viewport_draw_line ( dp->vp, dp->vtl->track_bg_gc, oldx, oldy, x, y, &dp->vtl->track_bg_color, dp->vtl->line_thickness + dp->vtl->bg_line_thickness );
+            track_line_run_add ( &run, dp->vp, dp->vtl->track_bg_gc, &dp->vtl->track_bg_color, dp->vtl->line_thickness + dp->vtl->bg_line_thickness, oldx, oldy, x, y );
           }
           else {
 
-            vik_viewport_draw_line ( dp->vp, main_gc, oldx, oldy, x, y, &main_gcolor, lt );
+            track_line_run_add ( &run, dp->vp, main_gc, &main_gcolor, lt, oldx, oldy, x, y );
 
-            if ( dp->vtl->drawelevation && list->next && !isnan(VIK_TRACKPOINT(list->next->data)->altitude) ) {
+            if ( dp->vtl->drawelevation && ii+1 < level.count && !isnan(level.tps[ii+1]->altitude) ) {
+              // The elevation is drawn over the line
+              track_line_run_flush ( &run, dp->vp );
               GdkPoint tmp[4];
               #define FIXALTITUDE(what) ((VIK_TRACKPOINT((what))->altitude-min_alt)/alt_diff*DRAW_ELEVATION_FACTOR*dp->vtl->elevation_factor/dp->xmpp)
 
 	      tmp[0].x = oldx;
 	      tmp[0].y = oldy;
 	      tmp[1].x = oldx;
-	      tmp[1].y = oldy-FIXALTITUDE(list->data);
+	      tmp[1].y = oldy-FIXALTITUDE(tp);
 	      tmp[2].x = x;
-	      tmp[2].y = y-FIXALTITUDE(list->next->data);
+	      tmp[2].y = y-FIXALTITUDE(level.tps[ii+1]);
 	      tmp[3].x = x;
 	      tmp[3].y = y;
 
@@ -2643,7 +2853,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 #endif
 	      vik_viewport_draw_polygon ( dp->vp, tmp_gc, TRUE, tmp, 4, &gcl );
 
-              vik_viewport_draw_line ( dp->vp, main_gc, oldx, oldy-FIXALTITUDE(list->data), x, y-FIXALTITUDE(list->next->data), &gcl, lt );
+              vik_viewport_draw_line ( dp->vp, main_gc, oldx, oldy-FIXALTITUDE(tp), x, y-FIXALTITUDE(level.tps[ii+1]), &gcl, lt );
             }
           }
         }
@@ -2686,9 +2896,9 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 	    if ( x != oldx || y != oldy )
 	      {
 		if ( draw_track_outline )
-		  vik_viewport_draw_line ( dp->vp, dp->vtl->track_bg_gc, oldx, oldy, x, y, &dp->vtl->track_bg_color, dp->vtl->line_thickness + dp->vtl->bg_line_thickness );
+		  track_line_run_add ( &run, dp->vp, dp->vtl->track_bg_gc, &dp->vtl->track_bg_color, dp->vtl->line_thickness + dp->vtl->bg_line_thickness, oldx, oldy, x, y );
 		else
-		  vik_viewport_draw_line ( dp->vp, main_gc, oldx, oldy, x, y, &main_gcolor, lt );
+		  track_line_run_add ( &run, dp->vp, main_gc, &main_gcolor, lt, oldx, oldy, x, y );
 	      }
           }
           else 
@@ -2706,6 +2916,8 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
         useoldvals = FALSE;
       }
     }
+    track_line_run_flush ( &run, dp->vp );
+    g_array_free ( run.points, TRUE );
 
     // Labels drawn after the trackpoints, so the labels are on top
     if ( dp->vtl->track_draw_labels ) {
@@ -2835,7 +3047,10 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
 
     // Draw appropriate symbol - either symbol image or simple types
     if ( dp->vtl->wp_draw_symbols && wp->symbol && wp->symbol_pixbuf ) {
-      vik_viewport_draw_pixbuf ( dp->vp, wp->symbol_pixbuf, 0, 0, x - gdk_pixbuf_get_width(wp->symbol_pixbuf)/2, y - gdk_pixbuf_get_height(wp->symbol_pixbuf)/2, -1, -1 );
+      gint w = gdk_pixbuf_get_width ( wp->symbol_pixbuf );
+      gint h = gdk_pixbuf_get_height ( wp->symbol_pixbuf );
+      dp->vtl->wp_symbol_extent = MAX ( dp->vtl->wp_symbol_extent, MAX(w, h) / 2 + 1 );
+      vik_viewport_draw_pixbuf ( dp->vp, wp->symbol_pixbuf, 0, 0, x - w/2, y - h/2, -1, -1 );
     } 
     else if ( wp == dp->vtl->current_wp ) {
       switch ( dp->vtl->wp_symbol ) {
@@ -2886,6 +3101,7 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
         label_y = y - height - 2 - gdk_pixbuf_get_height(wp->symbol_pixbuf)/2;
       else
         label_y = y - dp->vtl->wp_size - height - 2;
+      dp->vtl->wp_label_extent = MAX ( dp->vtl->wp_label_extent, MAX(width/2, y - label_y) + 1 );
 
       /* if highlight mode on, then draw background text in highlight colour */
       if ( dp->highlight ) {
@@ -2926,6 +3142,81 @@ static void trw_layer_draw_waypoint_cb ( gpointer id, VikWaypoint *wp, struct Dr
   }
 }
 
+typedef struct {
+  GMutex *mutex;
+  VikTrwLayer *vtl; /* NULL if not alive */
+  GPtrArray *levels; // Of VikTrackLevels
+} levels_thread_data;
+
+static void levels_weak_ref_cb ( gpointer ptr, GObject *dead_vtl )
+{
+  levels_thread_data *ltd = (levels_thread_data*)ptr;
+  g_mutex_lock ( ltd->mutex );
+  ltd->vtl = NULL;
+  g_mutex_unlock ( ltd->mutex );
+}
+
+static int trw_layer_levels_thread ( levels_thread_data *ltd, gpointer threaddata )
+{
+  int res = 0;
+  for ( guint ii = 0; ii < ltd->levels->len; ii++ ) {
+    vik_track_levels_calculate ( g_ptr_array_index(ltd->levels, ii) );
+    if ( a_background_thread_progress ( threaddata, (gdouble)(ii+1) / ltd->levels->len ) ) {
+      res = -1; // Abort thread
+      break;
+    }
+  }
+
+  g_mutex_lock ( ltd->mutex );
+  if ( ltd->vtl ) {
+    g_object_weak_unref ( G_OBJECT(ltd->vtl), levels_weak_ref_cb, ltd );
+    // Redraw using the simplified tracks
+    if ( res == 0 )
+      vik_layer_emit_update ( VIK_LAYER(ltd->vtl), FALSE ); // NB update requested from background thread
+    ltd->vtl = NULL;
+  }
+  g_mutex_unlock ( ltd->mutex );
+  return res;
+}
+
+static void trw_layer_levels_thread_free ( levels_thread_data *ltd )
+{
+  // Any not calculated due to cancelling are left unused, until the track next changes
+  for ( guint ii = 0; ii < ltd->levels->len; ii++ )
+    vik_track_levels_unref ( g_ptr_array_index(ltd->levels, ii) );
+  g_ptr_array_free ( ltd->levels, TRUE );
+  vik_mutex_free ( ltd->mutex );
+  g_free ( ltd );
+}
+
+static void trw_layer_levels_thread_cancel ( levels_thread_data *ltd )
+{
+  // Nothing to do, as the thread only modifies its own data
+}
+
+/**
+ * Simplify any tracks found to need it whilst drawing, which will then be redrawn
+ */
+static void trw_layer_calculate_levels ( struct DrawingParams *dp )
+{
+  if ( !dp->levels_todo )
+    return;
+  levels_thread_data *ltd = g_malloc ( sizeof(levels_thread_data) );
+  ltd->mutex = vik_mutex_new ();
+  ltd->vtl = dp->vtl;
+  ltd->levels = dp->levels_todo;
+  dp->levels_todo = NULL;
+  g_object_weak_ref ( G_OBJECT(dp->vtl), levels_weak_ref_cb, ltd );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(dp->vtl),
+                        _("Simplifying Tracks"),
+                        (vik_thr_func) trw_layer_levels_thread,
+                        ltd,
+                        (vik_thr_free_func) trw_layer_levels_thread_free,
+                        (vik_thr_free_func) trw_layer_levels_thread_cancel,
+                        ltd->levels->len );
+}
+
 static void trw_layer_draw_with_highlight ( VikTrwLayer *l, VikViewport *vvp, gboolean highlight )
 {
   static struct DrawingParams dp;
@@ -2933,14 +3224,17 @@ static void trw_layer_draw_with_highlight ( VikTrwLayer *l, VikViewport *vvp, gb
 
   init_drawing_params ( &dp, l, vvp, highlight );
 
+  // Only items within the viewport are visited
   if ( l->tracks_visible )
-    g_hash_table_foreach ( l->tracks, (GHFunc) trw_layer_draw_track_cb, &dp );
+    (void)spatial_index_foreach_in_bbox ( trw_layer_get_tracks_index(l), dp.bbox, (GHFunc) trw_layer_draw_track_cb, &dp );
 
   if ( l->routes_visible )
-    g_hash_table_foreach ( l->routes, (GHFunc) trw_layer_draw_track_cb, &dp );
+    (void)spatial_index_foreach_in_bbox ( trw_layer_get_routes_index(l), dp.bbox, (GHFunc) trw_layer_draw_track_cb, &dp );
 
   if (l->waypoints_visible)
-    g_hash_table_foreach ( l->waypoints, (GHFunc) trw_layer_draw_waypoint_cb, &dp );
+    (void)spatial_index_foreach_in_bbox ( trw_layer_get_waypoints_index(l), dp.wp_bbox, (GHFunc) trw_layer_draw_waypoint_cb, &dp );
+
+  trw_layer_calculate_levels ( &dp );
 }
 
 static void trw_layer_draw ( VikTrwLayer *l, VikViewport *vvp )
@@ -2986,6 +3280,7 @@ void vik_trw_layer_draw_highlight_item ( VikTrwLayer *vtl, VikTrack *trk, VikWay
   if ( vtl->waypoints_visible && wpt ) {
     trw_layer_draw_waypoint_cb ( NULL, wpt, &dp );
   }
+  trw_layer_calculate_levels ( &dp );
 }
 
 #if GTK_CHECK_VERSION (3,0,0)
@@ -3065,6 +3360,8 @@ void vik_trw_layer_draw_highlight_items ( VikTrwLayer *vtl, GHashTable *trks, GH
 
   if ( vtl->waypoints_visible && wpts )
     g_hash_table_foreach ( wpts, (GHFunc) trw_layer_draw_waypoint_cb, &dp );
+
+  trw_layer_calculate_levels ( &dp );
 }
 
 
@@ -4060,16 +4357,31 @@ VikTrack *vik_trw_layer_get_route ( VikTrwLayer *vtl, const gchar *name )
   return g_hash_table_find ( vtl->routes, (GHRFunc) trw_layer_track_find, (gpointer) name );
 }
 
+static void trw_layer_find_maxmin_bbox ( const LatLonBBox *bbox, struct LatLon maxmin[2] )
+{
+  if ( bbox->north > maxmin[0].lat || maxmin[0].lat == 0.0 )
+    maxmin[0].lat = bbox->north;
+  if ( bbox->south < maxmin[1].lat || maxmin[1].lat == 0.0 )
+    maxmin[1].lat = bbox->south;
+  if ( bbox->east > maxmin[0].lon || maxmin[0].lon == 0.0 )
+    maxmin[0].lon = bbox->east;
+  if ( bbox->west < maxmin[1].lon || maxmin[1].lon == 0.0 )
+    maxmin[1].lon = bbox->west;
+}
+
 static void trw_layer_find_maxmin_tracks ( const gpointer id, const VikTrack *trk, struct LatLon maxmin[2] )
 {
-  if ( trk->bbox.north > maxmin[0].lat || maxmin[0].lat == 0.0 )
-    maxmin[0].lat = trk->bbox.north;
-  if ( trk->bbox.south < maxmin[1].lat || maxmin[1].lat == 0.0 )
-    maxmin[1].lat = trk->bbox.south;
-  if ( trk->bbox.east > maxmin[0].lon || maxmin[0].lon == 0.0 )
-    maxmin[0].lon = trk->bbox.east;
-  if ( trk->bbox.west < maxmin[1].lon || maxmin[1].lon == 0.0 )
-    maxmin[1].lon = trk->bbox.west;
+  trw_layer_find_maxmin_bbox ( &trk->bbox, maxmin );
+}
+
+/**
+ * Extend maxmin by the bounds of all the tracks or routes, as kept by the index
+ */
+static void trw_layer_find_maxmin_index ( SpatialIndex *si, struct LatLon maxmin[2] )
+{
+  LatLonBBox bbox;
+  if ( spatial_index_get_bbox ( si, &bbox ) )
+    trw_layer_find_maxmin_bbox ( &bbox, maxmin );
 }
 
 static void trw_layer_find_maxmin (VikTrwLayer *vtl, struct LatLon maxmin[2])
@@ -4080,8 +4392,8 @@ static void trw_layer_find_maxmin (VikTrwLayer *vtl, struct LatLon maxmin[2])
   maxmin[1].lat = vtl->waypoints_bbox.south;
   maxmin[0].lon = vtl->waypoints_bbox.east;
   maxmin[1].lon = vtl->waypoints_bbox.west;
-  g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_find_maxmin_tracks, maxmin );
-  g_hash_table_foreach ( vtl->routes, (GHFunc) trw_layer_find_maxmin_tracks, maxmin );
+  trw_layer_find_maxmin_index ( trw_layer_get_tracks_index(vtl), maxmin );
+  trw_layer_find_maxmin_index ( trw_layer_get_routes_index(vtl), maxmin );
 }
 
 LatLonBBox vik_trw_layer_get_bbox ( VikTrwLayer *vtl )
@@ -4695,7 +5007,7 @@ static void trw_layer_auto_routes_view ( menu_array_layer values )
 
   if ( g_hash_table_size (vtl->routes) > 0 ) {
     struct LatLon maxmin[2] = { {0,0}, {0,0} };
-    g_hash_table_foreach ( vtl->routes, (GHFunc) trw_layer_find_maxmin_tracks, maxmin );
+    trw_layer_find_maxmin_index ( trw_layer_get_routes_index(vtl), maxmin );
     trw_layer_zoom_to_show_latlons ( vtl, vik_layers_panel_get_viewport (vlp), maxmin );
     vik_layers_panel_emit_update ( vlp, FALSE );
   }
@@ -4743,7 +5055,7 @@ static void trw_layer_auto_tracks_view ( menu_array_layer values )
 
   if ( g_hash_table_size (vtl->tracks) > 0 ) {
     struct LatLon maxmin[2] = { {0,0}, {0,0} };
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_find_maxmin_tracks, maxmin );
+    trw_layer_find_maxmin_index ( trw_layer_get_tracks_index(vtl), maxmin );
     trw_layer_zoom_to_show_latlons ( vtl, vik_layers_panel_get_viewport (vlp), maxmin );
     vik_layers_panel_emit_update ( vlp, FALSE );
   }
@@ -5052,6 +5364,7 @@ void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp
 
   highest_wp_number_add_wp(vtl, wp->name);
   g_hash_table_insert ( vtl->waypoints, GUINT_TO_POINTER(wp_uuid), wp );
+  vtl->waypoints_index_dirty = TRUE;
 }
 
 // Fake Track UUIDs vi simple increasing integer
@@ -5091,6 +5404,7 @@ void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
   }
 
   g_hash_table_insert ( vtl->tracks, GUINT_TO_POINTER(tr_uuid), t );
+  vtl->tracks_index_dirty = TRUE;
 
   trw_layer_update_treeview ( vtl, t, FALSE );
 }
@@ -5125,6 +5439,7 @@ void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
   }
 
   g_hash_table_insert ( vtl->routes, GUINT_TO_POINTER(rt_uuid), t );
+  vtl->routes_index_dirty = TRUE;
 
   trw_layer_update_treeview ( vtl, t, FALSE );
 }
@@ -5404,6 +5719,7 @@ gboolean vik_trw_layer_delete_track ( VikTrwLayer *vtl, VikTrack *trk )
         vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, it );
         g_hash_table_remove ( vtl->tracks_iters, udata.uuid );
         g_hash_table_remove ( vtl->tracks, udata.uuid );
+        vtl->tracks_index_dirty = TRUE;
 
 	// If last sublayer, then remove sublayer container
 	if ( g_hash_table_size (vtl->tracks) == 0 ) {
@@ -5451,6 +5767,7 @@ gboolean vik_trw_layer_delete_route ( VikTrwLayer *vtl, VikTrack *trk )
         vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, it );
         g_hash_table_remove ( vtl->routes_iters, udata.uuid );
         g_hash_table_remove ( vtl->routes, udata.uuid );
+        vtl->routes_index_dirty = TRUE;
 
         // If last sublayer, then remove sublayer container
         if ( g_hash_table_size (vtl->routes) == 0 ) {
@@ -5476,6 +5793,7 @@ static void delete_waypoint_low_level ( VikTrwLayer *vtl, VikWaypoint *wp, gpoin
 
   highest_wp_number_remove_wp ( vtl, wp->name );
   g_hash_table_remove ( vtl->waypoints, uuid ); // last because this frees the name
+  vtl->waypoints_index_dirty = TRUE;
 }
 
 static gboolean trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp )
@@ -5620,6 +5938,7 @@ void vik_trw_layer_delete_all_routes ( VikTrwLayer *vtl )
   if ( g_hash_table_size (vtl->routes) > 0 )
     vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter) );
   g_hash_table_remove_all(vtl->routes);
+  vtl->routes_index_dirty = TRUE;
 
   close_graphs_of_specific_track_or_type ( vtl, NULL, VIK_TRW_LAYER_SUBLAYER_ROUTES );
   vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
@@ -5638,6 +5957,7 @@ void vik_trw_layer_delete_all_tracks ( VikTrwLayer *vtl )
   if ( g_hash_table_size (vtl->tracks) > 0 )
     vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter) );
   g_hash_table_remove_all(vtl->tracks);
+  vtl->tracks_index_dirty = TRUE;
 
   close_graphs_of_specific_track_or_type ( vtl, NULL, VIK_TRW_LAYER_SUBLAYER_TRACKS );
   vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
@@ -5663,6 +5983,7 @@ void vik_trw_layer_delete_all_waypoints ( VikTrwLayer *vtl )
   if ( g_hash_table_size (vtl->waypoints) > 0 )
     vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter) );
   g_hash_table_remove_all(vtl->waypoints);
+  vtl->waypoints_index_dirty = TRUE;
 
   vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
 }
@@ -6370,6 +6691,7 @@ static void trw_layer_rotate ( menu_array_sublayer values )
     seg = g_list_first ( track->trackpoints );
     tp = VIK_TRACKPOINT(seg->data);
     tp->newsegment = TRUE;
+    vik_track_changed ( track );
 
     vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
   }
@@ -7193,6 +7515,7 @@ static void trw_layer_merge_with_other ( menu_array_sublayer values )
         else
           vik_trw_layer_delete_track (vtl, merge_track);
         track->trackpoints = g_list_sort(track->trackpoints, trackpoint_compare);
+        vik_track_changed ( track );
       }
     }
     for (l = merge_list; l != NULL; l = g_list_next(l))
@@ -7486,6 +7809,7 @@ static void trw_layer_merge_by_timestamp ( menu_array_sublayer values )
     }
 
     orig_trk->trackpoints = g_list_sort(orig_trk->trackpoints, trackpoint_compare);
+    vik_track_changed ( orig_trk );
   }
 
   g_list_free(nearby_tracks);
@@ -7506,6 +7830,7 @@ static void trw_layer_split_create_segments ( menu_array_sublayer values )
   if ( vtl->current_tpl && vtl->current_tp_track && !vtl->current_tp_track->is_route ) {
     if ( vtl->current_tpl->next && vtl->current_tpl->prev ) {
         VIK_TRACKPOINT(vtl->current_tpl->data)->newsegment = TRUE;
+        vik_track_changed ( vtl->current_tp_track );
         vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
     }
   }
@@ -7800,6 +8125,7 @@ static void trw_layer_trackpoint_selected_delete ( VikTrwLayer *vtl, VikTrack *t
     // Delete current trackpoint
     vik_trackpoint_free ( vtl->current_tpl->data );
     trk->trackpoints = g_list_delete_link ( trk->trackpoints, vtl->current_tpl );
+    vik_track_changed ( trk );
     trw_layer_cancel_current_tp ( vtl, FALSE );
   }
 }
@@ -9797,6 +10123,7 @@ static void trw_layer_insert_tp_beside_current_tp ( VikTrwLayer *vtl, gboolean b
         index = index + 1;
       // NB no recalculation of bounds since it is inserted between points
       trk->trackpoints = g_list_insert ( trk->trackpoints, tp_new, index );
+      vik_track_changed ( trk );
     }
   }
 
@@ -9898,6 +10225,8 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
     }
   }
   else if ( response == VIK_TRW_LAYER_TPWIN_DATA_CHANGED ) {
+    if ( vtl->current_tp_track )
+      vik_track_changed ( vtl->current_tp_track );
     vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
   }
 }
@@ -10101,36 +10430,68 @@ static void waypoint_search_closest_tp ( gpointer id, VikWaypoint *wp, WPSearchP
     }
 }
 
+/**
+ * Only the points in the runs of the track within reach of the position are considered
+ */
 static void track_search_closest_tp ( gpointer id, VikTrack *t, TPSearchParams *params )
 {
-  GList *tpl = t->trackpoints;
-  VikTrackpoint *tp;
-
   if ( !t->visible )
     return;
 
   if ( ! BBOX_INTERSECT ( t->bbox, params->bbox ) )
     return;
 
-  while (tpl)
-  {
-    gint x, y;
-    tp = VIK_TRACKPOINT(tpl->data);
+  const VikTrackColumns *tc = vik_track_get_columns ( t );
+  guint n_runs;
+  const LatLonBBox *runs = vik_track_get_runs ( t, &n_runs );
+  gint closest = -1;
 
-    vik_viewport_coord_to_screen ( params->vvp, &(tp->coord), &x, &y );
+  for ( guint rr = 0; rr < n_runs; rr++ ) {
+    if ( ! BBOX_INTERSECT ( runs[rr], params->bbox ) )
+      continue;
+    guint last = MIN ( (rr+1) * VIK_TRACK_RUN_POINTS, tc->count );
+    for ( guint ii = rr * VIK_TRACK_RUN_POINTS; ii < last; ii++ ) {
+      gint x, y;
+      vik_viewport_coord_to_screen ( params->vvp, &tc->coords[ii], &x, &y );
 
-    if ( abs (x - params->x) <= params->size && abs (y - params->y) <= params->size &&
-        ((!params->closest_tp) ||        /* was the old trackpoint we already found closer than this one? */
-          abs(x - params->x)+abs(y - params->y) < abs(x - params->closest_x)+abs(y - params->closest_y)))
-    {
-      params->closest_track_id = id;
-      params->closest_tp = tp;
-      params->closest_tpl = tpl;
-      params->closest_x = x;
-      params->closest_y = y;
+      if ( abs (x - params->x) <= params->size && abs (y - params->y) <= params->size &&
+          ((!params->closest_tp) ||        /* was the old trackpoint we already found closer than this one? */
+            abs(x - params->x)+abs(y - params->y) < abs(x - params->closest_x)+abs(y - params->closest_y)))
+      {
+        params->closest_track_id = id;
+        params->closest_tp = tc->tps[ii];
+        params->closest_x = x;
+        params->closest_y = y;
+        closest = ii;
+      }
     }
-    tpl = tpl->next;
   }
+
+  // The list position is only needed for the closest point
+  if ( closest >= 0 )
+    params->closest_tpl = g_list_nth ( t->trackpoints, closest );
+}
+
+/**
+ * Search only the tracks (or routes) whose bounds are within reach of the position
+ */
+static void trw_layer_search_closest_tp ( VikTrwLayer *vtl, gboolean routes, TPSearchParams *params )
+{
+  gint slack = params->size + 1;
+  LatLonBBox bbox = trw_layer_screen_bbox ( params->vvp, params->x - slack, params->y - slack, params->x + slack, params->y + slack );
+  SpatialIndex *si = routes ? trw_layer_get_routes_index ( vtl ) : trw_layer_get_tracks_index ( vtl );
+  (void)spatial_index_foreach_in_bbox ( si, bbox, (GHFunc) track_search_closest_tp, params );
+}
+
+/**
+ * Search only the waypoints within reach of the position,
+ *  allowing for the size of any images or symbols
+ */
+static void trw_layer_search_closest_wp ( VikTrwLayer *vtl, WPSearchParams *params )
+{
+  gint slack = MAX ( params->size, trw_layer_waypoint_extent ( vtl, FALSE ) ) + 1;
+  LatLonBBox bbox = trw_layer_screen_bbox ( params->vvp, params->x - slack, params->y - slack, params->x + slack, params->y + slack );
+  (void)spatial_index_foreach_in_bbox ( trw_layer_get_waypoints_index(vtl), bbox, (GHFunc) waypoint_search_closest_tp, params );
 }
 
 // ATM: Leave this as 'Track' only.
@@ -10145,7 +10506,7 @@ static VikTrackpoint *closest_tp_in_interval ( VikTrwLayer *vtl, VikViewport *vv
   params.closest_track_id = NULL;
   params.closest_tp = NULL;
   params.bbox = vik_viewport_get_bbox ( params.vvp );
-  g_hash_table_foreach ( vtl->tracks, (GHFunc) track_search_closest_tp, &params);
+  trw_layer_search_closest_tp ( vtl, FALSE, &params );
   return params.closest_tp;
 }
 
@@ -10160,7 +10521,7 @@ static VikWaypoint *closest_wp_in_interval ( VikTrwLayer *vtl, VikViewport *vvp,
   params.draw_symbols = vtl->wp_draw_symbols;
   params.closest_wp = NULL;
   params.closest_wp_id = NULL;
-  g_hash_table_foreach ( vtl->waypoints, (GHFunc) waypoint_search_closest_tp, &params);
+  trw_layer_search_closest_wp ( vtl, &params );
   return params.closest_wp;
 }
 
@@ -10301,7 +10662,7 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
     wp_params.closest_wp_id = NULL;
     wp_params.closest_wp = NULL;
 
-    g_hash_table_foreach ( vtl->waypoints, (GHFunc) waypoint_search_closest_tp, &wp_params);
+    trw_layer_search_closest_wp ( vtl, &wp_params );
 
     if ( wp_params.closest_wp )  {
 
@@ -10356,7 +10717,7 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
   tp_params.bbox = bbox;
 
   if (vtl->tracks_visible) {
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) track_search_closest_tp, &tp_params);
+    trw_layer_search_closest_tp ( vtl, FALSE, &tp_params );
 
     if ( tp_params.closest_tp )  {
 
@@ -10392,7 +10753,7 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
 
   // Try again for routes
   if (vtl->routes_visible) {
-    g_hash_table_foreach ( vtl->routes, (GHFunc) track_search_closest_tp, &tp_params);
+    trw_layer_search_closest_tp ( vtl, TRUE, &tp_params );
 
     if ( tp_params.closest_tp )  {
 
@@ -10645,7 +11006,7 @@ static VikLayerToolFuncStatus tool_edit_waypoint_click ( VikTrwLayer *vtl, GdkEv
   params.draw_symbols = vtl->wp_draw_symbols;
   params.closest_wp_id = NULL;
   params.closest_wp = NULL;
-  g_hash_table_foreach ( vtl->waypoints, (GHFunc) waypoint_search_closest_tp, &params);
+  trw_layer_search_closest_wp ( vtl, &params );
   if ( vtl->current_wp && (vtl->current_wp == params.closest_wp) )
   {
     if ( event->button == 3 )
@@ -11009,7 +11370,7 @@ static void update_statusbar ( VikTrwLayer *vtl )
 static gboolean tool_select_tp ( VikTrwLayer *vtl, TPSearchParams *params, gboolean search_tracks, gboolean search_routes )
 {
   if ( vtl->tracks_visible && search_tracks )
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) track_search_closest_tp, params);
+    trw_layer_search_closest_tp ( vtl, FALSE, params );
 
   if ( params->closest_tp )
   {
@@ -11024,7 +11385,7 @@ static gboolean tool_select_tp ( VikTrwLayer *vtl, TPSearchParams *params, gbool
   }
 
   if ( vtl->routes_visible && search_routes )
-    g_hash_table_foreach ( vtl->routes, (GHFunc) track_search_closest_tp, params);
+    trw_layer_search_closest_tp ( vtl, TRUE, params );
 
   if ( params->closest_tp )
   {
@@ -11423,9 +11784,9 @@ static VikLayerToolFuncStatus tool_edit_track_or_route_click ( VikTrwLayer *vtl,
   tp->newsegment = newsegment;
 
   if ( vtl->current_track ) {
-    vik_track_add_trackpoint ( vtl->current_track, tp, TRUE ); // Ensure bounds is updated
     /* Auto attempt to get elevation from DEM data (if it's available) */
     (void)vik_trackpoint_apply_dem_data ( tp );
+    vik_track_add_trackpoint ( vtl->current_track, tp, TRUE ); // Ensure bounds is updated
     if ( trw_layer_modified(vtl) )
       vik_window_set_modified ( (VikWindow *)(VIK_GTK_WINDOW_FROM_LAYER(vtl)) );
   }
@@ -12157,6 +12518,8 @@ static void trw_layer_track_alloc_colors ( VikTrwLayer *vtl )
  */
 void trw_layer_calculate_bounds_waypoints ( VikTrwLayer *vtl )
 {
+  vtl->waypoints_index_dirty = TRUE;
+
   struct LatLon topleft = { 0.0, 0.0 };
   struct LatLon bottomright = { 0.0, 0.0 };
   struct LatLon ll;
@@ -1259,6 +1259,22 @@ static void track_graph_leave ( GtkWidget *event_box, GdkEventMotion *event, Pro
   vik_trw_layer_trackpoint_draw ( widgets->vtl, widgets->vvp, NULL, NULL );
 }
 
+/**
+ * Returns: A newly allocated array of the DEM elevation at each trackpoint
+ */
+static gint16 *get_dem_elevations ( GList *trackpoints, VikDemInterpol method )
+{
+  guint count = g_list_length ( trackpoints );
+  VikCoord *coords = g_new ( VikCoord, count );
+  guint ii = 0;
+  for ( GList *iter = trackpoints; iter; iter = iter->next )
+    coords[ii++] = VIK_TRACKPOINT(iter->data)->coord;
+  gint16 *elevs = g_new ( gint16, count );
+  (void)a_dems_get_elev_by_coords ( coords, count, method, elevs );
+  g_free ( coords );
+  return elevs;
+}
+
 /**
  * Draws DEM points and a respresentative speed on the supplied pixmap
  *  Pixmap x axis should be distance based
@@ -1300,7 +1316,13 @@ static void draw_dem_alt_speed_dist ( VikTrack *tr,
   cairo_set_line_width ( cr, GRAPH_OVERLAY_LINE_WIDTH * vik_viewport_get_scale(vvp) );
 #endif
 
-  for (iter = tr->trackpoints; iter; iter = iter->next) {
+  // Look up all the DEM values in one go
+  gint16 *dem_elevs = NULL;
+  if ( do_dem )
+    dem_elevs = get_dem_elevations ( tr->trackpoints, a_dems_get_track_interpol(VIK_DEM_INTERPOL_BEST) );
+  guint tp_index = 0;
+
+  for (iter = tr->trackpoints; iter; iter = iter->next, tp_index++) {
     if (iter->prev) {
       dist += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) );
     }
@@ -1310,7 +1332,7 @@ static void draw_dem_alt_speed_dist ( VikTrack *tr,
     int y_alt, y_speed;
 
     if (do_dem) {
-      gint16 elev = a_dems_get_elev_by_coord(&(VIK_TRACKPOINT(iter->data)->coord), VIK_DEM_INTERPOL_BEST);
+      gint16 elev = dem_elevs[tp_index];
       if ( elev != VIK_DEM_INVALID_ELEVATION ) {
 	// Convert into height units
 	if (a_vik_get_units_height () == VIK_UNITS_HEIGHT_FEET)
@@ -1375,6 +1397,7 @@ static void draw_dem_alt_speed_dist ( VikTrack *tr,
       }
     }
   }
+  g_free ( dem_elevs );
 #if GTK_CHECK_VERSION (3,0,0)
   cairo_stroke ( cr );
 #endif
@@ -2403,11 +2426,25 @@ static void draw_dem_by_time ( PropWidgets *widgets, GtkWidget *window, GdkPixma
   if ( achunk == 0 )
     return;
 
+  // Find the trackpoints, so the DEM values can be looked up in one go
+  VikTrackpoint **tps = g_new ( VikTrackpoint*, widgets->profile_width );
+  VikCoord *coords = g_new ( VikCoord, widgets->profile_width );
+  guint count = 0;
   for ( guint i = 0; i < widgets->profile_width; i++ ) {
     // This could be slow doing this each time...
-    VikTrackpoint *tp = vik_track_get_closest_tp_by_percentage_time ( widgets->tr, ((gdouble)i/(gdouble)widgets->profile_width), NULL );
+    tps[i] = vik_track_get_closest_tp_by_percentage_time ( widgets->tr, ((gdouble)i/(gdouble)widgets->profile_width), NULL );
+    if ( tps[i] )
+      coords[count++] = tps[i]->coord;
+  }
+  gint16 *elevs = g_new ( gint16, count );
+  (void)a_dems_get_elev_by_coords ( coords, count, a_dems_get_track_interpol(VIK_DEM_INTERPOL_SIMPLE), elevs );
+  g_free ( coords );
+  count = 0;
+
+  for ( guint i = 0; i < widgets->profile_width; i++ ) {
+    VikTrackpoint *tp = tps[i];
     if ( tp ) {
-      gint16 elev = a_dems_get_elev_by_coord(&(tp->coord), VIK_DEM_INTERPOL_SIMPLE);
+      gint16 elev = elevs[count++];
       if ( elev != VIK_DEM_INVALID_ELEVATION ) {
 	// Convert into height units
 	if ( a_vik_get_units_height () == VIK_UNITS_HEIGHT_FEET )
@@ -2442,6 +2479,8 @@ static void draw_dem_by_time ( PropWidgets *widgets, GtkWidget *window, GdkPixma
 #endif
     }
   }
+  g_free ( elevs );
+  g_free ( tps );
 #if GTK_CHECK_VERSION (3,0,0)
   cairo_stroke ( cr );
 #else
@@ -126,8 +126,20 @@ struct _VikViewport {
   GdkPixmap *snapshot_buffer;
 #endif
   gboolean half_drawn;
+
+  guint cache_generation; // Unique to this viewport, changed to make every VikViewportCache out of date
 };
 
+/**
+ * Generations are never shared between viewports,
+ *  so a cache drawn in one viewport is never painted in another
+ */
+static guint viewport_cache_generation_new ( void )
+{
+  static guint generations = 0;
+  return ++generations;
+}
+
 static gdouble
 viewport_utm_zone_width ( VikViewport *vvp )
 {
@@ -226,6 +238,8 @@ vik_viewport_init ( VikViewport *vvp )
 {
   viewport_init_ra();
 
+  vvp->cache_generation = viewport_cache_generation_new ();
+
   struct UTM utm;
   struct LatLon ll;
   ll.lat = a_vik_get_default_lat();
@@ -1610,6 +1624,119 @@ void vik_viewport_draw_line ( VikViewport *vvp, GdkGC *gc, gint x1, gint y1, gin
   }
 }
 
+/**
+ * Whether the line between the points is entirely off one side of the viewport,
+ *  otherwise the line is set clipped as vik_viewport_draw_line()
+ */
+static gboolean viewport_clip_segment ( VikViewport *vvp, const GdkPoint *p1, const GdkPoint *p2, gint *x1, gint *y1, gint *x2, gint *y2 )
+{
+  *x1 = p1->x; *y1 = p1->y;
+  *x2 = p2->x; *y2 = p2->y;
+  if ( ( *x1 < 0 && *x2 < 0 ) || ( *y1 < 0 && *y2 < 0 ) ||
+       ( *x1 > vvp->width && *x2 > vvp->width ) || ( *y1 > vvp->height && *y2 > vvp->height ) )
+    return TRUE;
+  a_viewport_clip_line ( x1, y1, x2, y2 );
+  return FALSE;
+}
+
+/**
+ * vik_viewport_draw_lines:
+ * @points:  The positions to join together in turn
+ * @npoints: Number of positions
+ *
+ * Draw a polyline all in the same color and thickness.
+ *
+ * For GTK3 this builds a single path and so strokes it once,
+ *  rather than the per line overhead of vik_viewport_draw_line().
+ * Lines entirely off the viewport are skipped and the others are clipped, as vik_viewport_draw_line().
+ */
+void vik_viewport_draw_lines ( VikViewport *vvp, GdkGC *gc, GdkPoint *points, gint npoints, GdkColor *gcolor, guint thickness )
+{
+  gint x1, y1, x2, y2;
+  // Whether the path so far ends at the previous position
+  gboolean joined = FALSE;
+
+  if ( npoints < 2 )
+    return;
+
+#if GTK_CHECK_VERSION (3,0,0)
+  cairo_set_line_width ( gc, thickness );
+  if ( gcolor )
+    gdk_cairo_set_source_color ( gc, gcolor );
+  gboolean drawn = FALSE;
+  for ( gint nn = 1; nn < npoints; nn++ ) {
+    if ( viewport_clip_segment ( vvp, &points[nn-1], &points[nn], &x1, &y1, &x2, &y2 ) ) {
+      joined = FALSE;
+      continue;
+    }
+    if ( !joined || x1 != points[nn-1].x || y1 != points[nn-1].y )
+      cairo_move_to ( gc, x1-0.5, y1-0.5 );
+    cairo_line_to ( gc, x2-0.5, y2-0.5 );
+    joined = ( x2 == points[nn].x && y2 == points[nn].y );
+    drawn = TRUE;
+  }
+  if ( drawn )
+    cairo_stroke ( gc );
+#else
+  // A run of positions can not be longer than all of them
+  GdkPoint *run = g_new ( GdkPoint, npoints );
+  gint count = 0;
+  for ( gint nn = 1; nn < npoints; nn++ ) {
+    if ( viewport_clip_segment ( vvp, &points[nn-1], &points[nn], &x1, &y1, &x2, &y2 ) ) {
+      joined = FALSE;
+      continue;
+    }
+    if ( !joined || x1 != points[nn-1].x || y1 != points[nn-1].y ) {
+      if ( count > 1 )
+        gdk_draw_lines ( vvp->scr_buffer, gc, run, count );
+      run[0].x = x1;
+      run[0].y = y1;
+      count = 1;
+    }
+    run[count].x = x2;
+    run[count].y = y2;
+    count++;
+    joined = ( x2 == points[nn].x && y2 == points[nn].y );
+  }
+  if ( count > 1 )
+    gdk_draw_lines ( vvp->scr_buffer, gc, run, count );
+  g_free ( run );
+#endif
+}
+
+/**
+ * vik_viewport_draw_segments:
+ * @points:  Pairs of positions, the start and end of each line
+ * @npoints: Number of positions (i.e. twice the number of lines)
+ *
+ * Draw separate lines all in the same color and thickness,
+ *  for GTK3 as a single path in the same way as vik_viewport_draw_lines().
+ */
+void vik_viewport_draw_segments ( VikViewport *vvp, GdkGC *gc, GdkPoint *points, gint npoints, GdkColor *gcolor, guint thickness )
+{
+  gint x1, y1, x2, y2;
+#if GTK_CHECK_VERSION (3,0,0)
+  cairo_set_line_width ( gc, thickness );
+  if ( gcolor )
+    gdk_cairo_set_source_color ( gc, gcolor );
+  gboolean drawn = FALSE;
+  for ( gint nn = 1; nn < npoints; nn += 2 ) {
+    if ( viewport_clip_segment ( vvp, &points[nn-1], &points[nn], &x1, &y1, &x2, &y2 ) )
+      continue;
+    ui_cr_draw_line ( gc, x1-0.5, y1-0.5, x2-0.5, y2-0.5 );
+    drawn = TRUE;
+  }
+  if ( drawn )
+    cairo_stroke ( gc );
+#else
+  for ( gint nn = 1; nn < npoints; nn += 2 ) {
+    if ( viewport_clip_segment ( vvp, &points[nn-1], &points[nn], &x1, &y1, &x2, &y2 ) )
+      continue;
+    gdk_draw_line ( vvp->scr_buffer, gc, x1, y1, x2, y2 );
+  }
+#endif
+}
+
 /**
  * For GTK3 Need to pass in the color each time
  */
@@ -1879,6 +2006,137 @@ gboolean vik_viewport_get_half_drawn( VikViewport *vp )
   return vp->half_drawn;
 }
 
+/******** caching *******/
+struct _VikViewportCache {
+  cairo_pattern_t *pattern;
+  gint changes;       // Counts the invalidations, which may come from any thread
+  gint drawn_changes; // The value of changes when the pattern was started
+  guint generation;   // Of the viewport drawn in, which identifies it
+  // The view the pattern was drawn for
+  VikCoord center;
+  gdouble xmpp, ympp;
+  gint width, height;
+  VikViewportDrawMode drawmode;
+};
+
+VikViewportCache *vik_viewport_cache_new ()
+{
+  VikViewportCache *cache = g_malloc0 ( sizeof(VikViewportCache) );
+  // Out of date until drawn
+  cache->changes = 1;
+  return cache;
+}
+
+void vik_viewport_cache_free ( VikViewportCache *cache )
+{
+  if ( !cache )
+    return;
+  vik_viewport_cache_clear ( cache );
+  g_free ( cache );
+}
+
+/**
+ * vik_viewport_cache_clear:
+ *
+ * Release the cached image, e.g. whilst it is not going to be drawn,
+ *  keeping the cache itself for use again.
+ * Only from the main thread, as drawing is.
+ */
+void vik_viewport_cache_clear ( VikViewportCache *cache )
+{
+  if ( cache->pattern )
+    cairo_pattern_destroy ( cache->pattern );
+  cache->pattern = NULL;
+}
+
+/**
+ * vik_viewport_cache_invalidate:
+ *
+ * The cached image is no longer what would be drawn.
+ * This may be called from a background thread.
+ */
+void vik_viewport_cache_invalidate ( VikViewportCache *cache )
+{
+  g_atomic_int_inc ( &cache->changes );
+}
+
+/**
+ * vik_viewport_cache_invalidate_all:
+ *
+ * Nothing drawn so far in this viewport may be reused.
+ */
+void vik_viewport_cache_invalidate_all ( VikViewport *vp )
+{
+  vp->cache_generation = viewport_cache_generation_new ();
+}
+
+/**
+ * vik_viewport_cache_paint:
+ *
+ * Draw the cached image when it is still valid for the current view,
+ *  i.e. it was drawn in this viewport, it has not been invalidated
+ *  and the viewport has not moved, zoomed or resized since.
+ * Only available for GTK3, where everything is drawn via the one cairo context.
+ *
+ * Returns: TRUE if drawn, otherwise start again with vik_viewport_cache_begin()
+ */
+gboolean vik_viewport_cache_paint ( VikViewport *vp, VikViewportCache *cache )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( !cache->pattern ||
+       cache->drawn_changes != g_atomic_int_get ( &cache->changes ) ||
+       cache->generation != vp->cache_generation ||
+       cache->xmpp != vp->xmpp || cache->ympp != vp->ympp ||
+       cache->width != vp->width || cache->height != vp->height ||
+       cache->drawmode != vp->drawmode ||
+       !vik_coord_equals ( &cache->center, &vp->center ) )
+    return FALSE;
+  cairo_set_source ( vp->crt, cache->pattern );
+  cairo_paint ( vp->crt );
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/**
+ * vik_viewport_cache_begin:
+ *
+ * Whatever is drawn from now on goes into the cache rather than the viewport,
+ *  until vik_viewport_cache_end()
+ */
+void vik_viewport_cache_begin ( VikViewport *vp, VikViewportCache *cache )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  cache->drawn_changes = g_atomic_int_get ( &cache->changes );
+  // NB All GCs are references to this cairo context, so their drawing is redirected too
+  cairo_push_group ( vp->crt );
+#endif
+}
+
+/**
+ * vik_viewport_cache_end:
+ *
+ * Keep what has been drawn since vik_viewport_cache_begin() and draw it in the viewport
+ */
+void vik_viewport_cache_end ( VikViewport *vp, VikViewportCache *cache )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( cache->pattern )
+    cairo_pattern_destroy ( cache->pattern );
+  cache->pattern = cairo_pop_group ( vp->crt );
+  cache->generation = vp->cache_generation;
+  cache->center = vp->center;
+  cache->xmpp = vp->xmpp;
+  cache->ympp = vp->ympp;
+  cache->width = vp->width;
+  cache->height = vp->height;
+  cache->drawmode = vp->drawmode;
+  cairo_set_source ( vp->crt, cache->pattern );
+  cairo_paint ( vp->crt );
+#endif
+}
+
 
 const gchar *vik_viewport_get_drawmode_name(VikViewport *vv, VikViewportDrawMode mode)
  {
@@ -126,6 +126,17 @@ void vik_viewport_snapshot_load ( VikViewport *vp );
 void vik_viewport_set_half_drawn(VikViewport *vp, gboolean half_drawn);
 gboolean vik_viewport_get_half_drawn( VikViewport *vp );
 
+/* Caching of what has been drawn, e.g. of each layer */
+typedef struct _VikViewportCache VikViewportCache;
+VikViewportCache *vik_viewport_cache_new ();
+void vik_viewport_cache_free ( VikViewportCache *cache );
+void vik_viewport_cache_clear ( VikViewportCache *cache );
+void vik_viewport_cache_invalidate ( VikViewportCache *cache );
+void vik_viewport_cache_invalidate_all ( VikViewport *vp );
+gboolean vik_viewport_cache_paint ( VikViewport *vp, VikViewportCache *cache );
+void vik_viewport_cache_begin ( VikViewport *vp, VikViewportCache *cache );
+void vik_viewport_cache_end ( VikViewport *vp, VikViewportCache *cache );
+
 
 /***************************************************************************************************
  *  Drawing-related operations 
@@ -185,6 +196,8 @@ void vik_viewport_set_highlight_thickness ( VikViewport *vvp, gint thickness );
 void a_viewport_clip_line ( gint *x1, gint *y1, gint *x2, gint *y2 ); /* run this before drawing a line. vik_viewport_draw_line runs it for you */
 
 void vik_viewport_draw_line ( VikViewport *vvp, GdkGC *gc, gint x1, gint y1, gint x2, gint y2, GdkColor *gcolor, guint thickness );
+void vik_viewport_draw_lines ( VikViewport *vvp, GdkGC *gc, GdkPoint *points, gint npoints, GdkColor *gcolor, guint thickness );
+void vik_viewport_draw_segments ( VikViewport *vvp, GdkGC *gc, GdkPoint *points, gint npoints, GdkColor *gcolor, guint thickness );
 void vik_viewport_draw_rectangle ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x1, gint y1, gint x2, gint y2, GdkColor *gcolor );
 void vik_viewport_draw_arc ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x, gint y, gint width, gint height, gint angle1, gint angle2, GdkColor *gcolor );
 void vik_viewport_draw_polygon ( VikViewport *vvp, GdkGC *gc, gboolean filled, GdkPoint *points, gint npoints, GdkColor *gcolor );
@@ -1906,6 +1906,10 @@ static void draw_redraw ( VikWindow *vw )
   else
     old_trigger = VIK_LAYER(gp);
 
+  if ( ! new_trigger || new_trigger->type == VIK_LAYER_AGGREGATE )
+    /* have to redraw everything. */
+    vik_viewport_cache_invalidate_all ( vw->viking_vvp );
+
   if ( ! new_trigger )
     ; /* do nothing -- have to redraw everything. */
   else if ( (old_trigger != new_trigger) || !vik_coord_equals(&old_center, &vw->trigger_center) || (new_trigger->type == VIK_LAYER_AGGREGATE) )
@@ -6761,9 +6765,20 @@ gpointer vik_window_get_selected_trw_layer ( VikWindow *vw )
   return vw->selected_vtl;
 }
 
+/**
+ * The selected TRW layer is not drawn with the others (see trw_layer_draw()),
+ *  so on any change nothing previously drawn is valid
+ */
+static void window_set_selected_vtl ( VikWindow *vw, gpointer vtl )
+{
+  if ( vw->selected_vtl != vtl )
+    vik_viewport_cache_invalidate_all ( vw->viking_vvp );
+  vw->selected_vtl = vtl;
+}
+
 void vik_window_set_selected_trw_layer ( VikWindow *vw, gpointer vtl )
 {
-  vw->selected_vtl   = vtl;
+  window_set_selected_vtl ( vw, vtl );
   vw->containing_vtl = vtl;
   /* Clear others */
   vw->selected_track     = NULL;
@@ -6789,7 +6804,7 @@ void vik_window_set_selected_tracks ( VikWindow *vw, GHashTable *ght, gpointer v
   vw->selected_tracks = ght;
   vw->containing_vtl  = vtl;
   /* Clear others */
-  vw->selected_vtl       = NULL;
+  window_set_selected_vtl ( vw, NULL );
   vw->selected_track     = NULL;
   vw->selected_waypoint  = NULL;
   vw->selected_waypoints = NULL;
@@ -6810,7 +6825,7 @@ void vik_window_set_selected_track ( VikWindow *vw, VikTrack *vt, gpointer vtl )
     vik_layers_panel_track_add ( vw->viking_vlp, vt, vtl );
   vw->containing_vtl = vtl;
   /* Clear others */
-  vw->selected_vtl       = NULL;
+  window_set_selected_vtl ( vw, NULL );
   vw->selected_tracks    = NULL;
   vw->selected_waypoint  = NULL;
   vw->selected_waypoints = NULL;
@@ -6828,7 +6843,7 @@ void vik_window_set_selected_waypoints ( VikWindow *vw, GHashTable *ght, gpointe
   vw->selected_waypoints = ght;
   vw->containing_vtl     = vtl;
   /* Clear others */
-  vw->selected_vtl       = NULL;
+  window_set_selected_vtl ( vw, NULL );
   vw->selected_track     = NULL;
   vw->selected_tracks    = NULL;
   vw->selected_waypoint  = NULL;
@@ -6845,7 +6860,7 @@ void vik_window_set_selected_waypoint ( VikWindow *vw, gpointer *vwp, gpointer v
   vw->selected_waypoint = vwp;
   vw->containing_vtl    = vtl;
   /* Clear others */
-  vw->selected_vtl       = NULL;
+  window_set_selected_vtl ( vw, NULL );
   vw->selected_track     = NULL;
   vw->selected_tracks    = NULL;
   vw->selected_waypoints = NULL;
@@ -6861,7 +6876,7 @@ gboolean vik_window_clear_selected ( VikWindow *vw )
   gboolean need_redraw = FALSE;
   vw->containing_vtl = NULL;
   if ( vw->selected_vtl != NULL ) {
-    vw->selected_vtl = NULL;
+    window_set_selected_vtl ( vw, NULL );
     vik_layers_panel_track_remove ( vw->viking_vlp );
     need_redraw = TRUE;
   }
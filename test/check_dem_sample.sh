@@ -0,0 +1,49 @@
+#!/bin/sh
+# Copyright: CC0
+
+PROG=./test_dem_sample
+
+check_success ()
+{
+    value=$1
+    expected=$2
+    result=$($PROG $value)
+    if [ "$result" != "$expected" ]; then
+      echo "$value: $result != $expected"
+      exit 1
+    fi
+}
+
+check_failure ()
+{
+    result=$($PROG $1)
+    if [ "$?" = "0" ]; then
+      echo "Program unexpectedly succeeded: with $result"
+      exit 1
+    fi
+}
+
+# Elevations of 'lat lon' positions on the plane 2*column + 3*row
+#  in the order: batch bilinear, single bilinear, simple and shepard
+check_success "51.5 -1.5" "3000 3000 3000 3000"
+check_success "51.25 -1.75" "1500 1500 1500 1500"
+check_success "51.5005 -1.4995" "3003 3003 3002 3003"
+check_success "51.5012 -1.4993" "3006 3006 3005 3005"
+check_success "51 -2" "0 0 0 0"
+# The north east corner has no neighbours for simple or shepard
+check_success "52 -1" "6000 6000 -32768 -32768"
+check_success "50.5 -1.5" "-32768 -32768 -32768 -32768"
+
+# A grid over the whole DEM for batch against single bilinear and the plane itself
+check_success "compare 100" "10201 positions 10201 found 0 differ"
+
+# Mean of the overview 'level column row'
+check_success "overview 1 0 0" "2"
+check_success "overview 3 100 200" "809"
+check_success "overview 7 0 0" "317"
+# Partial blocks at the edges
+check_success "overview 6 1200 1200" "5907"
+check_success "overview 6 1199 37" "2457"
+
+check_failure "overview 0 0 0"
+check_failure ""
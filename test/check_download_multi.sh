@@ -0,0 +1,51 @@
+#!/bin/sh
+# Copyright: CC0
+# Run the concurrent download test against a local stand-in HTTP server
+if ! command -v python3 > /dev/null 2>&1; then
+    echo "Skipping download test as python3 is not available"
+    exit 0
+fi
+
+dir=$(mktemp -d)
+mkdir -p "$dir/www" "$dir/out"
+count=24
+i=0
+while [ $i -lt $count ]; do
+    head -c $((1000 + i * 100)) /dev/urandom > "$dir/www/$i.png"
+    i=$((i + 1))
+done
+
+# Serve on any free port, which is written into the port file
+python3 -c '
+import http.server, os, sys
+os.chdir(sys.argv[1])
+class Handler(http.server.SimpleHTTPRequestHandler):
+    def log_message(self, *args):
+        pass
+server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), Handler)
+with open(sys.argv[2] + ".tmp", "w") as f:
+    f.write(str(server.server_address[1]))
+os.rename(sys.argv[2] + ".tmp", sys.argv[2])
+server.serve_forever()
+' "$dir/www" "$dir/port" &
+server=$!
+
+tries=0
+while [ ! -f "$dir/port" ] && [ $tries -lt 50 ]; do
+    sleep 0.1
+    tries=$((tries + 1))
+done
+if [ ! -f "$dir/port" ]; then
+    echo "Skipping download test as the local server did not start"
+    kill $server 2> /dev/null
+    rm -rf "$dir"
+    exit 0
+fi
+
+# Keep any viking configuration files out of the way
+HOME="$dir" ./test_download_multi "http://127.0.0.1:$(cat "$dir/port")" "$dir/www" "$dir/out" $count
+result=$?
+
+kill $server
+rm -rf "$dir"
+exit $result
@@ -0,0 +1,29 @@
+#!/bin/sh
+# Copyright: CC0
+
+PROG=./test_heat_pyramid
+
+check_success ()
+{
+    value=$1
+    expected=$2
+    result=$($PROG $value)
+    if [ "$result" != "$expected" ]; then
+      echo "$value: $result != $expected"
+      exit 1
+    fi
+}
+
+# A wander of a number of points, checked at every zoom level against a plain array of the heat:
+#  output is the chunks and highest heat of the whole, and of what is left after taking away the first half
+check_success "compare 1" "7 chunks 1 max, 7 chunks 1 max left 0 differ"
+check_success "compare 1000" "47 chunks 5 max, 32 chunks 5 max left 0 differ"
+check_success "compare 200000" "796 chunks 27 max, 530 chunks 17 max left 0 differ"
+
+# Beyond the maximum zoom level by a number of levels, the heat is in the middle of the pixels it covers
+check_success "beyond 0" "0,0 3 1 heated"
+check_success "beyond 1" "1,1 3 1 heated"
+check_success "beyond 3" "4,4 3 1 heated"
+
+# Outside the world is ignored
+check_success "outside" "0 chunks"
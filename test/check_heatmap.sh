@@ -0,0 +1,31 @@
+#!/bin/sh
+# Copyright: CC0
+
+PROG=./test_heatmap
+
+check_success ()
+{
+    value=$1
+    expected=$2
+    result=$($PROG $value)
+    if [ "$result" != "$expected" ]; then
+      echo "$value: $result != $expected"
+      exit 1
+    fi
+}
+
+# A number of points stamped with a radius, checked against plain loops:
+#  output is the number of pixels with any heat and the number that differ
+check_success "stamp 1 12" "517 heated 0 differ"
+# In the corners, so most of the stamps are cut off
+check_success "stamp 2 12" "284 heated 0 differ"
+check_success "stamp 1000 12" "362725 heated 0 differ"
+check_success "stamp 200000 12" "701701 heated 0 differ"
+check_success "stamp 5000 3" "190423 heated 0 differ"
+check_success "stamp 5000 40" "701701 heated 0 differ"
+
+# Rendered with the saturation as the highest heat divided by a number, checked against plain loops:
+#  output is the number of pixels that are saturated and the number that differ
+check_success "render 1000 1" "1 saturated 0 differ"
+check_success "render 200000 3" "700547 saturated 0 differ"
+check_success "render 5000 10" "513349 saturated 0 differ"
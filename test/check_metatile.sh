@@ -6,8 +6,7 @@ if [ $(echo -n I | od -to2 | awk '{ print substr($2,6,1); exit}') != 1 ]; then
     exit 0
 fi
 
-if [ -n "$srcdir" ]; then
-  ./test_metatile "$srcdir/metatile_example" && rm tilefrommeta.png
-else
-  ./test_metatile && rm tilefrommeta.png
+if [ -z "$srcdir" ]; then
+  srcdir=.
 fi
+./test_metatile "$srcdir/metatile_example" "$srcdir/metatile_example_gz" && rm tilefrommeta.png
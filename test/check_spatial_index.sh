@@ -0,0 +1,24 @@
+#!/bin/sh
+# Copyright: CC0
+
+PROG=./test_spatial_index
+
+check_success ()
+{
+    value=$1
+    expected=$2
+    result=$($PROG $value)
+    if [ "$result" != "$expected" ]; then
+      echo "$value: $result != $expected"
+      exit 1
+    fi
+}
+
+# 'items queries' over a square degree, with the items found by the index checked against testing every item
+check_success "compare 1 10" "10 queries 0 found 0 differ"
+# Less than a single node
+check_success "compare 17 50" "50 queries 1 found 0 differ"
+check_success "compare 5000 200" "200 queries 3883 found 0 differ"
+check_success "compare 100000 100" "100 queries 38283 found 0 differ"
+# After moving some of the items
+check_success "changed 5000 200" "500 changed, 200 queries 3902 found 0 differ"
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Copyright: CC0
+
+PROG=./test_tile_bitmap
+
+check_success ()
+{
+    value=$1
+    expected=$2
+    result=$($PROG $value)
+    if [ "$result" != "$expected" ]; then
+      echo "$value: $result != $expected"
+      exit 1
+    fi
+}
+
+# A filled square of tiles from a corner, of a size:
+#  output is the number of tiles, the extents and the number of interior tiles
+check_success "square 0 0 0" "empty"
+check_success "square 0 0 1" "1 0,0 0,0 0"
+# Either side of zero
+check_success "square -3 -3 6" "36 -3,-3 2,2 16"
+# Across chunk borders
+check_success "square 60 60 8" "64 60,60 67,67 36"
+check_success "square -70 10 200" "40000 -70,10 129,209 39204"
+
+# A wander of a number of steps either side of zero, checked against a hash table of the tiles
+# The tiles, the interior tiles and those not in the first half of the wander
+check_success "compare 1" "1 tiles 0 interior 1 difference 0 differ"
+check_success "compare 1000" "358 tiles 94 interior 151 difference 0 differ"
+check_success "compare 200000" "57874 tiles 22879 interior 28759 difference 0 differ"
+
+# Iterating visits each tile after its neighbours to the west and north
+check_success "order 1000" "358 visited 0 differ"
+check_success "order 200000" "57874 visited 0 differ"
+
+# Counting the first half and the whole by labels, then taking away the whole
+check_success "labels 1000" "358 counted 207 left 0 differ"
+check_success "labels 200000" "57874 counted 29115 left 0 differ"
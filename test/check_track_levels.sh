@@ -0,0 +1,36 @@
+#!/bin/sh
+# Copyright: CC0
+
+PROG=./test_track_levels
+
+check_success ()
+{
+    value=$1
+    expected=$2
+    result=$($PROG $value)
+    if [ "$result" != "$expected" ]; then
+      echo "$value: $result != $expected"
+      exit 1
+    fi
+}
+
+# Simplified levels of a winding track of a few metres between points,
+#  with a stop of five minutes every 97 points and a new segment every 1000 points
+# Output is the number of levels and the points of the most simplified,
+#  then the points left out beyond the tolerance of a level,
+#  the ends of segments and stops left out, and the points not in the less simplified level
+
+# Too few points to need simplifying
+check_success "levels 100 60" "none"
+
+check_success "levels 600 60" "3 levels 8 kept 0 stray 0 missing 0 unnested"
+check_success "levels 5000 60" "3 levels 62 kept 0 stray 0 missing 0 unnested"
+check_success "levels 20000 60" "3 levels 247 kept 0 stray 0 missing 0 unnested"
+
+# Longer than any of the stops
+check_success "levels 5000 600" "4 levels 11 kept 0 stray 0 missing 0 unnested"
+
+# Points of the most simplified level when the stop length changes:
+#  then all the points are given until the levels are made again
+check_success "restop 5000 60 600" "62 5000 11"
+check_success "restop 5000 600 60" "11 5000 62"
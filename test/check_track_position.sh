@@ -0,0 +1,55 @@
+#!/bin/sh
+# Copyright: CC0
+
+PROG=./test_track_position
+
+check_success ()
+{
+    value=$1
+    expected=$2
+    result=$($PROG $value)
+    if [ "$result" != "$expected" ]; then
+      echo "$value: $result != $expected"
+      exit 1
+    fi
+}
+
+# Positions along a line of eleven points about 111.3m apart, 10 seconds apart
+#  except for a stop of 100 seconds before the new segment at point 6
+# Output is the index of the point found and its metres or seconds from the start
+
+# Nearest point by the fraction of the whole distance, including the gap between segments
+check_success "dist 0" "0 0.0"
+check_success "dist 0.27" "3 334.0"
+check_success "dist 0.5" "5 556.6"
+check_success "dist 0.6" "6 667.9"
+check_success "dist 1" "10 1113.2"
+
+# Nearest point by the fraction of the whole time
+check_success "time 0" "0 0.0"
+check_success "time 0.1" "2 20.0"
+check_success "time 0.5" "5 50.0"
+check_success "time 0.8" "6 150.0"
+check_success "time 1" "10 190.0"
+
+# Points either side of a distance
+check_success "next 0" "1 111.3"
+check_success "prev 0" "0 0.0"
+check_success "next 150" "2 222.6"
+check_success "prev 150" "1 111.3"
+check_success "next 300" "3 334.0"
+check_success "prev 300" "2 222.6"
+check_success "next 1200" "none"
+check_success "prev 1200" "none"
+
+# Length to a point, excluding the gap between segments
+check_success "length 0" "0 0.0"
+check_success "length 5" "5 556.6"
+check_success "length 6" "6 556.6"
+check_success "length 10" "10 1001.9"
+
+# A point added later is found, along with its length
+check_success "added 50" "11 240.0 1113.2"
+
+# Many positions along a long track against walking the points from the start
+check_success "compare 20000" "1503 queries 0 differ"
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Copyright: CC0
+
+PROG=./test_track_stats
+
+check_success ()
+{
+    value=$1
+    expected=$2
+    result=$($PROG $value)
+    if [ "$result" != "$expected" ]; then
+      echo "$value: $result != $expected"
+      exit 1
+    fi
+}
+
+# Points of 'lat,lon,altitude,timestamp' along a meridian, about 111.3m apart
+#  with a new segment started by the '/' and a stop in the last segment
+TRACK="51.000,-1.0,100,0 51.001,-1.0,110,10 51.002,-1.0,105,20 / 51.003,-1.0,120,100 51.004,-1.0,130,200"
+
+# Output order: length, length including gaps, duration, average speed, moving average speed, maximum speed,
+#  minimum altitude, maximum altitude, elevation gain up, elevation gain down
+check_success "stats $TRACK" "334.0 445.3 120 2.78 11.13 11.13 100 130 35 5"
+# The last point moved later and higher after the values were calculated
+check_success "changed $TRACK" "334.0 445.3 220 1.52 11.13 11.13 100 230 135 5"
+
+# Average elevation of each quarter of the distance
+check_success "map 51.000,-1.0,100,0 51.001,-1.0,110,10 51.002,-1.0,120,20 51.003,-1.0,130,30 51.004,-1.0,140,40" "105.0 115.0 125.0 135.0"
+# Across a gap between segments
+check_success "map $TRACK" "105.0 107.5 112.5 125.0"
+
+# Length to each point (not counting the gap between segments), then to a point not in the track
+check_success "to $TRACK" "0.0 111.3 222.6 222.6 334.0 334.0"
+# Similarly when the times are not in order
+check_success "to 51.000,-1.0,100,50 51.001,-1.0,110,10 51.002,-1.0,105,20" "0.0 111.3 222.6 222.6"
@@ -0,0 +1,159 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Elevations from a DEM of a sloping plane, as given by the various interpolation methods
+//  Also with --benchmark <count> to compare the speed of vik_dem_sample_batch() with looking up each position individually
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include "dem.h"
+
+#define NUM_ROWS 1201
+
+// A 3 arcsecond DEM covering N51 W002, with a sloping plane for its surface
+//  so bilinear interpolation should give exact values
+static VikDEM *dem_new_plane ( void )
+{
+  VikDEM *dem = g_malloc0 ( sizeof(VikDEM) );
+  dem->horiz_units = VIK_DEM_HORIZ_LL_ARCSECONDS;
+  dem->orig_vert_units = VIK_DEM_VERT_METERS;
+  dem->east_scale = dem->north_scale = 3.0;
+  dem->min_east = -2 * 3600;
+  dem->min_north = 51 * 3600;
+  dem->max_east = dem->min_east + 3600;
+  dem->max_north = dem->min_north + 3600;
+  dem->n_columns = dem->n_rows = NUM_ROWS;
+
+  gint16 *points = g_malloc ( sizeof(gint16) * NUM_ROWS * NUM_ROWS );
+  for ( guint row = 0; row < NUM_ROWS; row++ )
+    for ( guint col = 0; col < NUM_ROWS; col++ )
+      // Rows are from the north
+      points[(NUM_ROWS - 1 - row) * NUM_ROWS + col] = 2 * col + 3 * row;
+  dem->points = points;
+  return dem;
+}
+
+/**
+ * Print the elevation of the position from each method:
+ *  batch bilinear, single bilinear, simple and shepard
+ */
+static void print_elevations ( VikDEM *dem, gdouble lat, gdouble lon )
+{
+  gint16 batch;
+  (void)vik_dem_sample_batch ( dem, &lat, &lon, 1, &batch );
+  printf ( "%d %d %d %d\n", batch,
+           vik_dem_get_bilinear_interpol ( dem, lon * 3600, lat * 3600 ),
+           vik_dem_get_simple_interpol ( dem, lon * 3600, lat * 3600 ),
+           vik_dem_get_shepard_interpol ( dem, lon * 3600, lat * 3600 ) );
+}
+
+/**
+ * Batch elevations over a grid of positions across the DEM,
+ *  against single position bilinear interpolation and the plane itself
+ */
+static void print_comparison ( VikDEM *dem, guint steps )
+{
+  guint count = (steps + 1) * (steps + 1);
+  gdouble *lats = g_new ( gdouble, count );
+  gdouble *lons = g_new ( gdouble, count );
+  gint16 *elevs = g_new ( gint16, count );
+  for ( guint ii = 0; ii < count; ii++ ) {
+    lats[ii] = 51.0 + (gdouble)(ii / (steps + 1)) / steps;
+    lons[ii] = -2.0 + (gdouble)(ii % (steps + 1)) / steps;
+  }
+  guint found = vik_dem_sample_batch ( dem, lats, lons, count, elevs );
+
+  guint differ = 0;
+  for ( guint ii = 0; ii < count; ii++ ) {
+    gdouble gx = (lons[ii] * 3600 - dem->min_east) / dem->east_scale;
+    gdouble gy = (lats[ii] * 3600 - dem->min_north) / dem->north_scale;
+    gint16 expected = floor ( 2 * gx + 3 * gy + 0.5 );
+    gint16 single = vik_dem_get_bilinear_interpol ( dem, lons[ii] * 3600, lats[ii] * 3600 );
+    if ( abs(elevs[ii] - expected) > 1 || elevs[ii] != single )
+      differ++;
+  }
+  printf ( "%u positions %u found %u differ\n", count, found, differ );
+  g_free ( elevs );
+  g_free ( lons );
+  g_free ( lats );
+}
+
+/**
+ * Print the mean of the overview block at the level
+ *  covering the sample column and row (from the south west)
+ */
+static int print_overview ( VikDEM *dem, guint level, guint col, guint row )
+{
+  if ( !vik_dem_get_overview ( dem, level ) )
+    return 1;
+  printf ( "%d\n", vik_dem_get_xy_level ( dem, level, col, row ) );
+  return 0;
+}
+
+static void benchmark ( VikDEM *dem, guint count )
+{
+  gdouble *lats = g_new ( gdouble, count );
+  gdouble *lons = g_new ( gdouble, count );
+  gint16 *elevs = g_new ( gint16, count );
+  GRand *rand = g_rand_new_with_seed ( 42 );
+  for ( guint ii = 0; ii < count; ii++ ) {
+    lats[ii] = g_rand_double_range ( rand, 51.0, 52.0 );
+    lons[ii] = g_rand_double_range ( rand, -2.0, -1.0 );
+  }
+  g_rand_free ( rand );
+
+  gint64 tt1 = g_get_monotonic_time ();
+  (void)vik_dem_sample_batch ( dem, lats, lons, count, elevs );
+  gint64 tt2 = g_get_monotonic_time ();
+  for ( guint ii = 0; ii < count; ii++ )
+    elevs[ii] = vik_dem_get_shepard_interpol ( dem, lons[ii] * 3600, lats[ii] * 3600 );
+  gint64 tt3 = g_get_monotonic_time ();
+
+  printf ( "%u positions: batch %.3fs, individually %.3fs\n", count,
+           (gdouble)(tt2 - tt1) / G_USEC_PER_SEC, (gdouble)(tt3 - tt2) / G_USEC_PER_SEC );
+  g_free ( elevs );
+  g_free ( lons );
+  g_free ( lats );
+}
+
+int main ( int argc, char *argv[] )
+{
+  if ( argc < 2 ) {
+    fprintf ( stderr, "Usage: %s <lat> <lon> | compare <steps> | overview <level> <col> <row> | --benchmark <count>\n", argv[0] );
+    return 1;
+  }
+
+  VikDEM *dem = dem_new_plane ();
+  int result = 0;
+
+  if ( !strcmp ( argv[1], "--benchmark" ) && argc == 3 )
+    benchmark ( dem, atoi ( argv[2] ) );
+  else if ( !strcmp ( argv[1], "compare" ) && argc == 3 )
+    print_comparison ( dem, atoi ( argv[2] ) );
+  else if ( !strcmp ( argv[1], "overview" ) && argc == 5 )
+    result = print_overview ( dem, atoi ( argv[2] ), atoi ( argv[3] ), atoi ( argv[4] ) );
+  else if ( argc == 3 )
+    print_elevations ( dem, g_ascii_strtod ( argv[1], NULL ), g_ascii_strtod ( argv[2], NULL ) );
+  else
+    result = 1;
+
+  vik_dem_free ( dem );
+  return result;
+}
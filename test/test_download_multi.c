@@ -0,0 +1,153 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Download files concurrently from a (local) HTTP server
+// run like: ./test_download_multi http://127.0.0.1:8000 <served directory> <output directory> <number of files>
+//  The served directory should contain files named 0.png, 1.png, ... etc...
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "download.h"
+#include "curl_download.h"
+#include "preferences.h"
+#include "settings.h"
+
+static gint results[DOWNLOAD_NOT_REQUIRED+1-DOWNLOAD_PARAMETERS_ERROR];
+static guint completed = 0;
+
+static void done_cb ( DownloadResult_t result, gpointer user_data )
+{
+	results[result-DOWNLOAD_PARAMETERS_ERROR]++;
+	completed++;
+}
+
+static DownloadFileOptions *new_options ( void )
+{
+	DownloadFileOptions *options = g_malloc0 ( sizeof(DownloadFileOptions) );
+	// Always check with the server for an existing file
+	options->check_file_server_time = TRUE;
+	options->expiry_age = 0;
+	return options;
+}
+
+/**
+ * Returns the number of files downloaded successfully
+ */
+static guint download_all ( const gchar *url, const gchar *outdir, guint count, guint max_transfers, guint interval_ms )
+{
+	memset ( results, 0, sizeof(results) );
+	completed = 0;
+
+	void *multi = a_download_multi_init ( max_transfers, interval_ms );
+	for ( guint ii = 0; ii < count; ii++ ) {
+		gchar *uri = g_strdup_printf ( "/%d.png", ii );
+		gchar *fn = g_strdup_printf ( "%s%c%d.png", outdir, G_DIR_SEPARATOR, ii );
+		a_http_download_get_url_multi ( url, uri, fn, new_options(), multi, done_cb, NULL );
+		g_free ( fn );
+		g_free ( uri );
+	}
+	while ( a_download_multi_perform ( multi, 100 ) > 0 )
+		;
+	a_download_multi_cleanup ( multi );
+
+	if ( completed != count )
+		fprintf ( stderr, "Only %d of %d downloads completed\n", completed, count );
+	return results[DOWNLOAD_SUCCESS-DOWNLOAD_PARAMETERS_ERROR];
+}
+
+static gboolean compare_files ( const gchar *srcdir, const gchar *outdir, guint count )
+{
+	for ( guint ii = 0; ii < count; ii++ ) {
+		gchar *src = g_strdup_printf ( "%s%c%d.png", srcdir, G_DIR_SEPARATOR, ii );
+		gchar *out = g_strdup_printf ( "%s%c%d.png", outdir, G_DIR_SEPARATOR, ii );
+		gchar *src_data = NULL, *out_data = NULL;
+		gsize src_len = 0, out_len = 0;
+		gboolean same = g_file_get_contents ( src, &src_data, &src_len, NULL ) &&
+		                g_file_get_contents ( out, &out_data, &out_len, NULL ) &&
+		                src_len == out_len && memcmp ( src_data, out_data, src_len ) == 0;
+		if ( !same )
+			fprintf ( stderr, "Downloaded file %s differs from %s\n", out, src );
+		g_free ( src_data );
+		g_free ( out_data );
+		g_free ( out );
+		g_free ( src );
+		if ( !same )
+			return FALSE;
+	}
+	return TRUE;
+}
+
+int main ( int argc, char *argv[] )
+{
+	if ( argc != 5 )
+		return 1;
+
+	const gchar *url = argv[1];
+	const gchar *srcdir = argv[2];
+	const gchar *outdir = argv[3];
+	guint count = atoi ( argv[4] );
+
+	a_settings_init ();
+	// Preferences must be initialized as it gets auto used
+	a_preferences_init ();
+	a_download_init ();
+	curl_download_init ();
+
+	int ans = 0;
+
+	// New files
+	guint got = download_all ( url, outdir, count, 0, 0 );
+	if ( got != count || !compare_files ( srcdir, outdir, count ) ) {
+		fprintf ( stderr, "Initial download failed: %d of %d\n", got, count );
+		ans = 1;
+	}
+
+	// Existing files - the server should say they are not modified (If-Modified-Since)
+	//  and with a politeness limit
+	if ( !ans ) {
+		got = download_all ( url, outdir, count, 2, 10 );
+		if ( got != count || !compare_files ( srcdir, outdir, count ) ) {
+			fprintf ( stderr, "Repeat download failed: %d of %d\n", got, count );
+			ans = 1;
+		}
+	}
+
+	// Missing files are errors
+	if ( !ans ) {
+		memset ( results, 0, sizeof(results) );
+		completed = 0;
+		void *multi = a_download_multi_init ( 0, 0 );
+		gchar *fn = g_strdup_printf ( "%s%cmissing.png", outdir, G_DIR_SEPARATOR );
+		a_http_download_get_url_multi ( url, "/missing.png", fn, new_options(), multi, done_cb, NULL );
+		while ( a_download_multi_perform ( multi, 100 ) > 0 )
+			;
+		a_download_multi_cleanup ( multi );
+		if ( completed != 1 || results[DOWNLOAD_HTTP_ERROR-DOWNLOAD_PARAMETERS_ERROR] != 1 ||
+		     g_file_test ( fn, G_FILE_TEST_EXISTS ) ) {
+			fprintf ( stderr, "Missing file download not handled\n" );
+			ans = 1;
+		}
+		g_free ( fn );
+	}
+
+	curl_download_uninit ();
+	a_download_uninit ();
+	a_preferences_uninit ();
+
+	return ans;
+}
@@ -0,0 +1,203 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Check the heat pyramid against a plain array of the heat at the maximum zoom level
+//  Also with --benchmark <count> to time adding the heat
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "heatpyramid.h"
+
+#define MAX_ZOOM 6
+// The area the points are put in, crossing chunk and tile borders
+#define ORIGIN 1000
+#define AREA 400
+
+static guint32 expected[AREA*AREA];
+
+/**
+ * A wander around the area, the same each time,
+ *  mostly in small steps so some pixels get a lot of heat
+ */
+static void wander_step ( guint32 *seed, gint *x, gint *y )
+{
+  *seed = *seed * 1103515245 + 12345;
+  *x = CLAMP ( *x + (gint)((*seed >> 16) % 5) - 2, 0, AREA-1 );
+  *seed = *seed * 1103515245 + 12345;
+  *y = CLAMP ( *y + (gint)((*seed >> 16) % 5) - 2, 0, AREA-1 );
+}
+
+/**
+ * The heat of the pixel at the zoom level, from the pixels at the maximum zoom level within it
+ */
+static guint32 expected_heat ( guint zoom, gint x, gint y )
+{
+  guint shift = MAX_ZOOM - zoom;
+  guint32 sum = 0;
+  for ( gint yy = y << shift; yy < (y+1) << shift; yy++ )
+    for ( gint xx = x << shift; xx < (x+1) << shift; xx++ )
+      if ( xx >= ORIGIN && xx < ORIGIN+AREA && yy >= ORIGIN && yy < ORIGIN+AREA )
+        sum += expected[(yy-ORIGIN)*AREA + (xx-ORIGIN)];
+  return sum;
+}
+
+/**
+ * Compare every pixel (and a border around them) and the highest heat at each zoom level
+ *
+ * Returns: The number of differences
+ */
+static guint compare ( HeatPyramid *hp )
+{
+  guint differ = 0;
+  for ( guint zz = 0; zz <= MAX_ZOOM; zz++ ) {
+    guint shift = MAX_ZOOM - zz;
+    gint x1 = (ORIGIN >> shift) - 2;
+    gint x2 = ((ORIGIN+AREA) >> shift) + 2;
+    guint ww = x2 - x1;
+    guint32 *values = g_malloc ( ww * ww * sizeof(guint32) );
+    (void)heat_pyramid_read ( hp, zz, x1, x1, ww, ww, values );
+    guint32 max = 0;
+    for ( guint yy = 0; yy < ww; yy++ ) {
+      for ( guint xx = 0; xx < ww; xx++ ) {
+        guint32 heat = expected_heat ( zz, x1+xx, x1+yy );
+        max = MAX ( max, heat );
+        if ( values[yy*ww+xx] != heat )
+          differ++;
+      }
+    }
+    if ( heat_pyramid_get_max(hp, zz) != max )
+      differ++;
+    g_free ( values );
+  }
+  return differ;
+}
+
+/**
+ * Add the wander into one pyramid and the first half of it into another,
+ *  then merge the whole into a shared pyramid and take away the first half again
+ */
+static void print_compare ( guint count )
+{
+  HeatPyramid *hp = heat_pyramid_new ( MAX_ZOOM );
+  HeatPyramid *first = heat_pyramid_new ( MAX_ZOOM );
+  HeatPyramid *shared = heat_pyramid_new ( MAX_ZOOM );
+  guint32 seed = 1;
+  gint x = AREA/2, y = AREA/2;
+  for ( guint ii = 0; ii < count; ii++ ) {
+    wander_step ( &seed, &x, &y );
+    heat_pyramid_add ( hp, ORIGIN+x, ORIGIN+y, 1 );
+    expected[y*AREA + x]++;
+    if ( ii < count / 2 )
+      heat_pyramid_add ( first, ORIGIN+x, ORIGIN+y, 1 );
+  }
+  guint differ = compare ( hp );
+  heat_pyramid_merge ( shared, hp );
+  differ += compare ( shared );
+  guint chunks = heat_pyramid_size ( shared );
+  guint32 max = heat_pyramid_get_max ( shared, MAX_ZOOM );
+
+  heat_pyramid_subtract ( shared, first );
+  seed = 1;
+  x = AREA/2;
+  y = AREA/2;
+  for ( guint ii = 0; ii < count / 2; ii++ ) {
+    wander_step ( &seed, &x, &y );
+    expected[y*AREA + x]--;
+  }
+  differ += compare ( shared );
+
+  printf ( "%u chunks %u max, %u chunks %u max left %u differ\n", chunks, max,
+           heat_pyramid_size(shared), heat_pyramid_get_max(shared, MAX_ZOOM), differ );
+  heat_pyramid_unref ( shared );
+  heat_pyramid_unref ( first );
+  heat_pyramid_unref ( hp );
+}
+
+/**
+ * Beyond the maximum zoom level the heat of a pixel is in the middle of the pixels it covers:
+ *  output is the number of those with heat, and where (from the north west corner) and how much
+ */
+static void print_beyond ( guint dz )
+{
+  HeatPyramid *hp = heat_pyramid_new ( MAX_ZOOM );
+  gint px = ORIGIN + AREA/2;
+  heat_pyramid_add ( hp, px, px, 3 );
+  guint step = 1 << dz;
+  guint32 *values = g_malloc ( step * step * sizeof(guint32) );
+  if ( heat_pyramid_read ( hp, MAX_ZOOM+dz, px*step, px*step, step, step, values ) ) {
+    guint heated = 0;
+    for ( guint ii = 0; ii < step*step; ii++ ) {
+      if ( values[ii] ) {
+        if ( !heated )
+          printf ( "%u,%u %u ", ii % step, ii / step, values[ii] );
+        heated++;
+      }
+    }
+    printf ( "%u heated\n", heated );
+  }
+  else
+    printf ( "none\n" );
+  g_free ( values );
+  heat_pyramid_unref ( hp );
+}
+
+static void benchmark ( guint count )
+{
+  HeatPyramid *hp = heat_pyramid_new ( 15 );
+  guint32 seed = 1;
+  gint x = AREA/2, y = AREA/2;
+  gint64 tt1 = g_get_monotonic_time ();
+  for ( guint ii = 0; ii < count; ii++ ) {
+    wander_step ( &seed, &x, &y );
+    heat_pyramid_add ( hp, (1 << 22) + x, (1 << 22) + y, 1 );
+  }
+  gint64 tt2 = g_get_monotonic_time ();
+  printf ( "%u points: added in %.3fs, using %u chunks\n", count, (gdouble)(tt2 - tt1) / G_USEC_PER_SEC, heat_pyramid_size(hp) );
+  heat_pyramid_unref ( hp );
+}
+
+int main ( int argc, char *argv[] )
+{
+  if ( argc < 2 ) {
+    fprintf ( stderr, "Usage: %s compare <count> | beyond <zoom levels> | outside | --benchmark <count>\n", argv[0] );
+    return 1;
+  }
+
+  int result = 0;
+
+  if ( !strcmp ( argv[1], "--benchmark" ) && argc == 3 )
+    benchmark ( atoi ( argv[2] ) );
+  else if ( !strcmp ( argv[1], "compare" ) && argc == 3 )
+    print_compare ( atoi ( argv[2] ) );
+  else if ( !strcmp ( argv[1], "beyond" ) && argc == 3 )
+    print_beyond ( atoi ( argv[2] ) );
+  else if ( !strcmp ( argv[1], "outside" ) ) {
+    // Beyond the edges of the world is ignored
+    HeatPyramid *hp = heat_pyramid_new ( MAX_ZOOM );
+    heat_pyramid_add ( hp, -1, 0, 1 );
+    heat_pyramid_add ( hp, 0, 256 << MAX_ZOOM, 1 );
+    heat_pyramid_add ( hp, 256 << MAX_ZOOM, 0, 1 );
+    printf ( "%u chunks\n", heat_pyramid_size(hp) );
+    heat_pyramid_unref ( hp );
+  }
+  else
+    result = 1;
+
+  return result;
+}
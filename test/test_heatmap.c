@@ -0,0 +1,227 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Check the (vectorized) heatmap stamping and rendering against plain loops
+//  Also with --benchmark <count> to report how quickly points are stamped and pixels rendered
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include "misc/heatmap.h"
+
+#define WIDTH 1001
+#define HEIGHT 701
+#define RADIUS 12
+
+/**
+ * Points spread over the heatmap, the same each time,
+ *  including those near (and on) the edges so the stamps are cut off
+ */
+static void points_new ( guint count, guint **xs, guint **ys, gfloat **ws )
+{
+  guint32 seed = 1;
+  *xs = g_malloc ( count * sizeof(guint) );
+  *ys = g_malloc ( count * sizeof(guint) );
+  *ws = g_malloc ( count * sizeof(gfloat) );
+  for ( guint ii = 0; ii < count; ii++ ) {
+    seed = seed * 1103515245 + 12345;
+    (*xs)[ii] = (seed >> 8) % WIDTH;
+    seed = seed * 1103515245 + 12345;
+    (*ys)[ii] = (seed >> 8) % HEIGHT;
+    // Between 0.5 and 2
+    (*ws)[ii] = 0.5f + (gfloat)((seed >> 16) % 7) / 4;
+  }
+  if ( count > 1 ) {
+    (*xs)[0] = 0;
+    (*ys)[0] = 0;
+    (*xs)[1] = WIDTH-1;
+    (*ys)[1] = HEIGHT-1;
+  }
+}
+
+/**
+ * Stamp every other point with its weight
+ */
+static heatmap_t *heatmap_new_stamped ( guint count, const guint *xs, const guint *ys, const gfloat *ws, const heatmap_stamp_t *stamp )
+{
+  heatmap_t *hm = heatmap_new ( WIDTH, HEIGHT );
+  for ( guint ii = 0; ii < count; ii++ ) {
+    if ( ii % 2 )
+      heatmap_add_weighted_point_with_stamp ( hm, xs[ii], ys[ii], ws[ii], stamp );
+    else
+      heatmap_add_point_with_stamp ( hm, xs[ii], ys[ii], stamp );
+  }
+  return hm;
+}
+
+/**
+ * The heat of each point stamped one pixel at a time
+ */
+static void expected_stamp ( gfloat *buf, gint x, gint y, gfloat w, const heatmap_stamp_t *stamp )
+{
+  for ( gint sy = 0; sy < (gint)stamp->h; sy++ ) {
+    gint yy = y + sy - (gint)stamp->h/2;
+    if ( yy < 0 || yy >= HEIGHT )
+      continue;
+    for ( gint sx = 0; sx < (gint)stamp->w; sx++ ) {
+      gint xx = x + sx - (gint)stamp->w/2;
+      if ( xx < 0 || xx >= WIDTH )
+        continue;
+      buf[yy*WIDTH + xx] += stamp->buf[sy*stamp->w + sx] * w;
+    }
+  }
+}
+
+/**
+ * The color of each pixel looked up one at a time
+ */
+static void expected_render ( const gfloat *buf, const heatmap_colorscheme_t *cs, gfloat saturation, guchar *colors )
+{
+  for ( guint ii = 0; ii < WIDTH*HEIGHT; ii++ ) {
+    const gfloat val = (buf[ii] > saturation ? saturation : buf[ii]) / saturation;
+    const gsize idx = (gsize)((gfloat)(cs->ncolors-1)*val + 0.5f);
+    memcpy ( colors + 4*ii, cs->colors + idx*4, 4 );
+  }
+}
+
+/**
+ * Compare the heat of every pixel and the highest heat with those stamped by plain loops:
+ *  output is the number of pixels with any heat and the number that differ
+ */
+static void print_stamp ( guint count, guint radius )
+{
+  guint *xs, *ys;
+  gfloat *ws;
+  points_new ( count, &xs, &ys, &ws );
+  heatmap_stamp_t *stamp = heatmap_stamp_gen ( radius );
+  heatmap_t *hm = heatmap_new_stamped ( count, xs, ys, ws, stamp );
+
+  gfloat *expected = g_malloc0 ( WIDTH * HEIGHT * sizeof(gfloat) );
+  for ( guint ii = 0; ii < count; ii++ )
+    expected_stamp ( expected, xs[ii], ys[ii], (ii % 2) ? ws[ii] : 1.0f, stamp );
+
+  gfloat max = 0.0f;
+  guint heated = 0, differ = 0;
+  for ( guint ii = 0; ii < WIDTH*HEIGHT; ii++ ) {
+    max = MAX ( max, expected[ii] );
+    if ( expected[ii] > 0.0f )
+      heated++;
+    // Allowing for a different order of the operations when vectorized
+    if ( fabsf ( hm->buf[ii] - expected[ii] ) > 1e-5f * MAX(1.0f, expected[ii]) )
+      differ++;
+  }
+  if ( fabsf ( hm->max - max ) > 1e-5f * MAX(1.0f, max) )
+    differ++;
+  printf ( "%u heated %u differ\n", heated, differ );
+
+  g_free ( expected );
+  heatmap_free ( hm );
+  heatmap_stamp_free ( stamp );
+  g_free ( ws );
+  g_free ( ys );
+  g_free ( xs );
+}
+
+/**
+ * Render with the saturation as a fraction of the highest heat,
+ *  comparing the colors with those of plain loops from the same heat, so they must be exactly the same:
+ *  output is the number of pixels that are saturated and the number that differ
+ */
+static void print_render ( guint count, guint divisor )
+{
+  guint *xs, *ys;
+  gfloat *ws;
+  points_new ( count, &xs, &ys, &ws );
+  heatmap_stamp_t *stamp = heatmap_stamp_gen ( RADIUS );
+  heatmap_t *hm = heatmap_new_stamped ( count, xs, ys, ws, stamp );
+
+  gfloat saturation = hm->max / divisor;
+  guchar *colors = g_malloc ( WIDTH * HEIGHT * 4 );
+  guchar *expected_colors = g_malloc ( WIDTH * HEIGHT * 4 );
+  heatmap_render_saturated_to ( hm, heatmap_cs_default, saturation, colors );
+  expected_render ( hm->buf, heatmap_cs_default, saturation, expected_colors );
+  guint saturated = 0, differ = 0;
+  for ( guint ii = 0; ii < WIDTH*HEIGHT; ii++ ) {
+    if ( hm->buf[ii] >= saturation )
+      saturated++;
+    if ( memcmp ( colors + 4*ii, expected_colors + 4*ii, 4 ) )
+      differ++;
+  }
+  printf ( "%u saturated %u differ\n", saturated, differ );
+
+  g_free ( expected_colors );
+  g_free ( colors );
+  heatmap_free ( hm );
+  heatmap_stamp_free ( stamp );
+  g_free ( ws );
+  g_free ( ys );
+  g_free ( xs );
+}
+
+static void benchmark ( guint count )
+{
+  guint *xs, *ys;
+  gfloat *ws;
+  points_new ( count, &xs, &ys, &ws );
+  heatmap_stamp_t *stamp = heatmap_stamp_gen ( RADIUS );
+
+  gint64 tt1 = g_get_monotonic_time ();
+  heatmap_t *hm = heatmap_new_stamped ( count, xs, ys, ws, stamp );
+  gint64 tt2 = g_get_monotonic_time ();
+
+  guint renders = 20;
+  guchar *colors = g_malloc ( WIDTH * HEIGHT * 4 );
+  gint64 tt3 = g_get_monotonic_time ();
+  for ( guint ii = 0; ii < renders; ii++ )
+    heatmap_render_default_to ( hm, colors );
+  gint64 tt4 = g_get_monotonic_time ();
+
+  gdouble stamp_time = MAX ( 1, tt2 - tt1 ) / (gdouble)G_USEC_PER_SEC;
+  gdouble render_time = MAX ( 1, tt4 - tt3 ) / (gdouble)G_USEC_PER_SEC;
+  printf ( "%u points (stamp %ux%u): %.0f points/s\n", count, stamp->w, stamp->h, count / stamp_time );
+  printf ( "%ux%u heatmap rendered %u times: %.1f megapixels/s\n", WIDTH, HEIGHT, renders, (gdouble)WIDTH * HEIGHT * renders / render_time / 1e6 );
+
+  g_free ( colors );
+  heatmap_free ( hm );
+  heatmap_stamp_free ( stamp );
+  g_free ( ws );
+  g_free ( ys );
+  g_free ( xs );
+}
+
+int main ( int argc, char *argv[] )
+{
+  if ( argc < 3 ) {
+    fprintf ( stderr, "Usage: %s stamp <count> <radius> | render <count> <saturation divisor> | --benchmark <count>\n", argv[0] );
+    return 1;
+  }
+
+  int result = 0;
+
+  if ( !strcmp ( argv[1], "--benchmark" ) )
+    benchmark ( atoi ( argv[2] ) );
+  else if ( !strcmp ( argv[1], "stamp" ) && argc == 4 )
+    print_stamp ( atoi ( argv[2] ), atoi ( argv[3] ) );
+  else if ( !strcmp ( argv[1], "render" ) && argc == 4 && atoi ( argv[3] ) > 0 )
+    print_render ( atoi ( argv[2] ), atoi ( argv[3] ) );
+  else
+    result = 1;
+
+  return result;
+}
@@ -30,6 +30,7 @@
 #include <fcntl.h>
 
 #include "metatile.h"
+#include "compression.h"
 
 int main ( int argc, char *argv[] )
 {
@@ -62,6 +63,48 @@ int main ( int argc, char *argv[] )
       len = metatile_read(dir, x, y, z, buf, tile_max, &compressed, err_msg);
 
     if (len > 0) {
+        // Reading via the memory mapped metatile should give the same data
+        metatile_t *mt = metatile_open(argc > 1 ? argv[1] : dir, x, y, z, err_msg);
+        if (!mt) {
+            fprintf(stderr, "FAILED: %s\n", err_msg);
+            free(buf);
+            return 4;
+        }
+        GBytes *bytes = metatile_get_bytes(mt, x, y);
+        metatile_close(mt);
+        if (!bytes || g_bytes_get_size(bytes) != (gsize)len || memcmp(g_bytes_get_data(bytes, NULL), buf, len)) {
+            fprintf(stderr, "FAILED: memory mapped metatile data differs\n");
+            if (bytes)
+                g_bytes_unref(bytes);
+            free(buf);
+            return 5;
+        }
+        g_bytes_unref(bytes);
+
+        // A second directory is of the same tile gzipped within a compressed metatile
+        if (argc > 2) {
+            mt = metatile_open(argv[2], x, y, z, err_msg);
+            if (!mt || !metatile_is_compressed(mt)) {
+                fprintf(stderr, "FAILED: %s\n", mt ? "metatile not compressed" : err_msg);
+                metatile_close(mt);
+                free(buf);
+                return 6;
+            }
+            bytes = metatile_get_bytes(mt, x, y);
+            metatile_close(mt);
+            gsize size = 0;
+            void *data = bytes ? uncompress_gzip_data(g_bytes_get_data(bytes, NULL), g_bytes_get_size(bytes), &size) : NULL;
+            if (bytes)
+                g_bytes_unref(bytes);
+            if (!data || size != (gsize)len || memcmp(data, buf, len)) {
+                fprintf(stderr, "FAILED: uncompressed metatile data differs\n");
+                g_free(data);
+                free(buf);
+                return 7;
+            }
+            g_free(data);
+        }
+
         // Do something with buf
         // Just dump to a file
         FILE *fp;
@@ -0,0 +1,176 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Check the items found by the spatial index against testing every item
+//  Also with --benchmark <count> to compare the speed of the two
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "spatialindex.h"
+
+typedef struct {
+  LatLonBBox bbox;
+  guint version; // Incremented when moved
+  guint found;   // The query that last found it
+  guint found_count;
+} item_t;
+
+/**
+ * Items spread over a square degree, the same each time:
+ *  a mixture of points (as for waypoints) and areas of various sizes (as for tracks)
+ */
+static item_t *items_new ( guint count )
+{
+  item_t *items = g_malloc0 ( sizeof(item_t) * count );
+  for ( guint ii = 0; ii < count; ii++ ) {
+    gdouble lat = 51.0 + (gdouble)((ii * 7919) % 10007) / 10007;
+    gdouble lon = -2.0 + (gdouble)((ii * 104729) % 10009) / 10009;
+    gdouble height = (ii % 3) ? 0.002 * (ii % 5) : 0.0;
+    gdouble width = (ii % 3) ? 0.002 * (ii % 7) : 0.0;
+    LatLonBBox bbox = { lat, lat + height, lon + width, lon };
+    items[ii].bbox = bbox;
+  }
+  return items;
+}
+
+static LatLonBBox query_bbox ( guint qq )
+{
+  gdouble lat = 51.0 + (gdouble)((qq * 4099) % 1009) / 1009;
+  gdouble lon = -2.0 + (gdouble)((qq * 2003) % 1013) / 1013;
+  gdouble size = 0.01 * (1 + qq % 10);
+  LatLonBBox bbox = { lat, lat + size, lon + size, lon };
+  return bbox;
+}
+
+static SpatialIndex *index_new ( item_t *items, guint count )
+{
+  SpatialIndex *si = spatial_index_new ();
+  for ( guint ii = 0; ii < count; ii++ )
+    spatial_index_add ( si, GUINT_TO_POINTER(ii+1), &items[ii], items[ii].bbox, items[ii].version );
+  return si;
+}
+
+static void mark_found ( gpointer key, gpointer value, gpointer user_data )
+{
+  item_t *item = value;
+  guint qq = GPOINTER_TO_UINT(user_data);
+  if ( item->found == qq )
+    item->found_count++;
+  else {
+    item->found = qq;
+    item->found_count = 1;
+  }
+}
+
+/**
+ * Returns: The number of items where the index differs from testing each one,
+ *  including any given more than once
+ */
+static guint compare_queries ( SpatialIndex *si, item_t *items, guint count, guint queries, guint *found )
+{
+  guint differ = 0;
+  // Query numbers from 1, as 0 marks not found
+  for ( guint qq = 1; qq <= queries; qq++ ) {
+    LatLonBBox bbox = query_bbox ( qq );
+    *found += spatial_index_foreach_in_bbox ( si, bbox, mark_found, GUINT_TO_POINTER(qq) );
+    for ( guint ii = 0; ii < count; ii++ ) {
+      gboolean expected = BBOX_INTERSECT(items[ii].bbox, bbox);
+      gboolean was_found = items[ii].found == qq;
+      if ( expected != was_found || (was_found && items[ii].found_count != 1) )
+        differ++;
+    }
+  }
+  return differ;
+}
+
+/**
+ * Moved items are told apart by their version, as for tracks
+ */
+static gboolean check_item ( gpointer key, gpointer value, LatLonBBox *bbox, guint *stamp )
+{
+  item_t *item = value;
+  if ( item->version == *stamp )
+    return FALSE;
+  *bbox = item->bbox;
+  *stamp = item->version;
+  return TRUE;
+}
+
+static void benchmark ( item_t *items, guint count )
+{
+  guint queries = 1000, found = 0;
+  gint64 tt1 = g_get_monotonic_time ();
+  SpatialIndex *si = index_new ( items, count );
+  for ( guint qq = 1; qq <= queries; qq++ )
+    found += spatial_index_foreach_in_bbox ( si, query_bbox(qq), mark_found, GUINT_TO_POINTER(qq) );
+  gint64 tt2 = g_get_monotonic_time ();
+  for ( guint qq = 1; qq <= queries; qq++ ) {
+    LatLonBBox bbox = query_bbox ( qq );
+    for ( guint ii = 0; ii < count; ii++ )
+      if ( BBOX_INTERSECT(items[ii].bbox, bbox) )
+        found--;
+  }
+  gint64 tt3 = g_get_monotonic_time ();
+  printf ( "%u items %u queries: index %.3fs, every item %.3fs%s\n", count, queries,
+           (gdouble)(tt2 - tt1) / G_USEC_PER_SEC, (gdouble)(tt3 - tt2) / G_USEC_PER_SEC, found ? " DIFFER" : "" );
+  spatial_index_free ( si );
+}
+
+int main ( int argc, char *argv[] )
+{
+  if ( argc < 3 ) {
+    fprintf ( stderr, "Usage: %s compare|changed <count> <queries> | --benchmark <count>\n", argv[0] );
+    return 1;
+  }
+
+  guint count = atoi ( argv[2] );
+  item_t *items = items_new ( count );
+  int result = 0;
+
+  if ( !strcmp ( argv[1], "--benchmark" ) )
+    benchmark ( items, count );
+  else if ( argc == 4 && (!strcmp ( argv[1], "compare" ) || !strcmp ( argv[1], "changed" )) ) {
+    guint queries = atoi ( argv[3] );
+    guint found = 0;
+    SpatialIndex *si = index_new ( items, count );
+    guint differ = compare_queries ( si, items, count, queries, &found );
+    if ( !strcmp ( argv[1], "changed" ) ) {
+      // Move every tenth item a little north east, then search again
+      for ( guint ii = 0; ii < count; ii += 10 ) {
+        items[ii].bbox.south += 0.05;
+        items[ii].bbox.north += 0.05;
+        items[ii].bbox.east += 0.05;
+        items[ii].bbox.west += 0.05;
+        items[ii].version++;
+      }
+      for ( guint ii = 0; ii < count; ii++ )
+        items[ii].found = items[ii].found_count = 0;
+      printf ( "%u changed, ", spatial_index_check ( si, check_item ) );
+      found = 0;
+      differ += compare_queries ( si, items, count, queries, &found );
+    }
+    printf ( "%u queries %u found %u differ\n", queries, found, differ );
+    spatial_index_free ( si );
+  }
+  else
+    result = 1;
+
+  g_free ( items );
+  return result;
+}
@@ -0,0 +1,312 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Check the tile bitmap against a plain hash table of the same tiles
+//  Also with --benchmark <count> to compare the speed of the two
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "tilebitmap.h"
+
+/**
+ * Tiles of a wander either side of zero, so crossing chunk borders and negative positions.
+ * The same each time, with a step of at most one tile in each direction.
+ */
+static void wander_step ( guint32 *seed, gint *x, gint *y )
+{
+  *seed = *seed * 1103515245 + 12345;
+  *x += (gint)((*seed >> 16) % 3) - 1;
+  *seed = *seed * 1103515245 + 12345;
+  *y += (gint)((*seed >> 16) % 3) - 1;
+}
+
+static gint64 tile_key ( gint x, gint y )
+{
+  return (gint64)(((guint64)(guint32)x << 32) | (guint32)y);
+}
+
+static gint64 *tile_key_new ( gint x, gint y )
+{
+  gint64 *key = g_malloc ( sizeof(gint64) );
+  *key = tile_key ( x, y );
+  return key;
+}
+
+static gboolean in_set ( GHashTable *set, gint x, gint y )
+{
+  gint64 key = tile_key ( x, y );
+  return g_hash_table_lookup ( set, &key ) != NULL;
+}
+
+static gboolean is_interior ( GHashTable *set, gint x, gint y )
+{
+  for ( gint dy = -1; dy <= 1; dy++ )
+    for ( gint dx = -1; dx <= 1; dx++ )
+      if ( !in_set(set, x+dx, y+dy) )
+        return FALSE;
+  return TRUE;
+}
+
+/**
+ * Add the tiles of the wander to the bitmaps and the set, with the first half also in (half)
+ *
+ * Returns: The number of times adding a tile did not say whether it was new
+ */
+static guint wander_add ( guint count, TileBitmap *tb, TileBitmap *half, GHashTable *set )
+{
+  guint32 seed = 1;
+  gint x = 0, y = 0;
+  guint differ = 0;
+  for ( guint ii = 0; ii < count; ii++ ) {
+    wander_step ( &seed, &x, &y );
+    if ( tile_bitmap_add ( tb, x, y ) == in_set ( set, x, y ) )
+      differ++;
+    if ( !in_set ( set, x, y ) )
+      g_hash_table_insert ( set, tile_key_new ( x, y ), GINT_TO_POINTER(1) );
+    if ( ii < count / 2 )
+      (void)tile_bitmap_add ( half, x, y );
+  }
+  return differ;
+}
+
+/**
+ * Compare every tile within the extents (and a border around them):
+ *  those contained, the interior, the difference from the first half and the union with it
+ */
+static void print_comparison ( guint count )
+{
+  GHashTable *set = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  TileBitmap *tb = tile_bitmap_new ();
+  TileBitmap *half = tile_bitmap_new ();
+  guint differ = wander_add ( count, tb, half, set );
+  if ( tile_bitmap_size(tb) != g_hash_table_size(set) )
+    differ++;
+
+  gint xmin, ymin, xmax, ymax;
+  if ( !tile_bitmap_get_extents ( tb, &xmin, &ymin, &xmax, &ymax ) )
+    differ++;
+  TileBitmap *interior = tile_bitmap_new ();
+  TileBitmap *diff = tile_bitmap_new ();
+  guint interior_count = tile_bitmap_add_interior ( interior, tb );
+  guint diff_count = tile_bitmap_add_difference ( diff, tb, half );
+  guint interior_expected = 0, diff_expected = 0;
+  gint x1 = G_MAXINT, x2 = G_MININT, y1 = G_MAXINT, y2 = G_MININT;
+  for ( gint y = ymin - 2; y <= ymax + 2; y++ ) {
+    for ( gint x = xmin - 2; x <= xmax + 2; x++ ) {
+      gboolean expected = in_set ( set, x, y );
+      if ( tile_bitmap_contains(tb, x, y) != expected )
+        differ++;
+      if ( expected ) {
+        x1 = MIN ( x1, x ); x2 = MAX ( x2, x );
+        y1 = MIN ( y1, y ); y2 = MAX ( y2, y );
+      }
+      gboolean inner = expected && is_interior ( set, x, y );
+      if ( inner )
+        interior_expected++;
+      if ( tile_bitmap_contains(interior, x, y) != inner )
+        differ++;
+      gboolean differs = expected && !tile_bitmap_contains ( half, x, y );
+      if ( differs )
+        diff_expected++;
+      if ( tile_bitmap_contains(diff, x, y) != differs )
+        differ++;
+    }
+  }
+  if ( x1 != xmin || x2 != xmax || y1 != ymin || y2 != ymax )
+    differ++;
+  if ( interior_count != interior_expected || tile_bitmap_size(interior) != interior_expected )
+    differ++;
+  if ( diff_count != diff_expected || tile_bitmap_size(diff) != diff_expected )
+    differ++;
+
+  // The two parts together make up the whole again
+  guint union_count = tile_bitmap_add_union ( diff, half );
+  if ( union_count != tile_bitmap_size(half) || tile_bitmap_size(diff) != g_hash_table_size(set) )
+    differ++;
+
+  printf ( "%u tiles %u interior %u difference %u differ\n", g_hash_table_size(set), interior_count, diff_count, differ );
+  tile_bitmap_free ( diff );
+  tile_bitmap_free ( interior );
+  tile_bitmap_free ( half );
+  tile_bitmap_free ( tb );
+  g_hash_table_destroy ( set );
+}
+
+/**
+ * Iteration must visit each tile once, after its west and north neighbours
+ */
+static void print_order ( guint count )
+{
+  GHashTable *set = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  TileBitmap *tb = tile_bitmap_new ();
+  TileBitmap *half = tile_bitmap_new ();
+  guint differ = wander_add ( count, tb, half, set );
+
+  TileBitmapIter iter;
+  guint visited = 0;
+  gint x, y;
+  tile_bitmap_clear_labels ( tb );
+  tile_bitmap_iter_init ( &iter, tb );
+  while ( tile_bitmap_iter_next ( &iter, &x, &y ) ) {
+    visited++;
+    if ( !in_set(set, x, y) || tile_bitmap_get_label(tb, x, y) )
+      differ++;
+    if ( (in_set(set, x-1, y) && !tile_bitmap_get_label(tb, x-1, y)) ||
+         (in_set(set, x, y-1) && !tile_bitmap_get_label(tb, x, y-1)) ||
+         (in_set(set, x-1, y-1) && !tile_bitmap_get_label(tb, x-1, y-1)) )
+      differ++;
+    tile_bitmap_set_label ( tb, x, y, visited );
+  }
+  if ( visited != g_hash_table_size(set) )
+    differ++;
+
+  printf ( "%u visited %u differ\n", visited, differ );
+  tile_bitmap_free ( half );
+  tile_bitmap_free ( tb );
+  g_hash_table_destroy ( set );
+}
+
+/**
+ * Counting each tile of the first half and of the whole as labels,
+ *  then taking away the whole again leaves just the first half.
+ * Also a copy keeps the labels, which can then be cleared independently.
+ */
+static void print_labels ( guint count )
+{
+  GHashTable *set = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  TileBitmap *tb = tile_bitmap_new ();
+  TileBitmap *half = tile_bitmap_new ();
+  guint differ = wander_add ( count, tb, half, set );
+
+  TileBitmapIter iter;
+  gint x, y;
+  TileBitmap *counts = tile_bitmap_new ();
+  TileBitmap *halves[2] = { tile_bitmap_new (), tile_bitmap_new () };
+  tile_bitmap_add_union ( halves[0], half );
+  tile_bitmap_add_union ( halves[1], tb );
+  for ( guint hh = 0; hh < 2; hh++ ) {
+    tile_bitmap_iter_init ( &iter, halves[hh] );
+    while ( tile_bitmap_iter_next ( &iter, &x, &y ) )
+      tile_bitmap_set_label ( halves[hh], x, y, 1 );
+    tile_bitmap_add_labels ( counts, halves[hh] );
+  }
+  guint counted = tile_bitmap_size ( counts );
+  tile_bitmap_iter_init ( &iter, tb );
+  while ( tile_bitmap_iter_next ( &iter, &x, &y ) ) {
+    guint refs = tile_bitmap_get_label ( counts, x, y );
+    if ( refs > 1 )
+      tile_bitmap_set_label ( counts, x, y, refs - 1 );
+    else if ( !tile_bitmap_remove ( counts, x, y ) )
+      differ++;
+  }
+  if ( tile_bitmap_size(counts) != tile_bitmap_size(half) )
+    differ++;
+
+  tile_bitmap_iter_init ( &iter, tb );
+  while ( tile_bitmap_iter_next ( &iter, &x, &y ) )
+    tile_bitmap_set_label ( tb, x, y, 1 );
+  TileBitmap *copy = tile_bitmap_copy ( tb );
+  tile_bitmap_clear_labels ( tb );
+  tile_bitmap_iter_init ( &iter, tb );
+  while ( tile_bitmap_iter_next ( &iter, &x, &y ) )
+    if ( tile_bitmap_get_label(copy, x, y) != 1 || tile_bitmap_get_label(tb, x, y) != 0 )
+      differ++;
+  if ( tile_bitmap_size(copy) != tile_bitmap_size(tb) )
+    differ++;
+  tile_bitmap_clear ( tb );
+  if ( tile_bitmap_size(tb) || tile_bitmap_contains(tb, 0, 0) )
+    differ++;
+
+  printf ( "%u counted %u left %u differ\n", counted, tile_bitmap_size(counts), differ );
+  tile_bitmap_free ( copy );
+  tile_bitmap_free ( halves[0] );
+  tile_bitmap_free ( halves[1] );
+  tile_bitmap_free ( counts );
+  tile_bitmap_free ( half );
+  tile_bitmap_free ( tb );
+  g_hash_table_destroy ( set );
+}
+
+/**
+ * A filled square of tiles from (x,y), printing its size, extents and interior
+ */
+static void print_square ( gint x0, gint y0, gint size )
+{
+  TileBitmap *tb = tile_bitmap_new ();
+  TileBitmap *interior = tile_bitmap_new ();
+  for ( gint y = y0; y < y0 + size; y++ )
+    for ( gint x = x0; x < x0 + size; x++ )
+      (void)tile_bitmap_add ( tb, x, y );
+  gint xmin, ymin, xmax, ymax;
+  if ( tile_bitmap_get_extents ( tb, &xmin, &ymin, &xmax, &ymax ) )
+    printf ( "%u %d,%d %d,%d %u\n", tile_bitmap_size(tb), xmin, ymin, xmax, ymax, tile_bitmap_add_interior ( interior, tb ) );
+  else
+    printf ( "empty\n" );
+  tile_bitmap_free ( interior );
+  tile_bitmap_free ( tb );
+}
+
+static void benchmark ( guint count )
+{
+  guint32 seed = 1;
+  gint x = 0, y = 0;
+  TileBitmap *tb = tile_bitmap_new ();
+  gint64 tt1 = g_get_monotonic_time ();
+  for ( guint ii = 0; ii < count; ii++ ) {
+    wander_step ( &seed, &x, &y );
+    (void)tile_bitmap_add ( tb, x, y );
+  }
+  gint64 tt2 = g_get_monotonic_time ();
+  GHashTable *set = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  seed = 1;
+  x = y = 0;
+  for ( guint ii = 0; ii < count; ii++ ) {
+    wander_step ( &seed, &x, &y );
+    if ( !in_set ( set, x, y ) )
+      g_hash_table_insert ( set, tile_key_new ( x, y ), GINT_TO_POINTER(1) );
+  }
+  gint64 tt3 = g_get_monotonic_time ();
+  printf ( "%u tiles: bitmap %.3fs, hash table %.3fs\n", tile_bitmap_size(tb),
+           (gdouble)(tt2 - tt1) / G_USEC_PER_SEC, (gdouble)(tt3 - tt2) / G_USEC_PER_SEC );
+  g_hash_table_destroy ( set );
+  tile_bitmap_free ( tb );
+}
+
+int main ( int argc, char *argv[] )
+{
+  if ( argc < 3 ) {
+    fprintf ( stderr, "Usage: %s compare|order|labels <count> | square <x> <y> <size> | --benchmark <count>\n", argv[0] );
+    return 1;
+  }
+
+  int result = 0;
+  if ( !strcmp ( argv[1], "--benchmark" ) )
+    benchmark ( atoi ( argv[2] ) );
+  else if ( !strcmp ( argv[1], "compare" ) )
+    print_comparison ( atoi ( argv[2] ) );
+  else if ( !strcmp ( argv[1], "order" ) )
+    print_order ( atoi ( argv[2] ) );
+  else if ( !strcmp ( argv[1], "labels" ) )
+    print_labels ( atoi ( argv[2] ) );
+  else if ( !strcmp ( argv[1], "square" ) && argc == 5 )
+    print_square ( atoi ( argv[2] ), atoi ( argv[3] ), atoi ( argv[4] ) );
+  else
+    result = 1;
+  return result;
+}
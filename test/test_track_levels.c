@@ -0,0 +1,162 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Check the simplified levels of a track against the points they leave out
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include "viktrack.h"
+#include "settings.h"
+
+#define METRES_PER_DEGREE (6378137.0 * M_PI / 180.0)
+
+/**
+ * A winding track of irregular steps of a few metres, the same each time,
+ *  with a stop of five minutes every 97 points and a new segment every 1000 points
+ */
+static VikTrack *track_new_wander ( guint count )
+{
+  VikTrack *trk = vik_track_new ();
+  struct LatLon ll = { 51.0, -1.0 };
+  gdouble timestamp = 1500000000;
+  for ( guint ii = 0; ii < count; ii++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    ll.lat += 0.00005 * ((ii * 7) % 5) - 0.00009;
+    ll.lon += 0.00005 * ((ii * 3) % 7) - 0.00015 + 0.0001 * sin ( ii / 200.0 );
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    timestamp += (ii % 97 == 96) ? 300 : 5;
+    tp->timestamp = timestamp;
+    tp->newsegment = (ii % 1000 == 999);
+    trk->trackpoints = g_list_prepend ( trk->trackpoints, tp );
+  }
+  trk->trackpoints = g_list_reverse ( trk->trackpoints );
+  vik_track_calculate_bounds ( trk );
+  return trk;
+}
+
+static gboolean track_make_levels ( VikTrack *trk, gdouble stop_length )
+{
+  VikTrackLevels *tl = vik_track_levels_new ( trk, stop_length );
+  if ( !tl )
+    return FALSE;
+  vik_track_levels_calculate ( tl );
+  vik_track_levels_unref ( tl );
+  return TRUE;
+}
+
+/**
+ * Metres of the point from the line between two others, on a flat projection at the latitude
+ */
+static gdouble line_distance ( const VikCoord *pp, const VikCoord *aa, const VikCoord *bb, gdouble kx )
+{
+  gdouble px = pp->east_west * kx, py = pp->north_south * METRES_PER_DEGREE;
+  gdouble ax = aa->east_west * kx, ay = aa->north_south * METRES_PER_DEGREE;
+  gdouble dx = bb->east_west * kx - ax, dy = bb->north_south * METRES_PER_DEGREE - ay;
+  gdouble len2 = dx * dx + dy * dy;
+  gdouble tt = len2 > 0.0 ? CLAMP ( ((px - ax) * dx + (py - ay) * dy) / len2, 0.0, 1.0 ) : 0.0;
+  return hypot ( ax + tt * dx - px, ay + tt * dy - py );
+}
+
+/**
+ * Go through every level made, counting the points left out that are further than the tolerance
+ *  from the simplified line (stray), the ends of segments and stops left out (missing)
+ *  and the points kept that were not kept by the previous less simplified level (unnested)
+ */
+static void print_levels ( VikTrack *trk, gdouble stop_length )
+{
+  gdouble kx = METRES_PER_DEGREE * cos ( DEG2RAD((trk->bbox.north + trk->bbox.south) / 2) );
+  const VikTrackColumns *tc = vik_track_get_columns ( trk );
+  guint8 *kept = g_malloc0 ( tc->count );
+  guint n_levels = 0, count = tc->count, stray = 0, missing = 0, unnested = 0;
+  gdouble previous = 0.0;
+
+  for ( gdouble tolerance = VIK_TRACK_LEVELS_MIN_TOLERANCE; tolerance < 1e8; tolerance *= 2 ) {
+    VikTrackLevel level;
+    vik_track_get_level ( trk, tolerance, stop_length, &level );
+    if ( !level.indices || level.tolerance == previous )
+      continue;
+    previous = level.tolerance;
+    n_levels++;
+    count = level.count;
+
+    guint8 *was_kept = kept;
+    kept = g_malloc0 ( tc->count );
+    for ( guint ii = 0; ii < level.count; ii++ ) {
+      guint index = level.indices[ii];
+      kept[index] = 1;
+      if ( n_levels > 1 && !was_kept[index] )
+        unnested++;
+      if ( ii > 0 && !VIK_TRACK_COLUMNS_NEWSEGMENT(tc, index) )
+        for ( guint jj = level.indices[ii-1] + 1; jj < index; jj++ )
+          if ( line_distance ( &tc->coords[jj], &tc->coords[level.indices[ii-1]], &tc->coords[index], kx ) > level.tolerance + 1e-6 )
+            stray++;
+    }
+    g_free ( was_kept );
+
+    VIK_TRACK_COLUMNS_FOREACH(tc, ii) {
+      gboolean last = ii+1 == tc->count;
+      gboolean end = ii == 0 || last || VIK_TRACK_COLUMNS_NEWSEGMENT(tc, ii) || VIK_TRACK_COLUMNS_NEWSEGMENT(tc, ii+1);
+      gboolean stop = !last && tc->timestamps[ii+1] - tc->timestamps[ii] > stop_length;
+      if ( (end || stop) && !kept[ii] )
+        missing++;
+    }
+  }
+  g_free ( kept );
+  printf ( "%u levels %u kept %u stray %u missing %u unnested\n", n_levels, count, stray, missing, unnested );
+}
+
+int main ( int argc, char *argv[] )
+{
+  if ( argc < 3 ) {
+    fprintf ( stderr, "Usage: %s levels <count> <stop length> | restop <count> <stop length> <new stop length>\n", argv[0] );
+    return 1;
+  }
+
+  a_settings_init ();
+
+  VikTrack *trk = track_new_wander ( atoi ( argv[2] ) );
+  int result = 0;
+
+  if ( !strcmp ( argv[1], "levels" ) && argc == 4 ) {
+    if ( track_make_levels ( trk, atoi ( argv[3] ) ) )
+      print_levels ( trk, atoi ( argv[3] ) );
+    else
+      printf ( "none\n" );
+  }
+  else if ( !strcmp ( argv[1], "restop" ) && argc == 5 ) {
+    // Points of the most simplified level: as made, then for the new stop length before and after making its levels
+    VikTrackLevel before, changed, after;
+    (void)track_make_levels ( trk, atoi ( argv[3] ) );
+    vik_track_get_level ( trk, 1e8, atoi ( argv[3] ), &before );
+    vik_track_get_level ( trk, 1e8, atoi ( argv[4] ), &changed );
+    printf ( "%u %u ", before.count, changed.count );
+    if ( track_make_levels ( trk, atoi ( argv[4] ) ) ) {
+      vik_track_get_level ( trk, 1e8, atoi ( argv[4] ), &after );
+      printf ( "%u\n", after.count );
+    }
+    else
+      printf ( "none\n" );
+  }
+  else
+    result = 1;
+
+  vik_track_free ( trk );
+  return result;
+}
@@ -0,0 +1,215 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Positions found along a track by distance and by time
+//  Also with --benchmark <count> for the time taken on a long track
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+#include "viktrack.h"
+#include "settings.h"
+
+/**
+ * Eleven points northwards along a meridian, about 111.3m apart, every 10 seconds
+ *  except for a stop of 100 seconds before the new segment at the seventh point
+ */
+static VikTrack *track_new_line ( void )
+{
+  VikTrack *trk = vik_track_new ();
+  for ( guint ii = 0; ii <= 10; ii++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    struct LatLon ll = { 51.0 + 0.001 * ii, -1.0 };
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    tp->timestamp = 10 * ii + (ii > 5 ? 90 : 0);
+    tp->newsegment = (ii == 6);
+    trk->trackpoints = g_list_prepend ( trk->trackpoints, tp );
+  }
+  trk->trackpoints = g_list_reverse ( trk->trackpoints );
+  vik_track_calculate_bounds ( trk );
+  return trk;
+}
+
+/**
+ * A long track of irregular steps in both position and time, the same each time
+ */
+static VikTrack *track_new_wander ( guint count )
+{
+  VikTrack *trk = vik_track_new ();
+  struct LatLon ll = { 51.0, -1.0 };
+  gdouble timestamp = 1500000000;
+  for ( guint ii = 0; ii < count; ii++ ) {
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    ll.lat += 0.00005 * ((ii * 7) % 5) - 0.0001;
+    ll.lon += 0.00005 * ((ii * 3) % 7) - 0.00015;
+    vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+    // Including some stops and some segments
+    timestamp += (ii * 11) % 5;
+    tp->timestamp = timestamp;
+    tp->newsegment = (ii % 1000 == 999);
+    trk->trackpoints = g_list_prepend ( trk->trackpoints, tp );
+  }
+  trk->trackpoints = g_list_reverse ( trk->trackpoints );
+  vik_track_calculate_bounds ( trk );
+  return trk;
+}
+
+// Walk the track for the point nearest the distance along it
+static VikTrackpoint *walk_by_dist ( VikTrack *trk, gdouble dist, gdouble *from_start )
+{
+  gdouble current_dist = 0.0, last_dist = 0.0;
+  GList *iter = trk->trackpoints->next;
+  for ( ; iter; iter = iter->next ) {
+    last_dist = current_dist;
+    current_dist += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) );
+    if ( current_dist >= dist )
+      break;
+  }
+  if ( !iter ) {
+    *from_start = last_dist;
+    return VIK_TRACKPOINT(g_list_last(trk->trackpoints)->data);
+  }
+  if ( fabs(last_dist-dist) < fabs(current_dist-dist) ) {
+    *from_start = last_dist;
+    return VIK_TRACKPOINT(iter->prev->data);
+  }
+  *from_start = current_dist;
+  return VIK_TRACKPOINT(iter->data);
+}
+
+// Walk the track for the point nearest the time
+static VikTrackpoint *walk_by_time ( VikTrack *trk, gdouble t_pos )
+{
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+    gdouble ts = VIK_TRACKPOINT(iter->data)->timestamp;
+    if ( ts == t_pos )
+      return VIK_TRACKPOINT(iter->data);
+    if ( ts > t_pos ) {
+      if ( iter->prev && (t_pos - VIK_TRACKPOINT(iter->prev->data)->timestamp) <= (ts - t_pos) )
+        return VIK_TRACKPOINT(iter->prev->data);
+      return VIK_TRACKPOINT(iter->data);
+    }
+  }
+  return VIK_TRACKPOINT(g_list_last(trk->trackpoints)->data);
+}
+
+/**
+ * Queries spread along the track, against walking the trackpoints from the start
+ *
+ * Returns: The number of queries giving a different point
+ */
+static guint compare_queries ( VikTrack *trk, guint queries )
+{
+  gdouble length = vik_track_get_length_including_gaps ( trk );
+  gdouble t_start = vik_track_get_tp_first(trk)->timestamp;
+  gdouble t_total = vik_track_get_tp_last(trk)->timestamp - t_start;
+  guint differ = 0;
+
+  for ( guint qq = 0; qq <= queries; qq++ ) {
+    gdouble frac = (gdouble)qq / queries;
+    gdouble found_dist, walk_dist;
+    VikTrackpoint *tp = vik_track_get_closest_tp_by_percentage_dist ( trk, frac, &found_dist );
+    VikTrackpoint *walk_tp = walk_by_dist ( trk, length * frac, &walk_dist );
+    if ( tp != walk_tp || found_dist != walk_dist )
+      differ++;
+
+    gdouble seconds;
+    tp = vik_track_get_closest_tp_by_percentage_time ( trk, frac, &seconds );
+    walk_tp = walk_by_time ( trk, t_start + t_total * frac );
+    if ( tp != walk_tp || seconds != walk_tp->timestamp - t_start )
+      differ++;
+
+    // The next point must be at or beyond the distance
+    VikTrackpoint *tp_next = vik_track_get_tp_by_dist ( trk, length * frac, TRUE, &found_dist );
+    if ( qq > 0 && qq < queries && (!tp_next || found_dist < length * frac) )
+      differ++;
+  }
+  return differ;
+}
+
+static void print_point ( VikTrack *trk, VikTrackpoint *tp, gdouble value )
+{
+  if ( tp )
+    printf ( "%d %.1f\n", g_list_index ( trk->trackpoints, tp ), value );
+  else
+    printf ( "none\n" );
+}
+
+int main ( int argc, char *argv[] )
+{
+  if ( argc != 3 ) {
+    fprintf ( stderr, "Usage: %s dist|time <fraction> | next|prev <metres> | length <index> | added <seconds> | compare <count> | --benchmark <count>\n", argv[0] );
+    return 1;
+  }
+
+  a_settings_init ();
+
+  gdouble value = g_ascii_strtod ( argv[2], NULL );
+  VikTrack *trk = NULL;
+  gdouble found = 0.0;
+  int result = 0;
+
+  if ( !strcmp ( argv[1], "compare" ) || !strcmp ( argv[1], "--benchmark" ) ) {
+    guint count = atoi ( argv[2] );
+    if ( count < 2 )
+      return 1;
+    trk = track_new_wander ( count );
+    guint queries = 500;
+    gint64 tt1 = g_get_monotonic_time ();
+    guint differ = compare_queries ( trk, queries );
+    gint64 tt2 = g_get_monotonic_time ();
+    if ( !strcmp ( argv[1], "compare" ) )
+      printf ( "%u queries %u differ\n", (queries + 1) * 3, differ );
+    else
+      printf ( "%u trackpoints: %u position queries %.3fs\n", count, (queries + 1) * 3, (gdouble)(tt2 - tt1) / G_USEC_PER_SEC );
+  }
+  else {
+    trk = track_new_line ();
+    if ( !strcmp ( argv[1], "dist" ) )
+      print_point ( trk, vik_track_get_closest_tp_by_percentage_dist ( trk, value, &found ), found );
+    else if ( !strcmp ( argv[1], "time" ) )
+      print_point ( trk, vik_track_get_closest_tp_by_percentage_time ( trk, value, &found ), found );
+    else if ( !strcmp ( argv[1], "next" ) )
+      print_point ( trk, vik_track_get_tp_by_dist ( trk, value, TRUE, &found ), found );
+    else if ( !strcmp ( argv[1], "prev" ) )
+      print_point ( trk, vik_track_get_tp_by_dist ( trk, value, FALSE, &found ), found );
+    else if ( !strcmp ( argv[1], "length" ) ) {
+      // Excludes the gaps between segments
+      VikTrackpoint *tp = g_list_nth_data ( trk->trackpoints, atoi ( argv[2] ) );
+      print_point ( trk, tp, tp ? vik_track_get_length_to_trackpoint ( trk, tp ) : 0.0 );
+    }
+    else if ( !strcmp ( argv[1], "added" ) ) {
+      // A point added after the positions have been found once, the given seconds after the last
+      (void)vik_track_get_closest_tp_by_percentage_time ( trk, 1.0, &found );
+      VikTrackpoint *tp = vik_trackpoint_copy ( vik_track_get_tp_last ( trk ) );
+      tp->timestamp += value;
+      tp->coord.north_south += 0.001;
+      tp->newsegment = FALSE;
+      vik_track_add_trackpoint ( trk, tp, TRUE );
+      VikTrackpoint *tp_found = vik_track_get_closest_tp_by_percentage_time ( trk, 1.0, &found );
+      printf ( "%d %.1f %.1f\n", g_list_index ( trk->trackpoints, tp_found ), found,
+               vik_track_get_length_to_trackpoint ( trk, tp ) );
+    }
+    else
+      result = 1;
+  }
+
+  vik_track_free ( trk );
+  return result;
+}
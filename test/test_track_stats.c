@@ -0,0 +1,119 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Statistics of a track given on the command line, as derived from its columns
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include "viktrack.h"
+#include "settings.h"
+
+/**
+ * Points as 'lat,lon,altitude,timestamp', with a '/' before a point that starts a new segment
+ */
+static VikTrack *track_new_from_args ( int argc, char *argv[] )
+{
+  VikTrack *trk = vik_track_new ();
+  gboolean newsegment = FALSE;
+  for ( int ii = 0; ii < argc; ii++ ) {
+    if ( !strcmp ( argv[ii], "/" ) ) {
+      newsegment = TRUE;
+      continue;
+    }
+    gchar **parts = g_strsplit ( argv[ii], ",", -1 );
+    if ( g_strv_length ( parts ) == 4 ) {
+      VikTrackpoint *tp = vik_trackpoint_new ();
+      struct LatLon ll = { g_ascii_strtod ( parts[0], NULL ), g_ascii_strtod ( parts[1], NULL ) };
+      vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+      tp->altitude = g_ascii_strtod ( parts[2], NULL );
+      tp->timestamp = g_ascii_strtod ( parts[3], NULL );
+      tp->newsegment = newsegment;
+      trk->trackpoints = g_list_prepend ( trk->trackpoints, tp );
+    }
+    g_strfreev ( parts );
+    newsegment = FALSE;
+  }
+  trk->trackpoints = g_list_reverse ( trk->trackpoints );
+  vik_track_calculate_bounds ( trk );
+  return trk;
+}
+
+static void print_stats ( VikTrack *trk )
+{
+  gdouble min_alt, max_alt, up, down;
+  vik_track_get_minmax_alt ( trk, &min_alt, &max_alt );
+  vik_track_get_total_elevation_gain ( trk, &up, &down );
+  printf ( "%.1f %.1f %.0f %.2f %.2f %.2f %.0f %.0f %.0f %.0f\n",
+           vik_track_get_length ( trk ),
+           vik_track_get_length_including_gaps ( trk ),
+           vik_track_get_duration ( trk, FALSE ),
+           vik_track_get_average_speed ( trk ),
+           vik_track_get_average_speed_moving ( trk, 60 ),
+           vik_track_get_max_speed ( trk ),
+           min_alt, max_alt, up, down );
+}
+
+int main ( int argc, char *argv[] )
+{
+  if ( argc < 3 ) {
+    fprintf ( stderr, "Usage: %s stats|map|to|changed <lat,lon,alt,time> [/] ...\n", argv[0] );
+    return 1;
+  }
+
+  a_settings_init ();
+
+  VikTrack *trk = track_new_from_args ( argc - 2, argv + 2 );
+  int result = 0;
+
+  if ( !strcmp ( argv[1], "stats" ) )
+    print_stats ( trk );
+  else if ( !strcmp ( argv[1], "map" ) ) {
+    gdouble *map = vik_track_make_elevation_map ( trk, 4 );
+    if ( map ) {
+      printf ( "%.1f %.1f %.1f %.1f\n", map[0], map[1], map[2], map[3] );
+      g_free ( map );
+    }
+    else
+      result = 1;
+  }
+  else if ( !strcmp ( argv[1], "to" ) ) {
+    // The length along the track to each point, then to a point not in the track
+    VikTrackpoint *other = vik_trackpoint_new ();
+    for ( GList *iter = trk->trackpoints; iter; iter = iter->next )
+      printf ( "%.1f ", vik_track_get_length_to_trackpoint ( trk, VIK_TRACKPOINT(iter->data) ) );
+    printf ( "%.1f\n", vik_track_get_length_to_trackpoint ( trk, other ) );
+    vik_trackpoint_free ( other );
+  }
+  else if ( !strcmp ( argv[1], "changed" ) ) {
+    // Values calculated before the change must not be kept
+    gdouble min_alt, max_alt;
+    (void)vik_track_get_length ( trk );
+    (void)vik_track_get_average_speed ( trk );
+    (void)vik_track_get_minmax_alt ( trk, &min_alt, &max_alt );
+    VikTrackpoint *tp = vik_track_get_tp_last ( trk );
+    tp->altitude += 100;
+    tp->timestamp += 100;
+    vik_track_changed ( trk );
+    print_stats ( trk );
+  }
+  else
+    result = 1;
+
+  vik_track_free ( trk );
+  return result;
+}